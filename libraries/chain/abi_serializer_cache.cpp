@@ -0,0 +1,85 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#include <eosio/chain/abi_serializer_cache.hpp>
+#include <eosio/chain/account_object.hpp>
+
+#include <chainbase/chainbase.hpp>
+
+namespace eosio { namespace chain {
+
+   cached_abi_serializer::cached_abi_serializer( abi_def abi, abi_serializer serializer )
+   :entry( std::make_shared<const cached_abi>( cached_abi{ std::move(abi), std::move(serializer) } ) )
+   {}
+
+   abi_serializer_cache::abi_serializer_cache( uint32_t max_entries )
+   :max_entries( max_entries )
+   {}
+
+   cached_abi_serializer abi_serializer_cache::get( const chainbase::database& db, account_name n,
+                                                    const fc::microseconds& max_serialization_time ) {
+      const auto* sequence = db.find<account_sequence_object, by_name>( n );
+      if( sequence == nullptr ) return {};
+      const auto& account = db.get<account_object, by_name>( n );
+
+      {
+         std::lock_guard<std::mutex> g( mtx );
+         auto itr = entries.find( n );
+         if( itr != entries.end() && itr->second.abi_sequence == sequence->abi_sequence
+             && itr->second.abi_size == account.abi.size() ) {
+            ++stats.hits;
+            itr->second.last_access = ++access_count;
+            return itr->second.serializer;
+         }
+         ++stats.misses;
+      }
+
+      // build it out of lock, other accounts need not wait for this
+      abi_def abi;
+      if( !abi_serializer::to_abi( account.abi, abi ) ) return {};
+      abi_serializer serializer( abi, max_serialization_time );
+
+      entry e;
+      e.abi_sequence = sequence->abi_sequence;
+      e.abi_size = account.abi.size();
+      e.serializer = cached_abi_serializer( std::move(abi), std::move(serializer) );
+      auto result = e.serializer;
+
+      std::lock_guard<std::mutex> g( mtx );
+      e.last_access = ++access_count;
+      entries[n] = std::move(e);
+      evict();
+      return result;
+   }
+
+   void abi_serializer_cache::erase( account_name n ) {
+      std::lock_guard<std::mutex> g( mtx );
+      entries.erase( n );
+   }
+
+   void abi_serializer_cache::clear() {
+      std::lock_guard<std::mutex> g( mtx );
+      entries.clear();
+   }
+
+   abi_serializer_cache::cache_stats abi_serializer_cache::get_stats()const {
+      std::lock_guard<std::mutex> g( mtx );
+      auto result = stats;
+      result.entries = entries.size();
+      result.max_entries = max_entries;
+      return result;
+   }
+
+   // evict remove the least recently used entry while cache is over its limit, must hold mtx
+   void abi_serializer_cache::evict() {
+      while( entries.size() > max_entries && entries.size() > 1 ) {
+         auto victim = std::min_element( entries.begin(), entries.end(), []( const auto& a, const auto& b ) {
+            return a.second.last_access < b.second.last_access;
+         });
+         entries.erase( victim );
+         ++stats.evictions;
+      }
+   }
+
+} } // eosio::chain
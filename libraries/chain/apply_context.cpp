@@ -421,10 +421,12 @@ bool apply_context::cancel_deferred_transaction( const uint128_t& sender_id, acc
 }
 
 const table_id_object* apply_context::find_table( name code, name scope, name table ) {
+   trx_context.on_table_access( code, scope, table );
    return db.find<table_id_object, by_code_scope_table>(boost::make_tuple(code, scope, table));
 }
 
 const table_id_object& apply_context::find_or_create_table( name code, name scope, name table, const account_name &payer ) {
+   trx_context.on_table_access( code, scope, table );
    const auto* existing_tid =  db.find<table_id_object, by_code_scope_table>(boost::make_tuple(code, scope, table));
    if (existing_tid != nullptr) {
       return *existing_tid;
@@ -543,37 +545,28 @@ int apply_context::db_store_i64( uint64_t code, uint64_t scope, uint64_t table,
    int64_t billable_size = (int64_t)(buffer_size + config::billable_size_v<key_value_object>);
    update_db_usage( payer, billable_size);
 
+   if( is_chainstatus_table( tab ) ) {
+      control.on_chainstatus_stored( id, buffer, buffer_size );
+   }
+   if( is_vote4ramsum_table( tab ) ) {
+      on_vote4ram_changed( obj );
+   }
+   if( is_fixvotes_table( tab ) ) {
+      control.on_fixvotes_changed( tab.scope );
+   }
+
    keyval_cache.cache_table( tab );
    return keyval_cache.add( obj );
 }
 
-void apply_context::db_update_i64( int iterator, account_name payer, const char* buffer, size_t buffer_size ) {
-   const key_value_object& obj = keyval_cache.get( iterator );
-
-   const auto& table_obj = keyval_cache.get_table( obj.t_id );
-   EOS_ASSERT( table_obj.code == receiver, table_access_violation, "db access violation" );
-
-//   require_write_lock( table_obj.scope );
-
-   const int64_t overhead = config::billable_size_v<key_value_object>;
-   int64_t old_size = (int64_t)(obj.value.size() + overhead);
-   int64_t new_size = (int64_t)(buffer_size + overhead);
-
-   if( payer == account_name() ) payer = obj.payer;
-
-   if( account_name(obj.payer) != payer ) {
-      // refund the existing payer
-      update_db_usage( obj.payer,  -(old_size) );
-      // charge the new payer
-      update_db_usage( payer,  (new_size));
-   } else if(old_size != new_size) {
-      // charge/refund the existing payer the difference
-      update_db_usage( obj.payer, new_size - old_size);
-   }
+// on_vote4ram_changed the primary key of vote4ramsum row is the voter, its ram quota is reloaded at next check
+void apply_context::on_vote4ram_changed( const key_value_object& obj ) {
+   control.get_mutable_resource_limits_manager().on_vote4ram_changed( account_name(obj.primary_key) );
+}
 
-   db.modify( obj, [&]( auto& o ) {
-     o.value.assign( buffer, buffer_size );
-     o.payer = payer;
+void apply_context::db_update_i64( int iterator, account_name payer, const char* buffer, size_t buffer_size ) {
+   db_update_i64( iterator, payer, buffer_size, [&]( char* data ) {
+      memcpy( data, buffer, buffer_size );
    });
 }
 
@@ -587,6 +580,16 @@ void apply_context::db_remove_i64( int iterator ) {
 
    update_db_usage( obj.payer,  -(obj.value.size() + config::billable_size_v<key_value_object>) );
 
+   if( is_chainstatus_table( table_obj ) ) {
+      control.on_chainstatus_stored( obj.primary_key, nullptr, 0 );
+   }
+   if( is_vote4ramsum_table( table_obj ) ) {
+      on_vote4ram_changed( obj );
+   }
+   if( is_fixvotes_table( table_obj ) ) {
+      control.on_fixvotes_changed( table_obj.scope );
+   }
+
    db.modify( table_obj, [&]( auto& t ) {
       --t.count;
    });
@@ -746,7 +749,7 @@ void apply_context::add_ram_usage( account_name account, int64_t ram_delta ) {
 }
 
 int64_t apply_context::get_num_config_on_chain( const name& typ ) {
-   return ::eosio::chain::get_num_config_on_chain( db, typ );
+   return ::eosio::chain::get_num_config_on_chain( control, typ );
 }
 
 } } /// eosio::chain
@@ -4,9 +4,23 @@
  */
 #include <eosio/chain/block_log.hpp>
 #include <eosio/chain/exceptions.hpp>
+#include <eosio/chain/thread_utils.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
+#include <mutex>
+#include <thread>
 #include <fc/io/raw.hpp>
 
+#include <boost/filesystem.hpp>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+
 #define LOG_READ  (std::ios::in | std::ios::binary)
 #define LOG_WRITE (std::ios::out | std::ios::binary | std::ios::app)
 #define LOG_RW ( std::ios::in | std::ios::out | std::ios::binary )
@@ -24,6 +38,56 @@ namespace eosio { namespace chain {
    const uint32_t block_log::max_supported_version = 2;
 
    namespace detail {
+      namespace bip = boost::interprocess;
+
+      // block_log_view read only mappings of blocks.log and blocks.index with blocks in [first_block_num, end_block_num),
+      // a view is shared by readers and never changes, it is replaced by a new view when the log grows
+      class block_log_view {
+         public:
+            block_log_view( const fc::path& block_file, const fc::path& index_file, uint32_t first_block_num, uint32_t end_block_num )
+            :block_mapping( block_file.generic_string().c_str(), bip::read_only )
+            ,block_region( block_mapping, bip::read_only )
+            ,index_mapping( index_file.generic_string().c_str(), bip::read_only )
+            ,index_region( index_mapping, bip::read_only )
+            ,first_block_num( first_block_num )
+            ,end_block_num( end_block_num ) {
+               EOS_ASSERT( index_region.get_size() >= sizeof(uint64_t) * (end_block_num - first_block_num), block_log_exception,
+                           "Block log index is shorter than blocks in log" );
+            }
+
+            bool contains( uint32_t block_num )const {
+               return block_num >= first_block_num && block_num < end_block_num;
+            }
+
+            uint64_t get_block_pos( uint32_t block_num )const {
+               uint64_t pos;
+               memcpy( &pos, (const char*)index_region.get_address() + sizeof(uint64_t) * (block_num - first_block_num), sizeof(pos) );
+               return pos;
+            }
+
+            signed_block_ptr read_block( uint32_t block_num )const {
+               const uint64_t pos = get_block_pos( block_num );
+               EOS_ASSERT( pos < block_region.get_size(), block_log_exception,
+                           "Block position ${pos} is out of block log", ("pos", pos) );
+               fc::datastream<const char*> ds( (const char*)block_region.get_address() + pos, block_region.get_size() - pos );
+               auto b = std::make_shared<signed_block>();
+               fc::raw::unpack( ds, *b );
+               EOS_ASSERT( b->block_num() == block_num, reversible_blocks_exception,
+                           "Wrong block was read from block log.", ("returned", b->block_num())("expected", block_num) );
+               return b;
+            }
+
+         private:
+            bip::file_mapping  block_mapping;
+            bip::mapped_region block_region;
+            bip::file_mapping  index_mapping;
+            bip::mapped_region index_region;
+
+         public:
+            const uint32_t     first_block_num;
+            const uint32_t     end_block_num;
+      };
+
       class block_log_impl {
          public:
             signed_block_ptr         head;
@@ -37,6 +101,36 @@ namespace eosio { namespace chain {
             uint32_t                 version = 0;
             uint32_t                 first_block_num = 0;
 
+            std::atomic<uint32_t>                  read_head_num{0}; ///< last block flushed to files, 0 if none
+            std::shared_ptr<const block_log_view>  view; ///< only accessed by std::atomic_load and std::atomic_store
+            std::mutex                             view_mutex; ///< serializes mapping of new views
+
+            std::shared_ptr<const block_log_view> get_view( uint32_t block_num );
+            void reset_view( uint32_t head_num );
+
+            // blocks of append_async are packed and written by writer, queued blocks are read from write_queue until
+            // they are written. blocks are flushed after each group of queued blocks and synced at most once per
+            // sync_interval, a block is durable after its group is synced, or flushed if sync_interval is 0.
+            uint32_t                     write_queue_size = 0;
+            fc::microseconds             sync_interval;
+            std::thread                  writer;
+            std::mutex                   write_mutex; ///< guards members below
+            std::condition_variable      write_cv;    ///< notifies writer of queued blocks and stop
+            std::condition_variable      written_cv;  ///< notifies appenders and waiters of written blocks and errors
+            std::deque<signed_block_ptr> write_queue; ///< blocks not written yet, in order
+            bool                         stop_writer = false;
+            std::exception_ptr           write_error;
+            block_log::write_stats       stats;
+            std::atomic<uint32_t>        durable_head_num{0};
+
+            uint64_t         write_block( const signed_block_ptr& b );
+            void             sync_files();
+            void             write_loop();
+            void             wait_written();
+            void             close_writer();
+            signed_block_ptr find_queued( uint32_t block_num );
+            void             recover_tail();
+
             inline void check_open_files() {
                if( !open_files ) {
                   reopen();
@@ -53,6 +147,211 @@ namespace eosio { namespace chain {
             }
       };
 
+      std::shared_ptr<const block_log_view> block_log_impl::get_view( uint32_t block_num ) {
+         auto v = std::atomic_load( &view );
+         if( v && v->contains( block_num ) )
+            return v;
+
+         std::lock_guard<std::mutex> g( view_mutex );
+         v = std::atomic_load( &view );
+         if( v && v->contains( block_num ) )
+            return v;
+         const uint32_t head_num = read_head_num.load();
+         if( block_num > head_num || block_num < first_block_num )
+            return {};
+         v = std::make_shared<const block_log_view>( block_file, index_file, first_block_num, head_num + 1 );
+         std::atomic_store( &view, v );
+         return v;
+      }
+
+      // reset_view called by writer when files are replaced or rewritten, readers still holding a view read the old files
+      void block_log_impl::reset_view( uint32_t head_num ) {
+         std::lock_guard<std::mutex> g( view_mutex );
+         std::atomic_store( &view, std::shared_ptr<const block_log_view>() );
+         read_head_num = head_num;
+      }
+
+      // write_block packs b and writes it to streams without flush, returns bytes written to block file
+      uint64_t block_log_impl::write_block( const signed_block_ptr& b ) {
+         block_stream.seekp(0, std::ios::end);
+         index_stream.seekp(0, std::ios::end);
+         uint64_t pos = block_stream.tellp();
+         EOS_ASSERT(index_stream.tellp() == sizeof(uint64_t) * (b->block_num() - first_block_num),
+                   block_log_append_fail,
+                   "Append to index file occuring at wrong position.",
+                   ("position", (uint64_t) index_stream.tellp())
+                   ("expected", (b->block_num() - first_block_num) * sizeof(uint64_t)));
+         auto data = fc::raw::pack(*b);
+         block_stream.write(data.data(), data.size());
+         block_stream.write((char*)&pos, sizeof(pos));
+         index_stream.write((char*)&pos, sizeof(pos));
+         return data.size() + sizeof(pos);
+      }
+
+      void block_log_impl::sync_files() {
+         for( const auto& file : { block_file, index_file } ) {
+            int fd = ::open( file.generic_string().c_str(), O_RDONLY );
+            EOS_ASSERT( fd >= 0, block_log_append_fail, "Unable to open ${f} to sync it", ("f", file) );
+            int r = ::fsync( fd );
+            ::close( fd );
+            EOS_ASSERT( r == 0, block_log_append_fail, "Unable to sync ${f}", ("f", file) );
+         }
+      }
+
+      void block_log_impl::write_loop() {
+         std::unique_lock<std::mutex> g( write_mutex );
+         fc::time_point last_sync = fc::time_point::now();
+         uint32_t       written_head_num = 0;
+         while( true ) {
+            const bool sync_pending = sync_interval.count() > 0 && durable_head_num < written_head_num;
+            if( sync_pending ) {
+               write_cv.wait_until( g, std::chrono::system_clock::time_point( std::chrono::microseconds(
+                                          (last_sync + sync_interval).time_since_epoch().count() ) ),
+                                    [&]() { return stop_writer || !write_queue.empty(); } );
+            } else {
+               write_cv.wait( g, [&]() { return stop_writer || !write_queue.empty(); } );
+            }
+            if( write_queue.empty() && !sync_pending && stop_writer )
+               break;
+
+            // write all queued blocks as a group, readers still find them in write_queue while they are written
+            vector<signed_block_ptr> group( write_queue.begin(), write_queue.end() );
+            g.unlock();
+            uint64_t bytes = 0;
+            bool     synced = false;
+            const auto start = fc::time_point::now();
+            try {
+               for( const auto& b : group )
+                  bytes += write_block( b );
+               block_stream.flush();
+               index_stream.flush();
+               if( sync_interval.count() > 0 && (start - last_sync >= sync_interval || (stop_writer && group.empty())) ) {
+                  sync_files();
+                  last_sync = start;
+                  synced    = true;
+               }
+            } catch( ... ) {
+               g.lock();
+               write_error = std::current_exception();
+               written_cv.notify_all();
+               return;
+            }
+            if( !group.empty() ) {
+               written_head_num = group.back()->block_num();
+               read_head_num    = written_head_num;
+            }
+            if( sync_interval.count() == 0 || synced )
+               durable_head_num = written_head_num;
+
+            g.lock();
+            write_queue.erase( write_queue.begin(), write_queue.begin() + group.size() );
+            stats.blocks_written += group.size();
+            stats.bytes_written  += bytes;
+            stats.groups         += group.empty() ? 0 : 1;
+            stats.syncs          += synced ? 1 : 0;
+            stats.write_time     += fc::time_point::now() - start;
+            written_cv.notify_all();
+            if( stop_writer && write_queue.empty() && durable_head_num == written_head_num )
+               break;
+         }
+      }
+
+      void block_log_impl::wait_written() {
+         std::unique_lock<std::mutex> g( write_mutex );
+         written_cv.wait( g, [&]() { return write_queue.empty() || write_error; } );
+         if( write_error )
+            std::rethrow_exception( write_error );
+      }
+
+      void block_log_impl::close_writer() {
+         if( !writer.joinable() )
+            return;
+         {
+            std::lock_guard<std::mutex> g( write_mutex );
+            stop_writer = true;
+         }
+         write_cv.notify_one();
+         writer.join();
+         stop_writer = false;
+         if( write_error ) {
+            try {
+               std::rethrow_exception( write_error );
+            } catch( const fc::exception& e ) {
+               elog( "block log writer failed: ${e}", ("e", e.to_detail_string()) );
+            } catch( const std::exception& e ) {
+               elog( "block log writer failed: ${e}", ("e", e.what()) );
+            } catch( ... ) {
+               elog( "block log writer failed" );
+            }
+         }
+      }
+
+      signed_block_ptr block_log_impl::find_queued( uint32_t block_num ) {
+         std::lock_guard<std::mutex> g( write_mutex );
+         if( write_queue.empty() || block_num < write_queue.front()->block_num() )
+            return {};
+         const uint32_t i = block_num - write_queue.front()->block_num();
+         return i < write_queue.size() ? write_queue[i] : signed_block_ptr();
+      }
+
+      // recover_tail drops a partial block at the end of block file left by a crash while a block was written,
+      // the last block whose position is in index and is followed by its position is kept
+      void block_log_impl::recover_tail() {
+         const uint64_t size = fc::file_size( block_file );
+         const uint64_t index_size = fc::file_size( index_file );
+         if( size < sizeof(uint64_t) )
+            return;
+         uint64_t end = 0;
+         {
+            bip::file_mapping  mapping( block_file.generic_string().c_str(), bip::read_only );
+            bip::mapped_region region( mapping, bip::read_only );
+            const char* const addr = (const char*)region.get_address();
+
+            // ends_block returns end of block at pos if the block is complete and followed by pos
+            auto ends_block = [&]( uint64_t pos ) -> uint64_t {
+               if( pos >= size )
+                  return 0;
+               try {
+                  fc::datastream<const char*> ds( addr + pos, size - pos );
+                  signed_block b;
+                  fc::raw::unpack( ds, b );
+                  const uint64_t block_end = pos + ds.tellp();
+                  uint64_t trailer;
+                  if( block_end + sizeof(trailer) > size )
+                     return 0;
+                  memcpy( &trailer, addr + block_end, sizeof(trailer) );
+                  return trailer == pos ? block_end + sizeof(trailer) : 0;
+               } catch( ... ) {
+                  return 0;
+               }
+            };
+
+            uint64_t last_pos;
+            memcpy( &last_pos, addr + size - sizeof(last_pos), sizeof(last_pos) );
+            if( last_pos == block_log::npos || ends_block( last_pos ) == size )
+               return;
+
+            wlog( "Block log ends with a partial block, looking for the last complete block" );
+            if( index_size >= sizeof(uint64_t) ) {
+               bip::file_mapping  index_mapping( index_file.generic_string().c_str(), bip::read_only );
+               bip::mapped_region index_region( index_mapping, bip::read_only );
+               const char* const index_addr = (const char*)index_region.get_address();
+               for( uint64_t i = index_size / sizeof(uint64_t); i > 0 && !end; --i ) {
+                  uint64_t pos;
+                  memcpy( &pos, index_addr + (i - 1) * sizeof(pos), sizeof(pos) );
+                  end = ends_block( pos );
+               }
+            }
+         }
+         EOS_ASSERT( end, block_log_exception,
+                     "Block log ends with a partial block and no complete block is found by index, repair block log" );
+         wlog( "Truncating block log from ${s} to ${e} bytes", ("s", size)("e", end) );
+         reset_view( 0 );
+         close();
+         boost::filesystem::resize_file( block_file.generic_string(), end );
+         reopen();
+      }
+
       void block_log_impl::reopen() {
          close();
 
@@ -83,8 +382,13 @@ namespace eosio { namespace chain {
 
    block_log::~block_log() {
       if (my) {
-         flush();
-         my->close();
+         my->close_writer();
+         try {
+            // a failed writer is logged by close_writer, blocks it did not write are lost and files may not be flushed
+            if( !my->write_error )
+               flush();
+            my->close();
+         } FC_LOG_AND_DROP();
          my.reset();
       }
    }
@@ -123,6 +427,7 @@ namespace eosio { namespace chain {
 
       if (log_size) {
          ilog("Log is nonempty");
+         my->recover_tail();
          my->block_stream.seekg( 0 );
          my->version = 0;
          my->block_stream.read( (char*)&my->version, sizeof(my->version) );
@@ -175,42 +480,88 @@ namespace eosio { namespace chain {
          fc::remove_all(my->index_file);
          my->reopen();
       }
+
+      my->reset_view( my->head ? my->head->block_num() : 0 );
+      my->durable_head_num = my->read_head_num.load();
    }
 
    uint64_t block_log::append(const signed_block_ptr& b) {
       try {
          EOS_ASSERT( my->genesis_written_to_block_log, block_log_append_fail, "Cannot append to block log until the genesis is first written" );
 
+         my->wait_written();
          my->check_open_files();
 
          my->block_stream.seekp(0, std::ios::end);
-         my->index_stream.seekp(0, std::ios::end);
          uint64_t pos = my->block_stream.tellp();
-         EOS_ASSERT(my->index_stream.tellp() == sizeof(uint64_t) * (b->block_num() - my->first_block_num),
-                   block_log_append_fail,
-                   "Append to index file occuring at wrong position.",
-                   ("position", (uint64_t) my->index_stream.tellp())
-                   ("expected", (b->block_num() - my->first_block_num) * sizeof(uint64_t)));
-         auto data = fc::raw::pack(*b);
-         my->block_stream.write(data.data(), data.size());
-         my->block_stream.write((char*)&pos, sizeof(pos));
-         my->index_stream.write((char*)&pos, sizeof(pos));
+         my->write_block(b);
          my->head = b;
          my->head_id = b->id();
 
          flush();
+         my->read_head_num = b->block_num();
+         my->durable_head_num = b->block_num();
 
          return pos;
       }
       FC_LOG_AND_RETHROW()
    }
 
+   void block_log::append_async(const signed_block_ptr& b) {
+      if( !my->write_queue_size ) {
+         append(b);
+         return;
+      }
+      try {
+         EOS_ASSERT( my->genesis_written_to_block_log, block_log_append_fail, "Cannot append to block log until the genesis is first written" );
+         EOS_ASSERT( !my->head || b->block_num() == my->head->block_num() + 1, block_log_append_fail,
+                     "Append block ${n} after block log head ${h}", ("n", b->block_num())("h", my->head->block_num()) );
+
+         my->check_open_files();
+         std::unique_lock<std::mutex> g( my->write_mutex );
+         my->written_cv.wait( g, [&]() { return my->write_queue.size() < my->write_queue_size || my->write_error; } );
+         if( my->write_error )
+            std::rethrow_exception( my->write_error );
+         if( !my->writer.joinable() ) {
+            auto impl = my.get();
+            my->writer = std::thread( [impl]() { impl->write_loop(); } );
+         }
+         my->write_queue.push_back( b );
+         my->stats.max_queue_depth = std::max<uint32_t>( my->stats.max_queue_depth, my->write_queue.size() );
+         my->head = b;
+         my->head_id = b->id();
+         g.unlock();
+         my->write_cv.notify_one();
+      }
+      FC_LOG_AND_RETHROW()
+   }
+
+   void block_log::set_write_queue( uint32_t queue_size, fc::microseconds sync_interval ) {
+      my->close_writer();
+      my->write_queue_size = queue_size;
+      my->sync_interval    = sync_interval;
+   }
+
+   uint32_t block_log::durable_head_num()const {
+      return my->durable_head_num;
+   }
+
+   block_log::write_stats block_log::get_write_stats()const {
+      std::lock_guard<std::mutex> g( my->write_mutex );
+      auto result = my->stats;
+      result.queue_depth = my->write_queue.size();
+      return result;
+   }
+
    void block_log::flush() {
+      my->wait_written();
       my->block_stream.flush();
       my->index_stream.flush();
    }
 
    void block_log::reset( const genesis_state& gs, const signed_block_ptr& first_block, uint32_t first_block_num ) {
+      my->wait_written();
+      my->reset_view( 0 );
       my->close();
 
       fc::remove_all(my->block_file);
@@ -243,6 +594,7 @@ namespace eosio { namespace chain {
       my->block_stream.write( (char*)&my->version, sizeof(my->version) );
       my->block_stream.seekp( pos );
       flush();
+      my->durable_head_num = my->read_head_num.load();
    }
 
    std::pair<signed_block_ptr, uint64_t> block_log::read_block(uint64_t pos)const {
@@ -259,27 +611,51 @@ namespace eosio { namespace chain {
    signed_block_ptr block_log::read_block_by_num(uint32_t block_num)const {
       try {
          signed_block_ptr b;
-         uint64_t pos = get_block_pos(block_num);
-         if (pos != npos) {
-            b = read_block(pos).first;
-            EOS_ASSERT(b->block_num() == block_num, reversible_blocks_exception,
-                      "Wrong block was read from block log.", ("returned", b->block_num())("expected", block_num));
+         if (block_num > my->read_head_num) {
+            b = my->find_queued(block_num); // checked before views as writer updates read_head_num before dequeue
+            if (b)
+               return b;
+         }
+         auto v = my->get_view(block_num);
+         if (v) {
+            b = v->read_block(block_num);
          }
          return b;
       } FC_LOG_AND_RETHROW()
    }
 
+   vector<signed_block_ptr> block_log::read_block_range(uint32_t first_block_num, uint32_t count)const {
+      try {
+         vector<signed_block_ptr> result;
+         result.reserve(count);
+         std::shared_ptr<const detail::block_log_view> v;
+         for (uint32_t block_num = first_block_num; block_num - first_block_num < count; ++block_num) {
+            signed_block_ptr b;
+            if (block_num > my->read_head_num)
+               b = my->find_queued(block_num);
+            if (!b) {
+               if (!v || !v->contains(block_num)) {
+                  v = my->get_view(block_num);
+                  if (!v)
+                     break;
+               }
+               b = v->read_block(block_num);
+            }
+            result.emplace_back(std::move(b));
+         }
+         return result;
+      } FC_LOG_AND_RETHROW()
+   }
+
    uint64_t block_log::get_block_pos(uint32_t block_num) const {
-      my->check_open_files();
-      if (!(my->head && block_num <= block_header::num_from_id(my->head_id) && block_num >= my->first_block_num))
+      auto v = my->get_view(block_num);
+      if (!v)
          return npos;
-      my->index_stream.seekg(sizeof(uint64_t) * (block_num - my->first_block_num));
-      uint64_t pos;
-      my->index_stream.read((char*)&pos, sizeof(pos));
-      return pos;
+      return v->get_block_pos(block_num);
    }
 
    signed_block_ptr block_log::read_head()const {
+      my->wait_written();
       my->check_open_files();
 
       uint64_t pos;
@@ -306,8 +682,67 @@ namespace eosio { namespace chain {
       return my->first_block_num;
    }
 
+   void block_log::verify_blocks( uint32_t first_block_num, uint32_t last_block_num, uint16_t thread_pool_size,
+                                  const std::function<void(uint32_t)>& progress )const {
+      first_block_num = std::max( first_block_num, my->first_block_num );
+      auto v = my->get_view( last_block_num );
+      EOS_ASSERT( v && first_block_num <= last_block_num, block_log_exception,
+                  "Blocks ${f} to ${l} are not in block log", ("f", first_block_num)("l", last_block_num) );
+
+      // each chunk links its first block to the block before the chunk, so chunks are verified independently
+      const uint32_t total  = last_block_num - first_block_num + 1;
+      const uint32_t chunks = std::min<uint32_t>( std::max<uint16_t>( thread_pool_size, 1 ) * 4, total );
+      boost::asio::thread_pool   thread_pool( std::max<uint16_t>( thread_pool_size, 1 ) );
+      std::atomic<uint32_t>      verified{0};
+      vector<std::future<uint32_t>> chunk_results; ///< first broken block num of chunk, 0 if none
+      for( uint32_t i = 0; i < chunks; ++i ) {
+         const uint32_t begin = first_block_num + uint64_t(total) * i / chunks;
+         const uint32_t end   = first_block_num + uint64_t(total) * (i + 1) / chunks;
+         chunk_results.emplace_back( async_thread_pool( thread_pool, [v, begin, end, &verified]() -> uint32_t {
+            optional<block_id_type> prev_id;
+            if( v->contains( begin - 1 ) ) {
+               try {
+                  prev_id = v->read_block( begin - 1 )->id();
+               } catch( ... ) {
+                  // reported by the chunk of the block
+               }
+            }
+            for( uint32_t block_num = begin; block_num < end; ++block_num ) {
+               try {
+                  auto b = v->read_block( block_num );
+                  if( prev_id && b->previous != *prev_id )
+                     return block_num;
+                  prev_id = b->id();
+               } catch( ... ) {
+                  return block_num;
+               }
+               ++verified;
+            }
+            return 0;
+         }));
+      }
+
+      for( auto& r : chunk_results ) {
+         while( r.wait_for( std::chrono::seconds( 1 ) ) != std::future_status::ready ) {
+            if( progress ) progress( verified );
+         }
+      }
+      thread_pool.join();
+      if( progress ) progress( verified );
+
+      uint32_t broken = 0;
+      for( auto& r : chunk_results ) {
+         const uint32_t block_num = r.get();
+         if( block_num && (!broken || block_num < broken) )
+            broken = block_num;
+      }
+      EOS_ASSERT( !broken, block_log_exception,
+                  "Block ${n} in block log can not be read or does not link to the block before it", ("n", broken) );
+   }
+
    void block_log::construct_index() {
       ilog("Reconstructing Block Log Index...");
+      my->reset_view(0);
       my->close();
 
       fc::remove_all(my->index_file);
@@ -324,8 +759,6 @@ namespace eosio { namespace chain {
          return;
       }
 
-      signed_block tmp;
-
       uint64_t pos = 0;
       if (my->version == 1) {
          pos = 4; // Skip version which should have already been checked.
@@ -343,14 +776,65 @@ namespace eosio { namespace chain {
          my->block_stream.read((char*) &totem, sizeof(totem));
       }
 
-      my->index_stream.seekp(0, std::ios::end);
-      while( pos < end_pos ) {
-         fc::raw::unpack(my->block_stream, tmp);
-         my->block_stream.read((char*)&pos, sizeof(pos));
-         if(tmp.block_num() % 1000 == 0)
-            ilog( "Block log index reconstructed for block ${n}", ("n", tmp.block_num()));
-         my->index_stream.write((char*)&pos, sizeof(pos));
+      // walk the trailing positions of blocks back from the last block, only block headers are deserialized
+      const uint64_t first_pos = my->block_stream.tellg();
+      detail::bip::file_mapping  mapping( my->block_file.generic_string().c_str(), detail::bip::read_only );
+      detail::bip::mapped_region region( mapping, detail::bip::read_only );
+      const char* const addr = (const char*)region.get_address();
+      const uint64_t    size = region.get_size();
+
+      auto block_num_at = [&]( uint64_t pos ) {
+         EOS_ASSERT( pos >= first_pos && pos < size, block_log_exception,
+                     "Block log is corrupted, block position ${pos} is out of blocks", ("pos", pos) );
+         fc::datastream<const char*> ds( addr + pos, size - pos );
+         block_header h;
+         fc::raw::unpack( ds, h );
+         return h.block_num();
+      };
+
+      // the last block gives the number of blocks, the index is sized for them and written back to front
+      const uint32_t last_block_num = block_num_at( end_pos );
+      EOS_ASSERT( last_block_num >= my->first_block_num, block_log_exception,
+                  "Block log is corrupted, last block ${n} is before first block ${f}",
+                  ("n", last_block_num)("f", my->first_block_num) );
+      const uint64_t num_blocks = last_block_num - my->first_block_num + 1;
+
+      my->close();
+      boost::filesystem::resize_file( my->index_file.generic_string(), num_blocks * sizeof(uint64_t) );
+      {
+         detail::bip::file_mapping  index_mapping( my->index_file.generic_string().c_str(), detail::bip::read_write );
+         detail::bip::mapped_region index_region( index_mapping, detail::bip::read_write );
+         char* const index_addr = (char*)index_region.get_address();
+
+         pos = end_pos;
+         for( uint32_t block_num = last_block_num; ; --block_num ) {
+            const uint32_t found = block_num_at( pos );
+            EOS_ASSERT( found == block_num, block_log_exception,
+                        "Block log is corrupted, block at position ${pos} is ${found} but ${n} is expected",
+                        ("pos", pos)("found", found)("n", block_num) );
+            memcpy( index_addr + sizeof(uint64_t) * (block_num - my->first_block_num), &pos, sizeof(pos) );
+            if( block_num == my->first_block_num ) {
+               EOS_ASSERT( pos == first_pos, block_log_exception,
+                           "Block log is corrupted, first block ${n} is at position ${pos} but ${e} is expected",
+                           ("n", block_num)("pos", pos)("e", first_pos) );
+               break;
+            }
+
+            EOS_ASSERT( pos >= first_pos + sizeof(uint64_t), block_log_exception,
+                        "Block log is corrupted, no block before block ${n} at position ${pos}", ("n", block_num)("pos", pos) );
+            uint64_t prev_pos;
+            memcpy( &prev_pos, addr + pos - sizeof(prev_pos), sizeof(prev_pos) );
+            EOS_ASSERT( prev_pos < pos - sizeof(prev_pos), block_log_exception,
+                        "Block log is corrupted, block ${n} at position ${pos} is preceded by position ${prev}",
+                        ("n", block_num)("pos", pos)("prev", prev_pos) );
+            pos = prev_pos;
+            if( (last_block_num - block_num + 1) % 1000000 == 0 )
+               ilog( "Block log index found ${n} of ${t} blocks", ("n", last_block_num - block_num + 1)("t", num_blocks) );
+         }
+         index_region.flush();
       }
+      my->reopen();
+      ilog( "Block log index reconstructed for ${n} blocks", ("n", num_blocks) );
    } // construct_index
 
    fc::path block_log::repair_log( const fc::path& data_dir, uint32_t truncate_at_block ) {
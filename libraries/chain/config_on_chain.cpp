@@ -20,6 +20,22 @@ int64_t get_num_config_on_chain( const chainbase::database& db, const name& typ,
    return cfg_itr->num;
 }
 
+int64_t get_num_config_on_chain( const controller& ctl, const name& typ, const int64_t default_value/* = -1*/ ) {
+   return ctl.get_config_view().get_num(typ, default_value);
+}
+
+void config_view::rebuild( const chainbase::database& db ) {
+   const auto& idx = db.get_index<config_data_object_index, by_name>();
+
+   _nums.clear();
+   _nums.reserve(idx.size());
+   // by_name is ordered, so insert at end is O(1) for flat_map
+   for( const auto& cfg : idx ) {
+      _nums.emplace_hint(_nums.end(), cfg.typ, cfg.num);
+   }
+   _valid = true;
+}
+
 void set_num_config_on_chain( chainbase::database& db, const name& typ, const int64_t num ) {
    auto itr = db.find<config_data_object, by_name>(typ);
    if( itr == nullptr ) {
@@ -56,7 +72,7 @@ void set_config_on_chain( chainbase::database& db, const setconfig &cfg ) {
 
 bool is_func_has_open( const controller& ctl, const name &func_typ, const int64_t default_open_block) {
       const auto head_num = static_cast<int64_t>( ctl.head_block_num() );
-      const auto open_num = get_num_config_on_chain( ctl.db(), func_typ );
+      const auto open_num = get_num_config_on_chain( ctl, func_typ );
 
    return (head_num >= 0) && ((open_num >= 0 && head_num >= open_num)
                               || (open_num == -1 && default_open_block != 0 && head_num >= default_open_block));
@@ -65,7 +81,7 @@ bool is_func_has_open( const controller& ctl, const name &func_typ, const int64_
 // is_func_open_in_curr_block if a func is open in curr block
 bool is_func_open_in_curr_block( const controller& ctl, const name &func_typ, const int64_t default_open_block /* =0 */  ) {
    const auto head_num = static_cast<int64_t>( ctl.head_block_num() );
-   const auto open_num = get_num_config_on_chain( ctl.db(), func_typ );
+   const auto open_num = get_num_config_on_chain( ctl, func_typ );
    if( open_num < 0 ) {
       // no cfg
       return (default_open_block > 0) && (head_num == default_open_block); // if head_num < 0 , default_open_block != head_num
@@ -33,6 +33,16 @@
 #include <set>
 #include <boost/asio/thread_pool.hpp>
 #include <boost/asio/post.hpp>
+#include <boost/asio/strand.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
 
 
 namespace eosio { namespace chain {
@@ -134,9 +144,13 @@ struct controller_impl {
    block_state_ptr                head;
    fork_database                  fork_db;
    wasm_interface                 wasmif;
+   abi_serializer_cache           abi_cache;
    resource_limits_manager        resource_limits;
    authorization_manager          authorization;
    txfee_manager                  txfee;
+   mutable config_view            cfg_view; ///< rebuilt lazily, see get_config_view
+   mutable optional<bool>         chain_emergency; ///< emergency flag of the chainstatus row, reloaded lazily after a state undo
+   optional<bool>                 notified_emergency; ///< last emergency flag emitted by on_emergency_changed
    controller::config             conf;
    chain_id_type                  chain_id;
    bool                           replaying= false;
@@ -148,6 +162,19 @@ struct controller_impl {
    uint32_t                       snapshot_head_block = 0;
    boost::asio::thread_pool       thread_pool;
 
+   /**
+    *  Blocks started by prevalidate_block before they are pushed. Header states are built in order on
+    *  header_strand from the header state of the previous block, which may be prevalidated too, then producer
+    *  signatures and transaction signatures of the blocks are recovered in parallel on thread_pool.
+    */
+   struct prevalidated_block {
+      std::shared_future<block_state_ptr>  header; ///< header state, producer signature not verified
+      std::shared_future<block_state_ptr>  state;  ///< header state with producer signature verified
+      vector<transaction_metadata_ptr>     trxs;   ///< packed transactions of block, keys recovery started
+   };
+   map<block_id_type, prevalidated_block>                       prevalidated_blocks;
+   boost::asio::strand<boost::asio::thread_pool::executor_type> header_strand;
+
    typedef pair<scope_name,action_name>                   handler_key;
    map< account_name, map<handler_key, apply_handler> >   apply_handlers;
 
@@ -174,10 +201,23 @@ struct controller_impl {
       }
       head = prev;
       db.undo();
-
+      reset_state_views();
    }
 
 
+   /**
+    *  Views kept in memory over chainbase rows (config view, chain emergency flag, compiled fee schedule, ram quotas)
+    *  are not part of the undo stack, so any undo of the state db drops them and they reload lazily.
+    *  Plugins keeping such views are told by state_undone.
+    */
+   void reset_state_views() {
+      cfg_view.invalidate();
+      resource_limits.clear_ram_quotas();
+      chain_emergency.reset();
+      txfee.on_state_undo( head ? self.last_irreversible_block_num() : 0 );
+      emit( self.state_undone, head ? head->block_num : 0 );
+   }
+
    void set_apply_handler( account_name receiver, account_name contract, action_name action, apply_handler v ) {
       apply_handlers[receiver][make_pair(contract,action)] = v;
    }
@@ -192,14 +232,16 @@ struct controller_impl {
         cfg.reversible_cache_size ),
     blog( cfg.blocks_dir ),
     fork_db( cfg.state_dir ),
-    wasmif( cfg.wasm_runtime ),
+    wasmif( cfg.wasm_runtime, cfg.wasm_cache_size, cfg.wasm_compile_threads, cfg.wasm_cache_dir, cfg.wasm_disk_cache_size ),
+    abi_cache( cfg.abi_serializer_cache_size ),
     resource_limits( db ),
     authorization( s, db ),
     txfee(),
     conf( cfg ),
     chain_id( cfg.genesis.compute_chain_id() ),
     read_mode( cfg.read_mode ),
-    thread_pool( cfg.thread_pool_size )
+    thread_pool( cfg.thread_pool_size ),
+    header_strand( thread_pool.get_executor() )
    {
 
 #define SET_APP_HANDLER( receiver, contract, action) \
@@ -232,6 +274,7 @@ struct controller_impl {
                                  on_irreversible(b);
                                  });
 
+   blog.set_write_queue( cfg.block_log_write_queue_size, fc::milliseconds( cfg.block_log_sync_interval_ms ) );
    }
 
    /**
@@ -287,12 +330,22 @@ struct controller_impl {
       db.commit( s->block_num );
 
       if( append_to_blog ) {
-         blog.append(s->block);
+         blog.append_async(s->block);
       }
 
+      for( auto itr = prevalidated_blocks.begin(); itr != prevalidated_blocks.end(); ) {
+         if( block_header::num_from_id( itr->first ) <= s->block_num ) {
+            itr = prevalidated_blocks.erase( itr );
+         } else {
+            ++itr;
+         }
+      }
+
+      // reversible blocks are kept until they are durable in block log, so they are replayed after a crash
+      const uint32_t durable_num = std::min( s->block_num, blog.durable_head_num() );
       const auto& ubi = reversible_blocks.get_index<reversible_block_index,by_num>();
       auto objitr = ubi.begin();
-      while( objitr != ubi.end() && objitr->blocknum <= s->block_num ) {
+      while( objitr != ubi.end() && objitr->blocknum <= durable_num ) {
          reversible_blocks.remove( *objitr );
          objitr = ubi.begin();
       }
@@ -417,6 +470,7 @@ struct controller_impl {
       while( db.revision() > head->block_num ) {
          db.undo();
       }
+      reset_state_views();
 
       if( report_integrity_hash ) {
          const auto hash = calculate_integrity_hash();
@@ -448,6 +502,7 @@ struct controller_impl {
    void clear_all_undo() {
       // Rewind the database to the last irreversible block
       db.undo_all();
+      reset_state_views();
    }
 
    void initialize_schedule( producer_schedule_type& schedule ) {
@@ -458,14 +513,14 @@ struct controller_impl {
       }
    }
 
-   void add_contract_tables_to_snapshot( const snapshot_writer_ptr& snapshot ) const {
-      snapshot->write_section("contract_tables", [this]( auto& section ) {
-         index_utils<table_id_multi_index>::walk(db, [this, &section]( const table_id_object& table_row ){
+   void add_contract_tables_to_snapshot( const snapshot_writer_ptr& snapshot, const chainbase::database& db ) const {
+      snapshot->write_section("contract_tables", [&db]( auto& section ) {
+         index_utils<table_id_multi_index>::walk(db, [&db, &section]( const table_id_object& table_row ){
             // add a row for the table
             section.add_row(table_row, db);
 
             // followed by a size row and then N data rows for each type of table
-            contract_database_index_set::walk_indices([this, &section, &table_row]( auto utils ) {
+            contract_database_index_set::walk_indices([&db, &section, &table_row]( auto utils ) {
                using utils_t = decltype(utils);
                using value_t = typename decltype(utils)::index_t::value_type;
                using by_table_id = object_to_table_id_tag_t<value_t>;
@@ -476,7 +531,7 @@ struct controller_impl {
                unsigned_int size = utils_t::template size_range<by_table_id>(db, tid_key, next_tid_key);
                section.add_row(size, db);
 
-               utils_t::template walk_range<by_table_id>(db, tid_key, next_tid_key, [this, &section]( const auto &row ) {
+               utils_t::template walk_range<by_table_id>(db, tid_key, next_tid_key, [&db, &section]( const auto &row ) {
                   section.add_row(row, db);
                });
             });
@@ -514,19 +569,25 @@ struct controller_impl {
    }
 
    void add_to_snapshot( const snapshot_writer_ptr& snapshot ) const {
-      snapshot->write_section<chain_snapshot_header>([this]( auto &section ){
+      add_to_snapshot( snapshot, db, *fork_db.head(), authorization, resource_limits );
+   }
+
+   // add_to_snapshot write rows of db, the state database or a checkpoint of it, as of head_state
+   void add_to_snapshot( const snapshot_writer_ptr& snapshot, const chainbase::database& db, const block_header_state& head_state,
+                         const authorization_manager& authorization, const resource_limits_manager& resource_limits ) const {
+      snapshot->write_section<chain_snapshot_header>([&db]( auto &section ){
          section.add_row(chain_snapshot_header(), db);
       });
 
-      snapshot->write_section<genesis_state>([this]( auto &section ){
+      snapshot->write_section<genesis_state>([this, &db]( auto &section ){
          section.add_row(conf.genesis, db);
       });
 
-      snapshot->write_section<block_state>([this]( auto &section ){
-         section.template add_row<block_header_state>(*fork_db.head(), db);
+      snapshot->write_section<block_state>([&db, &head_state]( auto &section ){
+         section.template add_row<block_header_state>(head_state, db);
       });
 
-      controller_index_set::walk_indices([this, &snapshot]( auto utils ){
+      controller_index_set::walk_indices([&db, &snapshot]( auto utils ){
          using value_t = typename decltype(utils)::index_t::value_type;
 
          // skip the table_id_object as its inlined with contract tables section
@@ -534,19 +595,68 @@ struct controller_impl {
             return;
          }
 
-         snapshot->write_section<value_t>([this]( auto& section ){
-            decltype(utils)::walk(db, [this, &section]( const auto &row ) {
+         snapshot->write_section<value_t>([&db]( auto& section ){
+            decltype(utils)::walk(db, [&db, &section]( const auto &row ) {
                section.add_row(row, db);
             });
          });
       });
 
-      add_contract_tables_to_snapshot(snapshot);
+      add_contract_tables_to_snapshot(snapshot, db);
 
       authorization.add_to_snapshot(snapshot);
       resource_limits.add_to_snapshot(snapshot);
    }
 
+   // clone_state_file clone a file of state database as a reflink sharing its data, false if the file system has no
+   // reflinks or to is on other file system. A copy of the data would stop block processing for as long as the whole
+   // state is copied, and can not be made off main thread as the state changes meanwhile.
+   static bool clone_state_file( const fc::path& from, const fc::path& to ) {
+      int in = ::open( from.generic_string().c_str(), O_RDONLY );
+      EOS_ASSERT( in >= 0, snapshot_exception, "unable to open ${f}", ("f", from) );
+      auto close_in = fc::make_scoped_exit( [in]() { ::close( in ); } );
+      int out = ::open( to.generic_string().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+      EOS_ASSERT( out >= 0, snapshot_exception, "unable to create ${f}", ("f", to) );
+      auto close_out = fc::make_scoped_exit( [out]() { ::close( out ); } );
+
+#ifdef FICLONE
+      if( ::ioctl( out, FICLONE, in ) == 0 )
+         return true;
+      const int error = errno;
+      EOS_ASSERT( error == EOPNOTSUPP || error == EXDEV || error == EINVAL || error == ENOTTY ||
+                  error == ENOSYS, snapshot_exception, "unable to clone ${f} to ${t}: ${e}",
+                  ("f", from)("t", to)("e", std::string( strerror( error ) )) );
+#endif
+      return false;
+   }
+
+   optional<controller::snapshot_checkpoint> create_snapshot_checkpoint( const fc::path& dir ) const {
+      fc::create_directories( dir );
+      for( const auto& f : { "shared_memory.bin", "shared_memory.meta" } ) {
+         if( fc::exists( conf.state_dir / f ) && !clone_state_file( conf.state_dir / f, dir / f ) ) {
+            wlog( "unable to clone ${f} to ${d} as a reflink, the file system has no reflinks or is not the one of state",
+                  ("f", conf.state_dir / f)("d", dir) );
+            fc::remove_all( dir );
+            return {};
+         }
+      }
+      return controller::snapshot_checkpoint{ dir, *fork_db.head() };
+   }
+
+   // write_snapshot_from_checkpoint open checkpoint as a read only database, it is not changed by blocks applied meanwhile
+   void write_snapshot_from_checkpoint( const controller::snapshot_checkpoint& checkpoint, const snapshot_writer_ptr& snapshot ) const {
+      const bool allow_dirty = true; // state database is dirty while it is open
+      chainbase::database checkpoint_db( checkpoint.dir, database::read_only, 0, allow_dirty );
+      controller_index_set::add_indices( checkpoint_db );
+      contract_database_index_set::add_indices( checkpoint_db );
+      authorization_manager   checkpoint_authorization( self, checkpoint_db );
+      resource_limits_manager checkpoint_resource_limits( checkpoint_db );
+      checkpoint_authorization.add_indices();
+      checkpoint_resource_limits.add_indices();
+
+      add_to_snapshot( snapshot, checkpoint_db, checkpoint.head, checkpoint_authorization, checkpoint_resource_limits );
+   }
+
    void read_from_snapshot( const snapshot_reader_ptr& snapshot ) {
       snapshot->read_section<chain_snapshot_header>([this]( auto &section ){
          chain_snapshot_header header;
@@ -689,48 +799,123 @@ struct controller_impl {
             memory_db::chain_status{N(chainstatus), false});
    }
 
+   // genesis_account_rows data of a account in genesis, all prepared before any write to db
+   struct genesis_account_rows {
+      account_name name;
+      authority    auth;
+      bytes        eoslock_row; // empty for active account
+      bytes        account_row;
+   };
+
+   // prepare_genesis_account name, authority and packed rows of a account in genesis,
+   // it not touch db so can run on thread pool
+   static genesis_account_rows prepare_genesis_account( const account_tuple& account,
+                                                        const flat_set<account_name>& active_accounts,
+                                                        uint32_t inactive_freeze_percent ) {
+      genesis_account_rows rows;
+
+      rows.name = account.name;
+      if( rows.name == N(a) ) {
+         const auto pk_str = std::string(account.key);
+         const auto name_r = pk_str.substr(pk_str.size() - 12, 12);
+         rows.name = string_to_name(format_name(name_r).c_str());
+      }
+      rows.auth = authority(account.key);
+
+      // init asset
+      eosio::chain::asset amount;
+      if( active_accounts.find(account.name) == active_accounts.end() ) {
+         //issue eoslock token to this account
+         uint64_t eoslock_amount = account.asset.get_amount() * inactive_freeze_percent / 100;
+         rows.eoslock_row = fc::raw::pack(
+               memory_db::eoslock_account{rows.name, eosio::chain::asset(eoslock_amount, symbol(4, "EOSLOCK"))});
+
+         //inactive account freeze(lock) asset
+         amount = account.asset - eosio::chain::asset(eoslock_amount);
+      } else {
+         //active account
+         amount = account.asset;
+      }
+      rows.account_row = fc::raw::pack(memory_db::account_info{rows.name, amount});
+
+      return rows;
+   }
+
    // initialize_account init account from genesis;
    // inactive account freeze(lock) asset by inactive_freeze_percent;
+   // rows are prepared on thread pool, then written to db in the order of initial_account_list,
+   // so the state is same as insert them one by one
    void initialize_account() {
-      std::set<account_name> active_acc_set;
-      for (const auto &account : conf.active_initial_account_list) {
-         active_acc_set.insert(account.name);
+      const auto& genesis_accounts = conf.genesis.initial_account_list;
+      const auto total = genesis_accounts.size();
+      if( total == 0 ) return;
+
+      vector<account_name> active_names;
+      active_names.reserve(conf.active_initial_account_list.size());
+      for( const auto& account : conf.active_initial_account_list ) {
+         active_names.push_back(account.name);
+      }
+      std::sort(active_names.begin(), active_names.end());
+      active_names.erase(std::unique(active_names.begin(), active_names.end()), active_names.end());
+      const flat_set<account_name> active_accounts(boost::container::ordered_unique_range,
+                                                   active_names.begin(), active_names.end());
+
+      const auto start = fc::time_point::now();
+
+      vector<genesis_account_rows> prepared(total);
+      const size_t chunks = std::min<size_t>(std::max<uint16_t>(conf.thread_pool_size, 1), total);
+      const size_t chunk_size = (total + chunks - 1) / chunks;
+      vector<std::future<void>> prepare_futures;
+      prepare_futures.reserve(chunks);
+      for( size_t begin = 0; begin < total; begin += chunk_size ) {
+         const size_t end = std::min(begin + chunk_size, total);
+         prepare_futures.emplace_back(async_thread_pool(thread_pool, [&, begin, end]() {
+            for( size_t i = begin; i < end; ++i ) {
+               prepared[i] = prepare_genesis_account(genesis_accounts[i], active_accounts, conf.inactive_freeze_percent);
+            }
+         }));
+      }
+      // wait all before get, tasks write into prepared
+      for( auto& f : prepare_futures ) {
+         f.wait();
+      }
+      for( auto& f : prepare_futures ) {
+         f.get();
       }
 
-      const auto acc_name_a = N(a);
-      auto db = memory_db(self);
-      for (const auto &account : conf.genesis.initial_account_list) {
-         const auto &public_key = account.key;
-         auto acc_name = account.name;
-         if (acc_name == acc_name_a) {
-            const auto pk_str = std::string(public_key);
-            const auto name_r = pk_str.substr(pk_str.size() - 12, 12);
-            acc_name = string_to_name(format_name(name_r).c_str());
-         }
+      const auto prepared_time = fc::time_point::now();
+      ilog("initialize_account: prepared ${n} genesis accounts in ${t} ms",
+           ("n", total)("t", (prepared_time - start).count() / 1000));
 
-         // init asset
-         eosio::chain::asset amount;
-         if (active_acc_set.find(account.name) == active_acc_set.end()) {
-            //issue eoslock token to this account
-            uint64_t eoslock_amount = account.asset.get_amount() * conf.inactive_freeze_percent / 100;
-            db.insert(
-                    config::eoslock_account_name, config::eoslock_account_name, N(accounts), acc_name,
-                     memory_db::eoslock_account{acc_name, eosio::chain::asset(eoslock_amount, symbol(4, "EOSLOCK"))});
-
-            //inactive account freeze(lock) asset
-            amount = account.asset - eosio::chain::asset(eoslock_amount);
-         } else {
-            //active account
-            amount = account.asset;
+      auto mdb = memory_db(self);
+      memory_db::table_inserter eoslock_tbl(mdb, config::eoslock_account_name, config::eoslock_account_name, N(accounts));
+      memory_db::table_inserter accounts_tbl(mdb, config::system_account_name, config::system_account_name, N(accounts));
+
+      const size_t report_interval = std::max<size_t>(total / 10, 1);
+      for( size_t i = 0; i < total; ++i ) {
+         auto& rows = prepared[i];
+         if( !rows.eoslock_row.empty() ) {
+            eoslock_tbl.insert(rows.name, rows.name, rows.eoslock_row);
          }
 
          // initialize_account_to_table
-         db.insert(
-                 config::system_account_name, config::system_account_name, N(accounts), acc_name,
-                 memory_db::account_info{acc_name, amount});
-         const authority auth(public_key);
-         create_native_account(acc_name, auth, auth, false);
+         accounts_tbl.insert(rows.name, rows.name, rows.account_row);
+         create_native_account(rows.name, rows.auth, rows.auth, false);
+
+         // release rows so memory not grow with the whole genesis
+         rows = genesis_account_rows{};
+
+         if( (i + 1) % report_interval == 0 || i + 1 == total ) {
+            const auto elapsed = std::max<int64_t>((fc::time_point::now() - prepared_time).count(), 1);
+            ilog("initialize_account: ${i}/${n} genesis accounts written, ${r} accounts/s",
+                 ("i", i + 1)("n", total)("r", (i + 1) * 1000000 / elapsed));
+         }
       }
+      eoslock_tbl.flush();
+      accounts_tbl.flush();
+
+      ilog("initialize_account: initialized ${n} genesis accounts in ${t} ms",
+           ("n", total)("t", (fc::time_point::now() - start).count() / 1000));
    }
 
    // initialize_contract init sys contract
@@ -818,6 +1003,8 @@ struct controller_impl {
       // vote4ram func, as the early eosforce user's ram not limit
       // so at first we set freeram to -1 to unlimit user ram
       set_num_config_on_chain(db, config::res_typ::free_ram_per_account, -1);
+      cfg_view.invalidate();
+      resource_limits.clear_ram_quotas();
 
       auto empty_authority = authority(1, {}, {});
       auto active_producers_authority = authority(1, {}, {});
@@ -865,6 +1052,14 @@ struct controller_impl {
          }
 
          emit( self.accepted_block, pending->_pending_block_state );
+
+         const auto emergency = is_chain_emergency();
+         if( !notified_emergency ) {
+            notified_emergency = emergency;
+         } else if( *notified_emergency != emergency ) {
+            notified_emergency = emergency;
+            emit( self.on_emergency_changed, emergency );
+         }
       } catch (...) {
          // dont bother resetting pending, instead abort the block
          reset_pending_on_exit.cancel();
@@ -1162,6 +1357,39 @@ struct controller_impl {
       return r;
    }
 
+   const config_view& get_config_view() const {
+      if( !cfg_view.is_valid() ) {
+         cfg_view.rebuild( db );
+      }
+      return cfg_view;
+   }
+
+   bool is_chain_emergency() const {
+      if( !chain_emergency ) {
+         chain_emergency = check_chainstatus();
+      }
+      return *chain_emergency;
+   }
+
+   // on_chainstatus_stored called when the system contract write a row of chainstatus table,
+   // only the row check_chainstatus reads is kept. A nullptr data means the row is removed and a row
+   // which cannot be unpacked is left to check_chainstatus, both are reloaded next time.
+   // It is called in contract execution, so it never throws
+   void on_chainstatus_stored( uint64_t primary_key, const char* data, size_t size ) {
+      if( primary_key != N(chainstatus) ) {
+         return;
+      }
+      chain_emergency.reset();
+      if( data == nullptr ) {
+         return;
+      }
+      try {
+         chain_emergency = fc::raw::unpack<memory_db::chain_status>( data, size ).emergency;
+      } catch( const fc::exception& e ) {
+         wlog( "chainstatus row cannot be unpacked, reload it later: ${e}", ("e", e.to_string()) );
+      }
+   }
+
    bool check_chainstatus() const {
       const auto *cstatus_tid = db.find<table_id_object, by_code_scope_table>(
             boost::make_tuple(config::system_account_name, config::system_account_name, N(chainstatus)));
@@ -1180,8 +1408,8 @@ struct controller_impl {
    }
 
    void check_action( const vector<action>& actions ) const {
-      const auto chain_status = check_chainstatus();
-      const auto trx_size_limit = get_num_config_on_chain(db,
+      const auto chain_status = is_chain_emergency();
+      const auto trx_size_limit = get_config_view().get_num(
             config::res_typ::trx_size_limit,
             config::default_trx_size);
       for( const auto& _a : actions ) {
@@ -1397,6 +1625,8 @@ struct controller_impl {
       // when vote4ram open, change to 8kb per user
       if( is_func_open_in_curr_block(self, config::func_typ::vote_for_ram) ) {
          set_num_config_on_chain(db, config::res_typ::free_ram_per_account, 8 * 1024);
+         cfg_view.invalidate();
+         resource_limits.clear_ram_quotas();
       }
 
        // when on the specific block : create eosio account in table accounts of eosio system contract
@@ -1480,6 +1710,9 @@ struct controller_impl {
 
          check_func_open();
 
+         // check_func_open may change config rows, so build the view for this block after it
+         cfg_view.rebuild( db );
+
          try {
             auto onbtrx = std::make_shared<transaction_metadata>( get_on_block_transaction() );
             onbtrx->implicit = true;
@@ -1521,16 +1754,12 @@ struct controller_impl {
          start_block( b->timestamp, b->confirmed, s , producer_block_id);
 
          std::vector<transaction_metadata_ptr> packed_transactions;
-         packed_transactions.reserve( b->transactions.size() );
-         for( const auto& receipt : b->transactions ) {
-            if( receipt.trx.contains<packed_transaction>()) {
-               auto& pt = receipt.trx.get<packed_transaction>();
-               auto mtrx = std::make_shared<transaction_metadata>( std::make_shared<packed_transaction>( pt ) );
-               if( !self.skip_auth_check() ) {
-                  transaction_metadata::start_recover_keys( mtrx, thread_pool, chain_id, microseconds::maximum() );
-               }
-               packed_transactions.emplace_back( std::move( mtrx ) );
-            }
+         auto prevalidated = prevalidated_blocks.find( producer_block_id );
+         if( prevalidated != prevalidated_blocks.end() ) {
+            packed_transactions = std::move( prevalidated->second.trxs );
+            prevalidated_blocks.erase( prevalidated );
+         } else {
+            packed_transactions = start_recover_block_keys( b );
          }
 
          transaction_trace_ptr trace;
@@ -1597,6 +1826,84 @@ struct controller_impl {
       }
    } FC_CAPTURE_AND_RETHROW() } /// apply_block
 
+   // start_recover_block_keys create metadata of packed transactions of b and start to recover their keys,
+   // the metadata refer to the packed transactions in b and keep b alive instead of copying them
+   vector<transaction_metadata_ptr> start_recover_block_keys( const signed_block_ptr& b ) {
+      vector<transaction_metadata_ptr> packed_transactions;
+      packed_transactions.reserve( b->transactions.size() );
+      for( auto& receipt : b->transactions ) {
+         if( receipt.trx.contains<packed_transaction>()) {
+            auto& pt = receipt.trx.get<packed_transaction>();
+            auto mtrx = std::make_shared<transaction_metadata>( packed_transaction_ptr( b, &pt ) );
+            if( !self.skip_auth_check() ) {
+               transaction_metadata::start_recover_keys( mtrx, thread_pool, chain_id, microseconds::maximum() );
+            }
+            packed_transactions.emplace_back( std::move( mtrx ) );
+         }
+      }
+      return packed_transactions;
+   }
+
+   bool prevalidate_block( const signed_block_ptr& b ) {
+      EOS_ASSERT( b, block_validate_exception, "null block" );
+
+      auto id = b->id();
+      if( prevalidated_blocks.count( id ) || fork_db.get_block( id ) )
+         return false;
+
+      std::shared_future<block_state_ptr> prev;
+      auto pitr = prevalidated_blocks.find( b->previous );
+      if( pitr != prevalidated_blocks.end() ) {
+         prev = pitr->second.header;
+      } else {
+         auto prev_state = fork_db.get_block( b->previous );
+         if( !prev_state )
+            return false;
+         std::promise<block_state_ptr> p;
+         p.set_value( prev_state );
+         prev = p.get_future().share();
+      }
+
+      auto header = std::make_shared<std::promise<block_state_ptr>>();
+      auto state  = std::make_shared<std::promise<block_state_ptr>>();
+      auto& entry = prevalidated_blocks[id];
+      entry.header = header->get_future().share();
+      entry.state  = state->get_future().share();
+      entry.trxs   = start_recover_block_keys( b );
+
+      // header state of previous block is ready as it was built earlier on header_strand
+      boost::asio::post( header_strand, [b, prev, header, state, &pool = thread_pool]() {
+         block_state_ptr bs;
+         try {
+            const bool skip_validate_signee = true;
+            bs = std::make_shared<block_state>( *prev.get(), b, skip_validate_signee );
+            header->set_value( bs );
+         } catch( ... ) {
+            header->set_exception( std::current_exception() );
+            state->set_exception( std::current_exception() );
+            return;
+         }
+         boost::asio::post( pool, [bs, state]() {
+            try {
+               bs->verify_signee( bs->signee() );
+               state->set_value( bs );
+            } catch( ... ) {
+               state->set_exception( std::current_exception() );
+            }
+         } );
+      } );
+      return true;
+   }
+
+   uint32_t prevalidated_ahead()const {
+      uint32_t ready = 0;
+      for( const auto& p : prevalidated_blocks ) {
+         if( p.second.state.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready )
+            ++ready;
+      }
+      return ready;
+   }
+
    std::future<block_state_ptr> create_block_state_future( const signed_block_ptr& b ) {
       EOS_ASSERT( b, block_validate_exception, "null block" );
 
@@ -1609,12 +1916,37 @@ struct controller_impl {
       auto prev = fork_db.get_block( b->previous );
       EOS_ASSERT( prev, unlinkable_block_exception, "unlinkable block ${id}", ("id", id)("previous", b->previous) );
 
+      auto prevalidated = prevalidated_blocks.find( id );
+      if( prevalidated != prevalidated_blocks.end() ) {
+         return std::async( std::launch::deferred, [state = prevalidated->second.state]() { return state.get(); } );
+      }
+
       return async_thread_pool( thread_pool, [b, prev]() {
          const bool skip_validate_signee = false;
          return std::make_shared<block_state>( *prev, move( b ), skip_validate_signee );
       } );
    }
 
+   // precompile_block_code start to prepare the code of setcode in block before the block is applied
+   void precompile_block_code( const signed_block_ptr& b ) {
+      if( conf.wasm_compile_threads == 0 ) return;
+
+      for( const auto& receipt : b->transactions ) {
+         if( !receipt.trx.contains<packed_transaction>() ) continue;
+
+         for( const auto& act : receipt.trx.get<packed_transaction>().get_transaction().actions ) {
+            if( act.account != config::system_account_name || act.name != N(setcode) ) continue;
+            try {
+               const auto sc = act.data_as<setcode>();
+               if( sc.code.empty() ) continue;
+               wasmif.precompile( fc::sha256::hash( sc.code.data(), (uint32_t)sc.code.size() ), sc.code );
+            } catch( const fc::exception& ) {
+               // bad setcode will fail when the block is applied
+            }
+         }
+      }
+   }
+
    void push_block( std::future<block_state_ptr>& block_state_future ) {
       controller::block_status s = controller::block_status::complete;
       EOS_ASSERT(!pending, block_validate_exception, "it is not valid to push a block when there is a pending block");
@@ -1628,6 +1960,7 @@ struct controller_impl {
          emit( self.pre_accepted_block, b );
 
          fork_db.add( new_header_state, false );
+         precompile_block_code( b );
 
          if (conf.trusted_producers.count(b->producer)) {
             trusted_producer_light_validation = true;
@@ -1654,6 +1987,7 @@ struct controller_impl {
          emit( self.pre_accepted_block, b );
          const bool skip_validate_signee = !conf.force_all_checks;
          auto new_header_state = fork_db.add( b, skip_validate_signee );
+         precompile_block_code( b );
 
          emit( self.accepted_block_header, new_header_state );
 
@@ -1699,7 +2033,7 @@ struct controller_impl {
                apply_block( (*ritr)->block, (*ritr)->validated ? controller::block_status::validated : controller::block_status::complete );
                head = *ritr;
                fork_db.mark_in_current_chain( *ritr, true );
-               (*ritr)->validated = true;
+               fork_db.set_validity( *ritr, true );
             }
             catch (const fc::exception& e) { except = e; }
             if (except) {
@@ -1739,6 +2073,7 @@ struct controller_impl {
                unapplied_transactions[t->signed_id] = t;
          }
          pending.reset();
+         reset_state_views();
       }
    }
 
@@ -2087,6 +2422,32 @@ txfee_manager&         controller::get_mutable_txfee_manager()
    return my->txfee;
 }
 
+const config_view&     controller::get_config_view()const
+{
+   return my->get_config_view();
+}
+void                   controller::invalidate_config_view()
+{
+   my->cfg_view.invalidate();
+   my->resource_limits.clear_ram_quotas();
+}
+
+bool controller::is_chain_emergency()const {
+   return my->is_chain_emergency();
+}
+
+void controller::on_chainstatus_stored( uint64_t primary_key, const char* data, size_t size ) {
+   my->on_chainstatus_stored( primary_key, data, size );
+}
+
+void controller::on_state_undo() {
+   my->reset_state_views();
+}
+
+void controller::on_fixvotes_changed( account_name voter ) {
+   my->emit( fixvotes_changed, voter );
+}
+
 controller::controller( const controller::config& cfg )
 :my( new controller_impl( cfg, *this ) )
 {
@@ -2160,6 +2521,14 @@ boost::asio::thread_pool& controller::get_thread_pool() {
    return my->thread_pool;
 }
 
+bool controller::prevalidate_block( const signed_block_ptr& b ) {
+   return my->prevalidate_block( b );
+}
+
+uint32_t controller::prevalidated_ahead()const {
+   return my->prevalidated_ahead();
+}
+
 std::future<block_state_ptr> controller::create_block_state_future( const signed_block_ptr& b ) {
    return my->create_block_state_future( b );
 }
@@ -2313,6 +2682,14 @@ signed_block_ptr controller::fetch_block_by_number( uint32_t block_num )const  {
    return my->blog.read_block_by_num(block_num);
 } FC_CAPTURE_AND_RETHROW( (block_num) ) }
 
+vector<signed_block_ptr> controller::fetch_irreversible_block_range( uint32_t first_block_num, uint32_t count )const { try {
+   return my->blog.read_block_range( first_block_num, count );
+} FC_CAPTURE_AND_RETHROW( (first_block_num)(count) ) }
+
+block_log::write_stats controller::get_block_log_write_stats()const {
+   return my->blog.get_write_stats();
+}
+
 block_state_ptr controller::fetch_block_state_by_id( block_id_type id )const {
    auto state = my->fork_db.get_block(id);
    return state;
@@ -2346,6 +2723,15 @@ void controller::write_snapshot( const snapshot_writer_ptr& snapshot ) const {
    return my->add_to_snapshot(snapshot);
 }
 
+optional<controller::snapshot_checkpoint> controller::create_snapshot_checkpoint( const fc::path& dir ) const {
+   EOS_ASSERT( !my->pending, block_validate_exception, "cannot take a consistent snapshot with a pending block" );
+   return my->create_snapshot_checkpoint( dir );
+}
+
+void controller::write_snapshot( const snapshot_checkpoint& checkpoint, const snapshot_writer_ptr& snapshot ) const {
+   my->write_snapshot_from_checkpoint( checkpoint, snapshot );
+}
+
 void controller::pop_block() {
    my->pop_block();
 }
@@ -2459,6 +2845,10 @@ bool controller::contracts_console()const {
    return my->conf.contracts_console;
 }
 
+bool controller::batch_fee_settlement()const {
+   return my->conf.batch_fee_settlement;
+}
+
 chain_id_type controller::get_chain_id()const {
    return my->chain_id;
 }
@@ -2485,6 +2875,14 @@ wasm_interface& controller::get_wasm_interface() {
    return my->wasmif;
 }
 
+const wasm_interface& controller::get_wasm_interface()const {
+   return my->wasmif;
+}
+
+abi_serializer_cache& controller::get_abi_serializer_cache()const {
+   return my->abi_cache;
+}
+
 const account_object& controller::get_account( account_name name )const
 { try {
    return my->db.get<account_object, by_name>(name);
@@ -188,6 +188,10 @@ void apply_eosio_setcode(apply_context& context) {
    if (new_size != old_size) {
       context.add_ram_usage( act.account, new_size - old_size );
    }
+
+   if( code_size > 0 ) {
+      context.control.get_wasm_interface().precompile( code_id, act.code );
+   }
 }
 
 // setfee just for test imp contracts
@@ -272,6 +276,9 @@ void apply_eosio_setfee(apply_context& context) {
          fee_obj.ram_limit = act.ram_limit;
       });
    }
+
+   context.control.get_mutable_txfee_manager().on_setfee(
+         act.account, act.action, context.control.pending_block_state()->block_num);
 }
 
 void apply_eosio_setabi(apply_context& context) {
@@ -299,6 +306,7 @@ void apply_eosio_setabi(apply_context& context) {
    db.modify( account_sequence, [&]( auto& aso ) {
       aso.abi_sequence += 1;
    });
+   context.control.get_abi_serializer_cache().erase( act.account );
 
    if (new_size != old_size) {
       context.add_ram_usage( act.account, new_size - old_size );
@@ -488,6 +496,8 @@ void apply_eosio_setconfig(apply_context& context) {
    } 
    
    set_config_on_chain(context.db, cfg_data);
+   // the row changed, controller will rebuild config view at next read
+   context.control.invalidate_config_view();
 }
 
 void apply_eosio_onfee( apply_context& context ) {
@@ -498,6 +508,12 @@ void apply_eosio_onfee( apply_context& context ) {
    // need actor authorization
    // context.require_authorization(data.actor);
 
+   // rows are written once for all onfee in trx, see transaction_context::settle_fee
+   if( context.control.batch_fee_settlement() ) {
+      context.trx_context.settle_fee(data.actor, fee, data.bpname);
+      return;
+   }
+
    // accounts_table
    auto acnts_tbl = native_multi_index<N(accounts), memory_db::account_info>{
          context, config::system_account_name, config::system_account_name
@@ -546,7 +562,7 @@ void apply_eosio_voteagefee( apply_context& context ) {
    memory_db::bp_info bp_info_data;
    bps_tbl.get(data.bpname, bp_info_data, "bpname is not registered");
       
-   const auto voteage = fee.get_amount() * get_num_config_on_chain( context.db, config::res_typ::votage_ratio, 10000 ) / 10000;
+   const auto voteage = fee.get_amount() * get_num_config_on_chain( context.control, config::res_typ::votage_ratio, 10000 ) / 10000;
    const auto curr_block_num = context.control.head_block_num();
    const auto newest_total_voteage =
       bp_info_data.total_voteage + bp_info_data.total_staked * (curr_block_num - bp_info_data.voteage_update_height);
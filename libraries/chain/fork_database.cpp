@@ -6,8 +6,17 @@
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/mem_fun.hpp>
 #include <boost/multi_index/composite_key.hpp>
+#include <eosio/chain/thread_utils.hpp>
 #include <fc/io/fstream.hpp>
 #include <fstream>
+#include <future>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 namespace eosio { namespace chain {
    using boost::multi_index_container;
@@ -42,12 +51,280 @@ namespace eosio { namespace chain {
    > fork_multi_index_type;
 
 
+   /**
+    *  Changes of index are appended to forkdb.log as records, so fork database is not lost by a crash:
+    *
+    *    uint32_t size, uint8_t type, block_id_type id, payload of size - 1 - sizeof(id) bytes
+    *
+    *  add records have a packed block_state, a later add record of a id replaces the earlier one, flags records
+    *  have validated, in_current_chain and bft_irreversible_blocknum of the last added state of id, confirm records
+    *  have a packed header_confirmation added to the last added state of id, remove records have no payload.
+    *  The log is compacted to add records of the states in index when it has much more records than index, on a
+    *  compaction thread, and on close.
+    */
+   enum class fork_db_record_type : uint8_t {
+      add     = 1,
+      remove  = 2,
+      flags   = 3,
+      confirm = 4
+   };
+
+   static const uint32_t fork_db_log_version     = 1;
+   static const uint32_t fork_db_compact_factor  = 4;   ///< compact if records are more than this times of index size
+   static const uint32_t fork_db_compact_minimum = 4096;
+
    struct fork_database_impl {
       fork_multi_index_type index;
       block_state_ptr       head;
       fc::path              datadir;
+      fc::path              log_file;
+      std::ofstream         log;         ///< closed on close, changes made while closing are not recorded
+      uint64_t              records = 0; ///< records in log
+
+      std::future<void>     compacting;          ///< writing copies of states in index to log_file.tmp
+      std::ostringstream    compact_tail;        ///< records appended while compacting, added to the compacted log
+      uint64_t              compact_records = 0; ///< records in the compacted log
+
+      void append( fork_db_record_type type, const block_id_type& id, const vector<char>& payload = vector<char>() );
+      void append_state( const block_state& s ) { append( fork_db_record_type::add, s.id, fc::raw::pack( s ) ); }
+      void append_flags( const block_state& s );
+      void append_confirmation( const header_confirmation& c ) { append( fork_db_record_type::confirm, c.block_id, fc::raw::pack( c ) ); }
+      void maybe_compact();
+      void finish_compact();
+      void compact();
+      void load_log();
    };
 
+   static void write_record( std::ostream& out, fork_db_record_type type, const block_id_type& id, const vector<char>& payload ) {
+      const uint32_t size = 1 + sizeof(id) + payload.size();
+      out.write( (const char*)&size, sizeof(size) );
+      out.put( (char)type );
+      out.write( (const char*)&id, sizeof(id) );
+      out.write( payload.data(), payload.size() );
+   }
+
+   // write_states write a log of add records of states to file
+   static void write_states( const string& file, const vector<block_state_ptr>& states ) {
+      std::ofstream out( file.c_str(), std::ios::out | std::ios::binary | std::ofstream::trunc );
+      out.write( (const char*)&fork_db_log_version, sizeof(fork_db_log_version) );
+      for( const auto& s : states ) {
+         write_record( out, fork_db_record_type::add, s->id, fc::raw::pack( *s ) );
+      }
+      out.flush();
+      EOS_ASSERT( out.good(), fork_database_exception, "unable to write ${f}", ("f", file) );
+   }
+
+   void fork_database_impl::append( fork_db_record_type type, const block_id_type& id, const vector<char>& payload ) {
+      if( !log.is_open() )
+         return;
+      write_record( log, type, id, payload );
+      log.flush();
+      EOS_ASSERT( log.good(), fork_database_exception, "unable to write ${f}", ("f", log_file) );
+      ++records;
+      if( compacting.valid() ) {
+         write_record( compact_tail, type, id, payload );
+         ++compact_records;
+      }
+   }
+
+   void fork_database_impl::append_flags( const block_state& s ) {
+      vector<char> payload( sizeof(bool) * 2 + sizeof(uint32_t) );
+      fc::datastream<char*> ds( payload.data(), payload.size() );
+      fc::raw::pack( ds, s.validated );
+      fc::raw::pack( ds, s.in_current_chain );
+      fc::raw::pack( ds, s.bft_irreversible_blocknum );
+      append( fork_db_record_type::flags, s.id, payload );
+   }
+
+   /**
+    *  maybe_compact starts a compaction when log has much more records than index. States are copied on main
+    *  thread and packed and written on a compaction thread, records appended meanwhile are kept and added to
+    *  the compacted log when it is done, which is checked on later changes.
+    */
+   void fork_database_impl::maybe_compact() {
+      if( compacting.valid() ) {
+         if( compacting.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready )
+            finish_compact();
+         return;
+      }
+      if( !log.is_open() || records <= fork_db_compact_minimum || records <= fork_db_compact_factor * index.size() )
+         return;
+
+      vector<block_state_ptr> states;
+      states.reserve( index.size() );
+      for( const auto& s : index )
+         states.emplace_back( std::make_shared<block_state>( *s ) );
+      compact_records = states.size();
+      compact_tail.str( string() );
+      compacting = std::async( std::launch::async, [file = log_file.generic_string() + ".tmp", states = std::move( states )]() {
+         write_states( file, states );
+      } );
+   }
+
+   void fork_database_impl::finish_compact() {
+      const auto tmp_file = log_file.generic_string() + ".tmp";
+      const auto tail = compact_tail.str();
+      compact_tail.str( string() );
+      try {
+         compacting.get();
+         std::ofstream out( tmp_file.c_str(), std::ios::out | std::ios::binary | std::ios::app );
+         out.write( tail.data(), tail.size() );
+         out.flush();
+         EOS_ASSERT( out.good(), fork_database_exception, "unable to write ${f}", ("f", tmp_file) );
+      } catch( const fc::exception& e ) {
+         elog( "unable to compact ${f}, it is compacted again later: ${e}", ("f", log_file)("e", e.to_detail_string()) );
+         return;
+      } catch( const std::exception& e ) {
+         elog( "unable to compact ${f}, it is compacted again later: ${e}", ("f", log_file)("e", e.what()) );
+         return;
+      }
+
+      log.close();
+      fc::rename( tmp_file, log_file );
+      records = compact_records;
+      log.open( log_file.generic_string().c_str(), std::ios::out | std::ios::binary | std::ios::app );
+      EOS_ASSERT( log.good(), fork_database_exception, "unable to open ${f}", ("f", log_file) );
+   }
+
+   void fork_database_impl::compact() {
+      // a compaction in progress is replaced by this one
+      if( compacting.valid() ) {
+         compacting.wait();
+         compacting = std::future<void>();
+         compact_tail.str( string() );
+      }
+
+      auto tmp_file = log_file.generic_string() + ".tmp";
+      write_states( tmp_file, vector<block_state_ptr>( index.begin(), index.end() ) );
+      const bool was_open = log.is_open();
+      if( was_open )
+         log.close();
+      fc::rename( tmp_file, log_file );
+      records = index.size();
+      if( was_open )
+         log.open( log_file.generic_string().c_str(), std::ios::out | std::ios::binary | std::ios::app );
+   }
+
+   /**
+    *  load_log scans records of a read only mapping of log for the last add record and flags of each id, then
+    *  only the states left in index are unpacked, on a thread pool if there are many. A partial record at the
+    *  end of log left by a crash is truncated.
+    */
+   void fork_database_impl::load_log() {
+      namespace bip = boost::interprocess;
+      const uint64_t size = fc::file_size( log_file );
+      if( size < sizeof(uint32_t) ) {
+         fc::remove( log_file );
+         return;
+      }
+
+      struct entry {
+         const char*        data = nullptr; ///< packed block_state of last add record
+         uint32_t           size = 0;
+         optional<uint64_t> flags_pos;      ///< position of payload of last flags record after the add record
+         vector<std::pair<uint64_t, uint32_t>> confirmations; ///< payloads of confirm records after the add record
+      };
+      std::unordered_map<block_id_type, entry, std::hash<block_id_type>> entries;
+      uint64_t end = sizeof(uint32_t);
+      {
+         bip::file_mapping  mapping( log_file.generic_string().c_str(), bip::read_only );
+         bip::mapped_region region( mapping, bip::read_only );
+         const char* const addr = (const char*)region.get_address();
+
+         uint32_t version;
+         memcpy( &version, addr, sizeof(version) );
+         EOS_ASSERT( version == fork_db_log_version, fork_database_exception,
+                     "unsupported version ${v} of ${f}", ("v", version)("f", log_file) );
+
+         const uint32_t id_pos = sizeof(uint32_t) + 1;
+         while( end + id_pos + sizeof(block_id_type) <= size ) {
+            uint32_t record_size;
+            memcpy( &record_size, addr + end, sizeof(record_size) );
+            if( record_size < 1 + sizeof(block_id_type) || end + sizeof(record_size) + record_size > size )
+               break;
+            const auto type = (fork_db_record_type)addr[end + sizeof(record_size)];
+            block_id_type id;
+            memcpy( &id, addr + end + id_pos, sizeof(id) );
+            const uint64_t payload_pos  = end + id_pos + sizeof(id);
+            const uint32_t payload_size = record_size - 1 - sizeof(id);
+            if( type == fork_db_record_type::add ) {
+               entries[id] = entry{ addr + payload_pos, payload_size, {}, {} };
+            } else if( type == fork_db_record_type::remove ) {
+               entries.erase( id );
+            } else if( type == fork_db_record_type::flags ) {
+               auto itr = entries.find( id );
+               if( itr != entries.end() )
+                  itr->second.flags_pos = payload_pos;
+            } else if( type == fork_db_record_type::confirm ) {
+               auto itr = entries.find( id );
+               if( itr != entries.end() )
+                  itr->second.confirmations.emplace_back( payload_pos, payload_size );
+            } else {
+               break;
+            }
+            end += sizeof(record_size) + record_size;
+            ++records;
+         }
+
+         vector<block_state_ptr> states( entries.size() );
+         vector<const entry*>    loads;
+         loads.reserve( entries.size() );
+         for( const auto& e : entries )
+            loads.push_back( &e.second );
+
+         auto unpack = [&]( size_t begin, size_t last ) {
+            for( size_t i = begin; i < last; ++i ) {
+               const entry& e = *loads[i];
+               auto s = std::make_shared<block_state>();
+               fc::datastream<const char*> ds( e.data, e.size );
+               fc::raw::unpack( ds, *s );
+               if( e.flags_pos ) {
+                  fc::datastream<const char*> fds( addr + *e.flags_pos, sizeof(bool) * 2 + sizeof(uint32_t) );
+                  fc::raw::unpack( fds, s->validated );
+                  fc::raw::unpack( fds, s->in_current_chain );
+                  fc::raw::unpack( fds, s->bft_irreversible_blocknum );
+               }
+               // confirmations were validated when they were added
+               for( const auto& c : e.confirmations ) {
+                  fc::datastream<const char*> cds( addr + c.first, c.second );
+                  s->confirmations.emplace_back();
+                  fc::raw::unpack( cds, s->confirmations.back() );
+               }
+               states[i] = std::move( s );
+            }
+         };
+
+         const size_t threads = std::min<size_t>( std::max( 1u, std::thread::hardware_concurrency() ), loads.size() / 64 + 1 );
+         if( threads > 1 ) {
+            boost::asio::thread_pool pool( threads );
+            vector<std::future<void>> futures;
+            const size_t chunk = (loads.size() + threads - 1) / threads;
+            for( size_t begin = 0; begin < loads.size(); begin += chunk ) {
+               futures.emplace_back( async_thread_pool( pool, [&unpack, begin, last = std::min( begin + chunk, loads.size() )]() {
+                  unpack( begin, last );
+               } ) );
+            }
+            for( auto& f : futures )
+               f.get();
+            pool.join();
+         } else {
+            unpack( 0, loads.size() );
+         }
+
+         for( auto& s : states ) {
+            auto result = index.insert( std::move( s ) );
+            EOS_ASSERT( result.second, fork_database_exception, "duplicate state in ${f}", ("f", log_file) );
+         }
+      }
+
+      if( end != size ) {
+         wlog( "${f} ends with a partial record, truncating it from ${s} to ${e} bytes", ("f", log_file)("s", size)("e", end) );
+         boost::filesystem::resize_file( log_file.generic_string(), end );
+      }
+      if( !index.empty() )
+         head = *index.get<by_lib_block_num>().begin();
+   }
+
 
    fork_database::fork_database( const fc::path& data_dir ):my( new fork_database_impl() ) {
       my->datadir = data_dir;
@@ -55,8 +332,18 @@ namespace eosio { namespace chain {
       if (!fc::is_directory(my->datadir))
          fc::create_directories(my->datadir);
 
+      my->log_file = my->datadir / config::forkdb_log_filename;
+      if( fc::exists( my->log_file ) ) {
+         my->load_log();
+      }
+
+      // fork database of old versions is written once at shutdown, it is loaded and written to log,
+      // a forkdb.dat left with a log is older than the log
       auto fork_db_dat = my->datadir / config::forkdb_filename;
-      if( fc::exists( fork_db_dat ) ) {
+      if( fc::exists( my->log_file ) && fc::exists( fork_db_dat ) ) {
+         wlog( "removing ${d} left with ${f}", ("d", fork_db_dat)("f", my->log_file) );
+         fc::remove( fork_db_dat );
+      } else if( fc::exists( fork_db_dat ) ) {
          string content;
          fc::read_file_contents( fork_db_dat, content );
 
@@ -72,24 +359,21 @@ namespace eosio { namespace chain {
 
          my->head = get_block( head_id );
 
+         my->compact();
          fc::remove( fork_db_dat );
       }
+
+      if( !fc::exists( my->log_file ) )
+         my->compact();
+      my->log.open( my->log_file.generic_string().c_str(), std::ios::out | std::ios::binary | std::ios::app );
+      EOS_ASSERT( my->log.good(), fork_database_exception, "unable to open ${f}", ("f", my->log_file) );
    }
 
    void fork_database::close() {
       if( my->index.size() == 0 ) return;
 
-      auto fork_db_dat = my->datadir / config::forkdb_filename;
-      std::ofstream out( fork_db_dat.generic_string().c_str(), std::ios::out | std::ios::binary | std::ofstream::trunc );
-      uint32_t num_blocks_in_fork_db = my->index.size();
-      fc::raw::pack( out, unsigned_int{num_blocks_in_fork_db} );
-      for( const auto& s : my->index ) {
-         fc::raw::pack( out, *s );
-      }
-      if( my->head )
-         fc::raw::pack( out, my->head->id );
-      else
-         fc::raw::pack( out, block_id_type() );
+      my->compact();
+      my->log.close();
 
       /// we don't normally indicate the head block as irreversible
       /// we cannot normally prune the lib if it is the head block because
@@ -116,6 +400,7 @@ namespace eosio { namespace chain {
          //FC_ASSERT( s->block_num == s->header.block_num() );
 
       EOS_ASSERT( result.second, fork_database_exception, "unable to insert block state, duplicate state detected" );
+      my->append_state( *s );
       if( !my->head ) {
          my->head =  s;
       } else if( my->head->block_num < s->block_num ) {
@@ -135,6 +420,7 @@ namespace eosio { namespace chain {
 
       auto inserted = my->index.insert(n);
       EOS_ASSERT( inserted.second, fork_database_exception, "duplicate block added?" );
+      my->append_state( *n );
 
       my->head = *my->index.get<by_lib_block_num>().begin();
 
@@ -144,6 +430,7 @@ namespace eosio { namespace chain {
       if( oldest->block_num < lib ) {
          prune( oldest );
       }
+      my->maybe_compact();
 
       return n;
    }
@@ -215,8 +502,10 @@ namespace eosio { namespace chain {
 
       for( uint32_t i = 0; i < remove_queue.size(); ++i ) {
          auto itr = my->index.find( remove_queue[i] );
-         if( itr != my->index.end() )
+         if( itr != my->index.end() ) {
             my->index.erase(itr);
+            my->append( fork_db_record_type::remove, remove_queue[i] );
+         }
 
          auto& previdx = my->index.get<by_prev>();
          auto  previtr = previdx.lower_bound(remove_queue[i]);
@@ -235,6 +524,8 @@ namespace eosio { namespace chain {
       } else {
          /// remove older than irreversible and mark block as valid
          h->validated = true;
+         if( my->index.find( h->id ) != my->index.end() )
+            my->append_flags( *h );
       }
    }
 
@@ -249,6 +540,7 @@ namespace eosio { namespace chain {
       by_id_idx.modify( itr, [&]( auto& bsp ) { // Need to modify this way rather than directly so that Boost MultiIndex can re-sort
          bsp->in_current_chain = in_current_chain;
       });
+      my->append_flags( **itr );
    }
 
    void fork_database::prune( const block_state_ptr& h ) {
@@ -265,6 +557,7 @@ namespace eosio { namespace chain {
       if( itr != my->index.end() ) {
          irreversible(*itr);
          my->index.erase(itr);
+         my->append( fork_db_record_type::remove, h->id );
       }
 
       auto& numidx = my->index.get<by_block_num>();
@@ -301,6 +594,7 @@ namespace eosio { namespace chain {
       auto b = get_block( c.block_id );
       EOS_ASSERT( b, fork_db_block_not_found, "unable to find block id ${id}", ("id",c.block_id));
       b->add_confirmation( c );
+      my->append_confirmation( c );
 
       if( b->bft_irreversible_blocknum < b->block_num &&
          b->confirmations.size() >= ((b->active_schedule.producers.size() * 2) / 3 + 1) ) {
@@ -322,6 +616,7 @@ namespace eosio { namespace chain {
       idx.modify( itr, [&]( auto& bsp ) {
            bsp->bft_irreversible_blocknum = bsp->block_num;
       });
+      my->append_flags( **itr );
 
       /** to prevent stack-overflow, we perform a bredth-first traversal of the
        * fork database. At each stage we iterate over the leafs from the prior stage
@@ -341,6 +636,7 @@ namespace eosio { namespace chain {
                  if( bsp->bft_irreversible_blocknum < block_num ) {
                     bsp->bft_irreversible_blocknum = block_num;
                     updated.push_back( bsp->id );
+                    my->append_flags( *bsp );
                  }
                });
                ++pitr;
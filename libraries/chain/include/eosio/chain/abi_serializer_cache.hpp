@@ -0,0 +1,89 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <eosio/chain/abi_serializer.hpp>
+
+#include <memory>
+#include <mutex>
+
+namespace chainbase {
+   class database;
+}
+
+namespace eosio { namespace chain {
+
+   // cached_abi_serializer a shared, immutable abi_serializer with the abi_def it is built from,
+   // it acts like optional<abi_serializer> so it can be returned by resolvers of abi_serializer::to_variant
+   class cached_abi_serializer {
+      public:
+         cached_abi_serializer() = default;
+         cached_abi_serializer( abi_def abi, abi_serializer serializer );
+
+         bool valid()const { return bool(entry); }
+
+         const abi_serializer& operator*()const  { return entry->serializer; }
+         const abi_serializer* operator->()const { return &entry->serializer; }
+
+         const abi_def& get_abi()const { return entry->abi; }
+
+      private:
+         struct cached_abi {
+            abi_def        abi;
+            abi_serializer serializer;
+         };
+
+         std::shared_ptr<const cached_abi> entry;
+   };
+
+   /* abi_serializer_cache keeps the abi_serializer of accounts, keyed by (account, abi_sequence),
+    * so the abi of a account is unpacked and its type maps are built once for each setabi.
+    * A fork switch can bring back a abi_sequence with a different abi, but only by applying a setabi,
+    * which erases the entry of its account, so a hit compares just the sequence and the abi size.
+    * Least recently used entries are evicted when cache is full.
+    * Entries are guarded by a mutex, but get reads account rows of db, so it must be called on the thread
+    * which owns db, which is the main thread.
+    */
+   class abi_serializer_cache {
+      public:
+         struct cache_stats {
+            uint64_t hits        = 0;
+            uint64_t misses      = 0;
+            uint64_t evictions   = 0;
+            uint64_t entries     = 0;
+            uint64_t max_entries = 0;
+         };
+
+         explicit abi_serializer_cache( uint32_t max_entries );
+
+         // get abi_serializer of account n in db, not valid if n not exist or has no abi
+         cached_abi_serializer get( const chainbase::database& db, account_name n,
+                                    const fc::microseconds& max_serialization_time );
+
+         void erase( account_name n );
+         void clear();
+
+         cache_stats get_stats()const;
+
+      private:
+         struct entry {
+            uint64_t              abi_sequence = 0;
+            size_t                abi_size     = 0;
+            cached_abi_serializer serializer;
+            uint64_t              last_access  = 0;
+         };
+
+         void evict();
+
+         mutable std::mutex        mtx;
+         map<account_name, entry>  entries;
+         uint64_t                  access_count = 0;
+         uint32_t                  max_entries;
+         cache_stats               stats;
+   };
+
+} } // eosio::chain
+
+FC_REFLECT( eosio::chain::abi_serializer_cache::cache_stats, (hits)(misses)(evictions)(entries)(max_entries) )
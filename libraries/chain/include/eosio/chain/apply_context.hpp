@@ -545,6 +545,12 @@ class apply_context {
       void db_update_i64( int iterator, account_name payer, const char* buffer, size_t buffer_size );
       void db_remove_i64( int iterator );
       int  db_get_i64( int iterator, char* buffer, size_t buffer_size );
+
+      // for native contract, get the row without copy and update it by write new value into it directly
+      const key_value_object& db_get_row_i64( int iterator ) { return keyval_cache.get( iterator ); }
+      template<typename Packer>
+      void db_update_i64( int iterator, account_name payer, size_t buffer_size, Packer&& packer );
+
       int  db_next_i64( int iterator, uint64_t& primary );
       int  db_previous_i64( int iterator, uint64_t& primary );
       int  db_find_i64( uint64_t code, uint64_t scope, uint64_t table, uint64_t id );
@@ -560,6 +566,27 @@ class apply_context {
 
       int  db_store_i64( uint64_t code, uint64_t scope, uint64_t table, const account_name& payer, uint64_t id, const char* buffer, size_t buffer_size );
 
+      // is_chainstatus_table if the table is chainstatus in eosio system contract, controller keep its emergency flag
+      static bool is_chainstatus_table( const table_id_object& tab ) {
+         return tab.table == N(chainstatus)
+             && tab.code  == config::system_account_name
+             && tab.scope == config::system_account_name;
+      }
+
+      // is_vote4ramsum_table if the table is vote4ramsum in eosio system contract, ram quota of voters is derived from it
+      static bool is_vote4ramsum_table( const table_id_object& tab ) {
+         return tab.table == N(vote4ramsum)
+             && tab.code  == config::system_account_name
+             && tab.scope == config::system_account_name;
+      }
+
+      void on_vote4ram_changed( const key_value_object& obj );
+
+      // is_fixvotes_table if the table is fixvotes in eosio system contract, its scope is the voter
+      static bool is_fixvotes_table( const table_id_object& tab ) {
+         return tab.table == N(fixvotes)
+             && tab.code  == config::system_account_name;
+      }
 
    /// Misc methods:
    public:
@@ -609,6 +636,50 @@ class apply_context {
       //bytes                               _cached_trx;
 };
 
+// packer write buffer_size bytes into the value of row, ram is billed same as db_update_i64 with buffer
+template<typename Packer>
+void apply_context::db_update_i64( int iterator, account_name payer, size_t buffer_size, Packer&& packer ) {
+   const key_value_object& obj = keyval_cache.get( iterator );
+
+   const auto& table_obj = keyval_cache.get_table( obj.t_id );
+   EOS_ASSERT( table_obj.code == receiver, table_access_violation, "db access violation" );
+
+//   require_write_lock( table_obj.scope );
+
+   const int64_t overhead = config::billable_size_v<key_value_object>;
+   int64_t old_size = (int64_t)(obj.value.size() + overhead);
+   int64_t new_size = (int64_t)(buffer_size + overhead);
+
+   if( payer == account_name() ) payer = obj.payer;
+
+   if( account_name(obj.payer) != payer ) {
+      // refund the existing payer
+      update_db_usage( obj.payer,  -(old_size) );
+      // charge the new payer
+      update_db_usage( payer,  (new_size));
+   } else if(old_size != new_size) {
+      // charge/refund the existing payer the difference
+      update_db_usage( obj.payer, new_size - old_size);
+   }
+
+   db.modify( obj, [&]( auto& o ) {
+     // same size is the common case, resize do nothing then
+     o.value.resize( buffer_size );
+     packer( o.value.data() );
+     o.payer = payer;
+   });
+
+   if( is_chainstatus_table( table_obj ) ) {
+      control.on_chainstatus_stored( obj.primary_key, obj.value.data(), obj.value.size() );
+   }
+   if( is_vote4ramsum_table( table_obj ) ) {
+      on_vote4ram_changed( obj );
+   }
+   if( is_fixvotes_table( table_obj ) ) {
+      control.on_fixvotes_changed( table_obj.scope );
+   }
+}
+
 using apply_handler = std::function<void(apply_context&)>;
 
 } } // namespace eosio::chain
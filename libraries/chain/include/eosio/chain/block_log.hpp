@@ -34,6 +34,15 @@ namespace eosio { namespace chain {
     *
     * The main file is the only file that needs to persist. The index file can be reconstructed during a
     * linear scan of the main file.
+    *
+    * Blocks are appended through streams by one writer. read_block_by_num, read_block_range and get_block_pos
+    * read through read only mappings of both files without locks, so they can be called from any thread
+    * while blocks are appended; the mappings are replaced when a block after the mapped ones is read.
+    *
+    * append_async queues a block for a writer thread which packs and writes the queued blocks as a group, the
+    * queue is bounded by set_write_queue. Queued blocks are read from the queue until they are written. Files are
+    * synced at most once per sync interval, durable_head_num is the last block flushed, or synced if there is a
+    * sync interval. A partial block at the end of the main file left by a crash is truncated on open.
     */
 
    class block_log {
@@ -42,12 +51,34 @@ namespace eosio { namespace chain {
          block_log(block_log&& other);
          ~block_log();
 
+         struct write_stats {
+            uint64_t         blocks_written  = 0;
+            uint64_t         bytes_written   = 0;
+            uint64_t         groups          = 0; ///< writes of queued blocks
+            uint64_t         syncs           = 0;
+            uint32_t         queue_depth     = 0;
+            uint32_t         max_queue_depth = 0;
+            fc::microseconds write_time;          ///< time of writer spent on writing and syncing
+         };
+
          uint64_t append(const signed_block_ptr& b);
+         /**
+          * Queue b to be appended by writer thread, blocks if queue is full. Appends b on calling thread
+          * if queue size is 0. Throws the error of writer if it failed.
+          */
+         void append_async(const signed_block_ptr& b);
+         void set_write_queue( uint32_t queue_size, fc::microseconds sync_interval );
+         uint32_t     durable_head_num()const;
+         write_stats  get_write_stats()const;
          void flush();
          void reset( const genesis_state& gs, const signed_block_ptr& genesis_block, uint32_t first_block_num = 1 );
 
          std::pair<signed_block_ptr, uint64_t> read_block(uint64_t file_pos)const;
          signed_block_ptr read_block_by_num(uint32_t block_num)const;
+         /**
+          * Return the blocks from first_block_num, at most count, stops at the first block not in log.
+          */
+         vector<signed_block_ptr> read_block_range(uint32_t first_block_num, uint32_t count)const;
          signed_block_ptr read_block_by_id(const block_id_type& id)const {
             return read_block_by_num(block_header::num_from_id(id));
          }
@@ -60,6 +91,14 @@ namespace eosio { namespace chain {
          const signed_block_ptr& head()const;
          uint32_t                first_block_num() const;
 
+         /**
+          * Verify blocks from first_block_num to last_block_num on thread_pool_size threads, each block must be
+          * at its position in index and link to the id of the block before it. progress is called on the calling
+          * thread with the number of blocks verified. Throws block_log_exception for the first broken block.
+          */
+         void verify_blocks( uint32_t first_block_num, uint32_t last_block_num, uint16_t thread_pool_size,
+                             const std::function<void(uint32_t)>& progress = {} )const;
+
          static const uint64_t npos = std::numeric_limits<uint64_t>::max();
 
          static const uint32_t min_supported_version;
@@ -77,3 +116,6 @@ namespace eosio { namespace chain {
    };
 
 } }
+
+FC_REFLECT( eosio::chain::block_log::write_stats,
+            (blocks_written)(bytes_written)(groups)(syncs)(queue_depth)(max_queue_depth)(write_time) )
@@ -17,9 +17,13 @@ const static auto default_blocks_dir_name    = "blocks";
 const static auto reversible_blocks_dir_name = "reversible";
 const static auto default_reversible_cache_size = 340*1024*1024ll;/// 1MB * 340 blocks based on 21 producer BFT delay
 const static auto default_reversible_guard_size = 2*1024*1024ll;/// 1MB * 340 blocks based on 21 producer BFT delay
+const static uint32_t default_block_log_write_queue_size = 64; ///< irreversible blocks queued for block log writer, 0 to append on main thread
+const static uint32_t default_block_log_sync_interval_ms = 0;  ///< interval of syncing block log to disk, 0 to not sync
 
 const static auto default_state_dir_name     = "state";
-const static auto forkdb_filename            = "forkdb.dat";
+const static auto default_wasm_cache_dir_name = "wasm-cache";
+const static auto forkdb_filename            = "forkdb.dat"; ///< written by old versions at shutdown, migrated to forkdb_log_filename
+const static auto forkdb_log_filename        = "forkdb.log";
 const static auto default_state_size            = 1*1024*1024*1024ll;
 const static auto default_trx_size           = 100*1024ll;
 const static auto default_state_guard_size      =    128*1024*1024ll;
@@ -88,6 +92,11 @@ const static uint16_t   default_max_inline_action_depth        = 4;
 const static uint16_t   default_max_auth_depth                 = 6;
 const static uint32_t   default_sig_cpu_bill_pct               = 50 * percent_1; // billable percentage of signature recovery
 const static uint16_t   default_controller_thread_pool_size    = 2;
+const static uint64_t   default_wasm_cache_size                = 1024*1024*1024; ///< max bytes of instantiated wasm modules kept in cache
+const static uint16_t   default_wasm_compile_threads           = 1; ///< threads to prepare wasm modules in background
+const static uint64_t   default_wasm_disk_cache_size           = 1024*1024*1024; ///< max bytes of injected wasm modules kept on disk
+const static uint32_t   default_sig_recovery_cache_size        = 100000; ///< signatures kept with their recovered keys
+const static uint32_t   sig_recovery_cache_shards              = 16;
 
 const static uint32_t   min_net_usage_delta_between_base_and_max_for_trx  = 10*1024;
 // Should be large enough to allow recovery from badly set blockchain parameters without a hard fork
@@ -104,6 +113,7 @@ const static uint32_t   hashing_checktime_block_size       = 10*1024;  /// call
 
 const static eosio::chain::wasm_interface::vm_type default_wasm_runtime = eosio::chain::wasm_interface::vm_type::wabt;
 const static uint32_t   default_abi_serializer_max_time_ms = 15*1000; ///< default deadline for abi serialization methods
+const static uint32_t   default_abi_serializer_cache_size  = 1024;    ///< max accounts whose abi_serializer is cached
 
 /**
  *  The number of sequential blocks produced by a single producer
@@ -68,9 +68,35 @@ using config_data_object_index = chainbase::shared_multi_index_container<
       >
 >;
 
+// config_view a flat copy of config_data_object rows for per transaction path,
+// controller rebuild it in start_block and after setconfig change a row,
+// so is_func_has_open and get_num_config_on_chain no need a index lookup
+class config_view {
+   public:
+      void rebuild( const chainbase::database& db );
+      void invalidate() { _valid = false; }
+      bool is_valid() const { return _valid; }
+
+      // get_num return default_value if no found
+      int64_t get_num( const name& typ, const int64_t default_value = -1 ) const {
+         const auto itr = _nums.find(typ);
+         if( itr == _nums.end() ) {
+            return default_value;
+         }
+         return itr->second;
+      }
+
+   private:
+      flat_map<account_name, int64_t> _nums;
+      bool                            _valid = false;
+};
+
 // get_num_config_on_chain return -1 if no found
 int64_t get_num_config_on_chain( const chainbase::database& db, const name& typ, const int64_t default_value = -1 );
 
+// get_num_config_on_chain by config view in controller, return -1 if no found
+int64_t get_num_config_on_chain( const controller& ctl, const name& typ, const int64_t default_value = -1 );
+
 // set_num_config_on_chain if is -1 err
 void set_num_config_on_chain( chainbase::database& db, const name& typ, const int64_t num );
 
@@ -1,10 +1,12 @@
 #pragma once
 #include <eosio/chain/block_state.hpp>
+#include <eosio/chain/block_log.hpp>
 #include <eosio/chain/trace.hpp>
 #include <eosio/chain/genesis_state.hpp>
 #include <boost/signals2/signal.hpp>
 
 #include <eosio/chain/abi_serializer.hpp>
+#include <eosio/chain/abi_serializer_cache.hpp>
 #include <eosio/chain/account_object.hpp>
 #include <eosio/chain/snapshot.hpp>
 
@@ -19,6 +21,7 @@ namespace eosio { namespace chain {
 
    class authorization_manager;
    class txfee_manager;
+   class config_view;
 
    namespace resource_limits {
       class resource_limits_manager;
@@ -68,6 +71,8 @@ namespace eosio { namespace chain {
             uint64_t                 state_guard_size       =  chain::config::default_state_guard_size;
             uint64_t                 reversible_cache_size  =  chain::config::default_reversible_cache_size;
             uint64_t                 reversible_guard_size  =  chain::config::default_reversible_guard_size;
+            uint32_t                 block_log_write_queue_size = chain::config::default_block_log_write_queue_size;
+            uint32_t                 block_log_sync_interval_ms = chain::config::default_block_log_sync_interval_ms;
             uint32_t                 sig_cpu_bill_pct       =  chain::config::default_sig_cpu_bill_pct;
             uint16_t                 thread_pool_size       =  chain::config::default_controller_thread_pool_size;
             bool                     read_only              =  false;
@@ -75,9 +80,15 @@ namespace eosio { namespace chain {
             bool                     disable_replay_opts    =  false;
             bool                     contracts_console      =  false;
             bool                     allow_ram_billing_in_notify = false;
+            bool                     batch_fee_settlement   =  true;
 
             genesis_state            genesis;
             wasm_interface::vm_type  wasm_runtime = chain::config::default_wasm_runtime;
+            uint64_t                 wasm_cache_size        =  chain::config::default_wasm_cache_size;
+            uint16_t                 wasm_compile_threads   =  chain::config::default_wasm_compile_threads;
+            path                     wasm_cache_dir; ///< directory of injected wasm modules, empty to disable
+            uint64_t                 wasm_disk_cache_size   =  chain::config::default_wasm_disk_cache_size;
+            uint32_t                 abi_serializer_cache_size = chain::config::default_abi_serializer_cache_size;
 
             std::vector<account_tuple>  active_initial_account_list;
             uint32_t                    inactive_freeze_percent = 80;
@@ -148,6 +159,14 @@ namespace eosio { namespace chain {
          void commit_block();
          void pop_block();
 
+         /**
+          * Start to build the header state of b and recover its producer and transaction signatures on thread pool,
+          * they are used when b is pushed. b may link to a block prevalidated but not pushed yet, so a range of
+          * blocks can be prevalidated ahead of push_block. Returns false if b is known or does not link.
+          */
+         bool prevalidate_block( const signed_block_ptr& b );
+         /// number of prevalidated blocks with signatures recovered which are not applied yet
+         uint32_t prevalidated_ahead()const;
          std::future<block_state_ptr> create_block_state_future( const signed_block_ptr& b );
          void push_block( std::future<block_state_ptr>& block_state_future );
 
@@ -167,6 +186,16 @@ namespace eosio { namespace chain {
          const txfee_manager&                  get_txfee_manager()const;
          txfee_manager&                        get_mutable_txfee_manager();
 
+         /**
+          * The config view is a flat copy of config_data_object rows used by the per transaction path,
+          * it is rebuilt at start_block and lazily after it is invalidated by setconfig or a state undo.
+          */
+         const config_view&                    get_config_view()const;
+         void                                  invalidate_config_view();
+
+         /// emergency flag of the chainstatus row in eosio system contract, kept in memory by controller
+         bool                                  is_chain_emergency()const;
+
          const flat_set<account_name>&   get_actor_whitelist() const;
          const flat_set<account_name>&   get_actor_blacklist() const;
          const flat_set<account_name>&   get_contract_whitelist() const;
@@ -206,6 +235,11 @@ namespace eosio { namespace chain {
 
          signed_block_ptr fetch_block_by_number( uint32_t block_num )const;
          signed_block_ptr fetch_block_by_id( block_id_type id )const;
+         /**
+          * Return irreversible blocks from first_block_num read from block log, at most count
+          */
+         vector<signed_block_ptr> fetch_irreversible_block_range( uint32_t first_block_num, uint32_t count )const;
+         block_log::write_stats   get_block_log_write_stats()const;
 
          block_state_ptr fetch_block_state_by_number( uint32_t block_num )const;
          block_state_ptr fetch_block_state_by_id( block_id_type id )const;
@@ -215,6 +249,24 @@ namespace eosio { namespace chain {
          sha256 calculate_integrity_hash()const;
          void write_snapshot( const snapshot_writer_ptr& snapshot )const;
 
+         /**
+          * A copy of the state database files at head, rows of it are not changed by blocks applied later.
+          */
+         struct snapshot_checkpoint {
+            fc::path            dir;
+            block_header_state  head;
+         };
+         /**
+          * Clone the state database files to dir as reflinks, so only the clone stops block processing instead
+          * of the whole snapshot. Empty if dir is on a file system without reflinks or on other file system than
+          * the state database, a snapshot is then written by write_snapshot on main thread.
+          */
+         optional<snapshot_checkpoint> create_snapshot_checkpoint( const fc::path& dir )const;
+         /**
+          * Write a snapshot of checkpoint, may be called on any thread while blocks are applied.
+          */
+         void write_snapshot( const snapshot_checkpoint& checkpoint, const snapshot_writer_ptr& snapshot )const;
+
          bool sender_avoids_whitelist_blacklist_enforcement( account_name sender )const;
          void check_actor_list( const flat_set<account_name>& actors )const;
          void check_contract_list( account_name code )const;
@@ -246,6 +298,9 @@ namespace eosio { namespace chain {
 
          bool contracts_console()const;
 
+         /// if onfee actions of a transaction settle into one write of the accounts and bps rows
+         bool batch_fee_settlement()const;
+
          chain_id_type get_chain_id()const;
 
          db_read_mode get_read_mode()const;
@@ -260,6 +315,9 @@ namespace eosio { namespace chain {
          signal<void(const transaction_metadata_ptr&)> accepted_transaction;
          signal<void(const transaction_trace_ptr&)>    applied_transaction;
          signal<void(const int&)>                      bad_alloc;
+         signal<void(bool)>                            on_emergency_changed; ///< emitted on commit of a block which changed chainstatus
+         signal<void(uint32_t)>                        state_undone; ///< emitted after a undo of state db with head block num, no trace is emitted for undone changes
+         signal<void(account_name)>                    fixvotes_changed; ///< emitted when a row of eosio fixvotes table is written, with its scope which is the voter
 
          /*
          signal<void()>                                  pre_apply_block;
@@ -273,17 +331,24 @@ namespace eosio { namespace chain {
 
          const apply_handler* find_apply_handler( account_name contract, scope_name scope, action_name act )const;
          wasm_interface& get_wasm_interface();
+         const wasm_interface& get_wasm_interface()const;
 
 
-         optional<abi_serializer> get_abi_serializer( account_name n, const fc::microseconds& max_serialization_time )const {
+         abi_serializer_cache& get_abi_serializer_cache()const;
+
+         cached_abi_serializer get_cached_abi_serializer( account_name n, const fc::microseconds& max_serialization_time )const {
             if( n.good() ) {
                try {
-                  const auto& a = get_account( n );
-                  abi_def abi;
-                  if( abi_serializer::to_abi( a.abi, abi ))
-                     return abi_serializer( abi, max_serialization_time );
+                  return get_abi_serializer_cache().get( db(), n, max_serialization_time );
                } FC_CAPTURE_AND_LOG((n))
             }
+            return cached_abi_serializer();
+         }
+
+         optional<abi_serializer> get_abi_serializer( account_name n, const fc::microseconds& max_serialization_time )const {
+            auto abis = get_cached_abi_serializer( n, max_serialization_time );
+            if( abis.valid() )
+               return *abis;
             return optional<abi_serializer>();
          }
 
@@ -291,7 +356,7 @@ namespace eosio { namespace chain {
          fc::variant to_variant_with_abi( const T& obj, const fc::microseconds& max_serialization_time ) {
             fc::variant pretty_output;
             abi_serializer::to_variant( obj, pretty_output,
-                                        [&]( account_name n ){ return get_abi_serializer( n, max_serialization_time ); },
+                                        [&]( account_name n ){ return get_cached_abi_serializer( n, max_serialization_time ); },
                                         max_serialization_time);
             return pretty_output;
          }
@@ -302,6 +367,10 @@ namespace eosio { namespace chain {
 
          chainbase::database& mutable_db()const;
 
+         void on_chainstatus_stored( uint64_t primary_key, const char* data, size_t size );
+         void on_state_undo();
+         void on_fixvotes_changed( account_name voter );
+
          std::unique_ptr<controller_impl> my;
 
    };
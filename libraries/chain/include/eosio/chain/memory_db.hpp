@@ -28,8 +28,6 @@ public:
 
    /// Database methods:
 public:
-   constexpr static size_t max_stack_buffer_size = 512;
-
    template <typename T>
    void insert(const uint64_t &code,
                const uint64_t &scope,
@@ -57,23 +55,36 @@ public:
 
       if( !obj ) return false;
 
-      auto size = db_get_i64( obj, nullptr, 0 );
-      EOS_ASSERT( size >= 0, asset_type_exception, "error reading iterator" );
-
-      //using malloc/free here potentially is not exception-safe, although WASM doesn't support exceptions
-      void* buffer = max_stack_buffer_size < size_t(size) ? malloc(size_t(size)) : alloca(size_t(size));
-
-      db_get_i64( obj, (char *)buffer, uint32_t(size) );
+      unpack_row( *obj, out );
 
-      datastream<const char*> ds( (char*)buffer, uint32_t(size) );
+      return true;
+   }
 
-      if ( max_stack_buffer_size < size_t(size) ) {
-         free(buffer);
+   // table_inserter insert rows packed before into one table, for genesis,
+   // the table is created by first row like db_store_i64, its row count is updated once in flush
+   class table_inserter {
+   public:
+      table_inserter( memory_db& mdb, uint64_t code, uint64_t scope, uint64_t table )
+         : mdb(mdb), code(code), scope(scope), table(table) {
       }
 
-      fc::raw::unpack(ds, out);
+      void insert( const account_name& payer, uint64_t id, const bytes& data );
+      void flush();
 
-      return true;
+   private:
+      memory_db&             mdb;
+      uint64_t               code;
+      uint64_t               scope;
+      uint64_t               table;
+      const table_id_object* tab   = nullptr;
+      uint32_t               count = 0;
+   };
+
+   // unpack_row unpack the value of row directly, no copy to a buffer
+   template <typename T>
+   static void unpack_row( const key_value_object& obj, T& out ) {
+      datastream<const char*> ds( obj.value.data(), obj.value.size() );
+      fc::raw::unpack( ds, out );
    }
 
 private:
@@ -85,8 +96,6 @@ private:
                      const char *buffer,
                      size_t buffer_size );
 
-   int db_get_i64( const key_value_object* obj , char* buffer, size_t buffer_size ) const;
-
    const table_id_object *find_table( name code, name scope, name table );
    const table_id_object& find_or_create_table( name code, name scope, name table, const account_name& payer );
    void remove_table( const table_id_object& tid );
@@ -192,6 +201,17 @@ public:
 
 };
 
+// is_fixed_size_row rows which all fields has fixed size, so its packed size is never changed,
+// native_multi_index can modify them in place without calc the size
+template<typename T> struct is_fixed_size_row : std::false_type {};
+template<> struct is_fixed_size_row<memory_db::account_info>    : std::true_type {};
+template<> struct is_fixed_size_row<memory_db::eoslock_account> : std::true_type {};
+template<> struct is_fixed_size_row<memory_db::vote4ram_info>   : std::true_type {};
+template<> struct is_fixed_size_row<memory_db::votefix_info>    : std::true_type {};
+template<> struct is_fixed_size_row<memory_db::chain_status>    : std::true_type {};
+template<> struct is_fixed_size_row<memory_db::currency_stats>  : std::true_type {};
+template<> struct is_fixed_size_row<memory_db::vote_info>       : std::true_type {};
+
 // some imp same as api in wasm interface
 void eosio_contract_assert( bool condition, const char* msg );
 
@@ -208,9 +228,14 @@ private:
       // Limit table names to 12 characters so that the last character (4 bits) can be used to distinguish between the secondary indices.
       return (n & 0x000000000000000FULL) == 0;
    }
-   constexpr static size_t max_stack_buffer_size = 512;
    static_assert( validate_table_name(TableName), "multi_index does not support table names with a length greater than 12");
 
+   // fixed_row_size packed size of T if is_fixed_size_row<T>, it is same for all values
+   static size_t fixed_row_size() {
+      static const size_t size = fc::raw::pack_size( T{} );
+      return size;
+   }
+
    apply_context &_ctx;
 
    uint64_t _code;
@@ -231,21 +256,7 @@ public:
    }
 
    void load_object_by_primary_iterator( int32_t itr, T& out )const {
-      auto size = _ctx.db_get_i64( itr, nullptr, 0 );
-      eosio_contract_assert( size >= 0, "error reading iterator" );
-
-      //using malloc/free here potentially is not exception-safe, although WASM doesn't support exceptions
-      void* buffer = max_stack_buffer_size < size_t(size) ? malloc(size_t(size)) : alloca(size_t(size));
-
-      _ctx.db_get_i64( itr, (char *)buffer, uint32_t(size) );
-
-      datastream<const char*> ds( (char*)buffer, uint32_t(size) );
-
-      if ( max_stack_buffer_size < size_t(size) ) {
-         free(buffer);
-      }
-
-      fc::raw::unpack(ds, out);
+      memory_db::unpack_row( _ctx.db_get_row_i64( itr ), out );
    }
 
    bool find( uint64_t primary, T& out )const {
@@ -275,22 +286,13 @@ public:
 
       eosio_contract_assert( pk == obj.primary_key(), "updater cannot change primary key when modifying an object" );
 
-      datastream<size_t> ps;
-      fc::raw::pack(ps, obj);
-      size_t size = ps.tellp();
-
-      //using malloc/free here potentially is not exception-safe, although WASM doesn't support exceptions
-      void* buffer = max_stack_buffer_size < size ? malloc(size) : alloca(size);
-
-      datastream<char*> ds( (char*)buffer, size );
-      //ds << obj;
-      fc::raw::pack(ds, obj);
+      const size_t size = is_fixed_size_row<T>::value ? fixed_row_size() : fc::raw::pack_size( obj );
 
-      _ctx.db_update_i64( itr, payer, (char*)buffer, size );
-
-      if ( max_stack_buffer_size < size ) {
-         free( buffer );
-      }
+      // pack obj into the row directly, size is exact so packing never throw inside db modify
+      _ctx.db_update_i64( itr, payer, size, [&obj, size]( char* data ) {
+         datastream<char*> ds( data, size );
+         fc::raw::pack( ds, obj );
+      });
    }
 };
 
@@ -78,8 +78,20 @@ namespace eosio { namespace chain { namespace resource_limits {
 
          int64_t get_account_ram_usage( const account_name& name ) const;
 
+         /**
+          * ram quota of accounts is derived from the vote4ramsum rows of system contract and the res config,
+          * it is kept in memory and must be dropped when they change, it is reloaded lazily.
+          * These do not touch the state db, so an undo of state db must clear all quotas too.
+          */
+         int64_t get_account_ram_limit( const account_name& name ) const;
+         void    on_vote4ram_changed( const account_name& voter );
+         void    clear_ram_quotas();
+
       private:
-         chainbase::database& _db;
+         int64_t load_account_ram_limit( const account_name& name ) const;
+
+         chainbase::database&             _db;
+         mutable map<account_name,int64_t> _ram_quotas;
    };
 } } } /// eosio::chain
 
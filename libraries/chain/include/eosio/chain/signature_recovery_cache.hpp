@@ -0,0 +1,63 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <eosio/chain/config.hpp>
+#include <eosio/chain/types.hpp>
+#include <fc/time.hpp>
+
+#include <atomic>
+#include <memory>
+
+namespace eosio { namespace chain {
+
+   namespace detail { struct recovery_cache_shard; }
+
+   /**
+    * signature_recovery_cache maps (sig_digest, signature) to the key recovered from them, so a transaction
+    * recovered when it is relayed is not recovered again when the block with it is applied.
+    * It is shared by all threads and split into shards by digest, each with its own mutex,
+    * the oldest entries of a shard are evicted when it is full.
+    */
+   class signature_recovery_cache {
+      public:
+         struct stats {
+            uint64_t hits      = 0;
+            uint64_t misses    = 0;
+            uint64_t evictions = 0;
+            uint64_t size      = 0;
+            uint64_t capacity  = 0;
+         };
+
+         struct entry {
+            public_key_type  key;
+            fc::microseconds cpu_usage; ///< of recovery when it was a miss
+         };
+
+         static signature_recovery_cache& instance();
+
+         explicit signature_recovery_cache( uint32_t capacity = config::default_sig_recovery_cache_size );
+         ~signature_recovery_cache();
+
+         bool find( const digest_type& digest, const signature_type& sig, entry& result );
+         void add( const digest_type& digest, const signature_type& sig, const public_key_type& key, fc::microseconds cpu_usage );
+
+         /// evicts entries over the new capacity
+         void  set_capacity( uint32_t capacity );
+         stats get_stats()const;
+
+      private:
+         detail::recovery_cache_shard& shard( const digest_type& digest )const;
+
+         std::unique_ptr<detail::recovery_cache_shard[]> shards;
+         std::atomic<uint32_t>                           shard_capacity;
+         std::atomic<uint64_t>                           hits{0};
+         std::atomic<uint64_t>                           misses{0};
+         std::atomic<uint64_t>                           evictions{0};
+   };
+
+} } // eosio::chain
+
+FC_REFLECT( eosio::chain::signature_recovery_cache::stats, (hits)(misses)(evictions)(size)(capacity) )
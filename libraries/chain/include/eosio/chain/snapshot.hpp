@@ -7,15 +7,22 @@
 #include <eosio/chain/database_utils.hpp>
 #include <eosio/chain/exceptions.hpp>
 #include <fc/variant_object.hpp>
+#include <fc/io/datastream.hpp>
 #include <boost/core/demangle.hpp>
+#include <atomic>
+#include <memory>
 #include <ostream>
+#include <sstream>
 
 namespace eosio { namespace chain {
    /**
     * History:
     * Version 1: initial version with string identified sections and rows
+    * Version 3: binary snapshot sections are zlib compressed blocks of whole rows, indexed by a footer,
+    *            rows are not changed. Version 2 is skipped, it is a different format in upstream EOSIO.
     */
-   static const uint32_t current_snapshot_version = 1;
+   static const uint32_t current_snapshot_version = 3;
+   static const uint32_t minimum_snapshot_version = 1;
 
    namespace detail {
       template<typename T>
@@ -114,6 +121,22 @@ namespace eosio { namespace chain {
       snapshot_row_writer<T> make_row_writer( const T& data) {
          return snapshot_row_writer<T>(data);
       }
+
+      /// a compressed block of whole rows of a section in a version 3 snapshot
+      struct snapshot_block_entry {
+         uint64_t offset = 0;          ///< from start of snapshot
+         uint32_t compressed_size = 0;
+         uint32_t size = 0;
+         uint64_t row_count = 0;
+      };
+
+      struct snapshot_section_entry {
+         std::string                  name;
+         uint64_t                     row_count = 0;
+         vector<snapshot_block_entry> blocks;
+      };
+
+      class snapshot_block_decoder;
    }
 
    class snapshot_writer {
@@ -161,6 +184,7 @@ namespace eosio { namespace chain {
    namespace detail {
       struct abstract_snapshot_row_reader {
          virtual void provide(std::istream& in) const = 0;
+         virtual void provide(fc::datastream<const char*>& in) const = 0;
          virtual void provide(const fc::variant&) const = 0;
          virtual std::string row_type_name() const = 0;
       };
@@ -206,6 +230,12 @@ namespace eosio { namespace chain {
             });
          }
 
+         void provide(fc::datastream<const char*>& in) const override {
+            row_validation_helper::apply(data, [&in,this](){
+               fc::raw::unpack(in, data);
+            });
+         }
+
          void provide(const fc::variant& var) const override {
             row_validation_helper::apply(data, [&var,this]() {
                fc::from_variant(var, data);
@@ -327,28 +357,60 @@ namespace eosio { namespace chain {
          uint64_t cur_row;
    };
 
+   /**
+    * ostream_snapshot_writer writes a version 3 binary snapshot:
+    *
+    *   magic number, version, position of footer
+    *   for each section, rows packed into blocks of about block_size bytes, each compressed on its own
+    *   footer: size of it and the packed section entries with the blocks of each section
+    *
+    * A row is never split between blocks, so blocks can be decompressed and unpacked independently.
+    */
    class ostream_snapshot_writer : public snapshot_writer {
       public:
-         explicit ostream_snapshot_writer(std::ostream& snapshot);
+         explicit ostream_snapshot_writer(std::ostream& snapshot, uint32_t block_size = default_block_size);
 
          void write_start_section( const std::string& section_name ) override;
          void write_row( const detail::abstract_snapshot_row_writer& row_writer ) override;
          void write_end_section( ) override;
          void finalize();
 
+         /// progress of writer, may be read from other threads
+         uint64_t rows_written()const     { return total_rows; }
+         uint32_t sections_written()const { return total_sections; }
+         /// may be called from other threads, the next row written throws
+         void     cancel()                { cancelled = true; }
+
          static const uint32_t magic_number = 0x30510550;
+         static const uint32_t default_block_size = 1024*1024;
 
       private:
-         detail::ostream_wrapper snapshot;
-         std::streampos          header_pos;
-         std::streampos          section_pos;
-         uint64_t                row_count;
+         void write_block();
+
+         detail::ostream_wrapper                snapshot;
+         std::streampos                         header_pos;
+         const uint32_t                         block_size;
+         bool                                   in_section = false;
+         uint64_t                               row_count;
+         std::ostringstream                     block;
+         uint64_t                               block_rows = 0;
+         vector<detail::snapshot_section_entry> sections;
+         std::atomic<uint64_t>                  total_rows{0};
+         std::atomic<uint32_t>                  total_sections{0};
+         std::atomic<bool>                      cancelled{false};
 
    };
 
+   /**
+    * istream_snapshot_reader reads version 1 and version 3 binary snapshots.
+    * Blocks of a version 3 snapshot are decompressed on threads ahead of the rows read, so
+    * decompression of the next blocks and sections overlaps the rows inserted into the database.
+    */
    class istream_snapshot_reader : public snapshot_reader {
       public:
-         explicit istream_snapshot_reader(std::istream& snapshot);
+         /// @param threads to decompress blocks with, 0 for the number of cpus
+         explicit istream_snapshot_reader(std::istream& snapshot, uint16_t threads = 0);
+         ~istream_snapshot_reader();
 
          void validate() const override;
          bool has_section( const string& section_name ) override;
@@ -359,11 +421,18 @@ namespace eosio { namespace chain {
 
       private:
          bool validate_section() const;
+         uint32_t read_version() const;
+         vector<detail::snapshot_section_entry> read_footer() const;
+         detail::snapshot_block_decoder* decoder();
 
          std::istream&  snapshot;
          std::streampos header_pos;
          uint64_t       num_rows;
          uint64_t       cur_row;
+         uint16_t       threads;
+         bool           decoder_loaded = false;
+
+         std::unique_ptr<detail::snapshot_block_decoder> block_decoder; ///< version 3 only
    };
 
    class integrity_hash_snapshot_writer : public snapshot_writer {
@@ -381,3 +450,6 @@ namespace eosio { namespace chain {
    };
 
 }}
+
+FC_REFLECT( eosio::chain::detail::snapshot_block_entry, (offset)(compressed_size)(size)(row_count) )
+FC_REFLECT( eosio::chain::detail::snapshot_section_entry, (name)(row_count)(blocks) )
@@ -1,6 +1,7 @@
 #pragma once
 #include <eosio/chain/controller.hpp>
 #include <eosio/chain/trace.hpp>
+#include <eosio/chain/memory_db.hpp>
 #include <signal.h>
 
 namespace eosio { namespace chain {
@@ -28,6 +29,7 @@ namespace eosio { namespace chain {
                               const signed_transaction& t,
                               const transaction_id_type& trx_id,
                               fc::time_point start = fc::time_point::now() );
+         ~transaction_context();
 
          void init_for_implicit_trx( uint64_t initial_net_usage = 0 );
 
@@ -60,6 +62,20 @@ namespace eosio { namespace chain {
 
          void validate_referenced_accounts( const transaction& trx, bool enforce_actor_whitelist_blacklist )const;
 
+         // settle_fee debit fee from payer and add it to bp rewards pool like onfee,
+         // the rows are written back by flush_fee_settlement
+         void settle_fee( const account_name& payer, const asset& fee, const account_name& bpname );
+         void flush_fee_settlement();
+
+         // any access to accounts or bps table need see the fee settled before
+         inline void on_table_access( name code, name scope, name table ) {
+            if( BOOST_UNLIKELY(fee_payer_account.valid() || fee_bp.valid())
+                && code == config::system_account_name && scope == config::system_account_name
+                && (table == N(accounts) || table == N(bps)) ) {
+               flush_fee_settlement();
+            }
+         }
+
       private:
 
          friend struct controller_impl;
@@ -118,6 +134,10 @@ namespace eosio { namespace chain {
       private:
          bool                          is_initialized = false;
 
+         /// rows of fee payer and bp with the fee settled by onfee in this trx, not written to db yet
+         optional<memory_db::account_info>  fee_payer_account;
+         optional<memory_db::bp_info>       fee_bp;
+
 
          uint64_t                      net_limit = 0;
          bool                          net_limit_due_to_block = true;
@@ -32,6 +32,7 @@ class transaction_metadata {
       bool                                                       accepted = false;
       bool                                                       implicit = false;
       bool                                                       scheduled = false;
+      optional<uint64_t>                                         priority; ///< set by producer_plugin when it is first calculated
 
       transaction_metadata() = delete;
       transaction_metadata(const transaction_metadata&) = delete;
@@ -14,6 +14,48 @@ namespace eosio { namespace chain {
    struct transaction;
    struct action;
 
+   // is_fee_action if act is a onfee or voteagefee action which transaction_context dispatch to cost fee for a action,
+   // both have the data of onfee
+   bool is_fee_action( const action& act );
+
+   // fee_schedule_entry resolved fee and res limit for a (account, action)
+   struct fee_schedule_entry {
+      asset    fee;                // required fee, same as get_required_fee
+      bool     has_fee    = false; // false if no native fee and no setfee, the action cannot be exec
+      bool     by_setfee  = false; // true if has a action_fee_object, res will limit by fee
+      asset    setfee_fee;         // fee in action_fee_object
+      uint32_t cpu_limit  = 0;
+      uint32_t net_limit  = 0;
+      uint32_t ram_limit  = 0;
+   };
+
+   // compiled_fee_schedule a open addressing hash table from (account, action) to fee_schedule_entry,
+   // use linear probing and backward shift deletion, so a lookup is one probe in most case
+   class compiled_fee_schedule {
+      public:
+         const fee_schedule_entry* find( const account_name& account, const action_name& act )const;
+         void insert( const account_name& account, const action_name& act, const fee_schedule_entry& entry );
+         bool erase( const account_name& account, const action_name& act );
+         void clear();
+
+         size_t size()const { return _size; }
+
+      private:
+         struct slot {
+            uint64_t           account = 0;
+            uint64_t           act     = 0;
+            bool               used    = false;
+            fee_schedule_entry entry;
+         };
+
+         static uint64_t hash( uint64_t account, uint64_t act );
+         size_t find_slot( uint64_t account, uint64_t act )const;
+         void grow();
+
+         vector<slot> _slots;
+         size_t       _size = 0;
+   };
+
    class txfee_manager {
       public:
 
@@ -25,8 +67,21 @@ namespace eosio { namespace chain {
          asset get_required_fee( const controller& ctl, const action& act )const;
          asset get_required_fee( const controller& ctl, const account_name& account, const action_name& act )const;
 
+         // get_fee_schedule get resolved fee and res limit, resolve by native fee and action_fee_object in first call
+         fee_schedule_entry get_fee_schedule( const controller& ctl, const account_name& account, const action_name& act )const;
+
+         size_t compiled_fee_schedule_size()const { return fee_schedule.size(); }
+
+         // on_setfee drop the compiled entry for a action changed by setfee in block_num
+         void on_setfee( const account_name& account, const action_name& act, const uint32_t block_num );
+
+         // on_state_undo drop all compiled entries if a setfee in a reversible block may be undone
+         void on_state_undo( const uint32_t last_irreversible_block_num );
+
       private:
 
+        fee_schedule_entry resolve_fee_schedule( const controller& ctl, const account_name& account, const action_name& act )const;
+
         inline void init_native_fee(const account_name &acc, const action_name &act, const asset &fee) {
            fee_map[std::make_pair(acc, act)] = fee;
         }
@@ -42,6 +97,9 @@ namespace eosio { namespace chain {
         }
 
         std::map<std::pair<account_name, action_name>, asset> fee_map;
+
+        mutable compiled_fee_schedule fee_schedule;
+        uint32_t                      last_setfee_block_num = 0;
    };
 
 
@@ -19,6 +19,12 @@
 
 namespace eosio { namespace chain { namespace wasm_injections {
    using namespace IR;
+
+   // version of the injection rules, it must be bumped whenever the injected code of a module changes,
+   // so the injected modules cached on disk are discarded. The build also hashes the injection sources
+   // into the fingerprint of the disk cache (WASM_INJECTION_SOURCES), which catches a forgotten bump
+   constexpr uint32_t injection_version = 1;
+
    // helper functions for injection
 
    struct injector_utils {
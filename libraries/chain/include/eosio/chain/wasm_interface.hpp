@@ -56,7 +56,19 @@ namespace eosio { namespace chain {
             wabt
          };
 
-         wasm_interface(vm_type vm);
+         struct cache_stats {
+            uint64_t hits             = 0;
+            uint64_t misses           = 0;
+            uint64_t evictions        = 0;
+            uint64_t precompiled_hits = 0; ///< misses served by a module prepared in background
+            uint64_t modules          = 0;
+            uint64_t bytes            = 0;
+            uint64_t max_bytes        = 0;
+         };
+
+         // injected modules are kept on disk under cache_dir up to disk_cache_size bytes, an empty cache_dir disables the disk cache
+         wasm_interface(vm_type vm, uint64_t cache_size, uint16_t compile_threads, const fc::path& cache_dir,
+                        uint64_t disk_cache_size);
          ~wasm_interface();
 
          //validates code -- does a WASM validation pass and checks the wasm against EOSIO specific constraints
@@ -68,6 +80,11 @@ namespace eosio { namespace chain {
          //Immediately exits currently running wasm. UB is called when no wasm running
          void exit();
 
+         //Starts to parse and inject code in background, so the first apply of it need not wait for that
+         void precompile(const digest_type& code_id, const bytes& code);
+
+         cache_stats get_cache_stats()const;
+
       private:
          unique_ptr<struct wasm_interface_impl> my;
          friend class eosio::chain::webassembly::common::intrinsics_accessor;
@@ -80,3 +97,5 @@ namespace eosio{ namespace chain {
 }}
 
 FC_REFLECT_ENUM( eosio::chain::wasm_interface::vm_type, (wavm)(wabt) )
+FC_REFLECT( eosio::chain::wasm_interface::cache_stats,
+            (hits)(misses)(evictions)(precompiled_hits)(modules)(bytes)(max_bytes) )
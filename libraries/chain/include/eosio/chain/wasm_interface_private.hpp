@@ -5,10 +5,14 @@
 #include <eosio/chain/webassembly/wabt.hpp>
 #include <eosio/chain/webassembly/runtime_interface.hpp>
 #include <eosio/chain/wasm_eosio_injection.hpp>
+#include <eosio/chain/wasm_module_cache.hpp>
 #include <eosio/chain/transaction_context.hpp>
 #include <eosio/chain/exceptions.hpp>
+#include <eosio/chain/thread_utils.hpp>
 #include <fc/scoped_exit.hpp>
 
+#include <list>
+
 #include "IR/Module.h"
 #include "Runtime/Intrinsics.h"
 #include "Platform/Platform.h"
@@ -23,16 +27,39 @@ using namespace Runtime;
 namespace eosio { namespace chain {
 
    struct wasm_interface_impl {
-      wasm_interface_impl(wasm_interface::vm_type vm) {
+      struct cached_module {
+         std::unique_ptr<wasm_instantiated_module_interface> module;
+         uint64_t                                            size = 0;
+         std::list<digest_type>::iterator                    lru_itr;
+      };
+
+      // max modules prepared by precompile and not used yet, oldest is dropped when full
+      static constexpr size_t max_pending_prepares = 32;
+
+      wasm_interface_impl(wasm_interface::vm_type vm, uint64_t cache_size, uint16_t compile_threads,
+                          const fc::path& cache_dir, uint64_t disk_cache_size)
+      : max_cache_bytes(cache_size) {
          if(vm == wasm_interface::vm_type::wavm)
             runtime_interface = std::make_unique<webassembly::wavm::wavm_runtime>();
          else if(vm == wasm_interface::vm_type::wabt)
             runtime_interface = std::make_unique<webassembly::wabt_runtime::wabt_runtime>();
          else
             EOS_THROW(wasm_exception, "wasm_interface_impl fall through");
+
+         if(compile_threads > 0)
+            compile_pool = std::make_unique<boost::asio::thread_pool>(compile_threads);
+         if(!cache_dir.empty())
+            disk_cache = std::make_shared<wasm_module_cache>(cache_dir, disk_cache_size);
       }
 
-      std::vector<uint8_t> parse_initial_memory(const Module& module) {
+      ~wasm_interface_impl() {
+         if(compile_pool) {
+            compile_pool->stop();
+            compile_pool->join();
+         }
+      }
+
+      static std::vector<uint8_t> parse_initial_memory(const Module& module) {
          std::vector<uint8_t> mem_image;
 
          for(const DataSegment& data_segment : module.dataSegments) {
@@ -50,47 +77,141 @@ namespace eosio { namespace chain {
          return mem_image;
       }
 
+      // prepare_module parse, inject and serialize code, it not use the runtime so it can run on any thread
+      static injected_module prepare_module( const char* code, size_t code_size ) {
+         IR::Module module;
+         try {
+            Serialization::MemoryInputStream stream((const U8*)code, code_size);
+            WASM::serialize(stream, module);
+            module.userSections.clear();
+         } catch(const Serialization::FatalSerializationException& e) {
+            EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+         } catch(const IR::ValidationException& e) {
+            EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+         }
+
+         wasm_injections::wasm_binary_injection injector(module);
+         injector.inject();
+
+         injected_module prepared;
+         try {
+            Serialization::ArrayOutputStream outstream;
+            WASM::serialize(outstream, module);
+            prepared.code = outstream.getBytes();
+         } catch(const Serialization::FatalSerializationException& e) {
+            EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+         } catch(const IR::ValidationException& e) {
+            EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
+         }
+         prepared.initial_memory = parse_initial_memory(module);
+         return prepared;
+      }
+
+      // load_or_prepare_module take injected module from disk cache if there is one, else prepare it and store it
+      static injected_module load_or_prepare_module( const std::shared_ptr<wasm_module_cache>& disk_cache,
+                                                     const digest_type& code_id, const char* code, size_t code_size ) {
+         if( disk_cache ) {
+            auto loaded = disk_cache->load(code_id);
+            if( loaded ) return std::move(*loaded);
+         }
+         auto prepared = prepare_module(code, code_size);
+         if( disk_cache ) disk_cache->store(code_id, prepared);
+         return prepared;
+      }
+
+      void precompile( const digest_type& code_id, const bytes& code ) {
+         if( !compile_pool || code.empty() ) return;
+         if( instantiation_cache.find(code_id) != instantiation_cache.end() ) return;
+         for( const auto& p : pending_prepares ) {
+            if( p.first == code_id ) return;
+         }
+
+         if( pending_prepares.size() >= max_pending_prepares ) {
+            pending_prepares.pop_front();
+         }
+         pending_prepares.emplace_back(code_id, async_thread_pool(*compile_pool, [disk_cache = disk_cache, code_id, code]() {
+            return load_or_prepare_module(disk_cache, code_id, code.data(), code.size());
+         }));
+      }
+
       std::unique_ptr<wasm_instantiated_module_interface>& get_instantiated_module( const digest_type& code_id,
                                                                                     const shared_string& code,
                                                                                     transaction_context& trx_context )
       {
          auto it = instantiation_cache.find(code_id);
-         if(it == instantiation_cache.end()) {
-            auto timer_pause = fc::make_scoped_exit([&](){
-               trx_context.resume_billing_timer();
-            });
-            trx_context.pause_billing_timer();
-            IR::Module module;
-            try {
-               Serialization::MemoryInputStream stream((const U8*)code.data(), code.size());
-               WASM::serialize(stream, module);
-               module.userSections.clear();
-            } catch(const Serialization::FatalSerializationException& e) {
-               EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
-            } catch(const IR::ValidationException& e) {
-               EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
-            }
-
-            wasm_injections::wasm_binary_injection injector(module);
-            injector.inject();
-
-            std::vector<U8> bytes;
-            try {
-               Serialization::ArrayOutputStream outstream;
-               WASM::serialize(outstream, module);
-               bytes = outstream.getBytes();
-            } catch(const Serialization::FatalSerializationException& e) {
-               EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
-            } catch(const IR::ValidationException& e) {
-               EOS_ASSERT(false, wasm_serialization_error, e.message.c_str());
-            }
-            it = instantiation_cache.emplace(code_id, runtime_interface->instantiate_module((const char*)bytes.data(), bytes.size(), parse_initial_memory(module))).first;
+         if(it != instantiation_cache.end()) {
+            ++stats.hits;
+            lru.splice(lru.begin(), lru, it->second.lru_itr);
+            return it->second.module;
+         }
+
+         ++stats.misses;
+         auto timer_pause = fc::make_scoped_exit([&](){
+            trx_context.resume_billing_timer();
+         });
+         trx_context.pause_billing_timer();
+
+         injected_module prepared;
+         auto pending = std::find_if(pending_prepares.begin(), pending_prepares.end(),
+                                     [&code_id](const auto& p) { return p.first == code_id; });
+         if( pending != pending_prepares.end() ) {
+            auto prepare_future = std::move(pending->second);
+            pending_prepares.erase(pending);
+            prepared = prepare_future.get();
+            ++stats.precompiled_hits;
+         } else {
+            prepared = load_or_prepare_module(disk_cache, code_id, code.data(), code.size());
          }
-         return it->second;
+
+         cached_module entry;
+         entry.size = prepared.code.size() + prepared.initial_memory.size();
+         entry.module = runtime_interface->instantiate_module((const char*)prepared.code.data(), prepared.code.size(),
+                                                              std::move(prepared.initial_memory));
+         entry.size += entry.module->get_native_size();
+         lru.push_front(code_id);
+         entry.lru_itr = lru.begin();
+         cache_bytes += entry.size;
+         it = instantiation_cache.emplace(code_id, std::move(entry)).first;
+
+         evict_modules();
+         return it->second.module;
+      }
+
+      // evict_modules remove least recently used modules till cache is in its limit,
+      // the most recently used one is always kept as it is going to be applied.
+      // No module is running here, so the runtime can free what the evicted ones left
+      void evict_modules() {
+         bool evicted = false;
+         while( cache_bytes > max_cache_bytes && lru.size() > 1 ) {
+            auto victim = instantiation_cache.find(lru.back());
+            cache_bytes -= victim->second.size;
+            instantiation_cache.erase(victim);
+            lru.pop_back();
+            ++stats.evictions;
+            evicted = true;
+         }
+         if( evicted )
+            runtime_interface->free_unreferenced_modules();
+      }
+
+      wasm_interface::cache_stats get_cache_stats()const {
+         auto result = stats;
+         result.modules = instantiation_cache.size();
+         result.bytes = cache_bytes;
+         result.max_bytes = max_cache_bytes;
+         return result;
       }
 
       std::unique_ptr<wasm_runtime_interface> runtime_interface;
-      map<digest_type, std::unique_ptr<wasm_instantiated_module_interface>> instantiation_cache;
+      map<digest_type, cached_module>         instantiation_cache;
+      std::list<digest_type>                  lru; ///< code ids in instantiation_cache, most recently used first
+      uint64_t                                cache_bytes = 0;
+      uint64_t                                max_cache_bytes;
+      wasm_interface::cache_stats             stats;
+
+      std::shared_ptr<wasm_module_cache>                                         disk_cache; ///< null if disabled
+      std::unique_ptr<boost::asio::thread_pool>                                  compile_pool;
+      std::list<std::pair<digest_type, std::future<injected_module>>>          pending_prepares; ///< oldest first
    };
 
 #define _REGISTER_INTRINSIC_EXPLICIT(CLS, MOD, METHOD, WASM_SIG, NAME, SIG)\
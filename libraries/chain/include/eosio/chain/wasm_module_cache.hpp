@@ -0,0 +1,69 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+#include <eosio/chain/types.hpp>
+#include <fc/filesystem.hpp>
+
+#include <mutex>
+
+namespace eosio { namespace chain {
+
+   // injected_module code of a contract after injection with its initial memory image, ready to instantiate
+   struct injected_module {
+      std::vector<uint8_t> code;
+      std::vector<uint8_t> initial_memory;
+   };
+
+   /* The wasm module cache keeps injected modules on disk, so a restarted node needs not parse and inject
+    * the code of contracts again. Files are addressed by code_version in a directory named by the fingerprint
+    * of the injection rules and of the sources which build them, directories of other fingerprints are removed at open.
+    *
+    * +--------+------------------+----------------+
+    * | header | injected code    | initial memory |
+    * +--------+------------------+----------------+
+    *
+    * The header holds code_version, the fingerprint, both sizes and the sha256 of the two payloads. A file is
+    * memory mapped and checked against its header when loaded, a bad file is removed and treated as missing.
+    *
+    * Code of a setcode which never becomes irreversible is stored too, so the files are bounded by max_size,
+    * least recently used files are removed when a store exceeds it. The time of last use is the modified time
+    * of a file, so the order is kept across restarts.
+    * load and store can be called from any thread.
+    */
+   class wasm_module_cache {
+      public:
+         wasm_module_cache( const fc::path& dir, uint64_t max_size );
+
+         optional<injected_module> load( const digest_type& code_id )const;
+         void store( const digest_type& code_id, const injected_module& module )const;
+
+         // fingerprint of injection rules and constraints which changes the injected code
+         static digest_type injection_fingerprint();
+
+         const fc::path& get_dir()const { return dir; }
+         uint64_t        get_size()const;
+
+      private:
+         struct file_entry {
+            uint64_t size     = 0;
+            uint64_t last_use = 0; ///< order of use, larger is more recent
+         };
+
+         fc::path module_path( const digest_type& code_id )const;
+         void     load_files();
+         void     remove_file( const digest_type& code_id )const;
+         void     evict_files()const;
+
+         fc::path    dir;
+         digest_type fingerprint;
+         uint64_t    max_size;
+
+         mutable std::mutex                       files_mtx; ///< protect files, total_size and next_use
+         mutable std::map<digest_type, file_entry> files;
+         mutable uint64_t                         total_size = 0;
+         mutable uint64_t                         next_use   = 0;
+   };
+
+} } // eosio::chain
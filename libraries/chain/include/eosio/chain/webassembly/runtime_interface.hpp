@@ -10,6 +10,9 @@ class wasm_instantiated_module_interface {
    public:
       virtual void apply(apply_context& context) = 0;
 
+      //bytes of native code generated for the module, 0 for an interpreter
+      virtual uint64_t get_native_size()const { return 0; }
+
       virtual ~wasm_instantiated_module_interface();
 };
 
@@ -20,6 +23,10 @@ class wasm_runtime_interface {
       //immediately exit the currently running wasm_instantiated_module_interface. Yep, this assumes only one can possibly run at a time.
       virtual void immediately_exit_currently_running_module() = 0;
 
+      //frees memory of destroyed modules, for runtimes whose module instances are owned by a garbage collector
+      //instead of by wasm_instantiated_module_interface. Must not be called while a module is running.
+      virtual void free_unreferenced_modules() {}
+
       virtual ~wasm_runtime_interface();
 };
 
@@ -62,6 +62,33 @@ int memory_db::db_store_i64(
    return 1;
 }
 
+void memory_db::table_inserter::insert( const account_name& payer, uint64_t id, const bytes& data ) {
+   EOS_ASSERT( payer != account_name(), invalid_table_payer, "must specify a valid account to pay for new record" );
+
+   if( tab == nullptr ) {
+      tab = &mdb.find_or_create_table(code, scope, table, payer);
+   }
+
+   const auto tableid = tab->id;
+   mdb.db.create<key_value_object>([&]( auto& o ) {
+      o.t_id        = tableid;
+      o.primary_key = id;
+      o.value.resize(data.size());
+      o.payer       = payer;
+      memcpy( o.value.data(), data.data(), data.size() );
+   });
+   ++count;
+}
+
+void memory_db::table_inserter::flush() {
+   if( tab == nullptr || count == 0 ) return;
+
+   mdb.db.modify(*tab, [&]( auto& t ) {
+      t.count += count;
+   });
+   count = 0;
+}
+
 // some imp same as api in wasm interface
 void eosio_contract_assert( bool condition, const char* msg ) {
    if( !condition ) {
@@ -72,15 +99,4 @@ void eosio_contract_assert( bool condition, const char* msg ) {
    }
 }
 
-
-int memory_db::db_get_i64( const key_value_object* obj , char* buffer, size_t buffer_size ) const {
-   auto s = obj->value.size();
-   if( buffer_size == 0 ) return s;
-
-   auto copy_size = std::min( buffer_size, s );
-   memcpy( buffer, obj->value.data(), copy_size );
-
-   return copy_size;
-}
-
 } } /// eosio::chain
@@ -78,6 +78,7 @@ void resource_limits_manager::add_to_snapshot( const snapshot_writer_ptr& snapsh
 }
 
 void resource_limits_manager::read_from_snapshot( const snapshot_reader_ptr& snapshot ) {
+   clear_ram_quotas();
    resource_index_set::walk_indices([this, &snapshot]( auto utils ){
       snapshot->read_section<typename decltype(utils)::index_t::value_type>([this]( auto& section ) {
          bool more = !section.empty();
@@ -271,9 +272,9 @@ bool resource_limits_manager::set_account_limits( const account_name& account, i
    return decreased_limit;
 }
 
-inline int64_t get_account_ram_limit( database& db, const account_name& name ) {
+int64_t resource_limits_manager::load_account_ram_limit( const account_name& name )const {
    // every account can use 8k ram free default
-   const int64_t init_ram_size = get_num_config_on_chain(db, config::res_typ::free_ram_per_account, 8*1024);
+   const int64_t init_ram_size = get_num_config_on_chain(_db, config::res_typ::free_ram_per_account, 8*1024);
    // if is account by system use ram unlimit,
    // if is a common account with -1 ram limit use init limit
    if(    name == config::system_account_name
@@ -288,7 +289,7 @@ inline int64_t get_account_ram_limit( database& db, const account_name& name ) {
    }
 
    memory_db::vote4ram_info vote_info;
-   const auto ok = memory_db{db}.get(
+   const auto ok = memory_db{_db}.get(
          config::system_account_name,
          config::system_account_name,
          N(vote4ramsum),
@@ -299,7 +300,7 @@ inline int64_t get_account_ram_limit( database& db, const account_name& name ) {
    }
 
    // default is 100 eos for 10kb
-   const int64_t ram_rent = get_num_config_on_chain(db, config::res_typ::ram_rent_b_per_eos, 10240);
+   const int64_t ram_rent = get_num_config_on_chain(_db, config::res_typ::ram_rent_b_per_eos, 10240);
    const int64_t staked   = vote_info.staked.get_amount();
 
    // 1 eos for 1 kb, note because staked cannot too much by limit
@@ -308,15 +309,31 @@ inline int64_t get_account_ram_limit( database& db, const account_name& name ) {
    return res + init_ram_size;
 }
 
+int64_t resource_limits_manager::get_account_ram_limit( const account_name& name )const {
+   auto itr = _ram_quotas.find( name );
+   if( itr == _ram_quotas.end() ) {
+      itr = _ram_quotas.emplace( name, load_account_ram_limit( name ) ).first;
+   }
+   return itr->second;
+}
+
+void resource_limits_manager::on_vote4ram_changed( const account_name& voter ) {
+   _ram_quotas.erase( voter );
+}
+
+void resource_limits_manager::clear_ram_quotas() {
+   _ram_quotas.clear();
+}
+
 void resource_limits_manager::get_account_limits( const account_name& account, int64_t& ram_bytes, int64_t& net_weight, int64_t& cpu_weight ) const {
    const auto* pending_buo = _db.find<resource_limits_object,by_owner>( boost::make_tuple(true, account) );
    if (pending_buo) {
-      ram_bytes = get_account_ram_limit( _db, account );
+      ram_bytes = get_account_ram_limit( account );
       net_weight = pending_buo->net_weight;
       cpu_weight = pending_buo->cpu_weight;
    } else {
       const auto& buo = _db.get<resource_limits_object,by_owner>( boost::make_tuple( false, account ) );
-      ram_bytes = get_account_ram_limit( _db, account );
+      ram_bytes = get_account_ram_limit( account );
       net_weight = buo.net_weight;
       cpu_weight = buo.cpu_weight;
    }
@@ -0,0 +1,132 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#include <eosio/chain/signature_recovery_cache.hpp>
+
+#include <boost/functional/hash.hpp>
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/sequenced_index.hpp>
+
+#include <mutex>
+
+namespace eosio { namespace chain {
+
+using namespace boost::multi_index;
+
+namespace detail {
+
+   struct recovery_cache_key {
+      digest_type    digest;
+      signature_type sig;
+
+      friend bool operator == ( const recovery_cache_key& a, const recovery_cache_key& b ) {
+         return a.digest == b.digest && a.sig == b.sig;
+      }
+   };
+
+   struct recovery_cache_key_hash {
+      size_t operator()( const recovery_cache_key& k )const {
+         size_t seed = k.digest._hash[0];
+         boost::hash_combine( seed, boost::hash<signature_type>()( k.sig ) );
+         return seed;
+      }
+   };
+
+   struct cached_recovery {
+      recovery_cache_key                      key;
+      signature_recovery_cache::entry         value;
+   };
+
+   typedef multi_index_container<
+      cached_recovery,
+      indexed_by<
+         sequenced<>,
+         hashed_unique<
+            member<cached_recovery, recovery_cache_key, &cached_recovery::key>,
+            recovery_cache_key_hash
+         >
+      >
+   > recovery_cache_index;
+
+   struct recovery_cache_shard {
+      mutable std::mutex   mtx;
+      recovery_cache_index entries; ///< oldest first
+   };
+
+}
+
+signature_recovery_cache& signature_recovery_cache::instance() {
+   static signature_recovery_cache cache;
+   return cache;
+}
+
+signature_recovery_cache::signature_recovery_cache( uint32_t capacity )
+:shards( new detail::recovery_cache_shard[config::sig_recovery_cache_shards] )
+,shard_capacity( std::max<uint32_t>( capacity / config::sig_recovery_cache_shards, 1 ) )
+{
+}
+
+signature_recovery_cache::~signature_recovery_cache() = default;
+
+detail::recovery_cache_shard& signature_recovery_cache::shard( const digest_type& digest )const {
+   // digest is a hash, any part of it spreads entries evenly
+   return shards[digest._hash[1] % config::sig_recovery_cache_shards];
+}
+
+bool signature_recovery_cache::find( const digest_type& digest, const signature_type& sig, entry& result ) {
+   auto& s = shard( digest );
+   {
+      std::lock_guard<std::mutex> g( s.mtx );
+      const auto& idx = s.entries.get<1>();
+      auto itr = idx.find( detail::recovery_cache_key{digest, sig} );
+      if( itr != idx.end() ) {
+         result = itr->value;
+         ++hits;
+         return true;
+      }
+   }
+   ++misses;
+   return false;
+}
+
+void signature_recovery_cache::add( const digest_type& digest, const signature_type& sig, const public_key_type& key,
+                                    fc::microseconds cpu_usage ) {
+   auto& s = shard( digest );
+   std::lock_guard<std::mutex> g( s.mtx );
+   // fails on a entry added by other thread meanwhile, it is the same
+   s.entries.emplace_back( detail::cached_recovery{ {digest, sig}, {key, cpu_usage} } );
+   const auto capacity = shard_capacity.load();
+   while( s.entries.size() > capacity ) {
+      s.entries.pop_front();
+      ++evictions;
+   }
+}
+
+void signature_recovery_cache::set_capacity( uint32_t capacity ) {
+   shard_capacity = std::max<uint32_t>( capacity / config::sig_recovery_cache_shards, 1 );
+   for( uint32_t i = 0; i < config::sig_recovery_cache_shards; ++i ) {
+      std::lock_guard<std::mutex> g( shards[i].mtx );
+      while( shards[i].entries.size() > shard_capacity ) {
+         shards[i].entries.pop_front();
+         ++evictions;
+      }
+   }
+}
+
+signature_recovery_cache::stats signature_recovery_cache::get_stats()const {
+   stats result;
+   result.hits      = hits;
+   result.misses    = misses;
+   result.evictions = evictions;
+   result.capacity  = uint64_t(shard_capacity) * config::sig_recovery_cache_shards;
+   for( uint32_t i = 0; i < config::sig_recovery_cache_shards; ++i ) {
+      std::lock_guard<std::mutex> g( shards[i].mtx );
+      result.size += shards[i].entries.size();
+   }
+   return result;
+}
+
+} } // eosio::chain
@@ -1,9 +1,19 @@
 #include <eosio/chain/snapshot.hpp>
 #include <eosio/chain/exceptions.hpp>
+#include <eosio/chain/thread_utils.hpp>
 #include <fc/scoped_exit.hpp>
 
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+
+#include <map>
+#include <thread>
+
 namespace eosio { namespace chain {
 
+namespace bio = boost::iostreams;
+
 variant_snapshot_writer::variant_snapshot_writer(fc::mutable_variant_object& snapshot)
 : snapshot(snapshot)
 {
@@ -46,9 +56,11 @@ void variant_snapshot_reader::validate() const {
    EOS_ASSERT(version.is_integer(), snapshot_validation_exception,
          "Variant snapshot version is not an integer");
 
-   EOS_ASSERT(version.as_uint64() == (uint64_t)current_snapshot_version, snapshot_validation_exception,
-         "Variant snapshot is an unsuppored version.  Expected : ${expected}, Got: ${actual}",
-         ("expected", current_snapshot_version)("actual",o["version"].as_uint64()));
+   // rows of version 1 and version 3 are the same, they differ in binary snapshots only
+   EOS_ASSERT(version.as_uint64() == (uint64_t)minimum_snapshot_version || version.as_uint64() == (uint64_t)current_snapshot_version,
+         snapshot_validation_exception,
+         "Variant snapshot is an unsuppored version.  Expected : ${min} or ${expected}, Got: ${actual}",
+         ("min", minimum_snapshot_version)("expected", current_snapshot_version)("actual",o["version"].as_uint64()));
 
    EOS_ASSERT(o.contains("sections"), snapshot_validation_exception,
          "Variant snapshot has no sections");
@@ -114,10 +126,10 @@ void variant_snapshot_reader::clear_section() {
    cur_row = 0;
 }
 
-ostream_snapshot_writer::ostream_snapshot_writer(std::ostream& snapshot)
+ostream_snapshot_writer::ostream_snapshot_writer(std::ostream& snapshot, uint32_t block_size)
 :snapshot(snapshot)
 ,header_pos(snapshot.tellp())
-,section_pos(-1)
+,block_size(block_size)
 ,row_count(0)
 {
    // write magic number
@@ -127,73 +139,276 @@ ostream_snapshot_writer::ostream_snapshot_writer(std::ostream& snapshot)
    // write version
    auto version = current_snapshot_version;
    snapshot.write((char*)&version, sizeof(version));
+
+   // write a placeholder for the position of footer
+   uint64_t placeholder = std::numeric_limits<uint64_t>::max();
+   snapshot.write((char*)&placeholder, sizeof(placeholder));
 }
 
 void ostream_snapshot_writer::write_start_section( const std::string& section_name )
 {
-   EOS_ASSERT(section_pos == std::streampos(-1), snapshot_exception, "Attempting to write a new section without closing the previous section");
-   section_pos = snapshot.tellp();
+   EOS_ASSERT(!in_section, snapshot_exception, "Attempting to write a new section without closing the previous section");
+   in_section = true;
    row_count = 0;
-
-   uint64_t placeholder = std::numeric_limits<uint64_t>::max();
-
-   // write a placeholder for the section size
-   snapshot.write((char*)&placeholder, sizeof(placeholder));
-
-   // write placeholder for row count
-   snapshot.write((char*)&placeholder, sizeof(placeholder));
-
-   // write the section name (null terminated)
-   snapshot.write(section_name.data(), section_name.size());
-   snapshot.put(0);
+   sections.emplace_back();
+   sections.back().name = section_name;
 }
 
 void ostream_snapshot_writer::write_row( const detail::abstract_snapshot_row_writer& row_writer ) {
-   auto restore = snapshot.tellp();
+   EOS_ASSERT(!cancelled, snapshot_exception, "Snapshot is cancelled");
+   auto restore = block.tellp();
    try {
-      row_writer.write(snapshot);
+      detail::ostream_wrapper out(block);
+      row_writer.write(out);
    } catch (...) {
-      snapshot.seekp(restore);
+      block.seekp(restore);
       throw;
    }
    row_count++;
+   block_rows++;
+   total_rows++;
+
+   if( block.tellp() >= std::streampos(block_size) ) {
+      write_block();
+   }
+}
+
+void ostream_snapshot_writer::write_block() {
+   // a row which failed to write may have left bytes after tellp
+   const auto size = static_cast<size_t>(block.tellp());
+   const auto data = block.str();
+
+   bytes compressed;
+   bio::filtering_ostream comp;
+   comp.push(bio::zlib_compressor(bio::zlib::default_compression));
+   comp.push(bio::back_inserter(compressed));
+   bio::write(comp, data.data(), size);
+   bio::close(comp);
+
+   detail::snapshot_block_entry entry;
+   entry.offset          = snapshot.tellp() - header_pos;
+   entry.compressed_size = compressed.size();
+   entry.size            = size;
+   entry.row_count       = block_rows;
+   snapshot.write(compressed.data(), compressed.size());
+   sections.back().blocks.emplace_back(entry);
+
+   block.str(std::string());
+   block.clear();
+   block_rows = 0;
 }
 
 void ostream_snapshot_writer::write_end_section( ) {
+   if( block_rows > 0 ) {
+      write_block();
+   }
+   sections.back().row_count = row_count;
+
+   in_section = false;
+   row_count = 0;
+   total_sections++;
+}
+
+void ostream_snapshot_writer::finalize() {
+   EOS_ASSERT(!in_section, snapshot_exception, "Attempting to finalize snapshot without closing the last section");
+
+   uint64_t footer_pos = snapshot.tellp() - header_pos;
+   auto footer = fc::raw::pack(sections);
+   uint64_t footer_size = footer.size();
+   snapshot.write((char*)&footer_size, sizeof(footer_size));
+   snapshot.write(footer.data(), footer.size());
+
    auto restore = snapshot.tellp();
+   snapshot.seekp(header_pos + std::streamoff(sizeof(magic_number) + sizeof(current_snapshot_version)));
+   snapshot.write((char*)&footer_pos, sizeof(footer_pos));
+   snapshot.seekp(restore);
+}
 
-   uint64_t section_size = restore - section_pos - sizeof(uint64_t);
+namespace detail {
+
+   /**
+    * snapshot_block_decoder decompresses blocks of a version 3 snapshot on a thread pool.
+    * Blocks are read from the stream on the thread of the reader, then decompressed on the pool,
+    * up to read_ahead blocks in the order of the file after the block read last.
+    */
+   class snapshot_block_decoder {
+      public:
+         snapshot_block_decoder( std::istream& snapshot, std::streampos header_pos,
+                                 vector<snapshot_section_entry> sections, uint16_t threads )
+         :snapshot(snapshot)
+         ,header_pos(header_pos)
+         ,sections(std::move(sections))
+         ,read_ahead(threads * 2)
+         ,thread_pool(threads)
+         {
+            for( size_t s = 0; s < this->sections.size(); ++s ) {
+               section_first_block.push_back( blocks.size() );
+               for( const auto& b : this->sections[s].blocks ) {
+                  blocks.push_back( &b );
+               }
+            }
+            consumed.resize( blocks.size() );
+         }
 
-   snapshot.seekp(section_pos);
+         ~snapshot_block_decoder() {
+            thread_pool.join();
+            thread_pool.stop();
+         }
 
-   // write a the section size
-   snapshot.write((char*)&section_size, sizeof(section_size));
+         const vector<snapshot_section_entry>& get_sections()const { return sections; }
 
-   // write the row count
-   snapshot.write((char*)&row_count, sizeof(row_count));
+         void set_section( size_t section ) {
+            cur_block = section_first_block[section];
+            end_block = cur_block + sections[section].blocks.size();
+            cur_data.clear();
+            cur_stream.reset();
+            for( size_t i = cur_block; i < end_block && i < cur_block + read_ahead; ++i ) {
+               schedule( i );
+            }
+         }
 
-   snapshot.seekp(restore);
+         void read_row( abstract_snapshot_row_reader& row_reader ) {
+            while( !cur_stream || cur_stream->remaining() == 0 ) {
+               EOS_ASSERT( cur_block < end_block, snapshot_exception, "Binary snapshot section has more rows than its blocks" );
+               next_block();
+            }
+            row_reader.provide( *cur_stream );
+         }
 
-   section_pos = std::streampos(-1);
-   row_count = 0;
-}
+      private:
+         void schedule( size_t block ) {
+            if( block >= blocks.size() || decoded.count( block ) )
+               return;
+
+            const auto& entry = *blocks[block];
+            auto compressed = std::make_shared<bytes>( entry.compressed_size );
+            snapshot.seekg( header_pos + std::streamoff( entry.offset ) );
+            snapshot.read( compressed->data(), compressed->size() );
+            EOS_ASSERT( snapshot.good(), snapshot_exception, "Binary snapshot block at ${p} is truncated", ("p", entry.offset) );
+
+            decoded[block] = async_thread_pool( thread_pool, [compressed, size = entry.size]() {
+               bytes out;
+               out.reserve( size );
+               bio::filtering_ostream decomp;
+               decomp.push( bio::zlib_decompressor() );
+               decomp.push( bio::back_inserter( out ) );
+               bio::write( decomp, compressed->data(), compressed->size() );
+               bio::close( decomp );
+               EOS_ASSERT( out.size() == size, snapshot_exception,
+                           "Binary snapshot block decompressed to ${a} bytes, expected ${e}", ("a", out.size())("e", size) );
+               return out;
+            });
+         }
 
-void ostream_snapshot_writer::finalize() {
-   uint64_t end_marker = std::numeric_limits<uint64_t>::max();
+         void next_block() {
+            schedule( cur_block );
+            auto itr = decoded.find( cur_block );
+            try {
+               cur_data = itr->second.get();
+            } catch( const fc::exception& ) {
+               throw;
+            } catch( ... ) {
+               decoded.erase( itr );
+               snapshot_exception e( FC_LOG_MESSAGE( warn, "Binary snapshot block ${b} failed to decompress", ("b", cur_block) ),
+                                     std::current_exception() );
+               throw e;
+            }
+            decoded.erase( itr );
+            consumed[cur_block] = true;
+            cur_stream.emplace( cur_data.data(), cur_data.size() );
+
+            // keep the pool busy with the blocks after it, of this and the following sections
+            ++cur_block;
+            for( size_t i = cur_block, n = 0; i < blocks.size() && n < read_ahead; ++i, ++n ) {
+               if( !consumed[i] )
+                  schedule( i );
+            }
+         }
+
+         std::istream&                          snapshot;
+         std::streampos                         header_pos;
+         const vector<snapshot_section_entry>   sections;
+         vector<size_t>                         section_first_block;
+         vector<const snapshot_block_entry*>    blocks; ///< blocks of all sections in order of the file
+         vector<bool>                           consumed;
+         const size_t                           read_ahead;
+         boost::asio::thread_pool               thread_pool;
+         std::map<size_t, std::future<bytes>>   decoded;
+
+         size_t                                 cur_block = 0;
+         size_t                                 end_block = 0;
+         bytes                                  cur_data;
+         fc::optional<fc::datastream<const char*>> cur_stream;
+   };
 
-   // write a placeholder for the section size
-   snapshot.write((char*)&end_marker, sizeof(end_marker));
 }
 
-istream_snapshot_reader::istream_snapshot_reader(std::istream& snapshot)
+istream_snapshot_reader::istream_snapshot_reader(std::istream& snapshot, uint16_t threads)
 :snapshot(snapshot)
 ,header_pos(snapshot.tellg())
 ,num_rows(0)
 ,cur_row(0)
+,threads(threads > 0 ? threads : std::max<uint16_t>(std::thread::hardware_concurrency(), 1))
 {
 
 }
 
+istream_snapshot_reader::~istream_snapshot_reader() = default;
+
+uint32_t istream_snapshot_reader::read_version() const {
+   auto restore_pos = fc::make_scoped_exit([this,pos=snapshot.tellg()](){
+      snapshot.seekg(pos);
+   });
+
+   snapshot.seekg(header_pos + std::streamoff(sizeof(ostream_snapshot_writer::magic_number)));
+   uint32_t version = 0;
+   snapshot.read((char*)&version, sizeof(version));
+   return version;
+}
+
+vector<detail::snapshot_section_entry> istream_snapshot_reader::read_footer() const {
+   auto restore_pos = fc::make_scoped_exit([this,pos=snapshot.tellg()](){
+      snapshot.seekg(pos);
+   });
+
+   snapshot.seekg(header_pos + std::streamoff(sizeof(ostream_snapshot_writer::magic_number) + sizeof(current_snapshot_version)));
+   uint64_t footer_pos = 0;
+   snapshot.read((char*)&footer_pos, sizeof(footer_pos));
+   EOS_ASSERT(footer_pos != std::numeric_limits<uint64_t>::max(), snapshot_exception,
+              "Binary snapshot was not finalized");
+
+   snapshot.seekg(header_pos + std::streamoff(footer_pos));
+   uint64_t footer_size = 0;
+   snapshot.read((char*)&footer_size, sizeof(footer_size));
+   bytes footer(footer_size);
+   snapshot.read(footer.data(), footer.size());
+   EOS_ASSERT(snapshot.good(), snapshot_exception, "Binary snapshot footer is truncated");
+
+   auto sections = fc::raw::unpack<vector<detail::snapshot_section_entry>>(footer);
+   for( const auto& section : sections ) {
+      uint64_t rows = 0;
+      for( const auto& b : section.blocks ) {
+         EOS_ASSERT(b.offset + b.compressed_size <= footer_pos, snapshot_exception,
+                    "Binary snapshot section ${n} has a block out of the snapshot", ("n", section.name));
+         rows += b.row_count;
+      }
+      EOS_ASSERT(rows == section.row_count, snapshot_exception,
+                 "Binary snapshot section ${n} has ${r} rows in its blocks, expected ${e}",
+                 ("n", section.name)("r", rows)("e", section.row_count));
+   }
+   return sections;
+}
+
+detail::snapshot_block_decoder* istream_snapshot_reader::decoder() {
+   if( !decoder_loaded ) {
+      if( read_version() == current_snapshot_version ) {
+         block_decoder = std::make_unique<detail::snapshot_block_decoder>( snapshot, header_pos, read_footer(), threads );
+      }
+      decoder_loaded = true;
+   }
+   return block_decoder.get();
+}
+
 void istream_snapshot_reader::validate() const {
    // make sure to restore the read pos
    auto restore_pos = fc::make_scoped_exit([this,pos=snapshot.tellg(),ex=snapshot.exceptions()](){
@@ -212,14 +427,17 @@ void istream_snapshot_reader::validate() const {
                  "Binary snapshot has unexpected magic number!");
 
       // validate version
-      auto expected_version = current_snapshot_version;
-      decltype(expected_version) actual_version;
+      decltype(current_snapshot_version) actual_version;
       snapshot.read((char*)&actual_version, sizeof(actual_version));
-      EOS_ASSERT(actual_version == expected_version, snapshot_exception,
-                 "Binary snapshot is an unsuppored version.  Expected : ${expected}, Got: ${actual}",
-                 ("expected", expected_version)("actual", actual_version));
-
-      while (validate_section()) {}
+      EOS_ASSERT(actual_version == minimum_snapshot_version || actual_version == current_snapshot_version, snapshot_exception,
+                 "Binary snapshot is an unsuppored version.  Expected : ${min} or ${expected}, Got: ${actual}",
+                 ("min", minimum_snapshot_version)("expected", current_snapshot_version)("actual", actual_version));
+
+      if( actual_version == minimum_snapshot_version ) {
+         while (validate_section()) {}
+      } else {
+         read_footer();
+      }
    } catch( const std::exception& e ) {  \
       snapshot_exception fce(FC_LOG_MESSAGE( warn, "Binary snapshot validation threw IO exception (${what})",("what",e.what())));
       throw fce;
@@ -242,6 +460,12 @@ bool istream_snapshot_reader::validate_section() const {
 }
 
 bool istream_snapshot_reader::has_section( const string& section_name ) {
+   if( auto d = decoder() ) {
+      const auto& sections = d->get_sections();
+      return std::find_if( sections.begin(), sections.end(),
+                           [&]( const auto& s ) { return s.name == section_name; } ) != sections.end();
+   }
+
    auto restore_pos = fc::make_scoped_exit([this,pos=snapshot.tellg()](){
       snapshot.seekg(pos);
    });
@@ -280,6 +504,19 @@ bool istream_snapshot_reader::has_section( const string& section_name ) {
 }
 
 void istream_snapshot_reader::set_section( const string& section_name ) {
+   if( auto d = decoder() ) {
+      const auto& sections = d->get_sections();
+      for( size_t i = 0; i < sections.size(); ++i ) {
+         if( sections[i].name == section_name ) {
+            d->set_section( i );
+            cur_row = 0;
+            num_rows = sections[i].row_count;
+            return;
+         }
+      }
+      EOS_THROW(snapshot_exception, "Binary snapshot has no section named ${n}", ("n", section_name));
+   }
+
    auto restore_pos = fc::make_scoped_exit([this,pos=snapshot.tellg()](){
       snapshot.seekg(pos);
    });
@@ -323,7 +560,11 @@ void istream_snapshot_reader::set_section( const string& section_name ) {
 }
 
 bool istream_snapshot_reader::read_row( detail::abstract_snapshot_row_reader& row_reader ) {
-   row_reader.provide(snapshot);
+   if( auto d = decoder() ) {
+      d->read_row(row_reader);
+   } else {
+      row_reader.provide(snapshot);
+   }
    return ++cur_row < num_rows;
 }
 
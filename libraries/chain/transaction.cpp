@@ -6,13 +6,8 @@
 #include <fc/bitutil.hpp>
 #include <fc/smart_ref_impl.hpp>
 #include <algorithm>
-#include <mutex>
 
 #include <boost/range/adaptor/transformed.hpp>
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/sequenced_index.hpp>
-#include <boost/multi_index/hashed_index.hpp>
-#include <boost/multi_index/member.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/device/back_inserter.hpp>
 #include <boost/iostreams/filter/zlib.hpp>
@@ -20,36 +15,10 @@
 #include <eosio/chain/config.hpp>
 #include <eosio/chain/exceptions.hpp>
 #include <eosio/chain/transaction.hpp>
+#include <eosio/chain/signature_recovery_cache.hpp>
 
 namespace eosio { namespace chain {
 
-using namespace boost::multi_index;
-
-struct cached_pub_key {
-   transaction_id_type trx_id;
-   public_key_type pub_key;
-   signature_type sig;
-   fc::microseconds cpu_usage;
-   cached_pub_key(const cached_pub_key&) = delete;
-   cached_pub_key() = delete;
-   cached_pub_key& operator=(const cached_pub_key&) = delete;
-   cached_pub_key(cached_pub_key&&) = default;
-};
-struct by_sig{};
-
-typedef multi_index_container<
-   cached_pub_key,
-   indexed_by<
-      sequenced<>,
-      hashed_unique<
-         tag<by_sig>,
-         member<cached_pub_key,
-                signature_type,
-                &cached_pub_key::sig>
-      >
-   >
-> recovery_cache_type;
-
 void transaction_header::set_reference_block( const block_id_type& reference_block ) {
    ref_block_num    = fc::endian_reverse_u32(reference_block._hash[0]);
    ref_block_prefix = reference_block._hash[1];
@@ -89,36 +58,28 @@ fc::microseconds transaction::get_signature_keys( const vector<signature_type>&
 { try {
    using boost::adaptors::transformed;
 
-   constexpr size_t recovery_cache_size = 10000;
-   static recovery_cache_type recovery_cache;
-   static std::mutex cache_mtx;
+   auto& recovery_cache = signature_recovery_cache::instance();
 
    auto start = fc::time_point::now();
    recovered_pub_keys.clear();
    const digest_type digest = sig_digest(chain_id, cfd);
 
-   std::unique_lock<std::mutex> lock(cache_mtx, std::defer_lock);
    fc::microseconds sig_cpu_usage;
+   signature_recovery_cache::entry cached;
    for(const signature_type& sig : signatures) {
       auto now = fc::time_point::now();
       EOS_ASSERT( now < deadline, tx_cpu_usage_exceeded, "transaction signature verification executed for too long",
                   ("now", now)("deadline", deadline)("start", start) );
       public_key_type recov;
-      const auto& tid = id();
-      lock.lock();
-      recovery_cache_type::index<by_sig>::type::iterator it = recovery_cache.get<by_sig>().find( sig );
-      if( it == recovery_cache.get<by_sig>().end() || it->trx_id != tid ) {
-         lock.unlock();
+      if( !recovery_cache.find( digest, sig, cached ) ) {
          recov = public_key_type( sig, digest );
-         fc::microseconds cpu_usage = fc::time_point::now() - start;
-         lock.lock();
-         recovery_cache.emplace_back( cached_pub_key{tid, recov, sig, cpu_usage} ); //could fail on dup signatures; not a problem
+         fc::microseconds cpu_usage = fc::time_point::now() - now;
+         recovery_cache.add( digest, sig, recov, cpu_usage );
          sig_cpu_usage += cpu_usage;
       } else {
-         recov = it->pub_key;
-         sig_cpu_usage += it->cpu_usage;
+         recov = cached.key;
+         sig_cpu_usage += cached.cpu_usage;
       }
-      lock.unlock();
       bool successful_insertion = false;
       std::tie(std::ignore, successful_insertion) = recovered_pub_keys.insert(recov);
       EOS_ASSERT( allow_duplicate_keys || successful_insertion, tx_duplicate_sig,
@@ -126,11 +87,6 @@ fc::microseconds transaction::get_signature_keys( const vector<signature_type>&
                   ("key", recov) );
    }
 
-   lock.lock();
-   while ( recovery_cache.size() > recovery_cache_size )
-      recovery_cache.erase( recovery_cache.begin());
-   lock.unlock();
-
    return sig_cpu_usage;
 } FC_CAPTURE_AND_RETHROW() }
 
@@ -345,21 +345,20 @@ namespace bacc = boost::accumulators;
    void transaction_context::make_limit_by_contract(const asset &fee_ext){
       // now one trx just has one action in eosforce, so it can no include system contract
 
-      auto &db = control.db();
-
       // use_limit_by_contract is if setfee
       use_limit_by_contract = false;
       cpu_limit_by_contract = 0;
       net_limit_by_contract = 0;
       auto calc_res_fee = fee_ext;
 
+      const auto& txfee = control.get_txfee_manager();
+
       // all setfee action calc sum res limit
       for( const auto& act : trx.actions ) {
-         const auto info = db.find<action_fee_object, by_action_name>(
-               boost::make_tuple(act.account, act.name));
+         const auto info = txfee.get_fee_schedule(control, act.account, act.name);
 
          // no setfee, is native or err by get_require_fee
-         if( info == nullptr ) {
+         if( !info.by_setfee ) {
             // do nothing
             continue;
          }
@@ -367,18 +366,18 @@ namespace bacc = boost::accumulators;
          // setfee, if a trx has both native act and setfee act, will use res limit
          use_limit_by_contract = true;
 
-         if( (info->cpu_limit > 0)
-          || (info->net_limit > 0)
-          || (info->ram_limit > 0) ) {
+         if( (info.cpu_limit > 0)
+          || (info.net_limit > 0)
+          || (info.ram_limit > 0) ) {
             // setfee with res limit
             //dlog("get limit by contract ${con} ${cpu} ${net} ${ram}",
-            //      ("con", act.name)("cpu", info->cpu_limit)("net", info->net_limit)("ram", info->ram_limit));
-            cpu_limit_by_contract += info->cpu_limit;
-            net_limit_by_contract += info->net_limit;
+            //      ("con", act.name)("cpu", info.cpu_limit)("net", info.net_limit)("ram", info.ram_limit));
+            cpu_limit_by_contract += info.cpu_limit;
+            net_limit_by_contract += info.net_limit;
          } else {
             // setfee with zero res limit
             // calc res limit like fee_ext
-            calc_res_fee += info->fee;
+            calc_res_fee += info.setfee_fee;
          }
       }
 
@@ -387,21 +386,19 @@ namespace bacc = boost::accumulators;
          //
          // For First version we just use const value for main net stable
          //
-         cpu_limit_by_contract += m * get_num_config_on_chain(db, config::res_typ::cpu_per_fee, 100);
-         net_limit_by_contract += m * get_num_config_on_chain(db, config::res_typ::net_per_fee, 10000);
+         cpu_limit_by_contract += m * get_num_config_on_chain(control, config::res_typ::cpu_per_fee, 100);
+         net_limit_by_contract += m * get_num_config_on_chain(control, config::res_typ::net_per_fee, 10000);
       }
    }
 
    void transaction_context::add_limit_by_fee( const action &act ) {
-      auto &db = control.db();
-      const auto info = db.find<action_fee_object, by_action_name>(
-            boost::make_tuple(act.account, act.name));
+      const auto info = control.get_txfee_manager().get_fee_schedule(control, act.account, act.name);
 
       uint64_t cpu_limit_by_act = 0;
       uint64_t net_limit_by_act = 0;
 
       // no setfee, is native or err by get_require_fee
-      if( info == nullptr ) {
+      if( !info.by_setfee ) {
          //ilog("limit res ${acc}:${act} nil",
          //     ("acc", act.account)("act", act.name));
          return;
@@ -410,20 +407,20 @@ namespace bacc = boost::accumulators;
       // setfee, if a trx has both native act and setfee act, will use res limit
       use_limit_by_contract = true;
 
-      if(    (info->cpu_limit > 0)
-          || (info->net_limit > 0) ) {
+      if(    (info.cpu_limit > 0)
+          || (info.net_limit > 0) ) {
          // setfee with res limit
-         cpu_limit_by_act = info->cpu_limit;
-         net_limit_by_act = info->net_limit;
+         cpu_limit_by_act = info.cpu_limit;
+         net_limit_by_act = info.net_limit;
       } else {
          // setfee with zero res limit
          // calc res limit like fee_ext
-         const auto m = info->fee.get_amount() / 100; // 100 mine 0.01 eos
+         const auto m = info.setfee_fee.get_amount() / 100; // 100 mine 0.01 eos
          //
          // For First version we just use const value for main net stable
          //
-         cpu_limit_by_act = m * get_num_config_on_chain(db, config::res_typ::cpu_per_fee, 200);
-         net_limit_by_act = m * get_num_config_on_chain(db, config::res_typ::net_per_fee, 512);
+         cpu_limit_by_act = m * get_num_config_on_chain(control, config::res_typ::cpu_per_fee, 200);
+         net_limit_by_act = m * get_num_config_on_chain(control, config::res_typ::net_per_fee, 512);
       }
 
       cpu_limit_by_contract += cpu_limit_by_act;
@@ -432,7 +429,7 @@ namespace bacc = boost::accumulators;
       /*
       dlog("limit res ${acc}:${act} ${fee} to ${cpu},${net} in ${cpus},${nets}",
             ("acc", act.account)("act", act.name)
-            ("fee", info->fee)
+            ("fee", info.setfee_fee)
             ("cpu", cpu_limit_by_act)("net", net_limit_by_act)
             ("cpus", cpu_limit_by_contract)("nets", net_limit_by_contract));
       */
@@ -460,7 +457,7 @@ namespace bacc = boost::accumulators;
          const auto fee = control.get_txfee_manager().get_required_fee(control, act);
          const auto& fee_act = mk_fee_action(act, fee);
          // for lock developer 's EOSC before lock genesis user 's EOSC
-         EOS_ASSERT(get_num_config_on_chain(control.db(), name{fee_payer}, -1) != 1, transaction_exception, "locked developer EOSC account");
+         EOS_ASSERT(get_num_config_on_chain(control, name{fee_payer}, -1) != 1, transaction_exception, "locked developer EOSC account");
          if(max_fee_to_pay != asset{0}) {
             fee_costed += fee;
             EOS_ASSERT(fee_costed <= max_fee_to_pay, transaction_exception, "fee costed more then limit");
@@ -470,6 +467,64 @@ namespace bacc = boost::accumulators;
       }
    }
 
+   // like apply_eosio_onfee, but the rows stay in trx_context until some one access the tables
+   void transaction_context::settle_fee( const account_name& payer, const asset& fee, const account_name& bpname ) {
+      if(    ( fee_payer_account && fee_payer_account->name != payer )
+          || ( fee_bp && fee_bp->name != bpname ) ) {
+         flush_fee_settlement();
+      }
+
+      memory_db mdb(control);
+      if( !fee_payer_account ) {
+         memory_db::account_info account_info_data;
+         eosio_contract_assert(
+               mdb.get(config::system_account_name, config::system_account_name, N(accounts), payer, account_info_data),
+               "account is not found in accounts table" );
+         fee_payer_account = account_info_data;
+      }
+      eosio_contract_assert(fee <= fee_payer_account->available, "overdrawn available balance");
+      fee_payer_account->available -= fee;
+
+      if( bpname != name{} ) {
+         if( !fee_bp ) {
+            memory_db::bp_info bp_info_data;
+            eosio_contract_assert(
+                  mdb.get(config::system_account_name, config::system_account_name, N(bps), bpname, bp_info_data),
+                  "bpname is not registered" );
+            fee_bp = bp_info_data;
+         }
+         fee_bp->rewards_pool += fee;
+      }
+   }
+
+   template<typename T>
+   static void store_settled_row( chainbase::database& db, const name& table, const T& row ) {
+      const auto& tab = db.get<table_id_object, by_code_scope_table>(
+            boost::make_tuple(config::system_account_name, config::system_account_name, table));
+      const auto& obj = db.get<key_value_object, by_scope_primary>(boost::make_tuple(tab.id, row.primary_key()));
+      const auto data = fc::raw::pack(row);
+
+      // fee only change asset value, so there is no ram to bill like db_update_i64
+      EOS_ASSERT( data.size() == obj.value.size(), transaction_exception,
+                  "fee settlement changed size of row in ${t}", ("t", table) );
+
+      db.modify( obj, [&]( auto& o ) {
+         o.value.assign( data.data(), data.size() );
+      });
+   }
+
+   void transaction_context::flush_fee_settlement() {
+      auto& db = control.mutable_db();
+      if( fee_payer_account ) {
+         store_settled_row(db, N(accounts), *fee_payer_account);
+         fee_payer_account.reset();
+      }
+      if( fee_bp ) {
+         store_settled_row(db, N(bps), *fee_bp);
+         fee_bp.reset();
+      }
+   }
+
    void transaction_context::exec() {
       EOS_ASSERT( is_initialized, transaction_exception, "must first initialize" );
 
@@ -492,6 +547,8 @@ namespace bacc = boost::accumulators;
       } else {
          schedule_transaction();
       }
+
+      flush_fee_settlement();
    }
 
    void transaction_context::finalize() {
@@ -559,12 +616,25 @@ namespace bacc = boost::accumulators;
                                 block_timestamp_type(control.pending_block_time()).slot ); // Should never fail
    }
 
+   transaction_context::~transaction_context() {
+      // a session still open here is undone by its destructor,
+      // so the views in controller may hold rows written by this transaction
+      if (undo_session) control.on_state_undo();
+   }
+
    void transaction_context::squash() {
-      if (undo_session) undo_session->squash();
+      if (undo_session) {
+         undo_session->squash();
+         undo_session.reset();
+      }
    }
 
    void transaction_context::undo() {
-      if (undo_session) undo_session->undo();
+      if (undo_session) {
+         undo_session->undo();
+         undo_session.reset();
+         control.on_state_undo();
+      }
    }
 
    void transaction_context::check_net_usage()const {
@@ -9,6 +9,10 @@
 
 namespace eosio { namespace chain {
 
+   bool is_fee_action( const action& act ) {
+      return act.account == config::system_account_name
+          && ( act.name == N(onfee) || act.name == N(voteagefee) );
+   }
 
    txfee_manager::txfee_manager(){
       init_native_fee(config::system_account_name, N(newaccount), asset(1000));
@@ -105,9 +109,65 @@ namespace eosio { namespace chain {
    }
 
    asset txfee_manager::get_required_fee( const controller& ctl, const account_name& account, const action_name& act ) const {
+      const auto entry = get_fee_schedule(ctl, account, act);
+
+      // no fee found throw err
+      EOS_ASSERT(entry.has_fee, action_validate_exception,
+                 "action ${acc} ${act} name not include in feemap or db",
+                 ("acc", account)("act", act));
+
+      return entry.fee;
+   }
+
+   fee_schedule_entry txfee_manager::get_fee_schedule( const controller& ctl, const account_name& account, const action_name& act ) const {
+      const auto* compiled = fee_schedule.find(account, act);
+      if( compiled != nullptr ) {
+         return *compiled;
+      }
+
+      // only a action with fee or a action_fee_object is compiled, those are bounded by fee_map and the state db,
+      // a miss is resolved again each time, or any pushed action name would grow the table
+      const auto entry = resolve_fee_schedule(ctl, account, act);
+      if( entry.has_fee || entry.by_setfee ) {
+         fee_schedule.insert(account, act, entry);
+      }
+      return entry;
+   }
+
+   void txfee_manager::on_setfee( const account_name& account, const action_name& act, const uint32_t block_num ) {
+      fee_schedule.erase(account, act);
+      last_setfee_block_num = std::max(last_setfee_block_num, block_num);
+   }
+
+   void txfee_manager::on_state_undo( const uint32_t last_irreversible_block_num ) {
+      // action_fee_object is only changed by setfee, if no setfee after lib, no entry can be undone
+      if( last_setfee_block_num > last_irreversible_block_num ) {
+         fee_schedule.clear();
+      }
+   }
+
+   fee_schedule_entry txfee_manager::resolve_fee_schedule( const controller& ctl, const account_name& account, const action_name& act ) const {
       const auto &db = ctl.db();
       const auto block_num = ctl.head_block_num();
 
+      fee_schedule_entry entry;
+
+      const auto fee_in_db = db.find<action_fee_object, by_action_name>(
+            boost::make_tuple(account, act));
+      if( fee_in_db != nullptr ) {
+         entry.by_setfee  = true;
+         entry.setfee_fee = fee_in_db->fee;
+         entry.cpu_limit  = fee_in_db->cpu_limit;
+         entry.net_limit  = fee_in_db->net_limit;
+         entry.ram_limit  = fee_in_db->ram_limit;
+      }
+
+      const auto set_fee = [&entry]( const asset& fee ) {
+         entry.fee = fee;
+         entry.has_fee = true;
+         return entry;
+      };
+
       // keep consensus for main net, some action in main net exec action
       // like newaccount in diff account
       {
@@ -117,7 +177,7 @@ namespace eosio { namespace chain {
              )) {
             const auto native_fee = get_native_fee(block_num, config::system_account_name, act);
             if (native_fee != asset(0)) {
-               return native_fee;
+               return set_fee(native_fee);
             }
          }
 
@@ -127,34 +187,117 @@ namespace eosio { namespace chain {
              )) {
             const auto native_fee = get_native_fee(block_num, config::system_account_name, act);
             if (native_fee != asset(0)) {
-               return native_fee;
+               return set_fee(native_fee);
             }
          }
       }
 
       // first check if changed fee
-      try{
-         const auto fee_in_db = db.find<action_fee_object, by_action_name>(
-               boost::make_tuple(account, act));
-         if(    ( fee_in_db != nullptr )
-                && ( fee_in_db->fee != asset(0) ) ){
-            return fee_in_db->fee;
-         }
-      } catch (fc::exception &exp){
-         elog("catch exp ${e}", ("e", exp.what()));
-      } catch (...){
-         elog("catch unknown exp in get_required_fee");
+      if( entry.by_setfee && ( entry.setfee_fee != asset(0) ) ) {
+         return set_fee(entry.setfee_fee);
       }
 
       const auto native_fee = get_native_fee(block_num, account, act);
       if (native_fee != asset(0)) {
-         return native_fee;
+         return set_fee(native_fee);
       }
 
-      // no fee found throw err
-      EOS_ASSERT(false, action_validate_exception,
-                 "action ${acc} ${act} name not include in feemap or db",
-                 ("acc", account)("act", act));
+      return entry;
+   }
+
+   uint64_t compiled_fee_schedule::hash( uint64_t account, uint64_t act ) {
+      // murmur3 fmix64 of the two names
+      uint64_t h = account ^ ( act * 0x9e3779b97f4a7c15ULL + ( account << 6 ) + ( account >> 2 ) );
+      h ^= h >> 33;
+      h *= 0xff51afd7ed558ccdULL;
+      h ^= h >> 33;
+      h *= 0xc4ceb9fe1a85ec53ULL;
+      h ^= h >> 33;
+      return h;
+   }
+
+   size_t compiled_fee_schedule::find_slot( uint64_t account, uint64_t act ) const {
+      const auto mask = _slots.size() - 1;
+      auto i = hash(account, act) & mask;
+      while( _slots[i].used && ( _slots[i].account != account || _slots[i].act != act ) ) {
+         i = (i + 1) & mask;
+      }
+      return i;
+   }
+
+   const fee_schedule_entry* compiled_fee_schedule::find( const account_name& account, const action_name& act ) const {
+      if( _size == 0 ) {
+         return nullptr;
+      }
+
+      const auto& s = _slots[find_slot(account, act)];
+      return s.used ? &s.entry : nullptr;
+   }
+
+   void compiled_fee_schedule::insert( const account_name& account, const action_name& act, const fee_schedule_entry& entry ) {
+      // keep load factor under 1/2
+      if( ( _size + 1 ) * 2 > _slots.size() ) {
+         grow();
+      }
+
+      auto& s = _slots[find_slot(account, act)];
+      if( !s.used ) {
+         s.used = true;
+         s.account = account;
+         s.act = act;
+         ++_size;
+      }
+      s.entry = entry;
+   }
+
+   bool compiled_fee_schedule::erase( const account_name& account, const action_name& act ) {
+      if( _size == 0 ) {
+         return false;
+      }
+
+      const auto mask = _slots.size() - 1;
+      auto i = find_slot(account, act);
+      if( !_slots[i].used ) {
+         return false;
+      }
+
+      // backward shift the following entries in the probe chain, so no tombstone is needed
+      _slots[i].used = false;
+      auto j = i;
+      while( true ) {
+         j = (j + 1) & mask;
+         if( !_slots[j].used ) {
+            break;
+         }
+
+         const auto k = hash(_slots[j].account, _slots[j].act) & mask;
+         const bool movable = ( i <= j ) ? ( k <= i || k > j ) : ( k <= i && k > j );
+         if( movable ) {
+            _slots[i] = _slots[j];
+            _slots[j].used = false;
+            i = j;
+         }
+      }
+
+      --_size;
+      return true;
+   }
+
+   void compiled_fee_schedule::clear() {
+      _slots.clear();
+      _size = 0;
+   }
+
+   void compiled_fee_schedule::grow() {
+      auto old_slots = std::move(_slots);
+      _slots = vector<slot>(old_slots.empty() ? 64 : old_slots.size() * 2);
+      _size = 0;
+
+      for( const auto& s : old_slots ) {
+         if( s.used ) {
+            insert(s.account, s.act, s.entry);
+         }
+      }
    }
 
    asset txfee_manager::get_required_fee( const controller& ctl, const action& act ) const {
@@ -29,7 +29,9 @@ namespace eosio { namespace chain {
    using namespace webassembly;
    using namespace webassembly::common;
 
-   wasm_interface::wasm_interface(vm_type vm) : my( new wasm_interface_impl(vm) ) {}
+   wasm_interface::wasm_interface(vm_type vm, uint64_t cache_size, uint16_t compile_threads, const fc::path& cache_dir,
+                                  uint64_t disk_cache_size)
+   : my( new wasm_interface_impl(vm, cache_size, compile_threads, cache_dir, disk_cache_size) ) {}
 
    wasm_interface::~wasm_interface() {}
 
@@ -63,6 +65,14 @@ namespace eosio { namespace chain {
       my->runtime_interface->immediately_exit_currently_running_module();
    }
 
+   void wasm_interface::precompile( const digest_type& code_id, const bytes& code ) {
+      my->precompile(code_id, code);
+   }
+
+   wasm_interface::cache_stats wasm_interface::get_cache_stats()const {
+      return my->get_cache_stats();
+   }
+
    wasm_instantiated_module_interface::~wasm_instantiated_module_interface() {}
    wasm_runtime_interface::~wasm_runtime_interface() {}
 
@@ -0,0 +1,257 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#include <eosio/chain/wasm_module_cache.hpp>
+#include <eosio/chain/wasm_eosio_injection.hpp>
+#include <eosio/chain/exceptions.hpp>
+
+#include <fc/io/raw.hpp>
+#include <fc/crypto/sha256.hpp>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <thread>
+
+namespace eosio { namespace chain {
+
+   namespace detail {
+      const uint32_t module_file_magic   = 0x4d534157; // "WASM"
+      const uint32_t module_file_version = 1;
+
+      struct module_file_header {
+         uint32_t    magic        = module_file_magic;
+         uint32_t    version      = module_file_version;
+         digest_type code_id;
+         digest_type fingerprint;
+         uint64_t    code_size    = 0;
+         uint64_t    memory_size  = 0;
+         digest_type payload_hash;
+      };
+
+      digest_type hash_payload( const char* code, size_t code_size, const char* memory, size_t memory_size ) {
+         digest_type::encoder enc;
+         enc.write( code, code_size );
+         enc.write( memory, memory_size );
+         return enc.result();
+      }
+   }
+
+} } // eosio::chain
+
+FC_REFLECT( eosio::chain::detail::module_file_header, (magic)(version)(code_id)(fingerprint)(code_size)(memory_size)(payload_hash) )
+
+namespace eosio { namespace chain {
+
+   using namespace detail;
+
+   wasm_module_cache::wasm_module_cache( const fc::path& cache_dir, uint64_t max_size )
+   :fingerprint( injection_fingerprint() )
+   ,max_size( max_size )
+   {
+      using boost::filesystem::directory_iterator;
+
+      dir = cache_dir / fingerprint.str().substr( 0, 16 );
+
+      // modules injected by other rules are never used again
+      if( fc::is_directory( cache_dir ) ) {
+         for( directory_iterator enditr, itr{cache_dir}; itr != enditr; ++itr ) {
+            if( itr->path().generic_string() != dir.generic_string() ) {
+               ilog( "removing wasm module cache ${p} of other injection rules", ("p", itr->path().generic_string()) );
+               fc::remove_all( itr->path() );
+            }
+         }
+      }
+
+      if( !fc::is_directory( dir ) )
+         fc::create_directories( dir );
+
+      load_files();
+   }
+
+   void wasm_module_cache::load_files() {
+      using boost::filesystem::directory_iterator;
+
+      struct found_file {
+         std::time_t mtime;
+         digest_type code_id;
+         uint64_t    size;
+      };
+      vector<found_file> found;
+      for( directory_iterator enditr, itr{dir}; itr != enditr; ++itr ) {
+         const auto name = itr->path().filename().generic_string();
+         boost::system::error_code ec;
+         // modules are named by the 64 hex digits of code_version, others are left by a crash in store
+         if( name.size() == 64 && name.find_first_not_of( "0123456789abcdef" ) == std::string::npos ) {
+            const auto size = boost::filesystem::file_size( itr->path(), ec );
+            const auto mtime = boost::filesystem::last_write_time( itr->path(), ec );
+            if( !ec ) {
+               found.push_back( {mtime, digest_type( name ), size} );
+               continue;
+            }
+         }
+         boost::filesystem::remove( itr->path(), ec );
+      }
+
+      std::sort( found.begin(), found.end(), []( const found_file& a, const found_file& b ) { return a.mtime < b.mtime; } );
+      std::lock_guard<std::mutex> g( files_mtx );
+      for( const auto& f : found ) {
+         files[f.code_id] = file_entry{ f.size, ++next_use };
+         total_size += f.size;
+      }
+      evict_files();
+   }
+
+   uint64_t wasm_module_cache::get_size()const {
+      std::lock_guard<std::mutex> g( files_mtx );
+      return total_size;
+   }
+
+   void wasm_module_cache::remove_file( const digest_type& code_id )const {
+      {
+         std::lock_guard<std::mutex> g( files_mtx );
+         auto itr = files.find( code_id );
+         if( itr != files.end() ) {
+            total_size -= itr->second.size;
+            files.erase( itr );
+         }
+      }
+      boost::system::error_code ec;
+      boost::filesystem::remove( module_path( code_id ).generic_string(), ec );
+   }
+
+   // evict_files remove least recently used files till they are in max_size, files_mtx must be held
+   void wasm_module_cache::evict_files()const {
+      while( total_size > max_size && !files.empty() ) {
+         auto lru = std::min_element( files.begin(), files.end(), []( const auto& a, const auto& b ) {
+            return a.second.last_use < b.second.last_use;
+         });
+         boost::system::error_code ec;
+         boost::filesystem::remove( module_path( lru->first ).generic_string(), ec );
+         total_size -= lru->second.size;
+         files.erase( lru );
+      }
+   }
+
+   digest_type wasm_module_cache::injection_fingerprint() {
+      digest_type::encoder enc;
+      fc::raw::pack( enc, wasm_injections::injection_version );
+      fc::raw::pack( enc, wasm_constraints::maximum_linear_memory );
+      fc::raw::pack( enc, wasm_constraints::maximum_mutable_globals );
+      fc::raw::pack( enc, wasm_constraints::maximum_table_elements );
+      fc::raw::pack( enc, wasm_constraints::maximum_section_elements );
+      fc::raw::pack( enc, wasm_constraints::maximum_linear_memory_init );
+      fc::raw::pack( enc, wasm_constraints::maximum_func_local_bytes );
+      fc::raw::pack( enc, wasm_constraints::maximum_call_depth );
+      // a forgotten bump of injection_version must not serve code injected by other sources
+      fc::raw::pack( enc, std::string( EOSIO_WASM_INJECTION_HASH ) );
+      return enc.result();
+   }
+
+   fc::path wasm_module_cache::module_path( const digest_type& code_id )const {
+      return dir / code_id.str();
+   }
+
+   optional<injected_module> wasm_module_cache::load( const digest_type& code_id )const {
+      using namespace boost::interprocess;
+
+      const auto path = module_path( code_id );
+      if( !fc::exists( path ) ) {
+         remove_file( code_id );
+         return {};
+      }
+
+      try {
+         file_mapping  mapping( path.generic_string().c_str(), read_only );
+         mapped_region region( mapping, read_only );
+
+         const char*  data = static_cast<const char*>( region.get_address() );
+         const size_t size = region.get_size();
+
+         module_file_header header;
+         fc::datastream<const char*> ds( data, size );
+         fc::raw::unpack( ds, header );
+
+         const size_t header_size = ds.tellp();
+         EOS_ASSERT( header.magic == module_file_magic && header.version == module_file_version
+                     && header.code_id == code_id && header.fingerprint == fingerprint
+                     && header_size + header.code_size + header.memory_size == size,
+                     wasm_exception, "bad wasm module cache header" );
+
+         const char* code   = data + header_size;
+         const char* memory = code + header.code_size;
+         EOS_ASSERT( hash_payload( code, header.code_size, memory, header.memory_size ) == header.payload_hash,
+                     wasm_exception, "bad wasm module cache payload" );
+
+         injected_module module;
+         module.code.assign( code, code + header.code_size );
+         module.initial_memory.assign( memory, memory + header.memory_size );
+
+         {
+            std::lock_guard<std::mutex> g( files_mtx );
+            auto itr = files.find( code_id );
+            if( itr != files.end() )
+               itr->second.last_use = ++next_use;
+         }
+         boost::system::error_code ec;
+         boost::filesystem::last_write_time( path.generic_string(), std::time( nullptr ), ec );
+         return module;
+      } catch( const fc::exception& e ) {
+         wlog( "discard wasm module cache ${p}: ${e}", ("p", path.generic_string())("e", e.to_string()) );
+      } catch( const std::exception& e ) {
+         wlog( "discard wasm module cache ${p}: ${e}", ("p", path.generic_string())("e", e.what()) );
+      }
+
+      remove_file( code_id );
+      return {};
+   }
+
+   void wasm_module_cache::store( const digest_type& code_id, const injected_module& module )const {
+      module_file_header header;
+      header.code_id      = code_id;
+      header.fingerprint  = fingerprint;
+      header.code_size    = module.code.size();
+      header.memory_size  = module.initial_memory.size();
+      header.payload_hash = hash_payload( (const char*)module.code.data(), module.code.size(),
+                                          (const char*)module.initial_memory.data(), module.initial_memory.size() );
+
+      const auto packed_header = fc::raw::pack( header );
+      const uint64_t file_size = packed_header.size() + header.code_size + header.memory_size;
+      if( file_size > max_size )
+         return;
+
+      const auto path = module_path( code_id );
+      // write to a file of this thread and rename it, so a reader never see a partly written module
+      const fc::path tmp_path = path.generic_string() + "."
+                                + std::to_string( std::hash<std::thread::id>()( std::this_thread::get_id() ) ) + ".tmp";
+
+      try {
+         {
+            std::ofstream out( tmp_path.generic_string(), std::ios::out | std::ios::binary | std::ios::trunc );
+            out.write( packed_header.data(), packed_header.size() );
+            out.write( (const char*)module.code.data(), module.code.size() );
+            out.write( (const char*)module.initial_memory.data(), module.initial_memory.size() );
+            out.close();
+            EOS_ASSERT( out.good(), wasm_exception, "failed to write wasm module cache" );
+         }
+         fc::rename( tmp_path, path );
+
+         std::lock_guard<std::mutex> g( files_mtx );
+         auto& entry = files[code_id];
+         total_size += file_size - entry.size;
+         entry.size = file_size;
+         entry.last_use = ++next_use;
+         evict_files();
+      } catch( const fc::exception& e ) {
+         wlog( "failed to store wasm module cache ${p}: ${e}", ("p", path.generic_string())("e", e.to_string()) );
+         boost::system::error_code ec;
+         boost::filesystem::remove( tmp_path.generic_string(), ec );
+      }
+   }
+
+} } // eosio::chain
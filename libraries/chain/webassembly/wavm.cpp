@@ -13,6 +13,7 @@
 #include "Runtime/Intrinsics.h"
 
 #include <mutex>
+#include <set>
 
 using namespace IR;
 using namespace Runtime;
@@ -21,13 +22,30 @@ namespace eosio { namespace chain { namespace webassembly { namespace wavm {
 
 running_instance_context the_running_instance_context;
 
+// instances of all live wavm_instantiated_modules, they are the roots when unreferenced objects are freed,
+// WAVM objects are global so it is shared by all wavm_runtimes
+static std::set<ModuleInstance*> __live_instances;
+static std::mutex __live_instances_lock;
+
 class wavm_instantiated_module : public wasm_instantiated_module_interface {
    public:
       wavm_instantiated_module(ModuleInstance* instance, std::unique_ptr<Module> module, std::vector<uint8_t> initial_mem) :
          _initial_memory(initial_mem),
          _instance(instance),
          _module(std::move(module))
-      {}
+      {
+         std::lock_guard<std::mutex> l(__live_instances_lock);
+         __live_instances.insert(_instance);
+      }
+
+      ~wavm_instantiated_module() {
+         std::lock_guard<std::mutex> l(__live_instances_lock);
+         __live_instances.erase(_instance);
+      }
+
+      uint64_t get_native_size()const override {
+         return getModuleInstanceCodeBytes(_instance);
+      }
 
       void apply(apply_context& context) override {
          vector<Value> args = {Value(uint64_t(context.receiver)),
@@ -76,7 +94,8 @@ class wavm_instantiated_module : public wasm_instantiated_module_interface {
 
       std::vector<uint8_t>     _initial_memory;
       //naked pointer because ModuleInstance is opaque
-      //_instance is deleted via WAVM's object garbage collection when wavm_rutime is deleted
+      //_instance is deleted via WAVM's object garbage collection by free_unreferenced_modules after this is destroyed,
+      //or when wavm_runtime is deleted
       ModuleInstance*          _instance;
       std::unique_ptr<Module>  _module;
 };
@@ -127,6 +146,17 @@ std::unique_ptr<wasm_instantiated_module_interface> wavm_runtime::instantiate_mo
    return std::make_unique<wavm_instantiated_module>(instance, std::move(module), initial_memory);
 }
 
+void wavm_runtime::free_unreferenced_modules() {
+   std::vector<ObjectInstance*> roots;
+   {
+      std::lock_guard<std::mutex> l(__live_instances_lock);
+      roots.reserve(__live_instances.size());
+      for( auto instance : __live_instances )
+         roots.push_back(asObject(instance));
+   }
+   Runtime::freeUnreferencedObjects(std::move(roots));
+}
+
 void wavm_runtime::immediately_exit_currently_running_module() {
 #ifdef _WIN32
    throw wasm_exit();
@@ -486,6 +486,8 @@ namespace eosio { namespace testing {
          vcfg = default_config();
 
          vcfg.trusted_producers = trusted_producers;
+         // validate blocks with onfee settled one by one, so it cross check the batched settlement
+         vcfg.batch_fee_settlement = false;
 
          validating_node = std::make_unique<controller>(vcfg);
          validating_node->add_indices();
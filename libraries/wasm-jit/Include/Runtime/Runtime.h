@@ -210,6 +210,9 @@ namespace Runtime
 	RUNTIME_API uint64_t getDefaultMemorySize(ModuleInstance* moduleInstance);
 	RUNTIME_API TableInstance* getDefaultTable(ModuleInstance* moduleInstance);
 
+	// Gets the number of bytes committed for the JIT code and data of a ModuleInstance.
+	RUNTIME_API Uptr getModuleInstanceCodeBytes(ModuleInstance* moduleInstance);
+
 	RUNTIME_API void runInstanceStartFunc(ModuleInstance* moduleInstance);
 	RUNTIME_API void resetGlobalInstances(ModuleInstance* moduleInstance);
 	RUNTIME_API void resetMemory(MemoryInstance* memory, IR::MemoryType& newMemoryType);
@@ -184,6 +184,7 @@ namespace Runtime
 	MemoryInstance* getDefaultMemory(ModuleInstance* moduleInstance) { return moduleInstance->defaultMemory; }
 	uint64_t getDefaultMemorySize(ModuleInstance* moduleInstance) { return moduleInstance->defaultMemory->numPages << IR::numBytesPerPageLog2; }
 	TableInstance* getDefaultTable(ModuleInstance* moduleInstance) { return moduleInstance->defaultTable; }
+	Uptr getModuleInstanceCodeBytes(ModuleInstance* moduleInstance) { return moduleInstance->jitModule ? moduleInstance->jitModule->getNumCodeBytes() : 0; }
 
 	void runInstanceStartFunc(ModuleInstance* moduleInstance) {
 		if(moduleInstance->startFunctionIndex != UINTPTR_MAX)
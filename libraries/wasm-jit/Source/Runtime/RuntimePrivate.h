@@ -17,6 +17,9 @@ namespace LLVMJIT
 	struct JITModuleBase
 	{
 		virtual ~JITModuleBase() {}
+
+		// Returns the number of bytes committed for the generated code and data of the module.
+		virtual Uptr getNumCodeBytes() const { return 0; }
 	};
 
 	void init();
@@ -84,6 +84,8 @@ void chain_api_plugin::plugin_startup() {
 
    _http_plugin.add_api({
       CHAIN_RO_CALL(get_info, 200l),
+      CHAIN_RO_CALL(get_wasm_cache_stats, 200),
+      CHAIN_RO_CALL(get_abi_cache_stats, 200),
       CHAIN_RO_CALL(get_block, 200),
       CHAIN_RO_CALL(get_block_header_state, 200),
       CHAIN_RO_CALL(get_account, 200),
@@ -106,6 +108,7 @@ void chain_api_plugin::plugin_startup() {
       CHAIN_RO_CALL(get_chain_configs, 200),
       CHAIN_RO_CALL(get_action_fee, 200),
       CHAIN_RO_CALL(get_vote_rewards, 200),
+      CHAIN_RO_CALL(get_voter_rewards, 200),
       CHAIN_RO_CALL(get_transaction_id, 200),
       CHAIN_RW_CALL_ASYNC(push_block, chain_apis::read_write::push_block_results, 202),
       CHAIN_RW_CALL_ASYNC(push_transaction, chain_apis::read_write::push_transaction_results, 202),
@@ -32,10 +32,34 @@ namespace chain_apis {
 
 const auto sys_account = chain::config::system_account_name;
 
+// bp_total_assetage total voteage of a bp at block
+static int128_t bp_total_assetage( const chain::memory_db::bp_info& bp_data, uint32_t block_num ) {
+   return ( static_cast<int128_t>(bp_data.total_staked)
+            * static_cast<int128_t>(block_num - bp_data.voteage_update_height) )
+        + bp_data.total_voteage;
+}
+
+// vote_reward reward of voter by its voteage from bp
+static asset vote_reward( const chain::memory_db::bp_info& bp_data, uint32_t block_num, uint64_t voter_total_assetage ) {
+   const auto bp_assetage = bp_total_assetage( bp_data, block_num );
+   const auto amount_voteage = static_cast<int128_t>( bp_data.rewards_pool.get_amount() )
+                             * voter_total_assetage;
+   return asset{
+      bp_assetage > 0
+            ? static_cast<int64_t>( amount_voteage / bp_assetage )
+            : 0
+   };
+}
+
+// curr_vote_assetage voteage of voter 's current vote
+static int128_t curr_vote_assetage( const chain::memory_db::vote_info& curr_vote_data, uint32_t block_num ) {
+   return (   static_cast<int128_t>(curr_vote_data.staked.get_amount() / curr_vote_data.staked.precision())
+            * static_cast<int128_t>(block_num - curr_vote_data.voteage_update_height) )
+          + curr_vote_data.voteage;
+}
+
 // get_vote_rewards get voter 's reward by vote in eosforce
 read_only::get_vote_rewards_result read_only::get_vote_rewards( const read_only::get_vote_rewards_params& p )const {
-   //ilog( "get_vote_rewards ${acc} from ${bp}", ("acc", p.voter)("bp", p.bp_name));
-
    const auto curr_block_num = db.head_block_num();
 
    // 1. Need BP total voteage and reward_pool info
@@ -44,61 +68,86 @@ read_only::get_vote_rewards_result read_only::get_vote_rewards( const read_only:
                chain::contract_table_query_exception,
                "cannot find bp info by name ${n}", ("n", p.bp_name) );
 
-   //ilog( "bp data: ${data}", ("data", bp_data) );
-
-   const auto bp_total_assetage = 
-        ( static_cast<int128_t>(bp_data.total_staked)
-          * static_cast<int128_t>(curr_block_num - bp_data.voteage_update_height) )
-      + bp_data.total_voteage;
-
-   //ilog( "bp data: ${data} on ${n}", ("data", bp_total_assetage)("n", curr_block_num) );
-
    uint64_t voter_total_assetage = 0;
 
    // 2. Need calc voter current vote voteage
    chain::memory_db::vote_info curr_vote_data;
-   const auto is_has_curr_vote = get_table_row_by_primary_key(
-         sys_account, p.voter, N(votes), p.bp_name, curr_vote_data );
-   if( is_has_curr_vote ) {
-      //ilog( "get current vote data : ${d}", ("d", curr_vote_data) );
-      const auto curr_vote_assetage = 
-         (   static_cast<int128_t>(curr_vote_data.staked.get_amount() / curr_vote_data.staked.precision()) 
-           * static_cast<int128_t>(curr_block_num - curr_vote_data.voteage_update_height) )
-         + curr_vote_data.voteage;
-      
-      //ilog( "get current vote assetage : ${d}", ("d", curr_vote_assetage) );
-      voter_total_assetage += curr_vote_assetage;
+   if( get_table_row_by_primary_key( sys_account, p.voter, N(votes), p.bp_name, curr_vote_data ) ) {
+      voter_total_assetage += curr_vote_assetage( curr_vote_data, curr_block_num );
    }
 
-   // 3. Need calc the sum of voter 's fix-time vote voteage
-   walk_table_by_seckey<chain::memory_db::votefix_info>( 
-      sys_account, p.voter, N(fixvotes), p.bp_name, 
-      [&]( unsigned int c, const chain::memory_db::votefix_info& v ) -> bool{
-         //ilog("walk fix ${n} : ${data}", ("n", c)("data", v));
-         const auto fix_votepower_age =
-            (   static_cast<int128_t>(v.votepower_age.staked.get_amount() / v.votepower_age.staked.precision())
-              * static_cast<int128_t>(curr_block_num - v.votepower_age.update_height) )
-            + v.votepower_age.age;
-         voter_total_assetage += fix_votepower_age;
-         return false; // no break
-   } );
+   // 3. Need the sum of voter 's fix-time vote voteage, kept by vote_rewards index
+   if( vote_rewards != nullptr ) {
+      const auto fix_votes = vote_rewards->load_or_get( db, p.voter );
+      const auto itr = fix_votes.find( p.bp_name );
+      if( itr != fix_votes.end() ) {
+         voter_total_assetage += itr->second.voteage_at( curr_block_num );
+      }
+   } else {
+      walk_table_by_seckey<chain::memory_db::votefix_info>( 
+         sys_account, p.voter, N(fixvotes), p.bp_name, 
+         [&]( unsigned int c, const chain::memory_db::votefix_info& v ) -> bool{
+            const auto fix_votepower_age =
+               (   static_cast<int128_t>(v.votepower_age.staked.get_amount() / v.votepower_age.staked.precision())
+                 * static_cast<int128_t>(curr_block_num - v.votepower_age.update_height) )
+               + v.votepower_age.age;
+            voter_total_assetage += fix_votepower_age;
+            return false; // no break
+      } );
+   }
 
    // 4. Make reward to result
-   const auto amount_voteage = static_cast<int128_t>( bp_data.rewards_pool.get_amount() ) 
-                             * voter_total_assetage;
-   const auto& reward = asset{
-      bp_total_assetage > 0
-            ? static_cast<int64_t>( amount_voteage / bp_total_assetage )
-            : 0
-   };
-
    return {
-      reward,
+      vote_reward( bp_data, curr_block_num, voter_total_assetage ),
       voter_total_assetage,
       curr_block_num,
       {}
    };
 }
 
+// get_voter_rewards get voter 's rewards from all bps by current and fix-time votes
+read_only::get_voter_rewards_result read_only::get_voter_rewards( const read_only::get_voter_rewards_params& p )const {
+   const auto curr_block_num = db.head_block_num();
+
+   // bp name to voter total assetage, same as get_vote_rewards, uint64 as it
+   boost::container::flat_map<account_name, uint64_t> voter_assetages;
+
+   walk_key_value_table( sys_account, p.voter, N(votes), [&]( const chain::key_value_object& obj ) {
+      chain::memory_db::vote_info curr_vote_data;
+      fc::datastream<const char*> ds( obj.value.data(), obj.value.size() );
+      fc::raw::unpack( ds, curr_vote_data );
+      voter_assetages[curr_vote_data.bpname] += curr_vote_assetage( curr_vote_data, curr_block_num );
+      return true;
+   });
+
+   const auto add_fix_votes = [&]( const voter_fix_votes& fix_votes ) {
+      for( const auto& fix : fix_votes ) {
+         voter_assetages[fix.first] += fix.second.voteage_at( curr_block_num );
+      }
+   };
+   if( vote_rewards != nullptr ) {
+      add_fix_votes( vote_rewards->load_or_get( db, p.voter ) );
+   } else {
+      add_fix_votes( load_voter_fix_votes( db, p.voter ) );
+   }
+
+   get_voter_rewards_result result;
+   result.block_num = curr_block_num;
+   result.rewards.reserve( voter_assetages.size() );
+   for( const auto& voter_assetage : voter_assetages ) {
+      chain::memory_db::bp_info bp_data;
+      if( !get_table_row_by_primary_key( sys_account, sys_account, N(bps), voter_assetage.first, bp_data ) ) {
+         continue;
+      }
+      result.rewards.push_back( voter_bp_reward{
+         voter_assetage.first,
+         vote_reward( bp_data, curr_block_num, voter_assetage.second ),
+         voter_assetage.second
+      });
+   }
+
+   return result;
+}
+
 } // namespace chain_apis
 } // namespace eosio
\ No newline at end of file
@@ -16,6 +16,7 @@
 #include <eosio/chain/controller.hpp>
 #include <eosio/chain/generated_transaction_object.hpp>
 #include <eosio/chain/snapshot.hpp>
+#include <eosio/chain/signature_recovery_cache.hpp>
 
 #include <eosio/chain/eosio_contract.hpp>
 #include <eosio/chain/config_on_chain.hpp>
@@ -196,7 +197,10 @@ public:
    fc::optional<scoped_connection>                                   irreversible_block_connection;
    fc::optional<scoped_connection>                                   accepted_transaction_connection;
    fc::optional<scoped_connection>                                   applied_transaction_connection;
+   fc::optional<scoped_connection>                                   state_undone_connection;
+   fc::optional<scoped_connection>                                   fixvotes_changed_connection;
 
+   chain_apis::vote_reward_index                                     vote_rewards;
 };
 
 chain_plugin::chain_plugin()
@@ -214,14 +218,30 @@ void chain_plugin::set_program_options(options_description& cli, options_descrip
           "the location of the blocks directory (absolute path or relative to application data dir)")
          ("checkpoint", bpo::value<vector<string>>()->composing(), "Pairs of [BLOCK_NUM,BLOCK_ID] that should be enforced as checkpoints.")
          ("wasm-runtime", bpo::value<eosio::chain::wasm_interface::vm_type>()->value_name("wavm/wabt"), "Override default WASM runtime")
+         ("wasm-cache-size-mb", bpo::value<uint64_t>()->default_value(config::default_wasm_cache_size / (1024  * 1024)),
+          "Maximum size (in MiB) of instantiated WASM modules kept in cache, least recently used modules are evicted first")
+         ("wasm-compile-threads", bpo::value<uint16_t>()->default_value(config::default_wasm_compile_threads),
+          "Number of threads to prepare WASM modules of new contract code in background, 0 to prepare them on first use")
+         ("disable-wasm-disk-cache", bpo::bool_switch()->default_value(false),
+          "Do not keep injected WASM modules on disk under data-dir, every contract is parsed and injected again after restart")
+         ("wasm-disk-cache-size-mb", bpo::value<uint64_t>()->default_value(config::default_wasm_disk_cache_size / (1024  * 1024)),
+          "Maximum size (in MiB) of injected WASM modules kept on disk, least recently used modules are removed first")
          ("abi-serializer-max-time-ms", bpo::value<uint32_t>()->default_value(config::default_abi_serializer_max_time_ms),
           "Override default maximum ABI serialization time allowed in ms")
+         ("abi-serializer-cache-size", bpo::value<uint32_t>()->default_value(config::default_abi_serializer_cache_size),
+          "Maximum number of accounts whose decoded ABI is kept in cache for API and history serialization")
          ("chain-state-db-size-mb", bpo::value<uint64_t>()->default_value(config::default_state_size / (1024  * 1024)), "Maximum size (in MiB) of the chain state database")
          ("chain-state-db-guard-size-mb", bpo::value<uint64_t>()->default_value(config::default_state_guard_size / (1024  * 1024)), "Safely shut down node when free space remaining in the chain state database drops below this size (in MiB).")
          ("reversible-blocks-db-size-mb", bpo::value<uint64_t>()->default_value(config::default_reversible_cache_size / (1024  * 1024)), "Maximum size (in MiB) of the reversible blocks database")
          ("reversible-blocks-db-guard-size-mb", bpo::value<uint64_t>()->default_value(config::default_reversible_guard_size / (1024  * 1024)), "Safely shut down node when free space remaining in the reverseible blocks database drops below this size (in MiB).")
+         ("block-log-write-queue-size", bpo::value<uint32_t>()->default_value(config::default_block_log_write_queue_size),
+          "Number of irreversible blocks queued for block log writer thread, 0 to append blocks on main thread")
+         ("block-log-sync-interval-ms", bpo::value<uint32_t>()->default_value(config::default_block_log_sync_interval_ms),
+          "Interval in ms of syncing block log to disk by block log writer thread, 0 to not sync")
          ("signature-cpu-billable-pct", bpo::value<uint32_t>()->default_value(config::default_sig_cpu_bill_pct / config::percent_1),
           "Percentage of actual signature recovery cpu to bill. Whole number percentages, e.g. 50 for 50%")
+         ("signature-recovery-cache-size", bpo::value<uint32_t>()->default_value(config::default_sig_recovery_cache_size),
+          "Number of signatures kept with their recovered keys, so transactions relayed to the node are not recovered again in blocks")
          ("chain-threads", bpo::value<uint16_t>()->default_value(config::default_controller_thread_pool_size),
           "Number of worker threads in controller thread pool")
          ("contracts-console", bpo::bool_switch()->default_value(false),
@@ -253,6 +273,8 @@ void chain_plugin::set_program_options(options_description& cli, options_descrip
           "In \"light\" mode all incoming blocks headers will be fully validated; transactions in those validated blocks will be trusted \n")
          ("disable-ram-billing-notify-checks", bpo::bool_switch()->default_value(false),
           "Disable the check which subjectively fails a transaction if a contract bills more RAM to another account within the context of a notification handler (i.e. when the receiver is not the code of the action).")
+         ("disable-batch-fee-settlement", bpo::bool_switch()->default_value(false),
+          "Write the accounts and bps rows on every onfee action instead of settling all onfee actions of a transaction with one write.")
          ("trusted-producer", bpo::value<vector<string>>()->composing(), "Indicate a producer whose blocks headers signed by it will be fully validated, but transactions in those validated blocks will be trusted.")
          ;
 
@@ -451,12 +473,28 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
       if( options.count( "reversible-blocks-db-guard-size-mb" ))
          my->chain_config->reversible_guard_size = options.at( "reversible-blocks-db-guard-size-mb" ).as<uint64_t>() * 1024 * 1024;
 
+      if( options.count( "block-log-write-queue-size" ))
+         my->chain_config->block_log_write_queue_size = options.at( "block-log-write-queue-size" ).as<uint32_t>();
+
+      if( options.count( "block-log-sync-interval-ms" ))
+         my->chain_config->block_log_sync_interval_ms = options.at( "block-log-sync-interval-ms" ).as<uint32_t>();
+
+      if( options.count( "signature-recovery-cache-size" ))
+         signature_recovery_cache::instance().set_capacity( options.at( "signature-recovery-cache-size" ).as<uint32_t>() );
+
       if( options.count( "chain-threads" )) {
          my->chain_config->thread_pool_size = options.at( "chain-threads" ).as<uint16_t>();
          EOS_ASSERT( my->chain_config->thread_pool_size > 0, plugin_config_exception,
                      "chain-threads ${num} must be greater than 0", ("num", my->chain_config->thread_pool_size) );
       }
 
+      my->chain_config->wasm_cache_size = options.at( "wasm-cache-size-mb" ).as<uint64_t>() * 1024 * 1024;
+      my->chain_config->wasm_compile_threads = options.at( "wasm-compile-threads" ).as<uint16_t>();
+      if( !options.at( "disable-wasm-disk-cache" ).as<bool>() )
+         my->chain_config->wasm_cache_dir = app().data_dir() / config::default_wasm_cache_dir_name;
+      my->chain_config->wasm_disk_cache_size = options.at( "wasm-disk-cache-size-mb" ).as<uint64_t>() * 1024 * 1024;
+      my->chain_config->abi_serializer_cache_size = options.at( "abi-serializer-cache-size" ).as<uint32_t>();
+
       my->chain_config->sig_cpu_bill_pct = options.at("signature-cpu-billable-pct").as<uint32_t>();
       EOS_ASSERT( my->chain_config->sig_cpu_bill_pct >= 0 && my->chain_config->sig_cpu_bill_pct <= 100, plugin_config_exception,
                   "signature-cpu-billable-pct must be 0 - 100, ${pct}", ("pct", my->chain_config->sig_cpu_bill_pct) );
@@ -469,6 +507,7 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
       my->chain_config->disable_replay_opts = options.at( "disable-replay-opts" ).as<bool>();
       my->chain_config->contracts_console = options.at( "contracts-console" ).as<bool>();
       my->chain_config->allow_ram_billing_in_notify = options.at( "disable-ram-billing-notify-checks" ).as<bool>();
+      my->chain_config->batch_fee_settlement = !options.at( "disable-batch-fee-settlement" ).as<bool>();
 
       if( options.count( "extract-genesis-json" ) || options.at( "print-genesis-json" ).as<bool>()) {
          genesis_state gs;
@@ -603,7 +642,7 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
 
          // recover genesis information from the snapshot
          auto infile = std::ifstream(my->snapshot_path->generic_string(), (std::ios::in | std::ios::binary));
-         auto reader = std::make_shared<istream_snapshot_reader>(infile);
+         auto reader = std::make_shared<istream_snapshot_reader>(infile, my->chain_config->thread_pool_size);
          reader->validate();
          reader->read_section<genesis_state>([this]( auto &section ){
             section.read_row(my->chain_config->genesis);
@@ -733,6 +772,7 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
       } );
 
       my->irreversible_block_connection = my->chain->irreversible_block.connect( [this]( const block_state_ptr& blk ) {
+         my->vote_rewards.on_irreversible_block( blk->block_num );
          my->irreversible_block_channel.publish( priority::low, blk );
       } );
 
@@ -746,6 +786,15 @@ void chain_plugin::plugin_initialize(const variables_map& options) {
                my->applied_transaction_channel.publish( priority::low, trace );
             } );
 
+      my->state_undone_connection = my->chain->state_undone.connect( [this]( uint32_t ) {
+         my->vote_rewards.on_state_undone();
+      } );
+
+      // rows are written in the pending block
+      my->fixvotes_changed_connection = my->chain->fixvotes_changed.connect( [this]( account_name voter ) {
+         my->vote_rewards.on_fixvotes_changed( voter, my->chain->head_block_num() + 1 );
+      } );
+
       my->chain->add_indices();
    } FC_LOG_AND_RETHROW()
 
@@ -757,7 +806,7 @@ void chain_plugin::plugin_startup()
       auto shutdown = [](){ return app().is_quiting(); };
       if (my->snapshot_path) {
          auto infile = std::ifstream(my->snapshot_path->generic_string(), (std::ios::in | std::ios::binary));
-         auto reader = std::make_shared<istream_snapshot_reader>(infile);
+         auto reader = std::make_shared<istream_snapshot_reader>(infile, my->chain_config->thread_pool_size);
          my->chain->startup(shutdown, reader);
          infile.close();
       } else {
@@ -787,6 +836,10 @@ void chain_plugin::plugin_shutdown() {
    my->irreversible_block_connection.reset();
    my->accepted_transaction_connection.reset();
    my->applied_transaction_connection.reset();
+   my->state_undone_connection.reset();
+   my->fixvotes_changed_connection.reset();
+   ilog( "block log writer: ${s}", ("s", my->chain->get_block_log_write_stats()) );
+   ilog( "signature recovery cache: ${s}", ("s", signature_recovery_cache::instance().get_stats()) );
    my->chain->get_thread_pool().stop();
    my->chain->get_thread_pool().join();
    my->chain.reset();
@@ -1022,6 +1075,10 @@ bool chain_plugin::export_reversible_blocks( const fc::path& reversible_dir,
 controller& chain_plugin::chain() { return *my->chain; }
 const controller& chain_plugin::chain() const { return *my->chain; }
 
+chain_apis::read_only chain_plugin::get_read_only_api() const {
+   return chain_apis::read_only(chain(), get_abi_serializer_max_time(), &my->vote_rewards);
+}
+
 chain::chain_id_type chain_plugin::get_chain_id()const {
    EOS_ASSERT( my->chain_id.valid(), chain_id_type_exception, "chain ID has not been initialized yet" );
    return *my->chain_id;
@@ -1090,6 +1147,14 @@ read_only::get_info_results read_only::get_info(const read_only::get_info_params
    };
 }
 
+read_only::get_wasm_cache_stats_results read_only::get_wasm_cache_stats(const read_only::get_wasm_cache_stats_params&) const {
+   return db.get_wasm_interface().get_cache_stats();
+}
+
+read_only::get_abi_cache_stats_results read_only::get_abi_cache_stats(const read_only::get_abi_cache_stats_params&) const {
+   return db.get_abi_serializer_cache().get_stats();
+}
+
 uint64_t read_only::get_table_index_name(const read_only::get_table_rows_params& p, bool& primary) {
    using boost::algorithm::starts_with;
    // see multi_index packing of index name
@@ -1178,13 +1243,17 @@ double convert_to_type(const string& str, const string& desc) {
    return val;
 }
 
-abi_def get_abi( const controller& db, const name& account ) {
+// get_abi_serializer cached abi of account, an account without abi gets an empty one
+cached_abi_serializer get_abi_serializer( const controller& db, const name& account, const fc::microseconds& max_serialization_time ) {
    const auto &d = db.db();
    const account_object *code_accnt = d.find<account_object, by_name>(account);
    EOS_ASSERT(code_accnt != nullptr, chain::account_query_exception, "Fail to retrieve account for ${account}", ("account", account) );
-   abi_def abi;
-   abi_serializer::to_abi(code_accnt->abi, abi);
-   return abi;
+   auto abis = db.get_abi_serializer_cache().get(d, account, max_serialization_time);
+   if( !abis.valid() ) {
+      static const cached_abi_serializer empty_abi{ abi_def(), abi_serializer() };
+      return empty_abi;
+   }
+   return abis;
 }
 
 string get_table_type( const abi_def& abi, const name& table_name ) {
@@ -1197,7 +1266,8 @@ string get_table_type( const abi_def& abi, const name& table_name ) {
 }
 
 read_only::get_table_rows_result read_only::get_table_rows( const read_only::get_table_rows_params& p )const {
-   const abi_def abi = eosio::chain_apis::get_abi( db, p.code );
+   const auto abis = eosio::chain_apis::get_abi_serializer( db, p.code, abi_serializer_max_time );
+   const abi_def& abi = abis.get_abi();
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wstrict-aliasing"
    bool primary = false;
@@ -1206,38 +1276,38 @@ read_only::get_table_rows_result read_only::get_table_rows( const read_only::get
       EOS_ASSERT( p.table == table_with_index, chain::contract_table_query_exception, "Invalid table name ${t}", ( "t", p.table ));
       auto table_type = get_table_type( abi, p.table );
       if( table_type == KEYi64 || p.key_type == "i64" || p.key_type == "name" ) {
-         return get_table_rows_ex<key_value_index>(p,abi);
+         return get_table_rows_ex<key_value_index>(p,abis);
       }
       EOS_ASSERT( false, chain::contract_table_query_exception,  "Invalid table type ${type}", ("type",table_type)("abi",abi));
    } else {
       EOS_ASSERT( !p.key_type.empty(), chain::contract_table_query_exception, "key type required for non-primary index" );
 
       if (p.key_type == chain_apis::i64 || p.key_type == "name") {
-         return get_table_rows_by_seckey<index64_index, uint64_t>(p, abi, [](uint64_t v)->uint64_t {
+         return get_table_rows_by_seckey<index64_index, uint64_t>(p, abis, [](uint64_t v)->uint64_t {
             return v;
          });
       }
       else if (p.key_type == chain_apis::i128) {
-         return get_table_rows_by_seckey<index128_index, uint128_t>(p, abi, [](uint128_t v)->uint128_t {
+         return get_table_rows_by_seckey<index128_index, uint128_t>(p, abis, [](uint128_t v)->uint128_t {
             return v;
          });
       }
       else if (p.key_type == chain_apis::i256) {
          if ( p.encode_type == chain_apis::hex) {
             using  conv = keytype_converter<chain_apis::sha256,chain_apis::hex>;
-            return get_table_rows_by_seckey<conv::index_type, conv::input_type>(p, abi, conv::function());
+            return get_table_rows_by_seckey<conv::index_type, conv::input_type>(p, abis, conv::function());
          }
          using  conv = keytype_converter<chain_apis::i256>;
-         return get_table_rows_by_seckey<conv::index_type, conv::input_type>(p, abi, conv::function());
+         return get_table_rows_by_seckey<conv::index_type, conv::input_type>(p, abis, conv::function());
       }
       else if (p.key_type == chain_apis::float64) {
-         return get_table_rows_by_seckey<index_double_index, double>(p, abi, [](double v)->float64_t {
+         return get_table_rows_by_seckey<index_double_index, double>(p, abis, [](double v)->float64_t {
             float64_t f = *(float64_t *)&v;
             return f;
          });
       }
       else if (p.key_type == chain_apis::float128) {
-         return get_table_rows_by_seckey<index_long_double_index, double>(p, abi, [](double v)->float128_t{
+         return get_table_rows_by_seckey<index_long_double_index, double>(p, abis, [](double v)->float128_t{
             float64_t f = *(float64_t *)&v;
             float128_t f128;
             f64_to_f128M(f, &f128);
@@ -1246,11 +1316,11 @@ read_only::get_table_rows_result read_only::get_table_rows( const read_only::get
       }
       else if (p.key_type == chain_apis::sha256) {
          using  conv = keytype_converter<chain_apis::sha256,chain_apis::hex>;
-         return get_table_rows_by_seckey<conv::index_type, conv::input_type>(p, abi, conv::function());
+         return get_table_rows_by_seckey<conv::index_type, conv::input_type>(p, abis, conv::function());
       }
       else if(p.key_type == chain_apis::ripemd160) {
          using  conv = keytype_converter<chain_apis::ripemd160,chain_apis::hex>;
-         return get_table_rows_by_seckey<conv::index_type, conv::input_type>(p, abi, conv::function());
+         return get_table_rows_by_seckey<conv::index_type, conv::input_type>(p, abis, conv::function());
       }
       EOS_ASSERT(false, chain::contract_table_query_exception,  "Unsupported secondary index type: ${t}", ("t", p.key_type));
    }
@@ -1307,8 +1377,8 @@ read_only::get_table_by_scope_result read_only::get_table_by_scope( const read_o
 
 vector<asset> read_only::get_currency_balance( const read_only::get_currency_balance_params& p )const {
 
-   const abi_def abi = eosio::chain_apis::get_abi( db, p.code );
-   (void)get_table_type( abi, "accounts" );
+   const auto abis = eosio::chain_apis::get_abi_serializer( db, p.code, abi_serializer_max_time );
+   (void)get_table_type( abis.get_abi(), "accounts" );
 
    vector<asset> results;
    walk_key_value_table(p.code, p.account, N(accounts), [&](const key_value_object& obj){
@@ -1334,8 +1404,8 @@ vector<asset> read_only::get_currency_balance( const read_only::get_currency_bal
 fc::variant read_only::get_currency_stats( const read_only::get_currency_stats_params& p )const {
    fc::mutable_variant_object results;
 
-   const abi_def abi = eosio::chain_apis::get_abi( db, p.code );
-   (void)get_table_type( abi, "stat" );
+   const auto abis = eosio::chain_apis::get_abi_serializer( db, p.code, abi_serializer_max_time );
+   (void)get_table_type( abis.get_abi(), "stat" );
 
    uint64_t scope = ( eosio::chain::string_to_symbol( 0, boost::algorithm::to_upper_copy(p.symbol).c_str() ) >> 8 );
 
@@ -1373,9 +1443,10 @@ fc::variant get_global_row( const database& db, const abi_def& abi, const abi_se
 }
 
 read_only::get_producers_result read_only::get_producers( const read_only::get_producers_params& p ) const try {
-   const abi_def abi = eosio::chain_apis::get_abi(db, config::system_account_name);
+   const auto cached_abis = eosio::chain_apis::get_abi_serializer(db, config::system_account_name, abi_serializer_max_time);
+   const abi_def& abi = cached_abis.get_abi();
+   const abi_serializer& abis = *cached_abis;
    const auto table_type = get_table_type(abi, N(producers));
-   const abi_serializer abis{ abi, abi_serializer_max_time };
    EOS_ASSERT(table_type == KEYi64, chain::contract_table_query_exception, "Invalid table type ${type} for table producers", ("type",table_type));
 
    const auto& d = db.db();
@@ -1451,16 +1522,8 @@ read_only::get_producer_schedule_result read_only::get_producer_schedule( const
 template<typename Api>
 struct resolver_factory {
    static auto make(const Api* api, const fc::microseconds& max_serialization_time) {
-      return [api, max_serialization_time](const account_name &name) -> optional<abi_serializer> {
-         const auto* accnt = api->db.db().template find<account_object, by_name>(name);
-         if (accnt != nullptr) {
-            abi_def abi;
-            if (abi_serializer::to_abi(accnt->abi, abi)) {
-               return abi_serializer(abi, max_serialization_time);
-            }
-         }
-
-         return optional<abi_serializer>();
+      return [api, max_serialization_time](const account_name &name) -> cached_abi_serializer {
+         return api->db.get_abi_serializer_cache().get(api->db.db(), name, max_serialization_time);
       };
    }
 };
@@ -1786,11 +1849,9 @@ read_only::get_account_results read_only::get_account( const get_account_params&
       ++perm;
    }
 
-   const auto& code_account = db.db().get<account_object,by_name>( config::system_account_name );
-
-   abi_def abi;
-   if( abi_serializer::to_abi(code_account.abi, abi) ) {
-      abi_serializer abis( abi, abi_serializer_max_time );
+   const auto cached_abis = db.get_abi_serializer_cache().get( d, config::system_account_name, abi_serializer_max_time );
+   if( cached_abis.valid() ) {
+      const abi_serializer& abis = *cached_abis;
       auto core_symbol = extract_core_symbol();
 
       if (params.expected_core_symbol.valid())
@@ -1853,16 +1914,16 @@ read_only::abi_json_to_bin_result read_only::abi_json_to_bin( const read_only::a
    const auto code_account = db.db().find<account_object,by_name>( params.code );
    EOS_ASSERT(code_account != nullptr, contract_query_exception, "Contract can't be found ${contract}", ("contract", params.code));
 
-   abi_def abi;
-   if( abi_serializer::to_abi(code_account->abi, abi) ) {
-      abi_serializer abis( abi, abi_serializer_max_time );
+   const auto cached_abis = db.get_abi_serializer_cache().get( db.db(), params.code, abi_serializer_max_time );
+   if( cached_abis.valid() ) {
+      const abi_serializer& abis = *cached_abis;
       auto action_type = abis.get_action_type(params.action);
       EOS_ASSERT(!action_type.empty(), action_validate_exception, "Unknown action ${action} in contract ${contract}", ("action", params.action)("contract", params.code));
       try {
          result.binargs = abis.variant_to_binary( action_type, params.args, abi_serializer_max_time, shorten_abi_errors );
       } EOS_RETHROW_EXCEPTIONS(chain::invalid_action_args_exception,
                                 "'${args}' is invalid args for action '${action}' code '${code}'. expected '${proto}'",
-                                ("args", params.args)("action", params.action)("code", params.code)("proto", action_abi_to_variant(abi, action_type)))
+                                ("args", params.args)("action", params.action)("code", params.code)("proto", action_abi_to_variant(cached_abis.get_abi(), action_type)))
    } else {
       EOS_ASSERT(false, abi_not_found_exception, "No ABI found for ${contract}", ("contract", params.code));
    }
@@ -1872,11 +1933,10 @@ read_only::abi_json_to_bin_result read_only::abi_json_to_bin( const read_only::a
 
 read_only::abi_bin_to_json_result read_only::abi_bin_to_json( const read_only::abi_bin_to_json_params& params )const {
    abi_bin_to_json_result result;
-   const auto& code_account = db.db().get<account_object,by_name>( params.code );
-   abi_def abi;
-   if( abi_serializer::to_abi(code_account.abi, abi) ) {
-      abi_serializer abis( abi, abi_serializer_max_time );
-      result.args = abis.binary_to_variant( abis.get_action_type( params.action ), params.binargs, abi_serializer_max_time, shorten_abi_errors );
+   db.db().get<account_object,by_name>( params.code );
+   const auto abis = db.get_abi_serializer_cache().get( db.db(), params.code, abi_serializer_max_time );
+   if( abis.valid() ) {
+      result.args = abis->binary_to_variant( abis->get_action_type( params.action ), params.binargs, abi_serializer_max_time, shorten_abi_errors );
    } else {
       EOS_ASSERT(false, abi_not_found_exception, "No ABI found for ${contract}", ("contract", params.code));
    }
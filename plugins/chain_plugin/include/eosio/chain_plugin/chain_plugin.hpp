@@ -16,6 +16,7 @@
 #include <eosio/chain/plugin_interface.hpp>
 #include <eosio/chain/types.hpp>
 #include <eosio/chain/memory_db.hpp>
+#include <eosio/chain_plugin/vote_reward_index.hpp>
 
 #include <boost/container/flat_set.hpp>
 #include <boost/multiprecision/cpp_int.hpp>
@@ -44,6 +45,7 @@ namespace eosio {
    using chain::action_name;
    using chain::abi_def;
    using chain::abi_serializer;
+   using chain::cached_abi_serializer;
 
 namespace chain_apis {
 struct empty{};
@@ -75,12 +77,13 @@ class read_only {
    const controller& db;
    const fc::microseconds abi_serializer_max_time;
    bool  shorten_abi_errors = true;
+   vote_reward_index* vote_rewards = nullptr; ///< fixvotes sums kept by chain_plugin and filled by queries, walk fixvotes if null
 
 public:
    static const string KEYi64;
 
-   read_only(const controller& db, const fc::microseconds& abi_serializer_max_time)
-      : db(db), abi_serializer_max_time(abi_serializer_max_time) {}
+   read_only(const controller& db, const fc::microseconds& abi_serializer_max_time, vote_reward_index* vote_rewards = nullptr)
+      : db(db), abi_serializer_max_time(abi_serializer_max_time), vote_rewards(vote_rewards) {}
 
    void validate() const {}
 
@@ -109,6 +112,14 @@ public:
    };
    get_info_results get_info(const get_info_params&) const;
 
+   using get_wasm_cache_stats_params = empty;
+   using get_wasm_cache_stats_results = chain::wasm_interface::cache_stats;
+   get_wasm_cache_stats_results get_wasm_cache_stats(const get_wasm_cache_stats_params&) const;
+
+   using get_abi_cache_stats_params = empty;
+   using get_abi_cache_stats_results = chain::abi_serializer_cache::cache_stats;
+   get_abi_cache_stats_results get_abi_cache_stats(const get_abi_cache_stats_params&) const;
+
    struct producer_info {
       name                       producer_name;
    };
@@ -478,6 +489,24 @@ public:
 
    get_vote_rewards_result get_vote_rewards( const get_vote_rewards_params& params )const;
 
+   struct get_voter_rewards_params {
+      account_name voter = 0;
+   };
+
+   struct voter_bp_reward {
+      account_name bp_name           = 0;
+      asset        vote_reward;
+      uint128_t    vote_assetage_sum = 0;
+   };
+
+   struct get_voter_rewards_result {
+      vector<voter_bp_reward> rewards; ///< one for each bp voted by voter, current or fix-time
+      uint32_t                block_num = 0;
+   };
+
+   // get_voter_rewards get rewards of a voter from all bps it votes in one call
+   get_voter_rewards_result get_voter_rewards( const get_voter_rewards_params& params )const;
+
    struct get_producer_schedule_params {
    };
 
@@ -529,14 +558,13 @@ public:
    static uint64_t get_table_index_name(const read_only::get_table_rows_params& p, bool& primary);
 
    template <typename IndexType, typename SecKeyType, typename ConvFn>
-   read_only::get_table_rows_result get_table_rows_by_seckey( const read_only::get_table_rows_params& p, const abi_def& abi, ConvFn conv )const {
+   read_only::get_table_rows_result get_table_rows_by_seckey( const read_only::get_table_rows_params& p, const cached_abi_serializer& cached_abis, ConvFn conv )const {
       read_only::get_table_rows_result result;
       const auto& d = db.db();
+      const abi_serializer& abis = *cached_abis;
 
       uint64_t scope = convert_to_type<uint64_t>(p.scope, "scope");
 
-      abi_serializer abis;
-      abis.set_abi(abi, abi_serializer_max_time);
       bool primary = false;
       const uint64_t table_with_index = get_table_index_name(p, primary);
       const auto* t_id = d.find<chain::table_id_object, chain::by_code_scope_table>(boost::make_tuple(p.code, scope, p.table));
@@ -626,13 +654,12 @@ public:
    }
 
    template <typename IndexType>
-   read_only::get_table_rows_result get_table_rows_ex( const read_only::get_table_rows_params& p, const abi_def& abi )const {
+   read_only::get_table_rows_result get_table_rows_ex( const read_only::get_table_rows_params& p, const cached_abi_serializer& cached_abis )const {
       read_only::get_table_rows_result result;
       const auto& d = db.db();
+      const abi_serializer& abis = *cached_abis;
 
       uint64_t scope = convert_to_type<uint64_t>(p.scope, "scope");
-      abi_serializer abis;
-      abis.set_abi(abi, abi_serializer_max_time);
       const auto* t_id = d.find<chain::table_id_object, chain::by_code_scope_table>(boost::make_tuple(p.code, scope, p.table));
       if( t_id != nullptr ) {
          const auto& idx = d.get_index<IndexType, chain::by_scope_primary>();
@@ -642,7 +669,7 @@ public:
          //Return only rows that contain key.
          if( !p.table_key.empty()) {
             const auto& idxk = d.get_index<chain::key_value_index, chain::by_scope_primary>();
-            uint64_t t_key = get_table_key(p, abi);
+            uint64_t t_key = get_table_key(p, cached_abis.get_abi());
             lower = idxk.lower_bound(boost::make_tuple(t_id->id, t_key));
             upper = idxk.lower_bound(boost::make_tuple(next_tid, t_key));
             if( lower == idxk.end() || lower->t_id != t_id->id || t_key != lower->primary_key ) {
@@ -805,7 +832,7 @@ public:
    void plugin_startup();
    void plugin_shutdown();
 
-   chain_apis::read_only get_read_only_api() const { return chain_apis::read_only(chain(), get_abi_serializer_max_time()); }
+   chain_apis::read_only get_read_only_api() const;
    chain_apis::read_write get_read_write_api() { return chain_apis::read_write(chain(), get_abi_serializer_max_time()); }
 
    void accept_block( const chain::signed_block_ptr& block );
@@ -907,4 +934,7 @@ FC_REFLECT( eosio::chain_apis::read_only::get_chain_configs_result, (typ)(num)(k
 FC_REFLECT( eosio::chain_apis::read_only::get_action_fee_params, (account)(action) )
 FC_REFLECT( eosio::chain_apis::read_only::get_action_fee_result, (fee) )
 FC_REFLECT( eosio::chain_apis::read_only::get_vote_rewards_params, (voter)(bp_name) )
-FC_REFLECT( eosio::chain_apis::read_only::get_vote_rewards_result, (vote_reward)(vote_assetage_sum)(block_num)(ext_datas) )
\ No newline at end of file
+FC_REFLECT( eosio::chain_apis::read_only::get_vote_rewards_result, (vote_reward)(vote_assetage_sum)(block_num)(ext_datas) )
+FC_REFLECT( eosio::chain_apis::read_only::get_voter_rewards_params, (voter) )
+FC_REFLECT( eosio::chain_apis::read_only::voter_bp_reward, (bp_name)(vote_reward)(vote_assetage_sum) )
+FC_REFLECT( eosio::chain_apis::read_only::get_voter_rewards_result, (rewards)(block_num) )
\ No newline at end of file
@@ -0,0 +1,57 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+#include <eosio/chain/controller.hpp>
+
+#include <boost/container/flat_map.hpp>
+
+#include <mutex>
+
+namespace eosio { namespace chain_apis {
+
+   using chain::int128_t;
+   using chain::account_name;
+
+   // fix_vote_sum sum of fix-time votes from a voter to a bp,
+   // voteage of a vote is staked * (n - update_height) + age, so the sum at block n is staked * n + age_offset
+   struct fix_vote_sum {
+      int128_t staked     = 0; ///< sum of staked in units of core symbol
+      int128_t age_offset = 0; ///< sum of age - staked * update_height
+
+      int128_t voteage_at( uint32_t block_num )const {
+         return staked * static_cast<int128_t>(block_num) + age_offset;
+      }
+   };
+
+   using voter_fix_votes = boost::container::flat_map<account_name, fix_vote_sum>; ///< bp name to fix votes sum
+
+   // load_voter_fix_votes walk all fixvotes rows of voter and sum them by bp
+   voter_fix_votes load_voter_fix_votes( const chain::controller& chain, account_name voter );
+
+   /* vote_reward_index keeps the fixvotes sums of voters, so vote rewards are answered without walking fixvotes.
+    * The sums of a voter are loaded at first query and dropped when a fixvotes row in the scope of the voter
+    * is written, as reported by controller::fixvotes_changed for any action, inline or not. No signal is
+    * emitted for undo, so the voters changed in reversible blocks are dropped on each state undo too.
+    * Queries of the const read_only api fill it, so every method takes the mutex. load_or_get reads db,
+    * which is read on main thread only.
+    */
+   class vote_reward_index {
+      public:
+         // load_or_get sums of voter, loaded from db and kept if they are not in index
+         voter_fix_votes load_or_get( const chain::controller& chain, account_name voter );
+
+         void on_fixvotes_changed( account_name voter, uint32_t block_num );
+         void on_irreversible_block( uint32_t block_num );
+         void on_state_undone();
+
+         size_t size()const;
+
+      private:
+         mutable std::mutex                      mtx;
+         std::map<account_name, voter_fix_votes> voters;
+         std::map<account_name, uint32_t>        reversible_changed; ///< voter to last block num changed after lib
+   };
+
+} } // eosio::chain_apis
@@ -0,0 +1,78 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#include <eosio/chain_plugin/vote_reward_index.hpp>
+#include <eosio/chain/contract_table_objects.hpp>
+#include <eosio/chain/config.hpp>
+#include <eosio/chain/memory_db.hpp>
+
+namespace eosio { namespace chain_apis {
+
+   voter_fix_votes load_voter_fix_votes( const chain::controller& chain, account_name voter ) {
+      const auto& d = chain.db();
+      voter_fix_votes result;
+
+      const auto* t_id = d.find<chain::table_id_object, chain::by_code_scope_table>(
+            boost::make_tuple( chain::config::system_account_name, voter, N(fixvotes) ) );
+      if( t_id == nullptr ) return result;
+
+      const auto& idx = d.get_index<chain::key_value_index, chain::by_scope_primary>();
+      decltype(t_id->id) next_tid( t_id->id._id + 1 );
+      auto lower = idx.lower_bound( boost::make_tuple( t_id->id ) );
+      auto upper = idx.lower_bound( boost::make_tuple( next_tid ) );
+
+      chain::memory_db::votefix_info v;
+      for( auto itr = lower; itr != upper; ++itr ) {
+         fc::datastream<const char*> ds( itr->value.data(), itr->value.size() );
+         fc::raw::unpack( ds, v );
+
+         const auto staked = static_cast<int128_t>( v.votepower_age.staked.get_amount() / v.votepower_age.staked.precision() );
+         auto& sum = result[v.bpname];
+         sum.staked     += staked;
+         sum.age_offset += static_cast<int128_t>( v.votepower_age.age )
+                         - staked * static_cast<int128_t>( v.votepower_age.update_height );
+      }
+
+      return result;
+   }
+
+   voter_fix_votes vote_reward_index::load_or_get( const chain::controller& chain, account_name voter ) {
+      std::lock_guard<std::mutex> g( mtx );
+      auto itr = voters.find( voter );
+      if( itr == voters.end() ) {
+         itr = voters.emplace( voter, load_voter_fix_votes( chain, voter ) ).first;
+      }
+      return itr->second;
+   }
+
+   void vote_reward_index::on_fixvotes_changed( account_name voter, uint32_t block_num ) {
+      std::lock_guard<std::mutex> g( mtx );
+      voters.erase( voter );
+      reversible_changed[voter] = block_num;
+   }
+
+   void vote_reward_index::on_irreversible_block( uint32_t block_num ) {
+      std::lock_guard<std::mutex> g( mtx );
+      for( auto itr = reversible_changed.begin(); itr != reversible_changed.end(); ) {
+         if( itr->second <= block_num ) {
+            itr = reversible_changed.erase( itr );
+         } else {
+            ++itr;
+         }
+      }
+   }
+
+   void vote_reward_index::on_state_undone() {
+      std::lock_guard<std::mutex> g( mtx );
+      for( const auto& changed : reversible_changed ) {
+         voters.erase( changed.first );
+      }
+   }
+
+   size_t vote_reward_index::size()const {
+      std::lock_guard<std::mutex> g( mtx );
+      return voters.size();
+   }
+
+} } // eosio::chain_apis
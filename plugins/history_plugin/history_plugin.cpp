@@ -1,8 +1,9 @@
 #include <eosio/history_plugin/history_plugin.hpp>
-#include <eosio/history_plugin/account_control_history_object.hpp>
-#include <eosio/history_plugin/public_key_history_object.hpp>
+#include <eosio/history_plugin/history_store.hpp>
 #include <eosio/chain/controller.hpp>
 #include <eosio/chain/trace.hpp>
+#include <eosio/chain/contract_types.hpp>
+#include <eosio/chain/txfee_manager.hpp>
 #include <eosio/chain_plugin/chain_plugin.hpp>
 
 #include <fc/io/json.hpp>
@@ -17,109 +18,25 @@ namespace eosio {
    static appbase::abstract_plugin& _history_plugin = app().register_plugin<history_plugin>();
 
 
-   struct account_history_object : public chainbase::object<account_history_object_type, account_history_object>  {
-      OBJECT_CTOR( account_history_object );
-
-      id_type      id;
-      account_name account; ///< the name of the account which has this action in its history
-      uint64_t     action_sequence_num = 0; ///< the sequence number of the relevant action (global)
-      int32_t      account_sequence_num = 0; ///< the sequence number for this account (per-account)
-   };
-
-   struct action_history_object : public chainbase::object<action_history_object_type, action_history_object> {
-
-      OBJECT_CTOR( action_history_object, (packed_action_trace) );
-
-      id_type      id;
-      uint64_t     action_sequence_num; ///< the sequence number of the relevant action
-
-      shared_string        packed_action_trace;
-      uint32_t             block_num;
-      block_timestamp_type block_time;
-      transaction_id_type  trx_id;
-   };
-   using account_history_id_type = account_history_object::id_type;
-   using action_history_id_type  = action_history_object::id_type;
-
-
-   struct by_action_sequence_num;
-   struct by_account_action_seq;
-   struct by_trx_id;
-
-   using action_history_index = chainbase::shared_multi_index_container<
-      action_history_object,
-      indexed_by<
-         ordered_unique<tag<by_id>, member<action_history_object, action_history_object::id_type, &action_history_object::id>>,
-         ordered_unique<tag<by_action_sequence_num>, member<action_history_object, uint64_t, &action_history_object::action_sequence_num>>,
-         ordered_unique<tag<by_trx_id>,
-            composite_key< action_history_object,
-               member<action_history_object, transaction_id_type, &action_history_object::trx_id>,
-               member<action_history_object, uint64_t, &action_history_object::action_sequence_num >
-            >
-         >
-      >
-   >;
-
-   using account_history_index = chainbase::shared_multi_index_container<
-      account_history_object,
-      indexed_by<
-         ordered_unique<tag<by_id>, member<account_history_object, account_history_object::id_type, &account_history_object::id>>,
-         ordered_unique<tag<by_account_action_seq>,
-            composite_key< account_history_object,
-               member<account_history_object, account_name, &account_history_object::account >,
-               member<account_history_object, int32_t, &account_history_object::account_sequence_num >
-            >
-         >
-      >
-   >;
-
-} /// namespace eosio
-
-CHAINBASE_SET_INDEX_TYPE(eosio::account_history_object, eosio::account_history_index)
-CHAINBASE_SET_INDEX_TYPE(eosio::action_history_object, eosio::action_history_index)
-
-namespace eosio {
-
-   template<typename MultiIndex, typename LookupType>
-   static void remove(chainbase::database& db, const account_name& account_name, const permission_name& permission)
+   static auth_change make_auth_change( const account_name& account, const permission_name& permission, const authority& auth )
    {
-      const auto& idx = db.get_index<MultiIndex, LookupType>();
-      auto& mutable_idx = db.get_mutable_index<MultiIndex>();
-      while(!idx.empty()) {
-         auto key = boost::make_tuple(account_name, permission);
-         const auto& itr = idx.lower_bound(key);
-         if (itr == idx.end())
-            break;
-
-         const auto& range_end = idx.upper_bound(key);
-         if (itr == range_end)
-            break;
-
-         mutable_idx.remove(*itr);
+      auth_change result{ {account, permission} };
+      for( const auto& k : auth.keys ) {
+         result.keys.push_back( k.key );
       }
-   }
-
-   static void add(chainbase::database& db, const vector<key_weight>& keys, const account_name& name, const permission_name& permission)
-   {
-      for (auto pub_key_weight : keys ) {
-         db.create<public_key_history_object>([&](public_key_history_object& obj) {
-            obj.public_key = pub_key_weight.key;
-            obj.name = name;
-            obj.permission = permission;
-         });
+      for( const auto& a : auth.accounts ) {
+         result.controllers.push_back( a.permission.actor );
       }
+      return result;
    }
 
-   static void add(chainbase::database& db, const vector<permission_level_weight>& controlling_accounts, const account_name& account_name, const permission_name& permission)
-   {
-      for (auto controlling_account : controlling_accounts ) {
-         db.create<account_control_history_object>([&](account_control_history_object& obj) {
-            obj.controlled_account = account_name;
-            obj.controlled_permission = permission;
-            obj.controlling_account = controlling_account.permission.actor;
-         });
-      }
-   }
+   // pending_history history of the pending block of chain, it is added to store when the block is accepted
+   // and dropped when the block is aborted, so the store never has to undo speculative actions
+   struct pending_history {
+      block_state_ptr       block;
+      vector<history_entry> actions;
+      vector<auth_change>   auths;
+   };
 
    struct filter_entry {
       name receiver;
@@ -138,10 +55,15 @@ namespace eosio {
    class history_plugin_impl {
       public:
          bool bypass_filter = false;
+         bool compact_fee_traces = false;
+         bool restart_on_gap     = false;
          std::set<filter_entry> filter_on;
          std::set<filter_entry> filter_out;
          chain_plugin*          chain_plug = nullptr;
+         std::unique_ptr<history_store> store;
+         pending_history        pending;
          fc::optional<scoped_connection> applied_transaction_connection;
+         fc::optional<scoped_connection> accepted_block_connection;
 
           bool filter(const action_trace& act) {
             bool pass_on = false;
@@ -205,75 +127,76 @@ namespace eosio {
             return result;
          }
 
-         void record_account_action( account_name n, const base_action_trace& act ) {
-            auto& chain = chain_plug->chain();
-            chainbase::database& db = const_cast<chainbase::database&>( chain.db() ); // Override read-only access to state DB (highly unrecommended practice!)
-
-            const auto& idx = db.get_index<account_history_index, by_account_action_seq>();
-            auto itr = idx.lower_bound( boost::make_tuple( name(n.value+1), 0 ) );
-
-            uint64_t asn = 0;
-            if( itr != idx.begin() ) --itr;
-            if( itr->account == n )
-               asn = itr->account_sequence_num + 1;
-
-            //idump((n)(act.receipt.global_sequence)(asn));
-            const auto& a = db.create<account_history_object>( [&]( auto& aho ) {
-              aho.account = n;
-              aho.action_sequence_num = act.receipt.global_sequence;
-              aho.account_sequence_num = asn;
-            });
-            //idump((a.account)(a.action_sequence_num)(a.action_sequence_num));
+         // current_pending pending history of the current pending block, reset if the block is changed
+         pending_history& current_pending() {
+            const auto& bs = chain_plug->chain().pending_block_state();
+            if( pending.block != bs ) {
+               pending = pending_history{ bs };
+            }
+            return pending;
+         }
+
+         // get_pending pending history to read, nullptr if it is not of the current pending block
+         const pending_history* get_pending()const {
+            const auto& bs = chain_plug->chain().pending_block_state();
+            return bs && pending.block == bs ? &pending : nullptr;
          }
 
          void on_system_action( const action_trace& at ) {
-            auto& chain = chain_plug->chain();
-            chainbase::database& db = const_cast<chainbase::database&>( chain.db() ); // Override read-only access to state DB (highly unrecommended practice!)
             if( at.act.name == N(newaccount) )
             {
                const auto create = at.act.data_as<chain::newaccount>();
-               add(db, create.owner.keys, create.name, N(owner));
-               add(db, create.owner.accounts, create.name, N(owner));
-               add(db, create.active.keys, create.name, N(active));
-               add(db, create.active.accounts, create.name, N(active));
+               auto& auths = current_pending().auths;
+               auths.emplace_back( make_auth_change( create.name, N(owner), create.owner ) );
+               auths.emplace_back( make_auth_change( create.name, N(active), create.active ) );
             }
             else if( at.act.name == N(updateauth) )
             {
                const auto update = at.act.data_as<chain::updateauth>();
-               remove<public_key_history_multi_index, by_account_permission>(db, update.account, update.permission);
-               remove<account_control_history_multi_index, by_controlled_authority>(db, update.account, update.permission);
-               add(db, update.auth.keys, update.account, update.permission);
-               add(db, update.auth.accounts, update.account, update.permission);
+               current_pending().auths.emplace_back( make_auth_change( update.account, update.permission, update.auth ) );
             }
             else if( at.act.name == N(deleteauth) )
             {
                const auto del = at.act.data_as<chain::deleteauth>();
-               remove<public_key_history_multi_index, by_account_permission>(db, del.account, del.permission);
-               remove<account_control_history_multi_index, by_controlled_authority>(db, del.account, del.permission);
+               current_pending().auths.emplace_back( auth_change{ {del.account, del.permission} } );
             }
          }
 
-         void on_action_trace( const action_trace& at ) {
+         void add_history( const action_trace& at, const asset& fee, const set<account_name>& accounts ) {
+            //idump((fc::json::to_pretty_string(at)));
+            auto& chain = chain_plug->chain();
+
+            history_entry e;
+            e.action.global_sequence     = at.receipt.global_sequence;
+            e.action.block_num           = chain.pending_block_state()->block_num;
+            e.action.block_time          = chain.pending_block_time();
+            e.action.trx_id              = at.trx_id;
+            e.action.packed_action_trace = fc::raw::pack( at );
+            e.action.fee                 = fee;
+            e.accounts.insert( accounts.begin(), accounts.end() );
+
+            current_pending().actions.emplace_back( std::move(e) );
+         }
+
+         // add_fee_history fee actions tracked by themselves, in history of the receiver and the payer
+         void add_fee_history( const vector<const action_trace*>& fee_traces ) {
+            for( const auto* f : fee_traces ) {
+               // onfee and voteagefee has same data
+               add_history( *f, asset(), { f->receipt.receiver, fc::raw::unpack<chain::onfee>( f->act.data ).actor } );
+            }
+         }
+
+         // on_action_trace fee_traces are fee actions paid for at, folded into its fee if it is tracked,
+         // the fee is paid whatever the filter says, so they are tracked by themselves if at is not
+         void on_action_trace( const action_trace& at, const vector<const action_trace*>& fee_traces = {} ) {
             if( filter( at ) ) {
-               //idump((fc::json::to_pretty_string(at)));
-               auto& chain = chain_plug->chain();
-               chainbase::database& db = const_cast<chainbase::database&>( chain.db() ); // Override read-only access to state DB (highly unrecommended practice!)
-
-               db.create<action_history_object>( [&]( auto& aho ) {
-                  auto ps = fc::raw::pack_size( at );
-                  aho.packed_action_trace.resize(ps);
-                  datastream<char*> ds( aho.packed_action_trace.data(), ps );
-                  fc::raw::pack( ds, at );
-                  aho.action_sequence_num = at.receipt.global_sequence;
-                  aho.block_num = chain.pending_block_state()->block_num;
-                  aho.block_time = chain.pending_block_time();
-                  aho.trx_id     = at.trx_id;
-               });
-
-               auto aset = account_set( at );
-               for( auto a : aset ) {
-                  record_account_action( a, at );
+               asset fee;
+               for( const auto* f : fee_traces ) {
+                  fee += fc::raw::unpack<chain::onfee>( f->act.data ).fee;
                }
+               add_history( at, fee, account_set( at ) );
+            } else {
+               add_fee_history( fee_traces );
             }
             if( at.receipt.receiver == chain::config::system_account_name )
                on_system_action( at );
@@ -286,9 +209,101 @@ namespace eosio {
             if( !trace->receipt || (trace->receipt->status != transaction_receipt_header::executed &&
                   trace->receipt->status != transaction_receipt_header::soft_fail) )
                return;
+            // a fee action is dispatched before each action of trx, with history-compact-fee-traces
+            // it is not tracked by itself but folded into the fee of the action it is paid for
+            vector<const action_trace*> fee_traces;
             for( const auto& atrace : trace->action_traces ) {
-               on_action_trace( atrace );
+               if( compact_fee_traces && is_fee_action( atrace.act ) ) {
+                  fee_traces.push_back( &atrace );
+                  continue;
+               }
+               on_action_trace( atrace, fee_traces );
+               fee_traces.clear();
             }
+            add_fee_history( fee_traces );
+         }
+
+         // on_accepted_block add history of the block to store, a block applied again after a fork switch
+         // replaces the history of the old one in store
+         void on_accepted_block( const block_state_ptr& bs ) {
+            if( pending.block == bs ) {
+               store->add_block( bs->block_num, pending.actions, pending.auths );
+            } else {
+               store->add_block( bs->block_num, {}, {} );
+            }
+            pending = pending_history();
+         }
+
+         uint32_t account_action_count( account_name n )const {
+            uint32_t result = store->account_action_count( n );
+            if( const auto* p = get_pending() ) {
+               for( const auto& e : p->actions ) {
+                  result += e.accounts.count( n );
+               }
+            }
+            return result;
+         }
+
+         // get_account_action action of account by its account sequence, actions of pending block are after the stored ones
+         history_action get_account_action( account_name n, uint32_t account_sequence )const {
+            uint32_t seq = store->account_action_count( n );
+            if( account_sequence < seq ) {
+               return store->get_account_action( n, account_sequence );
+            }
+
+            const auto* p = get_pending();
+            EOS_ASSERT( p != nullptr, chain::plugin_exception, "no action ${s} in history of ${n}", ("s", account_sequence)("n", n) );
+            for( const auto& e : p->actions ) {
+               if( e.accounts.count( n ) && seq++ == account_sequence ) {
+                  return e.action;
+               }
+            }
+            EOS_THROW( chain::plugin_exception, "no action ${s} in history of ${n}", ("s", account_sequence)("n", n) );
+         }
+
+         // get_transaction_actions actions of the first trx id not less than lower_id and accepted by match, in store or pending block
+         vector<history_action> get_transaction_actions( const transaction_id_type& lower_id,
+                                                         const std::function<bool(const transaction_id_type&)>& match )const {
+            auto result = store->get_transaction_actions( lower_id, match );
+            const auto* p = get_pending();
+            if( p == nullptr ) return result;
+
+            fc::optional<transaction_id_type> pending_id;
+            for( const auto& e : p->actions ) {
+               const auto& id = e.action.trx_id;
+               if( !(id < lower_id) && match( id ) && ( !pending_id || id < *pending_id ) )
+                  pending_id = id;
+            }
+            if( !pending_id || ( !result.empty() && result.front().trx_id < *pending_id ) ) return result;
+
+            result.clear();
+            for( const auto& e : p->actions ) {
+               if( e.action.trx_id == *pending_id )
+                  result.push_back( e.action );
+            }
+            return result;
+         }
+
+         // get_accounts accounts having a permission accepted by match, auth changes of pending block override stored ones
+         template<typename Matcher>
+         vector<account_name> get_accounts( const vector<permission_level>& stored, Matcher&& match )const {
+            std::map<permission_level, const auth_change*> changed;
+            if( const auto* p = get_pending() ) {
+               for( const auto& a : p->auths ) {
+                  changed[a.permission] = &a;
+               }
+            }
+
+            std::set<account_name> accounts;
+            for( const auto& p : stored ) {
+               if( !changed.count( p ) )
+                  accounts.insert( p.actor );
+            }
+            for( const auto& c : changed ) {
+               if( match( *c.second ) )
+                  accounts.insert( c.first.actor );
+            }
+            return vector<account_name>( accounts.begin(), accounts.end() );
          }
    };
 
@@ -310,6 +325,18 @@ namespace eosio {
             ("filter-out,F", bpo::value<vector<string>>()->composing(),
              "Do not track actions which match receiver:action:actor. Action and Actor both blank excludes all from Reciever. Actor blank excludes all from reciever:action. Receiver may not be blank.")
             ;
+      cfg.add_options()
+            ("history-dir", bpo::value<bfs::path>()->default_value("history"),
+             "the location of the history directory (absolute path or relative to application data dir)")
+            ;
+      cfg.add_options()
+            ("history-compact-fee-traces", bpo::bool_switch()->default_value(false),
+             "Do not track onfee and voteagefee actions, record the fee in the action it is paid for instead.")
+            ;
+      cfg.add_options()
+            ("history-restart-on-gap", bpo::bool_switch()->default_value(false),
+             "Wipe the history in history-dir and restart it from the head block if the history does not reach the head block, instead of refusing to start.")
+            ;
    }
 
    void history_plugin::plugin_initialize(const variables_map& options) {
@@ -319,7 +346,7 @@ namespace eosio {
             for( auto& s : fo ) {
                if( s == "*" || s == "\"*\"" ) {
                   my->bypass_filter = true;
-                  wlog( "--filter-on * enabled. This can fill shared_mem, causing nodeos to stop." );
+                  wlog( "--filter-on * enabled. This can fill the disk of history-dir." );
                   break;
                }
                std::vector<std::string> v;
@@ -344,37 +371,44 @@ namespace eosio {
             }
          }
 
+         my->compact_fee_traces = options.at( "history-compact-fee-traces" ).as<bool>();
+         my->restart_on_gap     = options.at( "history-restart-on-gap" ).as<bool>();
+
          my->chain_plug = app().find_plugin<chain_plugin>();
          EOS_ASSERT( my->chain_plug, chain::missing_chain_plugin_exception, ""  );
          auto& chain = my->chain_plug->chain();
 
-         chainbase::database& db = const_cast<chainbase::database&>( chain.db() ); // Override read-only access to state DB (highly unrecommended practice!)
-         // TODO: Use separate chainbase database for managing the state of the history_plugin (or remove deprecated history_plugin entirely) 
-         db.add_index<account_history_index>();
-         db.add_index<action_history_index>();
-         db.add_index<account_control_history_multi_index>();
-         db.add_index<public_key_history_multi_index>();
+         auto dir_option = options.at( "history-dir" ).as<bfs::path>();
+         if( dir_option.is_relative() )
+            dir_option = app().data_dir() / dir_option;
+         my->store = std::make_unique<history_store>( dir_option, history_store::default_index_run_size,
+                                                      my->restart_on_gap );
 
          my->applied_transaction_connection.emplace(
                chain.applied_transaction.connect( [&]( const transaction_trace_ptr& p ) {
                   my->on_applied_transaction( p );
                } ));
+         my->accepted_block_connection.emplace(
+               chain.accepted_block.connect( [&]( const block_state_ptr& p ) {
+                  my->on_accepted_block( p );
+               } ));
       } FC_LOG_AND_RETHROW()
    }
 
    void history_plugin::plugin_startup() {
       auto& chain = my->chain_plug->chain();
-      if( chain.head_block_num() == 1 ) {
-         // Override read-only access to state DB (highly unrecommended practice!)
-         chainbase::database& db = const_cast<chainbase::database&>( chain.db());
-
+      EOS_ASSERT( my->store->empty() || my->store->end_block() > chain.head_block_num() || my->restart_on_gap,
+                  chain::plugin_exception,
+                  "history in history-dir has blocks ${b}-${e} but head block is ${h}, history would not be contiguous, "
+                  "remove the history directory or set history-restart-on-gap to wipe it",
+                  ("b", my->store->begin_block())("e", my->store->end_block() - 1)("h", chain.head_block_num()) );
+      if( chain.head_block_num() == 1 && my->store->empty() ) {
          genesis_state gs;
          const auto genesis_file = app().config_dir() / "genesis.json";
          gs = fc::json::from_file(genesis_file).as<genesis_state>();
 
          const auto spec_acc_in_gene = N(a);
-         const auto owner_pm_lv = vector<permission_level_weight>{{{1, config::owner_name}, 1}};
-         const auto active_pm_lv = vector<permission_level_weight>{{{1, config::active_name}, 1}};
+         vector<auth_change> auths;
 
          for( const auto& account : gs.initial_account_list ) {
             const auto& public_key = account.key;
@@ -387,16 +421,16 @@ namespace eosio {
                     ("pk_str", pk_str)("name_r", name_r)("acc", acc_name)("pb", public_key));
             }
 
-            add(db, vector<key_weight>(1, {public_key, 1}), acc_name, config::owner_name);
-            add(db, owner_pm_lv, acc_name, config::owner_name);
-            add(db, vector<key_weight>(1, {public_key, 1}), acc_name, config::active_name);
-            add(db, active_pm_lv, acc_name, config::active_name);
+            auths.emplace_back( auth_change{ {acc_name, config::owner_name}, {public_key}, {account_name(1)} } );
+            auths.emplace_back( auth_change{ {acc_name, config::active_name}, {public_key}, {account_name(1)} } );
          }
+         my->store->add_block( 1, {}, auths );
       }
    }
 
    void history_plugin::plugin_shutdown() {
       my->applied_transaction_connection.reset();
+      my->accepted_block_connection.reset();
    }
 
 
@@ -406,26 +440,17 @@ namespace eosio {
       read_only::get_actions_result read_only::get_actions( const read_only::get_actions_params& params )const {
          edump((params));
         auto& chain = history->chain_plug->chain();
-        const auto& db = chain.db();
         const auto abi_serializer_max_time = history->chain_plug->get_abi_serializer_max_time();
 
-        const auto& idx = db.get_index<account_history_index, by_account_action_seq>();
-
         int32_t start = 0;
         int32_t pos = params.pos ? *params.pos : -1;
         int32_t end = 0;
         int32_t offset = params.offset ? *params.offset : -20;
         auto n = params.account_name;
         idump((pos));
-        if( pos == -1 ) {
-            auto itr = idx.lower_bound( boost::make_tuple( name(n.value+1), 0 ) );
-            if( itr == idx.begin() ) {
-               if( itr->account == n )
-                  pos = itr->account_sequence_num+1;
-            } else if( itr != idx.begin() ) --itr;
-
-            if( itr->account == n )
-               pos = itr->account_sequence_num + 1;
+        const uint32_t count = history->account_action_count( n );
+        if( pos == -1 && count > 0 ) {
+            pos = count;
         }
 
         if( pos== -1 ) pos = 0xfffffff;
@@ -442,32 +467,31 @@ namespace eosio {
 
         idump((start)(end));
 
-        auto start_itr = idx.lower_bound( boost::make_tuple( n, start ) );
-        auto end_itr = idx.upper_bound( boost::make_tuple( n, end) );
-
         auto start_time = fc::time_point::now();
         auto end_time = start_time;
 
         get_actions_result result;
         result.last_irreversible_block = chain.last_irreversible_block_num();
-        while( start_itr != end_itr ) {
-           const auto& a = db.get<action_history_object, by_action_sequence_num>( start_itr->action_sequence_num );
+        for( int64_t seq = std::max( start, 0 ); seq <= end && seq < count; ++seq ) {
+           const auto a = history->get_account_action( n, seq );
            fc::datastream<const char*> ds( a.packed_action_trace.data(), a.packed_action_trace.size() );
            action_trace t;
            fc::raw::unpack( ds, t );
            result.actions.emplace_back( ordered_action_result{
-                                 start_itr->action_sequence_num,
-                                 start_itr->account_sequence_num,
+                                 a.global_sequence,
+                                 static_cast<int32_t>(seq),
                                  a.block_num, a.block_time,
                                  chain.to_variant_with_abi(t, abi_serializer_max_time)
                                  });
+           if( a.fee.get_amount() != 0 ) {
+              result.actions.back().fee = a.fee;
+           }
 
            end_time = fc::time_point::now();
            if( end_time - start_time > fc::microseconds(100000) ) {
               result.time_limit_exceeded_error = true;
               break;
            }
-           ++start_itr;
         }
         return result;
       }
@@ -496,11 +520,9 @@ namespace eosio {
             return (*(input_id.data() + input_id_size) & 0xF0) == (*(id.data() + input_id_size) & 0xF0);
          };
 
-         const auto& db = chain.db();
-         const auto& idx = db.get_index<action_history_index, by_trx_id>();
-         auto itr = idx.lower_bound( boost::make_tuple( input_id ) );
+         const auto actions = history->get_transaction_actions( input_id, txn_id_matched );
 
-         bool in_history = (itr != idx.end() && txn_id_matched(itr->trx_id) );
+         bool in_history = !actions.empty();
 
          if( !in_history && !p.block_num_hint ) {
             EOS_THROW(tx_not_found, "Transaction ${id} not found in history and no block hint was given", ("id",p.id));
@@ -509,19 +531,16 @@ namespace eosio {
          get_transaction_result result;
 
          if( in_history ) {
-            result.id         = itr->trx_id;
+            result.id         = actions.front().trx_id;
             result.last_irreversible_block = chain.last_irreversible_block_num();
-            result.block_num  = itr->block_num;
-            result.block_time = itr->block_time;
+            result.block_num  = actions.front().block_num;
+            result.block_time = actions.front().block_time;
 
-            while( itr != idx.end() && itr->trx_id == result.id ) {
-
-              fc::datastream<const char*> ds( itr->packed_action_trace.data(), itr->packed_action_trace.size() );
+            for( const auto& a : actions ) {
+              fc::datastream<const char*> ds( a.packed_action_trace.data(), a.packed_action_trace.size() );
               action_trace t;
               fc::raw::unpack( ds, t );
               result.traces.emplace_back( chain.to_variant_with_abi(t, abi_serializer_max_time) );
-
-              ++itr;
             }
 
             auto blk = chain.fetch_block_by_number( result.block_num );
@@ -595,23 +614,17 @@ namespace eosio {
       }
 
       read_only::get_key_accounts_results read_only::get_key_accounts(const get_key_accounts_params& params) const {
-         std::set<account_name> accounts;
-         const auto& db = history->chain_plug->chain().db();
-         const auto& pub_key_idx = db.get_index<public_key_history_multi_index, by_pub_key>();
-         auto range = pub_key_idx.equal_range( params.public_key );
-         for (auto obj = range.first; obj != range.second; ++obj)
-            accounts.insert(obj->name);
-         return {vector<account_name>(accounts.begin(), accounts.end())};
+         const auto& key = params.public_key;
+         return {history->get_accounts( history->store->get_key_permissions( key ), [&key]( const auth_change& a ) {
+            return std::find( a.keys.begin(), a.keys.end(), key ) != a.keys.end();
+         })};
       }
 
       read_only::get_controlled_accounts_results read_only::get_controlled_accounts(const get_controlled_accounts_params& params) const {
-         std::set<account_name> accounts;
-         const auto& db = history->chain_plug->chain().db();
-         const auto& account_control_idx = db.get_index<account_control_history_multi_index, by_controlling>();
-         auto range = account_control_idx.equal_range( params.controlling_account );
-         for (auto obj = range.first; obj != range.second; ++obj)
-            accounts.insert(obj->controlled_account);
-         return {vector<account_name>(accounts.begin(), accounts.end())};
+         const auto& controlling = params.controlling_account;
+         return {history->get_accounts( history->store->get_controlled_permissions( controlling ), [&controlling]( const auth_change& a ) {
+            return std::find( a.controllers.begin(), a.controllers.end(), controlling ) != a.controllers.end();
+         })};
       }
 
    } /// history_apis
@@ -0,0 +1,605 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#include <eosio/history_plugin/history_store.hpp>
+#include <eosio/chain/exceptions.hpp>
+
+#include <fc/io/raw.hpp>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <tuple>
+
+namespace eosio { namespace detail {
+
+   struct history_block_summary {
+      uint32_t block_num    = 0;
+      uint64_t actions_end  = 0;
+      uint64_t accounts_end = 0;
+      uint64_t trxs_end     = 0;
+      uint64_t auth_end     = 0;
+   };
+
+   // history_auth_record a auth change with what it replaced, so it can be reverted on truncate
+   struct history_auth_record {
+      uint32_t                block_num = 0;
+      auth_change             change;
+      vector<public_key_type> prev_keys;
+      vector<account_name>    prev_controllers;
+   };
+
+} } /// namespace eosio::detail
+
+FC_REFLECT( eosio::detail::history_block_summary, (block_num)(actions_end)(accounts_end)(trxs_end)(auth_end) )
+FC_REFLECT( eosio::detail::history_auth_record, (block_num)(change)(prev_keys)(prev_controllers) )
+
+namespace eosio {
+
+   using namespace detail;
+   namespace bfs = boost::filesystem;
+
+   static const char* const actions_log_name     = "actions.log";
+   static const char* const blocks_index_name    = "blocks.index";
+   static const char* const accounts_index_name  = "accounts.index";
+   static const char* const accounts_sorted_name = "accounts.sorted";
+   static const char* const trx_index_name       = "trx.index";
+   static const char* const trx_sorted_name      = "trx.sorted";
+   static const char* const auth_log_name        = "auth.log";
+
+   // records in index files are fixed size
+   template<typename T>
+   static uint64_t record_size() {
+      static const uint64_t size = fc::raw::pack_size( T{} );
+      return size;
+   }
+
+   template<typename T>
+   static void append( std::fstream& f, const T& v ) {
+      const auto data = fc::raw::pack( v );
+      f.write( data.data(), data.size() );
+   }
+
+   static vector<char> read_bytes( std::fstream& f, uint64_t begin, uint64_t end ) {
+      vector<char> buffer( end - begin );
+      f.seekg( begin );
+      f.read( buffer.data(), buffer.size() );
+      EOS_ASSERT( f.good(), chain::plugin_exception, "failed to read history store" );
+      return buffer;
+   }
+
+   // read_records read records [begin, end) of a index file
+   template<typename T>
+   static vector<T> read_records( std::fstream& f, uint64_t begin, uint64_t end ) {
+      const auto buffer = read_bytes( f, begin * record_size<T>(), end * record_size<T>() );
+      vector<T> result( end - begin );
+      fc::datastream<const char*> ds( buffer.data(), buffer.size() );
+      for( auto& r : result ) {
+         fc::raw::unpack( ds, r );
+      }
+      return result;
+   }
+
+   // for_each_record walk records [begin, end) of a index file in chunks, they can be too many to read at once
+   template<typename T, typename F>
+   static void for_each_record( std::fstream& f, uint64_t begin, uint64_t end, F&& f_record ) {
+      const uint64_t chunk = 64 * 1024;
+      for( ; begin < end; begin += chunk ) {
+         for( const auto& r : read_records<T>( f, begin, std::min( begin + chunk, end ) ) ) {
+            f_record( r );
+         }
+      }
+   }
+
+   static uint64_t size_of( const fc::path& p ) {
+      return bfs::exists( p.generic_string() ) ? bfs::file_size( p.generic_string() ) : 0;
+   }
+
+   static void open_file( std::fstream& f, const fc::path& p ) {
+      f.open( p.generic_string(), std::ios_base::binary | std::ios_base::in | std::ios_base::out | std::ios_base::app );
+      EOS_ASSERT( f.is_open(), chain::plugin_exception, "failed to open ${f}", ("f", p.generic_string()) );
+   }
+
+   // a block is complete once its summary is written, drop_tail drop anything written after the last one
+   static void drop_tail( const fc::path& p, uint64_t end ) {
+      EOS_ASSERT( size_of( p ) >= end, chain::plugin_exception, "corrupt ${f}, it is shorter than ${e} bytes",
+                  ("f", p.generic_string())("e", end) );
+      if( size_of( p ) > end ) {
+         wlog( "drop ${n} bytes of incomplete block from ${f}", ("n", size_of( p ) - end)("f", p.generic_string()) );
+         bfs::resize_file( p.generic_string(), end );
+      }
+   }
+
+   // partition_point the first index in [first, last) not accepted by pred, pred accepts a prefix of it
+   template<typename Pred>
+   static uint64_t partition_point( uint64_t first, uint64_t last, Pred&& pred ) {
+      while( first < last ) {
+         const uint64_t mid = first + ( last - first ) / 2;
+         if( pred( mid ) ) {
+            first = mid + 1;
+         } else {
+            last = mid;
+         }
+      }
+      return first;
+   }
+
+   // the sorted file of a history_index starts with the run size
+   static const uint64_t sorted_header_size = sizeof(uint64_t);
+
+   // mapped_record read record i of a mapping of records
+   template<typename T>
+   static T mapped_record( const char* data, uint64_t i ) {
+      fc::datastream<const char*> ds( data + i * record_size<T>(), record_size<T>() );
+      T result;
+      fc::raw::unpack( ds, result );
+      return result;
+   }
+
+   template<typename Key>
+   history_index<Key>::history_index( const fc::path& index_path, const fc::path& sorted_path, uint64_t run_size )
+   :index_path( index_path ), sorted_path( sorted_path ), run_size( run_size )
+   {
+      EOS_ASSERT( run_size > 0, chain::plugin_exception, "run size of history index must be positive" );
+   }
+
+   template<typename Key>
+   history_index<Key>::~history_index() {
+      index.flush();
+      sorted.flush();
+   }
+
+   template<typename Key>
+   uint64_t history_index<Key>::run_bytes()const {
+      return run_size * record_size<record>();
+   }
+
+   template<typename Key>
+   void history_index<Key>::open( uint64_t end ) {
+      drop_tail( index_path, end * record_size<record>() );
+      open_file( index, index_path );
+      _end = end;
+
+      uint64_t sorted_run_size = 0;
+      if( size_of( sorted_path ) >= sorted_header_size ) {
+         std::ifstream f( sorted_path.generic_string(), std::ios_base::binary );
+         f.read( reinterpret_cast<char*>( &sorted_run_size ), sorted_header_size );
+      }
+      if( sorted_run_size != run_size ) {
+         if( bfs::exists( sorted_path.generic_string() ) ) {
+            wlog( "${f} is sorted in runs of ${o} records, sort it again in runs of ${n}",
+                  ("f", sorted_path.generic_string())("o", sorted_run_size)("n", run_size) );
+         }
+         std::ofstream f( sorted_path.generic_string(), std::ios_base::binary | std::ios_base::trunc );
+         f.write( reinterpret_cast<const char*>( &run_size ), sorted_header_size );
+         EOS_ASSERT( f.good(), chain::plugin_exception, "failed to write ${f}", ("f", sorted_path.generic_string()) );
+      }
+
+      // runs of dropped records are dropped too, a partly written run is sorted again
+      runs = std::min( ( size_of( sorted_path ) - sorted_header_size ) / run_bytes(), _end / run_size );
+      bfs::resize_file( sorted_path.generic_string(), sorted_header_size + runs * run_bytes() );
+      open_file( sorted, sorted_path );
+
+      load_tail();
+      sort_runs();
+   }
+
+   template<typename Key>
+   void history_index<Key>::append( const Key& key, uint64_t pos ) {
+      eosio::append( index, record{ key, pos } );
+      tail[key].push_back( pos );
+      ++_end;
+   }
+
+   template<typename Key>
+   void history_index<Key>::flush() {
+      index.flush();
+   }
+
+   template<typename Key>
+   bool history_index<Key>::good()const {
+      return index.good();
+   }
+
+   template<typename Key>
+   void history_index<Key>::sort_runs() {
+      if( runs == _end / run_size ) return;
+
+      index.flush();
+      for( ; runs < _end / run_size; ++runs ) {
+         auto records = read_records<record>( index, runs * run_size, ( runs + 1 ) * run_size );
+         std::sort( records.begin(), records.end(), []( const record& a, const record& b ) {
+            return std::tie( a.key, a.pos ) < std::tie( b.key, b.pos );
+         });
+
+         vector<char> data( run_bytes() );
+         fc::datastream<char*> ds( data.data(), data.size() );
+         for( const auto& r : records ) {
+            fc::raw::pack( ds, r );
+         }
+         sorted.write( data.data(), data.size() );
+      }
+      sorted.flush();
+      EOS_ASSERT( sorted.good(), chain::plugin_exception, "failed to write ${f}", ("f", sorted_path.generic_string()) );
+
+      load_tail();
+   }
+
+   template<typename Key>
+   void history_index<Key>::truncate( uint64_t end ) {
+      index.flush();
+      sorted.flush();
+
+      // the mapping must not outlive the part of the sorted file it maps
+      sorted_region.reset();
+      sorted_mapping.reset();
+
+      runs = std::min( runs, end / run_size );
+      bfs::resize_file( index_path.generic_string(), end * record_size<record>() );
+      bfs::resize_file( sorted_path.generic_string(), sorted_header_size + runs * run_bytes() );
+      _end = end;
+
+      load_tail();
+   }
+
+   template<typename Key>
+   void history_index<Key>::load_tail() {
+      tail.clear();
+      for_each_record<record>( index, runs * run_size, _end, [this]( const record& r ) {
+         tail[r.key].push_back( r.pos );
+      });
+   }
+
+   template<typename Key>
+   const char* history_index<Key>::map_sorted()const {
+      if( runs == 0 ) return nullptr;
+
+      const uint64_t size = sorted_header_size + runs * run_bytes();
+      if( !sorted_region || sorted_region->get_size() < size ) {
+         using namespace boost::interprocess;
+         sorted_region.reset();
+         sorted_mapping.reset( new file_mapping( sorted_path.generic_string().c_str(), read_only ) );
+         sorted_region.reset( new mapped_region( *sorted_mapping, read_only, 0, size ) );
+      }
+      return static_cast<const char*>( sorted_region->get_address() ) + sorted_header_size;
+   }
+
+   // equal_range records of key in a run, as record numbers in the sorted file
+   template<typename Key>
+   std::pair<uint64_t, uint64_t> history_index<Key>::equal_range( const char* sorted_data, uint64_t run, const Key& key )const {
+      const auto key_at = [&]( uint64_t i ) {
+         return mapped_record<record>( sorted_data, i ).key;
+      };
+      const uint64_t first = partition_point( run * run_size, ( run + 1 ) * run_size, [&]( uint64_t i ) {
+         return key_at( i ) < key;
+      });
+      const uint64_t last = partition_point( first, ( run + 1 ) * run_size, [&]( uint64_t i ) {
+         return !( key < key_at( i ) );
+      });
+      return { first, last };
+   }
+
+   template<typename Key>
+   uint64_t history_index<Key>::count( const Key& key )const {
+      uint64_t result = 0;
+      const char* data = map_sorted();
+      for( uint64_t r = 0; r < runs; ++r ) {
+         const auto range = equal_range( data, r, key );
+         result += range.second - range.first;
+      }
+      auto itr = tail.find( key );
+      return itr == tail.end() ? result : result + itr->second.size();
+   }
+
+   template<typename Key>
+   fc::optional<uint64_t> history_index<Key>::get( const Key& key, uint64_t sequence )const {
+      const char* data = map_sorted();
+      for( uint64_t r = 0; r < runs; ++r ) {
+         const auto range = equal_range( data, r, key );
+         if( sequence < range.second - range.first ) {
+            return mapped_record<record>( data, range.first + sequence ).pos;
+         }
+         sequence -= range.second - range.first;
+      }
+      auto itr = tail.find( key );
+      if( itr == tail.end() || sequence >= itr->second.size() ) return {};
+      return itr->second[sequence];
+   }
+
+   template<typename Key>
+   fc::optional<Key> history_index<Key>::lower_bound( const Key& key )const {
+      fc::optional<Key> result;
+      auto itr = tail.lower_bound( key );
+      if( itr != tail.end() ) result = itr->first;
+
+      const char* data = map_sorted();
+      for( uint64_t r = 0; r < runs; ++r ) {
+         const auto first = equal_range( data, r, key ).first;
+         if( first == ( r + 1 ) * run_size ) continue;
+
+         const auto found = mapped_record<record>( data, first ).key;
+         if( !result || found < *result ) result = found;
+      }
+      return result;
+   }
+
+   template<typename Key>
+   vector<uint64_t> history_index<Key>::positions( const Key& key )const {
+      vector<uint64_t> result;
+      const char* data = map_sorted();
+      for( uint64_t r = 0; r < runs; ++r ) {
+         const auto range = equal_range( data, r, key );
+         for( auto i = range.first; i < range.second; ++i ) {
+            result.push_back( mapped_record<record>( data, i ).pos );
+         }
+      }
+      auto itr = tail.find( key );
+      if( itr != tail.end() ) result.insert( result.end(), itr->second.begin(), itr->second.end() );
+      return result;
+   }
+
+   template<typename Key>
+   static void erase_permission( std::multimap<Key, permission_level>& index, const Key& k, const permission_level& p ) {
+      auto range = index.equal_range( k );
+      for( auto itr = range.first; itr != range.second; ++itr ) {
+         if( itr->second == p ) {
+            index.erase( itr );
+            return;
+         }
+      }
+   }
+
+   history_store::history_store( const fc::path& dir, uint64_t index_run_size, bool restart_on_gap )
+   :dir( dir )
+   ,accounts( dir / accounts_index_name, dir / accounts_sorted_name, index_run_size )
+   ,trxs( dir / trx_index_name, dir / trx_sorted_name, index_run_size )
+   ,restart_on_gap( restart_on_gap )
+   {
+      if( !fc::is_directory( dir ) )
+         fc::create_directories( dir );
+
+      open();
+      load_authorities();
+
+      if( empty() ) {
+         ilog( "history store is empty" );
+      } else {
+         ilog( "history store has blocks ${b}-${e}, ${a} actions", ("b", _begin_block)("e", _end_block - 1)("a", trxs.end()) );
+      }
+   }
+
+   history_store::~history_store() {
+      actions_log.flush();
+      auth_log.flush();
+      blocks_index.flush();
+   }
+
+   void history_store::open() {
+      open_file( blocks_index, dir / blocks_index_name );
+
+      history_block_summary last;
+      const uint64_t summaries = size_of( dir / blocks_index_name ) / record_size<history_block_summary>();
+      if( summaries > 0 ) {
+         const auto first = read_records<history_block_summary>( blocks_index, 0, 1 ).front();
+         last = read_records<history_block_summary>( blocks_index, summaries - 1, summaries ).front();
+         EOS_ASSERT( last.block_num >= first.block_num && last.block_num - first.block_num + 1 == summaries,
+                     chain::plugin_exception, "corrupt ${f}", ("f", ( dir / blocks_index_name ).generic_string()) );
+
+         _begin_block = first.block_num;
+         _end_block   = last.block_num + 1;
+         actions_end  = last.actions_end;
+         auth_end     = last.auth_end;
+      }
+
+      blocks_index.close();
+      drop_tail( dir / blocks_index_name, summaries * record_size<history_block_summary>() );
+      drop_tail( dir / actions_log_name,  actions_end );
+      drop_tail( dir / auth_log_name,     auth_end );
+
+      open_file( blocks_index, dir / blocks_index_name );
+      open_file( actions_log,  dir / actions_log_name );
+      open_file( auth_log,     dir / auth_log_name );
+      accounts.open( last.accounts_end );
+      trxs.open( last.trxs_end );
+   }
+
+   void history_store::load_authorities() {
+      const auto auths = read_bytes( auth_log, 0, auth_end );
+      fc::datastream<const char*> ds( auths.data(), auths.size() );
+      while( ds.remaining() ) {
+         history_auth_record r;
+         fc::raw::unpack( ds, r );
+         set_auth( r.change.permission, r.change.keys, r.change.controllers );
+      }
+   }
+
+   void history_store::add_block( uint32_t block_num, const vector<history_entry>& actions, const vector<auth_change>& auths ) {
+      if( !empty() && block_num < _end_block ) {
+         truncate( block_num );
+      } else if( !empty() && block_num > _end_block ) {
+         EOS_ASSERT( restart_on_gap, chain::plugin_exception,
+                     "history store has blocks ${b}-${e} but got block ${n}, "
+                     "remove the history directory or set history-restart-on-gap to restart the history from it",
+                     ("b", _begin_block)("e", _end_block - 1)("n", block_num) );
+         wlog( "history store has blocks ${b}-${e} but got block ${n}, wipe it and restart the history from it",
+               ("b", _begin_block)("e", _end_block - 1)("n", block_num) );
+         truncate( _begin_block );
+      }
+
+      for( const auto& e : actions ) {
+         const uint64_t pos  = actions_end;
+         const auto     data = fc::raw::pack( e.action );
+         actions_log.write( data.data(), data.size() );
+         actions_end += data.size();
+
+         for( const auto& a : e.accounts ) {
+            accounts.append( a, pos );
+         }
+         trxs.append( e.action.trx_id, pos );
+      }
+
+      for( const auto& a : auths ) {
+         history_auth_record r{ block_num, a };
+         auto itr = authorities.find( a.permission );
+         if( itr != authorities.end() ) {
+            r.prev_keys        = itr->second.keys;
+            r.prev_controllers = itr->second.controllers;
+         }
+         const auto data = fc::raw::pack( r );
+         auth_log.write( data.data(), data.size() );
+         auth_end += data.size();
+
+         set_auth( a.permission, a.keys, a.controllers );
+      }
+
+      actions_log.flush();
+      accounts.flush();
+      trxs.flush();
+      auth_log.flush();
+      EOS_ASSERT( actions_log.good() && accounts.good() && trxs.good() && auth_log.good(),
+                  chain::plugin_exception, "failed to write history of block ${b}", ("b", block_num) );
+
+      // the summary is written last, a block without it is dropped on open
+      append( blocks_index, history_block_summary{ block_num, actions_end, accounts.end(), trxs.end(), auth_end } );
+      blocks_index.flush();
+
+      accounts.sort_runs();
+      trxs.sort_runs();
+
+      if( empty() ) _begin_block = block_num;
+      _end_block = block_num + 1;
+   }
+
+   void history_store::truncate( uint32_t block_num ) {
+      const uint32_t num_removed = _end_block - std::max( block_num, _begin_block );
+
+      actions_log.flush();
+      auth_log.flush();
+      blocks_index.flush();
+
+      history_block_summary end;
+      if( block_num <= _begin_block ) {
+         authorities.clear();
+         key_permissions.clear();
+         controlled_permissions.clear();
+         _begin_block = _end_block = 0;
+      } else {
+         end = read_records<history_block_summary>( blocks_index, block_num - 1 - _begin_block, block_num - _begin_block ).front();
+
+         vector<history_auth_record> auths;
+         const auto auth_data = read_bytes( auth_log, end.auth_end, auth_end );
+         fc::datastream<const char*> ds( auth_data.data(), auth_data.size() );
+         while( ds.remaining() ) {
+            auths.emplace_back();
+            fc::raw::unpack( ds, auths.back() );
+         }
+         for( auto itr = auths.rbegin(); itr != auths.rend(); ++itr ) {
+            set_auth( itr->change.permission, itr->prev_keys, itr->prev_controllers );
+         }
+
+         _end_block = block_num;
+      }
+
+      // the mapping must not outlive the part of actions.log it maps
+      actions_region.reset();
+      actions_mapping.reset();
+
+      const auto blocks_end = static_cast<uint64_t>( _end_block - _begin_block ) * record_size<history_block_summary>();
+      bfs::resize_file( ( dir / blocks_index_name ).generic_string(), blocks_end );
+      bfs::resize_file( ( dir / actions_log_name ).generic_string(),  end.actions_end );
+      bfs::resize_file( ( dir / auth_log_name ).generic_string(),     end.auth_end );
+      accounts.truncate( end.accounts_end );
+      trxs.truncate( end.trxs_end );
+
+      actions_end = end.actions_end;
+      auth_end    = end.auth_end;
+
+      ilog( "fork or replay: removed history of ${n} blocks", ("n", num_removed) );
+   }
+
+   void history_store::set_auth( const permission_level& permission, const vector<public_key_type>& keys,
+                                 const vector<account_name>& controllers ) {
+      auto itr = authorities.find( permission );
+      if( itr != authorities.end() ) {
+         for( const auto& k : itr->second.keys ) {
+            erase_permission( key_permissions, k, permission );
+         }
+         for( const auto& c : itr->second.controllers ) {
+            erase_permission( controlled_permissions, c, permission );
+         }
+         authorities.erase( itr );
+      }
+
+      // a deleted permission
+      if( keys.empty() && controllers.empty() ) return;
+
+      authorities.emplace( permission, auth_value{ keys, controllers } );
+      for( const auto& k : keys ) {
+         key_permissions.emplace( k, permission );
+      }
+      for( const auto& c : controllers ) {
+         controlled_permissions.emplace( c, permission );
+      }
+   }
+
+   history_action history_store::read_action( uint64_t pos )const {
+      EOS_ASSERT( pos < actions_end, chain::plugin_exception, "read non-existing action in history store" );
+
+      if( !actions_region || pos >= actions_region->get_size() ) {
+         using namespace boost::interprocess;
+         actions_region.reset();
+         actions_mapping.reset( new file_mapping( ( dir / actions_log_name ).generic_string().c_str(), read_only ) );
+         actions_region.reset( new mapped_region( *actions_mapping, read_only, 0, actions_end ) );
+      }
+
+      const char* data = static_cast<const char*>( actions_region->get_address() );
+      fc::datastream<const char*> ds( data + pos, actions_region->get_size() - pos );
+      history_action result;
+      fc::raw::unpack( ds, result );
+      return result;
+   }
+
+   uint32_t history_store::account_action_count( account_name n )const {
+      return accounts.count( n );
+   }
+
+   history_action history_store::get_account_action( account_name n, uint32_t account_sequence )const {
+      const auto pos = accounts.get( n, account_sequence );
+      EOS_ASSERT( pos.valid(), chain::plugin_exception, "no action ${s} in history of ${n}", ("s", account_sequence)("n", n) );
+      return read_action( *pos );
+   }
+
+   vector<history_action> history_store::get_transaction_actions( const transaction_id_type& lower_id,
+                                                                  const std::function<bool(const transaction_id_type&)>& match )const {
+      vector<history_action> result;
+      const auto id = trxs.lower_bound( lower_id );
+      if( !id || !match( *id ) ) return result;
+
+      const auto positions = trxs.positions( *id );
+      result.reserve( positions.size() );
+      for( const auto pos : positions ) {
+         result.emplace_back( read_action( pos ) );
+      }
+      return result;
+   }
+
+   vector<permission_level> history_store::get_key_permissions( const public_key_type& key )const {
+      vector<permission_level> result;
+      auto range = key_permissions.equal_range( key );
+      for( auto itr = range.first; itr != range.second; ++itr ) {
+         result.push_back( itr->second );
+      }
+      return result;
+   }
+
+   vector<permission_level> history_store::get_controlled_permissions( account_name controlling )const {
+      vector<permission_level> result;
+      auto range = controlled_permissions.equal_range( controlling );
+      for( auto itr = range.first; itr != range.second; ++itr ) {
+         result.push_back( itr->second );
+      }
+      return result;
+   }
+
+} /// namespace eosio
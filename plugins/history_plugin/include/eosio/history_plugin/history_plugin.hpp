@@ -42,6 +42,7 @@ class read_only {
          uint32_t                     block_num;
          chain::block_timestamp_type  block_time;
          fc::variant                  action_trace;
+         optional<chain::asset>       fee; ///< fee paid for the action, set when fee traces are compacted
       };
 
       struct get_actions_result {
@@ -139,7 +140,7 @@ class history_plugin : public plugin<history_plugin> {
 
 FC_REFLECT( eosio::history_apis::read_only::get_actions_params, (account_name)(pos)(offset) )
 FC_REFLECT( eosio::history_apis::read_only::get_actions_result, (actions)(last_irreversible_block)(time_limit_exceeded_error) )
-FC_REFLECT( eosio::history_apis::read_only::ordered_action_result, (global_action_seq)(account_action_seq)(block_num)(block_time)(action_trace) )
+FC_REFLECT( eosio::history_apis::read_only::ordered_action_result, (global_action_seq)(account_action_seq)(block_num)(block_time)(action_trace)(fee) )
 
 FC_REFLECT( eosio::history_apis::read_only::get_transaction_params, (id)(block_num_hint) )
 FC_REFLECT( eosio::history_apis::read_only::get_transaction_result, (id)(trx)(block_time)(block_num)(last_irreversible_block)(traces) )
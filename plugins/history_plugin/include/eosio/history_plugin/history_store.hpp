@@ -0,0 +1,197 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <eosio/chain/types.hpp>
+#include <eosio/chain/action.hpp>
+#include <eosio/chain/asset.hpp>
+#include <eosio/chain/block_timestamp.hpp>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+
+namespace eosio {
+   using chain::account_name;
+   using chain::permission_name;
+   using chain::permission_level;
+   using chain::public_key_type;
+   using chain::transaction_id_type;
+   using chain::block_timestamp_type;
+   using chain::bytes;
+   using chain::flat_set;
+   using std::vector;
+
+   // history_action a action trace tracked by history_plugin
+   struct history_action {
+      uint64_t              global_sequence = 0;
+      uint32_t              block_num       = 0;
+      block_timestamp_type  block_time;
+      transaction_id_type   trx_id;
+      bytes                 packed_action_trace;
+      chain::asset          fee; ///< fee actions folded into this action by history-compact-fee-traces
+   };
+
+   // history_entry a action with the accounts which have it in their history
+   struct history_entry {
+      history_action         action;
+      flat_set<account_name> accounts;
+   };
+
+   // auth_change keys and controlling accounts of a permission after a system action, both empty if it is deleted
+   struct auth_change {
+      permission_level        permission;
+      vector<public_key_type> keys;
+      vector<account_name>    controllers;
+   };
+
+   // history_index_record a record of a history index, the key and the position of a action in actions.log
+   template<typename Key>
+   struct history_index_record {
+      Key      key;
+      uint64_t pos = 0;
+   };
+
+   /*
+    * history_index a index of actions.log kept on disk:
+    *
+    *   the index file  records in the order they are added
+    *   the sorted file the run size, then each run of run_size records of the index file sorted by key and position
+    *
+    * Records after the last complete run are kept in memory, so at most run_size - 1 of them.
+    * A key is looked up by a binary search in each run of a read only mapping of the sorted file, runs are in
+    * the order they are added, so records of a key are in the order they are added too.
+    * The sorted file is derived from the index file, missing runs are sorted again on open.
+    */
+   template<typename Key>
+   class history_index {
+      public:
+         using record = history_index_record<Key>;
+
+         history_index( const fc::path& index_path, const fc::path& sorted_path, uint64_t run_size );
+         ~history_index();
+
+         // open drop records from end, they are of incomplete blocks
+         void     open( uint64_t end );
+         uint64_t end()const { return _end; }
+
+         void append( const Key& key, uint64_t pos );
+         void flush();
+         bool good()const;
+         // sort_runs sort complete runs of records added, it is called after the records of a block are flushed
+         void sort_runs();
+         void truncate( uint64_t end );
+
+         uint64_t                 count( const Key& key )const;
+         fc::optional<uint64_t>   get( const Key& key, uint64_t sequence )const;
+         // lower_bound the first key not less than key
+         fc::optional<Key>        lower_bound( const Key& key )const;
+         vector<uint64_t>         positions( const Key& key )const;
+
+      private:
+         uint64_t run_bytes()const;
+         void     load_tail();
+         const char* map_sorted()const;
+         std::pair<uint64_t, uint64_t> equal_range( const char* sorted_data, uint64_t run, const Key& key )const;
+
+         fc::path                          index_path;
+         fc::path                          sorted_path;
+         const uint64_t                    run_size;
+         std::fstream                      index;
+         std::fstream                      sorted;
+         uint64_t                          _end = 0; ///< records in the index file
+         uint64_t                          runs = 0; ///< runs in the sorted file
+         std::map<Key, vector<uint64_t>>   tail;     ///< records after the last run
+
+         mutable std::unique_ptr<boost::interprocess::file_mapping>  sorted_mapping;
+         mutable std::unique_ptr<boost::interprocess::mapped_region> sorted_region; ///< remapped when a run is added
+   };
+
+   /*
+    * history_store keeps the history of blocks in append-only files out of the state db:
+    *
+    *   actions.log     packed history_action, one after another
+    *   blocks.index    a block_summary for each block, the end of other files after the block is added
+    *   accounts.index  (account, position in actions.log) for each account of each action,
+    *                   the account_sequence of a action is its order in the records of the account
+    *   accounts.sorted accounts.index sorted in runs, see history_index
+    *   trx.index       (trx_id, position in actions.log) for each action
+    *   trx.sorted      trx.index sorted in runs
+    *   auth.log        auth changes with the keys and controlling accounts they replaced
+    *
+    * Actions are read from a read only mapping of actions.log. The auth changes are loaded into memory on open.
+    * Blocks are added in order, a block not after the last one means a fork switch or a replay,
+    * so the history of it and the blocks after it are truncated first. A block after a gap, the store is
+    * behind the chain when the plugin is enabled later or the chain restarts from a snapshot, is refused unless
+    * restart_on_gap, then the history is wiped and restarts from the block.
+    * It is used on main thread only.
+    */
+   class history_store {
+      public:
+         static constexpr uint64_t default_index_run_size = 1024 * 1024;
+
+         explicit history_store( const fc::path& dir, uint64_t index_run_size = default_index_run_size,
+                                 bool restart_on_gap = false );
+         ~history_store();
+
+         uint32_t begin_block()const { return _begin_block; }
+         uint32_t end_block()const   { return _end_block; }
+         bool     empty()const       { return _begin_block == _end_block; }
+
+         void add_block( uint32_t block_num, const vector<history_entry>& actions, const vector<auth_change>& auths );
+
+         uint32_t       account_action_count( account_name n )const;
+         history_action get_account_action( account_name n, uint32_t account_sequence )const;
+
+         // get_transaction_actions actions of the first trx id not less than lower_id and accepted by match
+         vector<history_action> get_transaction_actions( const transaction_id_type& lower_id,
+                                                         const std::function<bool(const transaction_id_type&)>& match )const;
+
+         vector<permission_level> get_key_permissions( const public_key_type& key )const;
+         vector<permission_level> get_controlled_permissions( account_name controlling )const;
+
+      private:
+         struct auth_value {
+            vector<public_key_type> keys;
+            vector<account_name>    controllers;
+         };
+
+         void open();
+         void load_authorities();
+         void truncate( uint32_t block_num );
+         void set_auth( const permission_level& permission, const vector<public_key_type>& keys,
+                        const vector<account_name>& controllers );
+         history_action read_action( uint64_t pos )const;
+
+         fc::path                   dir;
+         std::fstream               actions_log;
+         std::fstream               blocks_index;
+         std::fstream               auth_log;
+         history_index<account_name>         accounts;
+         history_index<transaction_id_type>  trxs;
+
+         bool                       restart_on_gap = false;
+         uint32_t                   _begin_block = 0;
+         uint32_t                   _end_block   = 0;
+         uint64_t                   actions_end  = 0; ///< size of actions.log
+         uint64_t                   auth_end     = 0; ///< size of auth.log
+
+         std::map<permission_level, auth_value>           authorities;
+         std::multimap<public_key_type, permission_level> key_permissions;
+         std::multimap<account_name, permission_level>    controlled_permissions;
+
+         mutable std::unique_ptr<boost::interprocess::file_mapping>  actions_mapping;
+         mutable std::unique_ptr<boost::interprocess::mapped_region> actions_region; ///< remapped when actions.log grows
+   };
+
+} /// namespace eosio
+
+FC_REFLECT( eosio::history_action, (global_sequence)(block_num)(block_time)(trx_id)(packed_action_trace)(fee) )
+FC_REFLECT( eosio::auth_change, (permission)(keys)(controllers) )
+FC_REFLECT_TEMPLATE( (typename Key), eosio::history_index_record<Key>, (key)(pos) )
@@ -8,6 +8,7 @@
 #include <eosio/chain/exceptions.hpp>
 #include <eosio/chain/transaction.hpp>
 #include <eosio/chain/types.hpp>
+#include <eosio/chain/txfee_manager.hpp>
 
 #include <fc/io/json.hpp>
 #include <fc/utf8.hpp>
@@ -66,6 +67,20 @@ struct filter_entry {
    }
 };
 
+// fee_trace a fee action folded into the transaction trace by mongodb-compact-fee-traces
+struct fee_trace {
+   action_name  action;
+   account_name actor;
+   chain::asset fee;
+   account_name bpname;
+};
+
+} // namespace eosio
+
+FC_REFLECT( eosio::fee_trace, (action)(actor)(fee)(bpname) )
+
+namespace eosio {
+
 class mongo_db_plugin_impl {
 public:
    mongo_db_plugin_impl();
@@ -91,7 +106,7 @@ public:
    void process_irreversible_block(const chain::block_state_ptr&);
    void _process_irreversible_block(const chain::block_state_ptr&);
 
-   optional<abi_serializer> get_abi_serializer( account_name n );
+   cached_abi_serializer get_abi_serializer( account_name n );
    template<typename T> fc::variant to_variant_with_abi( const T& obj );
 
    void purge_abi_cache();
@@ -102,6 +117,8 @@ public:
                           bool& write_ttrace );
 
    void update_account(const chain::action& act);
+   void add_block_fees( const chain::block_state_ptr& bs, const std::chrono::milliseconds& now );
+   void update_fee_totals( const chain::block_state_ptr& bs );
 
    void add_pub_keys( const vector<chain::key_weight>& keys, const account_name& name,
                       const permission_name& permission, const std::chrono::milliseconds& now );
@@ -140,6 +157,7 @@ public:
    bool store_transactions = true;
    bool store_transaction_traces = true;
    bool store_action_traces = true;
+   bool compact_fee_traces = false;
 
    std::string db_name;
    mongocxx::instance mongo_inst;
@@ -154,6 +172,8 @@ public:
    mongocxx::collection _blocks;
    mongocxx::collection _pub_keys;
    mongocxx::collection _account_controls;
+   mongocxx::collection _fees;
+   mongocxx::collection _fee_totals;
 
    size_t max_queue_size = 0;
    int queue_sleep_time = 0;
@@ -166,6 +186,8 @@ public:
    std::deque<chain::block_state_ptr> block_state_process_queue;
    std::deque<chain::block_state_ptr> irreversible_block_state_queue;
    std::deque<chain::block_state_ptr> irreversible_block_state_process_queue;
+   // fees of executed trxs by trx id until their block is accepted, a trx applied again replaces them, consum thread
+   std::map<chain::transaction_id_type, std::pair<uint32_t, vector<fee_trace>>> applied_fees;
    std::mutex mtx;
    std::condition_variable condition;
    std::thread consume_thread;
@@ -180,7 +202,7 @@ public:
    struct abi_cache {
       account_name                     account;
       fc::time_point                   last_accessed;
-      fc::optional<abi_serializer>     serializer;
+      cached_abi_serializer            serializer; ///< shared, so resolver need not copy it
    };
 
    typedef boost::multi_index_container<abi_cache,
@@ -207,6 +229,8 @@ public:
    static const std::string accounts_col;
    static const std::string pub_keys_col;
    static const std::string account_controls_col;
+   static const std::string fees_col;
+   static const std::string fee_totals_col;
 };
 
 const action_name mongo_db_plugin_impl::newaccount = chain::newaccount::get_name();
@@ -224,6 +248,8 @@ const std::string mongo_db_plugin_impl::action_traces_col = "action_traces";
 const std::string mongo_db_plugin_impl::accounts_col = "accounts";
 const std::string mongo_db_plugin_impl::pub_keys_col = "pub_keys";
 const std::string mongo_db_plugin_impl::account_controls_col = "account_controls";
+const std::string mongo_db_plugin_impl::fees_col = "fees";
+const std::string mongo_db_plugin_impl::fee_totals_col = "fee_totals";
 
 bool mongo_db_plugin_impl::filter_include( const account_name& receiver, const action_name& act_name,
                                            const vector<chain::permission_level>& authorization ) const
@@ -408,6 +434,8 @@ void mongo_db_plugin_impl::consume_blocks() {
       _block_states = mongo_conn[db_name][block_states_col];
       _pub_keys = mongo_conn[db_name][pub_keys_col];
       _account_controls = mongo_conn[db_name][account_controls_col];
+      _fees = mongo_conn[db_name][fees_col];
+      _fee_totals = mongo_conn[db_name][fee_totals_col];
       insert_default_abi();
       while (true) {
          std::unique_lock<std::mutex> lock(mtx);
@@ -596,7 +624,7 @@ void mongo_db_plugin_impl::purge_abi_cache() {
    }
 }
 
-optional<abi_serializer> mongo_db_plugin_impl::get_abi_serializer( account_name n ) {
+cached_abi_serializer mongo_db_plugin_impl::get_abi_serializer( account_name n ) {
    using bsoncxx::builder::basic::kvp;
    using bsoncxx::builder::basic::make_document;
    if( n.good()) {
@@ -620,7 +648,7 @@ optional<abi_serializer> mongo_db_plugin_impl::get_abi_serializer( account_name
                   abi = fc::json::from_string( bsoncxx::to_json( view["abi"].get_document())).as<abi_def>();
                } catch (...) {
                   ilog( "Unable to convert account abi to abi_def for ${n}", ( "n", n ));
-                  return optional<abi_serializer>();
+                  return cached_abi_serializer();
                }
 
                purge_abi_cache(); // make room if necessary
@@ -669,14 +697,14 @@ optional<abi_serializer> mongo_db_plugin_impl::get_abi_serializer( account_name
                   }
                }
                abis.set_abi( abi, abi_serializer_max_time );
-               entry.serializer.emplace( std::move( abis ) );
+               entry.serializer = cached_abi_serializer( std::move( abi ), std::move( abis ) );
                abi_cache_index.insert( entry );
                return entry.serializer;
             }
          }
       } FC_CAPTURE_AND_LOG((n))
    }
-   return optional<abi_serializer>();
+   return cached_abi_serializer();
 }
 
 template<typename T>
@@ -896,9 +924,16 @@ void mongo_db_plugin_impl::_process_applied_transaction( const chain::transactio
    bool write_atraces = false;
    bool write_ttrace = false; // filters apply to transaction_traces as well
    bool executed = t->receipt.valid() && t->receipt->status == chain::transaction_receipt_header::executed;
+   vector<fee_trace> fees;
 
    for( const auto& atrace : t->action_traces ) {
       try {
+         if( compact_fee_traces && chain::is_fee_action( atrace.act ) ) {
+            // onfee and voteagefee has same data
+            const auto fee = fc::raw::unpack<chain::onfee>( atrace.act.data );
+            fees.emplace_back( fee_trace{ atrace.act.name, fee.actor, fee.fee, fee.bpname } );
+            continue;
+         }
          write_atraces |= add_action_trace( bulk_action_traces, atrace, t, executed, now, write_ttrace );
       } catch(...) {
          handle_mongo_exception("add action traces", __LINE__);
@@ -907,11 +942,25 @@ void mongo_db_plugin_impl::_process_applied_transaction( const chain::transactio
 
    if( !start_block_reached ) return; //< add_action_trace calls update_account which must be called always
 
+   // fees of a transaction are kept until its block is accepted, a transaction applied again replaces them
+   if( executed && !fees.empty() ) {
+      applied_fees[t->id] = std::make_pair( t->block_num, fees );
+   }
+
    // transaction trace insert
 
    if( store_transaction_traces && write_ttrace ) {
       try {
-         auto v = to_variant_with_abi( *t );
+         // fee action traces are replaced by the fee field
+         fc::optional<chain::transaction_trace> compact_trace;
+         if( !fees.empty() ) {
+            compact_trace = *t;
+            auto& traces = compact_trace->action_traces;
+            traces.erase( std::remove_if( traces.begin(), traces.end(), []( const chain::action_trace& at ) {
+               return chain::is_fee_action( at.act );
+            }), traces.end() );
+         }
+         auto v = to_variant_with_abi( compact_trace ? *compact_trace : *t );
          string json = fc::json::to_string( v );
          try {
             const auto& value = bsoncxx::from_json( json );
@@ -927,6 +976,10 @@ void mongo_db_plugin_impl::_process_applied_transaction( const chain::transactio
                elog( "  JSON: ${j}", ("j", json) );
             }
          }
+         if( !fees.empty() ) {
+            const auto& fee_value = bsoncxx::from_json( fc::json::to_string( fc::mutable_variant_object( "fee", fees ) ) );
+            trans_traces_doc.append( bsoncxx::builder::concatenate_doc{fee_value.view()} );
+         }
          trans_traces_doc.append( kvp( "createdAt", b_date{now} ) );
 
          try {
@@ -973,6 +1026,10 @@ void mongo_db_plugin_impl::_process_accepted_block( const chain::block_state_ptr
    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
          std::chrono::microseconds{fc::time_point::now().time_since_epoch().count()});
 
+   if( compact_fee_traces ) {
+      add_block_fees( bs, now );
+   }
+
    if( store_block_states ) {
       auto block_state_doc = bsoncxx::builder::basic::document{};
       block_state_doc.append( kvp( "block_num", b_int32{static_cast<int32_t>(block_num)} ),
@@ -1140,6 +1197,135 @@ void mongo_db_plugin_impl::_process_irreversible_block(const chain::block_state_
          }
       }
    }
+
+   if( compact_fee_traces ) {
+      update_fee_totals( bs );
+   }
+}
+
+// add_block_fees write fees of transactions in a accepted block to fees in one bulk write, by block id, so a block
+// of other fork has its own. Fees of transactions applied in blocks not accepted are dropped.
+void mongo_db_plugin_impl::add_block_fees( const chain::block_state_ptr& bs, const std::chrono::milliseconds& now ) {
+   using namespace bsoncxx::types;
+   using bsoncxx::builder::basic::make_document;
+   using bsoncxx::builder::basic::kvp;
+
+   const auto block_num = bs->block_num;
+   const auto block_id_str = bs->id.str();
+   mongocxx::options::bulk_write bulk_opts;
+   bulk_opts.ordered( false );
+   auto bulk = _fees.create_bulk_write( bulk_opts );
+   bool fees_in_block = false;
+
+   for( const auto& receipt : bs->block->transactions ) {
+      const auto id = receipt.trx.contains<packed_transaction>() ? receipt.trx.get<packed_transaction>().id()
+                                                                 : receipt.trx.get<transaction_id_type>();
+      auto itr = applied_fees.find( id );
+      if( itr == applied_fees.end() || itr->second.first != block_num ) continue;
+
+      const auto trx_id_str = id.str();
+      const auto& fee_value = bsoncxx::from_json( fc::json::to_string( fc::mutable_variant_object( "fee", itr->second.second ) ) );
+      auto fee_doc = bsoncxx::builder::basic::document{};
+      fee_doc.append( kvp( "trx_id", trx_id_str ),
+                      kvp( "block_id", block_id_str ),
+                      kvp( "block_num", b_int32{static_cast<int32_t>(block_num)} ),
+                      bsoncxx::builder::concatenate_doc{fee_value.view()},
+                      kvp( "createdAt", b_date{now} ) );
+
+      mongocxx::model::update_one update_op{ make_document( kvp( "trx_id", trx_id_str ), kvp( "block_id", block_id_str ) ),
+                                             make_document( kvp( "$set", fee_doc.view() ) ) };
+      update_op.upsert( true );
+      bulk.append( update_op );
+      fees_in_block = true;
+   }
+
+   for( auto itr = applied_fees.begin(); itr != applied_fees.end(); ) {
+      if( itr->second.first <= block_num )
+         itr = applied_fees.erase( itr );
+      else
+         ++itr;
+   }
+
+   if( fees_in_block ) {
+      try {
+         if( !bulk.execute() ) {
+            EOS_ASSERT( false, chain::mongo_db_insert_fail, "Bulk fees insert failed for block: ${bid}", ("bid", bs->id) );
+         }
+      } catch( ... ) {
+         handle_mongo_exception( "bulk fees insert", __LINE__ );
+      }
+   }
+}
+
+// update_fee_totals add fees of transactions in a irreversible block to fee totals of payers, then delete them
+// and the fees of other forks up to the block. A total keeps the last block counted in it and is only updated by
+// a later block, so a block processed again after a resync, replay or restart is not counted twice.
+void mongo_db_plugin_impl::update_fee_totals( const chain::block_state_ptr& bs ) {
+   using namespace bsoncxx::types;
+   using bsoncxx::builder::basic::make_document;
+   using bsoncxx::builder::basic::kvp;
+
+   const auto block_num = bs->block_num;
+   const b_int32 block_num_value{static_cast<int32_t>(block_num)};
+   std::map<account_name, std::pair<int64_t, int64_t>> totals; ///< payer to fee amount and fee actions
+   try {
+      auto cursor = _fees.find( make_document( kvp( "block_num", block_num_value ), kvp( "block_id", bs->id.str() ) ) );
+      for( const auto& fee_doc : cursor ) {
+         const auto fees = fc::json::from_string( bsoncxx::to_json( fee_doc ) )["fee"].as<vector<fee_trace>>();
+         for( const auto& f : fees ) {
+            auto& total = totals[f.actor];
+            total.first  += f.fee.get_amount();
+            total.second += 1;
+         }
+      }
+   } catch( ... ) {
+      handle_mongo_exception( "fees of block", __LINE__ );
+      return;
+   }
+
+   if( !totals.empty() ) {
+      auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::microseconds{fc::time_point::now().time_since_epoch().count()});
+
+      // ordered, a total counted before is updated if it is before the block, else it is inserted if none
+      mongocxx::options::bulk_write bulk_opts;
+      bulk_opts.ordered( true );
+      auto bulk = _fee_totals.create_bulk_write( bulk_opts );
+      for( const auto& total : totals ) {
+         const auto account_str = total.first.to_string();
+         const auto fee         = b_int64{total.second.first};
+         const auto fee_actions = b_int64{total.second.second};
+
+         mongocxx::model::update_one update_op{
+               make_document( kvp( "account", account_str ), kvp( "block_num", make_document( kvp( "$lt", block_num_value ) ) ) ),
+               make_document( kvp( "$inc", make_document( kvp( "fee", fee ), kvp( "fee_actions", fee_actions ) ) ),
+                              kvp( "$set", make_document( kvp( "block_num", block_num_value ), kvp( "updatedAt", b_date{now} ) ) ) ) };
+         bulk.append( update_op );
+
+         mongocxx::model::update_one insert_op{
+               make_document( kvp( "account", account_str ) ),
+               make_document( kvp( "$setOnInsert", make_document( kvp( "fee", fee ), kvp( "fee_actions", fee_actions ),
+                                                                  kvp( "block_num", block_num_value ),
+                                                                  kvp( "updatedAt", b_date{now} ) ) ) ) };
+         insert_op.upsert( true );
+         bulk.append( insert_op );
+      }
+
+      try {
+         if( !bulk.execute() ) {
+            EOS_ASSERT( false, chain::mongo_db_update_fail, "Bulk fee totals update failed for block: ${n}", ("n", block_num) );
+         }
+      } catch( ... ) {
+         handle_mongo_exception( "fee totals update", __LINE__ );
+         return;
+      }
+   }
+
+   try {
+      _fees.delete_many( make_document( kvp( "block_num", make_document( kvp( "$lte", block_num_value ) ) ) ) );
+   } catch( ... ) {
+      handle_mongo_exception( "fees delete", __LINE__ );
+   }
 }
 
 void mongo_db_plugin_impl::add_pub_keys( const vector<chain::key_weight>& keys, const account_name& name,
@@ -1389,6 +1575,8 @@ void mongo_db_plugin_impl::wipe_database() {
    auto accounts = mongo_conn[db_name][accounts_col];
    auto pub_keys = mongo_conn[db_name][pub_keys_col];
    auto account_controls = mongo_conn[db_name][account_controls_col];
+   auto fees = mongo_conn[db_name][fees_col];
+   auto fee_totals = mongo_conn[db_name][fee_totals_col];
 
    block_states.drop();
    blocks.drop();
@@ -1398,6 +1586,8 @@ void mongo_db_plugin_impl::wipe_database() {
    accounts.drop();
    pub_keys.drop();
    account_controls.drop();
+   fees.drop();
+   fee_totals.drop();
    ilog("done wipe_database");
 }
 
@@ -1564,6 +1754,14 @@ void mongo_db_plugin_impl::init() {
                   bsoncxx::from_json( R"xxx({ "controlled_account" : 1, "controlled_permission" : 1 })xxx" ));
             account_controls.create_index( bsoncxx::from_json( R"xxx({ "controlling_account" : 1 })xxx" ));
 
+            // fees indexes
+            auto fees = mongo_conn[db_name][fees_col];
+            fees.create_index( bsoncxx::from_json( R"xxx({ "block_num" : 1 })xxx" ));
+
+            // fee_totals indexes
+            auto fee_totals = mongo_conn[db_name][fee_totals_col];
+            fee_totals.create_index( bsoncxx::from_json( R"xxx({ "account" : 1 })xxx" ));
+
          } catch (...) {
             handle_mongo_exception( "create indexes", __LINE__ );
          }
@@ -1620,6 +1818,8 @@ void mongo_db_plugin::set_program_options(options_description& cli, options_desc
           "Enables storing transaction traces in mongodb.")
          ("mongodb-store-action-traces", bpo::value<bool>()->default_value(true),
           "Enables storing action traces in mongodb.")
+         ("mongodb-compact-fee-traces", bpo::value<bool>()->default_value(false),
+          "Store onfee and voteagefee actions in the fee field of transaction traces instead of action traces, keep them in fees until their block is irreversible, then sum them by payer in fee_totals.")
          ("mongodb-filter-on", bpo::value<vector<string>>()->composing(),
           "Track actions which match receiver:action:actor. Receiver, Action, & Actor may be blank to include all. i.e. eosio:: or :transfer:  Use * or leave unspecified to include all.")
          ("mongodb-filter-out", bpo::value<vector<string>>()->composing(),
@@ -1677,6 +1877,9 @@ void mongo_db_plugin::plugin_initialize(const variables_map& options)
          if( options.count( "mongodb-store-action-traces" )) {
             my->store_action_traces = options.at( "mongodb-store-action-traces" ).as<bool>();
          }
+         if( options.count( "mongodb-compact-fee-traces" )) {
+            my->compact_fee_traces = options.at( "mongodb-compact-fee-traces" ).as<bool>();
+         }
          if( options.count( "mongodb-filter-on" )) {
             auto fo = options.at( "mongodb-filter-on" ).as<vector<string>>();
             my->filter_on_star = false;
@@ -129,6 +129,19 @@ namespace eosio {
       unique_ptr< sync_manager >       sync_master;
       unique_ptr< dispatch_manager >   dispatcher;
 
+      /**
+       * Blocks received while syncing wait in sync_blocks and are applied in order by apply_sync_block,
+       * the first sync_prevalidate_span of them are prevalidated by controller on chain threads meanwhile.
+       */
+      struct sync_block {
+         connection_ptr   c;
+         signed_block_ptr block;
+         bool             prevalidated = false;
+      };
+      deque<sync_block>                sync_blocks;
+      uint32_t                         sync_prevalidate_span = 0;
+      uint32_t                         sync_blocks_applied = 0;
+
       unique_ptr<boost::asio::steady_timer> connector_check;
       unique_ptr<boost::asio::steady_timer> transaction_check;
       unique_ptr<boost::asio::steady_timer> keepalive_timer;
@@ -213,6 +226,9 @@ namespace eosio {
       void handle_message(const connection_ptr& c, const sync_request_message& msg);
       void handle_message(const connection_ptr& c, const signed_block& msg) = delete; // signed_block_ptr overload used instead
       void handle_message(const connection_ptr& c, const signed_block_ptr& msg);
+      void accept_block(const connection_ptr& c, const signed_block_ptr& msg);
+      void prevalidate_sync_blocks();
+      void apply_sync_block();
       void handle_message(const connection_ptr& c, const packed_transaction& msg) = delete; // packed_transaction_ptr overload used instead
       void handle_message(const connection_ptr& c, const packed_transaction_ptr& msg);
 
@@ -311,6 +327,7 @@ namespace eosio {
    constexpr auto     def_txn_expire_wait = std::chrono::seconds(3);
    constexpr auto     def_resp_expected_wait = std::chrono::seconds(5);
    constexpr auto     def_sync_fetch_span = 100;
+   constexpr uint32_t sync_read_ahead_blocks = 32; // irreversible blocks read from block log at once to serve sync
 
    constexpr auto     message_header_size = 4;
    constexpr uint32_t signed_block_which = 7;        // see protocol net_message
@@ -496,6 +513,7 @@ namespace eosio {
       peer_block_state_index  blk_state;
       transaction_state_index trx_state;
       optional<sync_state>    peer_requested;  // this peer is requesting info from us
+      deque<signed_block_ptr> sync_read_ahead; // irreversible blocks read for peer_requested, in order
       std::shared_ptr<boost::asio::io_context>  server_ioc; // keep ioc alive
       boost::asio::io_context::strand           strand;
       socket_ptr                                socket;
@@ -794,6 +812,7 @@ namespace eosio {
 
    void connection::reset() {
       peer_requested.reset();
+      sync_read_ahead.clear();
       blk_state.clear();
       trx_state.clear();
    }
@@ -1027,7 +1046,20 @@ namespace eosio {
       }
       try {
          controller& cc = my_impl->chain_plug->chain();
-         signed_block_ptr sb = cc.fetch_block_by_number(num);
+         if( !sync_read_ahead.empty() && sync_read_ahead.front()->block_num() != num )
+            sync_read_ahead.clear();
+         if( sync_read_ahead.empty() && num <= cc.last_irreversible_block_num() ) {
+            const uint32_t last = std::min( peer_requested ? peer_requested->end_block : num, cc.last_irreversible_block_num() );
+            auto blocks = cc.fetch_irreversible_block_range( num, std::min( last - num + 1, sync_read_ahead_blocks ) );
+            sync_read_ahead.insert( sync_read_ahead.end(), blocks.begin(), blocks.end() );
+         }
+         signed_block_ptr sb;
+         if( !sync_read_ahead.empty() ) {
+            sb = sync_read_ahead.front();
+            sync_read_ahead.pop_front();
+         } else {
+            sb = cc.fetch_block_by_number(num);
+         }
          if(sb) {
             enqueue_block( sb, trigger_send, true);
             return true;
@@ -2510,6 +2542,50 @@ namespace eosio {
    }
 
    void net_plugin_impl::handle_message(const connection_ptr& c, const signed_block_ptr& msg) {
+      if( sync_blocks.empty() && !sync_master->is_active(c) ) {
+         accept_block( c, msg );
+         return;
+      }
+      c->cancel_wait();
+      sync_blocks.push_back( {c, msg} );
+      prevalidate_sync_blocks();
+      app().post( priority::medium, [this]() {
+         apply_sync_block();
+      });
+   }
+
+   void net_plugin_impl::prevalidate_sync_blocks() {
+      controller& cc = chain_plug->chain();
+      const size_t span = std::min<size_t>( sync_blocks.size(), sync_prevalidate_span );
+      for( size_t i = 0; i < span; ++i ) {
+         auto& sb = sync_blocks[i];
+         if( sb.prevalidated )
+            continue;
+         sb.prevalidated = true;
+         try {
+            cc.prevalidate_block( sb.block );
+         } catch( const fc::exception& e ) {
+            // block is rejected when it is applied
+            fc_dlog( logger, "unable to prevalidate block #${n}: ${e}", ("n", sb.block->block_num())("e", e.to_string()) );
+         }
+      }
+   }
+
+   void net_plugin_impl::apply_sync_block() {
+      if( sync_blocks.empty() )
+         return;
+      auto sb = std::move( sync_blocks.front() );
+      sync_blocks.pop_front();
+      accept_block( sb.c, sb.block );
+      prevalidate_sync_blocks();
+
+      if( sync_prevalidate_span && ++sync_blocks_applied % sync_prevalidate_span == 0 ) {
+         fc_ilog( logger, "sync prevalidation is ${a} blocks ahead of block #${n}, ${q} blocks queued",
+                  ("a", chain_plug->chain().prevalidated_ahead())("n", sb.block->block_num())("q", sync_blocks.size()) );
+      }
+   }
+
+   void net_plugin_impl::accept_block(const connection_ptr& c, const signed_block_ptr& msg) {
       controller &cc = chain_plug->chain();
       block_id_type blk_id = msg->id();
       uint32_t blk_num = msg->block_num();
@@ -2895,6 +2971,7 @@ namespace eosio {
          my->network_version_match = options.at( "network-version-match" ).as<bool>();
 
          my->sync_master.reset( new sync_manager( options.at( "sync-fetch-span" ).as<uint32_t>()));
+         my->sync_prevalidate_span = options.at( "sync-fetch-span" ).as<uint32_t>();
          my->dispatcher.reset( new dispatch_manager );
 
          my->connector_period = std::chrono::seconds( options.at( "connection-cleanup-period" ).as<int>());
@@ -3066,6 +3143,7 @@ namespace eosio {
             my->keepalive_timer->cancel();
 
          my->done = true;
+         my->sync_blocks.clear();
          if( my->acceptor ) {
             fc_ilog( logger, "close acceptor" );
             my->acceptor->cancel();
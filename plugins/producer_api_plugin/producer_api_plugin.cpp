@@ -90,6 +90,10 @@ void producer_api_plugin::plugin_startup() {
             INVOKE_R_V(producer, get_integrity_hash), 201),
        CALL(producer, producer, create_snapshot,
             INVOKE_R_V(producer, create_snapshot), 201),
+       CALL(producer, producer, get_snapshot_status,
+            INVOKE_R_V(producer, get_snapshot_status), 201),
+       CALL(producer, producer, get_pending_transaction_stats,
+            INVOKE_R_V(producer, get_pending_transaction_stats), 201),
    });
 }
 
@@ -0,0 +1,125 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#pragma once
+
+#include <eosio/chain/plugin_interface.hpp>
+#include <eosio/chain/transaction_metadata.hpp>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/composite_key.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+
+#include <map>
+
+namespace eosio {
+   namespace chain { class controller; }
+
+   using chain::account_name;
+   using chain::transaction_metadata_ptr;
+   using chain::transaction_trace_ptr;
+   using chain::plugin_interface::next_function;
+
+   // pending_transaction a incoming transaction waiting for a pending block
+   struct pending_transaction {
+      transaction_metadata_ptr               trx;
+      bool                                   persist_until_expired = false;
+      next_function<transaction_trace_ptr>   next;
+      uint64_t                               priority = 0; ///< fee paid per estimated cost of its cpu and net
+      account_name                           payer;
+      uint64_t                               size = 0;     ///< packed size, counted against max_bytes
+      uint64_t                               seq = 0;      ///< order of arrival, set by queue
+   };
+
+   /**
+    * calculate_paid_fee fee trn pays as charged by controller, 0 if it cannot be accepted for its fee:
+    * before onfee_action trn.fee is charged, after it the required fee is charged, trn.fee is only checked
+    * to be enough if fee_limit is not open, else the required fee has to be in the fee limit of trn if any
+    */
+   chain::asset calculate_paid_fee( const chain::transaction& trn, const chain::asset& required_fee,
+                                    bool is_onfee_act, bool is_fee_limit );
+
+   /// calculate_trx_priority fee paid by trx per fee of the cpu and net it is estimated to use, 0 if it cannot pay
+   uint64_t calculate_trx_priority( const chain::controller& chain, const transaction_metadata_ptr& trx );
+
+   /**
+    * pending_transaction_queue keeps incoming transactions, highest priority first and in order of arrival
+    * for a same priority. It is bounded in bytes and in transactions of each payer, when it is full
+    * a transaction is added only if transactions of lower priority can be evicted to make room for it.
+    * It is used on main thread only.
+    */
+   class pending_transaction_queue {
+      public:
+         struct stats {
+            uint64_t depth                 = 0;
+            uint64_t bytes                 = 0;
+            uint64_t max_depth             = 0;
+            uint64_t added                 = 0;
+            uint64_t dropped_queue_full    = 0; ///< not added or evicted as queue is full of higher priority trxs
+            uint64_t dropped_account_limit = 0; ///< not added or evicted as payer has too many higher priority trxs
+         };
+
+         enum class drop_reason {
+            queue_full,
+            account_limit
+         };
+
+         pending_transaction_queue( uint64_t max_bytes, uint32_t max_per_account );
+
+         void set_limits( uint64_t max_bytes, uint32_t max_per_account );
+
+         /// add e, calls drop for each transaction evicted for it, or for e only if it is not added
+         void add( pending_transaction&& e, const std::function<void(pending_transaction&&, drop_reason)>& drop );
+
+         bool   empty()const { return _queue.empty(); }
+         size_t size()const  { return _queue.size(); }
+
+         /// remove and return the transaction of highest priority
+         pending_transaction pop();
+
+         const stats& get_stats()const { return _stats; }
+
+      private:
+         struct by_priority;
+         struct by_payer;
+
+         using queue_type = boost::multi_index_container<
+            pending_transaction,
+            boost::multi_index::indexed_by<
+               boost::multi_index::ordered_unique< boost::multi_index::tag<by_priority>,
+                  boost::multi_index::composite_key< pending_transaction,
+                     boost::multi_index::member<pending_transaction, uint64_t, &pending_transaction::priority>,
+                     boost::multi_index::member<pending_transaction, uint64_t, &pending_transaction::seq>
+                  >,
+                  boost::multi_index::composite_key_compare< std::greater<uint64_t>, std::less<uint64_t> >
+               >,
+               boost::multi_index::ordered_unique< boost::multi_index::tag<by_payer>,
+                  boost::multi_index::composite_key< pending_transaction,
+                     boost::multi_index::member<pending_transaction, account_name, &pending_transaction::payer>,
+                     boost::multi_index::member<pending_transaction, uint64_t, &pending_transaction::priority>,
+                     boost::multi_index::member<pending_transaction, uint64_t, &pending_transaction::seq>
+                  >,
+                  boost::multi_index::composite_key_compare< std::less<account_name>, std::less<uint64_t>, std::greater<uint64_t> >
+               >
+            >
+         >;
+
+         using priority_iterator = queue_type::index<by_priority>::type::iterator;
+
+         void on_removed( const pending_transaction& e );
+         void evict( priority_iterator itr, drop_reason reason, const std::function<void(pending_transaction&&, drop_reason)>& drop );
+
+         queue_type                        _queue;
+         std::map<account_name, uint32_t>  _payer_count;
+         uint64_t                          _max_bytes;
+         uint32_t                          _max_per_account;
+         uint64_t                          _next_seq = 0;
+         stats                             _stats;
+   };
+
+} // namespace eosio
+
+FC_REFLECT( eosio::pending_transaction_queue::stats,
+            (depth)(bytes)(max_depth)(added)(dropped_queue_full)(dropped_account_limit) )
@@ -7,6 +7,7 @@
 
 #include <eosio/chain_plugin/chain_plugin.hpp>
 #include <eosio/http_client_plugin/http_client_plugin.hpp>
+#include <eosio/producer_plugin/pending_transaction_queue.hpp>
 
 #include <appbase/application.hpp>
 
@@ -51,6 +52,16 @@ public:
       std::string          snapshot_name;
    };
 
+   struct snapshot_status {
+      chain::block_id_type head_block_id;
+      std::string          snapshot_name;
+      std::string          status; ///< in_progress, completed or failed
+      uint64_t             rows_written = 0;
+      uint32_t             sections_written = 0;
+      int64_t              elapsed_ms = 0;
+      std::string          error;
+   };
+
    producer_plugin();
    virtual ~producer_plugin();
 
@@ -81,7 +92,16 @@ public:
    void set_whitelist_blacklist(const whitelist_blacklist& params);
 
    integrity_hash_information get_integrity_hash() const;
+   /**
+    * Take a checkpoint of the state database at head and write snapshot from it on a background thread,
+    * returns when the checkpoint is taken. Progress is reported by get_snapshot_status. Without reflinks
+    * for the checkpoint, snapshot is written from the state database before it returns.
+    */
    snapshot_information create_snapshot() const;
+   vector<snapshot_status> get_snapshot_status() const;
+
+   /// depth of incoming transactions waiting for a pending block and counts of transactions dropped by its limits
+   pending_transaction_queue::stats get_pending_transaction_stats() const;
 
    signal<void(const chain::producer_confirmation&)> confirmed_block;
 private:
@@ -95,4 +115,5 @@ FC_REFLECT(eosio::producer_plugin::greylist_params, (accounts));
 FC_REFLECT(eosio::producer_plugin::whitelist_blacklist, (actor_whitelist)(actor_blacklist)(contract_whitelist)(contract_blacklist)(action_blacklist)(key_blacklist) )
 FC_REFLECT(eosio::producer_plugin::integrity_hash_information, (head_block_id)(integrity_hash))
 FC_REFLECT(eosio::producer_plugin::snapshot_information, (head_block_id)(snapshot_name))
+FC_REFLECT(eosio::producer_plugin::snapshot_status, (head_block_id)(snapshot_name)(status)(rows_written)(sections_written)(elapsed_ms)(error))
 
@@ -0,0 +1,154 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE
+ */
+#include <eosio/producer_plugin/pending_transaction_queue.hpp>
+#include <eosio/chain/controller.hpp>
+#include <eosio/chain/global_property_object.hpp>
+#include <eosio/chain/txfee_manager.hpp>
+#include <eosio/chain/config_on_chain.hpp>
+
+#include <limits>
+
+namespace eosio {
+
+using namespace eosio::chain;
+
+asset calculate_paid_fee( const transaction& trn, const asset& required_fee, bool is_onfee_act, bool is_fee_limit ) {
+   if( !is_fee_limit ) {
+      // trn.fee has to be enough, before onfee_action all of it is charged
+      if( trn.fee < required_fee )
+         return asset{ 0 };
+      return is_onfee_act ? required_fee : trn.fee;
+   }
+   // the required fee is charged by fee actions, trx fails if it is over a fee limit of trn
+   asset fee_limit{ 0 };
+   get_from_extensions( trn.transaction_extensions, transaction::fee_limit, fee_limit );
+   if( fee_limit.get_amount() != 0 && required_fee > fee_limit )
+      return asset{ 0 };
+   return required_fee;
+}
+
+uint64_t calculate_trx_priority( const controller& chain, const transaction_metadata_ptr& trx ) {
+   static constexpr double priority_scale = 1000000;
+   const auto& trn = trx->packed_trx->get_transaction();
+   try {
+      const auto& txfee = chain.get_txfee_manager();
+      const auto is_onfee_act = is_func_has_open( chain, config::func_typ::onfee_action );
+      const auto is_fee_limit = is_onfee_act && is_func_has_open( chain, config::func_typ::fee_limit );
+      const asset paid = calculate_paid_fee( trn, txfee.get_required_fee( chain, trn ), is_onfee_act, is_fee_limit );
+      if( paid.get_amount() <= 0 )
+         return 0;
+
+      const uint64_t min_cpu_us = chain.get_global_properties().configuration.min_transaction_cpu_usage;
+      uint64_t cpu_us = 0;
+      for( const auto& act : trn.actions ) {
+         const auto info = txfee.get_fee_schedule( chain, act.account, act.name );
+         cpu_us += (info.by_setfee && info.cpu_limit > 0) ? info.cpu_limit : min_cpu_us;
+      }
+      const uint64_t net_bytes = trx->packed_trx->get_unprunable_size() + trx->packed_trx->get_prunable_size();
+
+      // cpu and net got by 0.01 (100 in amount) of fee, same as in transaction_context
+      const auto cpu_per_fee = std::max<int64_t>( get_num_config_on_chain( chain, config::res_typ::cpu_per_fee, 100 ), 1 );
+      const auto net_per_fee = std::max<int64_t>( get_num_config_on_chain( chain, config::res_typ::net_per_fee, 10000 ), 1 );
+      const double cost = 100.0 * cpu_us / cpu_per_fee + 100.0 * net_bytes / net_per_fee;
+      const double priority = paid.get_amount() / std::max( cost, 1.0 ) * priority_scale;
+      return static_cast<uint64_t>( std::min( priority, double( std::numeric_limits<uint32_t>::max() ) * priority_scale ) );
+   } catch( ... ) {
+      // it is rejected when it is pushed
+      return 0;
+   }
+}
+
+pending_transaction_queue::pending_transaction_queue( uint64_t max_bytes, uint32_t max_per_account )
+:_max_bytes( max_bytes )
+,_max_per_account( max_per_account )
+{
+}
+
+void pending_transaction_queue::set_limits( uint64_t max_bytes, uint32_t max_per_account ) {
+   _max_bytes = max_bytes;
+   _max_per_account = max_per_account;
+}
+
+void pending_transaction_queue::on_removed( const pending_transaction& e ) {
+   auto count = _payer_count.find( e.payer );
+   if( --count->second == 0 )
+      _payer_count.erase( count );
+   _stats.bytes -= e.size;
+   _stats.depth = _queue.size();
+}
+
+void pending_transaction_queue::evict( priority_iterator itr, drop_reason reason,
+                                       const std::function<void(pending_transaction&&, drop_reason)>& drop ) {
+   pending_transaction evicted = *itr;
+   _queue.get<by_priority>().erase( itr );
+   on_removed( evicted );
+   if( reason == drop_reason::queue_full )
+      ++_stats.dropped_queue_full;
+   else
+      ++_stats.dropped_account_limit;
+   drop( std::move( evicted ), reason );
+}
+
+void pending_transaction_queue::add( pending_transaction&& e, const std::function<void(pending_transaction&&, drop_reason)>& drop ) {
+   e.seq = _next_seq++;
+   auto& by_priority_idx = _queue.get<by_priority>();
+
+   // a payer has at most _max_per_account trxs, its trx of lowest priority is evicted for a higher one
+   auto payer_victim = by_priority_idx.end();
+   auto count = _payer_count.find( e.payer );
+   if( _max_per_account > 0 && count != _payer_count.end() && count->second >= _max_per_account ) {
+      auto lowest = _queue.get<by_payer>().lower_bound( e.payer );
+      if( lowest->priority >= e.priority ) {
+         ++_stats.dropped_account_limit;
+         drop( std::move( e ), drop_reason::account_limit );
+         return;
+      }
+      payer_victim = _queue.project<by_priority>( lowest );
+   }
+
+   // trxs of lower priority are evicted from lowest while there is no room for e,
+   // nothing is evicted if e does not fit after all of them
+   uint64_t bytes = _stats.bytes;
+   if( payer_victim != by_priority_idx.end() )
+      bytes -= payer_victim->size;
+   std::vector<priority_iterator> victims;
+   for( auto itr = by_priority_idx.rbegin();
+        itr != by_priority_idx.rend() && bytes + e.size > _max_bytes && itr->priority < e.priority; ++itr ) {
+      auto victim = std::prev( itr.base() );
+      if( victim == payer_victim )
+         continue;
+      bytes -= victim->size;
+      victims.push_back( victim );
+   }
+   if( bytes + e.size > _max_bytes ) {
+      ++_stats.dropped_queue_full;
+      drop( std::move( e ), drop_reason::queue_full );
+      return;
+   }
+
+   if( payer_victim != by_priority_idx.end() )
+      evict( payer_victim, drop_reason::account_limit, drop );
+   for( auto victim : victims ) {
+      evict( victim, drop_reason::queue_full, drop );
+   }
+
+   ++_payer_count[e.payer];
+   _stats.bytes += e.size;
+   ++_stats.added;
+   _queue.insert( std::move( e ) );
+   _stats.depth = _queue.size();
+   _stats.max_depth = std::max( _stats.max_depth, _stats.depth );
+}
+
+pending_transaction pending_transaction_queue::pop() {
+   auto& by_priority_idx = _queue.get<by_priority>();
+   auto itr = by_priority_idx.begin();
+   pending_transaction e = *itr;
+   by_priority_idx.erase( itr );
+   on_removed( e );
+   return e;
+}
+
+} // namespace eosio
@@ -3,6 +3,7 @@
  *  @copyright defined in eos/LICENSE
  */
 #include <eosio/producer_plugin/producer_plugin.hpp>
+#include <eosio/producer_plugin/pending_transaction_queue.hpp>
 #include <eosio/chain/producer_object.hpp>
 #include <eosio/chain/plugin_interface.hpp>
 #include <eosio/chain/global_property_object.hpp>
@@ -161,6 +162,7 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
 
       fc::optional<scoped_connection>                          _accepted_block_connection;
       fc::optional<scoped_connection>                          _irreversible_block_connection;
+      fc::optional<scoped_connection>                          _emergency_changed_connection;
 
       /*
        * HACK ALERT
@@ -181,6 +183,34 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
       // path to write the snapshots to
       bfs::path _snapshots_dir;
 
+      // snapshots are written from checkpoints of state database on _snapshot_thread while blocks are applied
+      struct snapshot_job {
+         producer_plugin::snapshot_information    info;
+         fc::time_point                           start;
+         fc::optional<fc::time_point>             done;
+         std::string                              error;
+         std::shared_ptr<ostream_snapshot_writer> writer; ///< progress is read from it while it is written
+      };
+      std::map<chain::block_id_type, snapshot_job>             _snapshots;
+      fc::optional<boost::asio::thread_pool>                    _snapshot_thread;
+
+      // prune_snapshots drop the oldest finished snapshot jobs, only the last ones are reported by get_snapshot_status
+      void prune_snapshots() {
+         static const size_t max_finished_snapshots = 16;
+         vector<std::map<chain::block_id_type, snapshot_job>::iterator> finished;
+         for( auto itr = _snapshots.begin(); itr != _snapshots.end(); ++itr ) {
+            if( itr->second.done )
+               finished.push_back( itr );
+         }
+         if( finished.size() <= max_finished_snapshots )
+            return;
+         std::sort( finished.begin(), finished.end(), []( const auto& a, const auto& b ) {
+            return *a->second.done < *b->second.done;
+         });
+         for( size_t i = 0; i < finished.size() - max_finished_snapshots; ++i )
+            _snapshots.erase( finished[i] );
+      }
+
 
       void on_block( const block_state_ptr& bsp ) {
          if( bsp->header.timestamp <= _last_signed_block_time ) return;
@@ -249,6 +279,14 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
          _irreversible_block_time = lib->timestamp.to_time_point();
       }
 
+      void on_emergency_changed( bool emergency ) {
+         if( emergency ) {
+            wlog("chain is in emergency now, only setemergency, onblock and fee actions will be accepted");
+         } else {
+            ilog("chain emergency is over");
+         }
+      }
+
       template<typename Type, typename Channel, typename F>
       auto publish_results_of(const Type &data, Channel& channel, F f) {
          auto publish_success = fc::make_scoped_exit([&, this](){
@@ -347,7 +385,38 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
          }
       }
 
-      std::deque<std::tuple<transaction_metadata_ptr, bool, next_function<transaction_trace_ptr>>> _pending_incoming_transactions;
+      pending_transaction_queue _pending_incoming_transactions{ 128*1024*1024, 1000 };
+
+      void add_pending_transaction( pending_transaction&& e ) {
+         _pending_incoming_transactions.add( std::move( e ), [this]( pending_transaction&& dropped, pending_transaction_queue::drop_reason reason ) {
+            const char* why = reason == pending_transaction_queue::drop_reason::queue_full ?
+                              "queue of pending transactions is full of transactions of higher fee" :
+                              "account has too many pending transactions of higher fee";
+            fc_dlog( _trx_trace_log, "[TRX_TRACE] DROPPING pending tx: ${txid} : ${why}", ("txid", dropped.trx->id)("why", why) );
+            auto e_ptr = std::static_pointer_cast<fc::exception>( std::make_shared<too_many_tx_at_once>(
+                  FC_LOG_MESSAGE( error, "dropped transaction ${id}, ${why}", ("id", dropped.trx->id)("why", why) ) ) );
+            dropped.next( e_ptr );
+            _transaction_ack_channel.publish( priority::low, std::pair<fc::exception_ptr, transaction_metadata_ptr>( e_ptr, dropped.trx ) );
+         });
+      }
+
+      // priority is calculated once for a trx, it is kept with it while it is pending or unapplied
+      uint64_t get_trx_priority( const transaction_metadata_ptr& trx ) {
+         if( !trx->priority )
+            trx->priority = calculate_trx_priority( chain_plug->chain(), trx );
+         return *trx->priority;
+      }
+
+      void add_pending_transaction( const transaction_metadata_ptr& trx, bool persist_until_expired, next_function<transaction_trace_ptr> next ) {
+         pending_transaction e;
+         e.trx                   = trx;
+         e.persist_until_expired = persist_until_expired;
+         e.next                  = std::move( next );
+         e.priority              = get_trx_priority( trx );
+         e.payer                 = trx->packed_trx->get_transaction().first_authorizor();
+         e.size                  = trx->packed_trx->get_unprunable_size() + trx->packed_trx->get_prunable_size();
+         add_pending_transaction( std::move( e ) );
+      }
 
       void on_incoming_transaction_async(const transaction_metadata_ptr& trx, bool persist_until_expired, next_function<transaction_trace_ptr> next) {
          chain::controller& chain = chain_plug->chain();
@@ -366,7 +435,7 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
       void process_incoming_transaction_async(const transaction_metadata_ptr& trx, bool persist_until_expired, next_function<transaction_trace_ptr> next) {
          chain::controller& chain = chain_plug->chain();
          if (!chain.pending_block_state()) {
-            _pending_incoming_transactions.emplace_back(trx, persist_until_expired, next);
+            add_pending_transaction(trx, persist_until_expired, next);
             return;
          }
 
@@ -424,7 +493,7 @@ class producer_plugin_impl : public std::enable_shared_from_this<producer_plugin
             auto trace = chain.push_transaction(trx, deadline);
             if (trace->except) {
                if (failure_is_subjective(*trace->except, deadline_is_subjective)) {
-                  _pending_incoming_transactions.emplace_back(trx, persist_until_expired, next);
+                  add_pending_transaction(trx, persist_until_expired, next);
                   if (_pending_block_mode == pending_block_mode::producing) {
                      fc_dlog(_trx_trace_log, "[TRX_TRACE] Block ${block_num} for producer ${prod} COULD NOT FIT, tx: ${txid} RETRYING ",
                              ("block_num", chain.head_block_num() + 1)
@@ -551,6 +620,10 @@ void producer_plugin::set_program_options(
           "Maximum wall-clock time, in milliseconds, spent retiring scheduled transactions in any block before returning to normal transaction processing.")
          ("incoming-defer-ratio", bpo::value<double>()->default_value(1.0),
           "ratio between incoming transations and deferred transactions when both are exhausted")
+         ("pending-transactions-size-mb", bpo::value<uint32_t>()->default_value(128),
+          "Maximum size (in MiB) of incoming transactions waiting for a pending block, transactions of lowest fee per cpu and net are dropped first")
+         ("pending-transactions-per-account", bpo::value<uint32_t>()->default_value(1000),
+          "Maximum number of incoming transactions of an account waiting for a pending block, 0 for no limit")
          ("producer-threads", bpo::value<uint16_t>()->default_value(config::default_controller_thread_pool_size),
           "Number of worker threads in producer thread pool")
          ("snapshots-dir", bpo::value<bfs::path>()->default_value("snapshots"),
@@ -687,6 +760,9 @@ void producer_plugin::plugin_initialize(const boost::program_options::variables_
 
    my->_incoming_defer_ratio = options.at("incoming-defer-ratio").as<double>();
 
+   my->_pending_incoming_transactions.set_limits( uint64_t(options.at("pending-transactions-size-mb").as<uint32_t>()) * 1024 * 1024,
+                                                  options.at("pending-transactions-per-account").as<uint32_t>() );
+
    auto thread_pool_size = options.at( "producer-threads" ).as<uint16_t>();
    EOS_ASSERT( thread_pool_size > 0, plugin_config_exception,
                "producer-threads ${num} must be greater than 0", ("num", thread_pool_size));
@@ -707,6 +783,18 @@ void producer_plugin::plugin_initialize(const boost::program_options::variables_
                   "No such directory '${dir}'", ("dir", my->_snapshots_dir.generic_string()) );
    }
 
+   // checkpoints and partial snapshots left by a snapshot which was being written at shutdown
+   if( fc::is_directory( my->_snapshots_dir ) ) {
+      vector<bfs::path> stale;
+      for( bfs::directory_iterator enditr, itr{my->_snapshots_dir}; itr != enditr; ++itr ) {
+         const auto name = itr->path().filename().generic_string();
+         if( boost::starts_with( name, ".checkpoint-" ) || boost::ends_with( name, ".bin.tmp" ) )
+            stale.push_back( itr->path() );
+      }
+      for( const auto& p : stale )
+         bfs::remove_all( p );
+   }
+
    my->_incoming_block_subscription = app().get_channel<incoming::channels::block>().subscribe([this](const signed_block_ptr& block){
       try {
          my->on_incoming_block(block);
@@ -754,6 +842,7 @@ void producer_plugin::plugin_startup()
 
    my->_accepted_block_connection.emplace(chain.accepted_block.connect( [this]( const auto& bsp ){ my->on_block( bsp ); } ));
    my->_irreversible_block_connection.emplace(chain.irreversible_block.connect( [this]( const auto& bsp ){ my->on_irreversible_block( bsp->block ); } ));
+   my->_emergency_changed_connection.emplace(chain.on_emergency_changed.connect( [this]( bool emergency ){ my->on_emergency_changed( emergency ); } ));
 
    const auto lib_num = chain.last_irreversible_block_num();
    const auto lib = chain.fetch_block_by_number(lib_num);
@@ -790,8 +879,18 @@ void producer_plugin::plugin_shutdown() {
       my->_thread_pool->join();
       my->_thread_pool->stop();
    }
+   if( my->_snapshot_thread ) {
+      // a snapshot being written is cancelled, its partial file and checkpoint are removed by the snapshot thread
+      for( auto& s : my->_snapshots ) {
+         if( !s.second.done )
+            s.second.writer->cancel();
+      }
+      my->_snapshot_thread->join();
+      my->_snapshot_thread->stop();
+   }
    my->_accepted_block_connection.reset();
    my->_irreversible_block_connection.reset();
+   my->_emergency_changed_connection.reset();
 }
 
 void producer_plugin::handle_sighup() {
@@ -955,18 +1054,116 @@ producer_plugin::snapshot_information producer_plugin::create_snapshot() const {
    auto head_id = chain.head_block_id();
    std::string snapshot_path = (my->_snapshots_dir / fc::format_string("snapshot-${id}.bin", fc::mutable_variant_object()("id", head_id))).generic_string();
 
-   EOS_ASSERT( !fc::is_regular_file(snapshot_path), snapshot_exists_exception,
+   EOS_ASSERT( !fc::is_regular_file(snapshot_path) && !my->_snapshots.count(head_id), snapshot_exists_exception,
                "snapshot named ${name} already exists", ("name", snapshot_path));
 
+   // only the checkpoint is taken on main thread, snapshot is written from it on snapshot thread
+   auto checkpoint_dir = my->_snapshots_dir / fc::format_string(".checkpoint-${id}", fc::mutable_variant_object()("id", head_id));
+   fc::remove_all( checkpoint_dir );
+   const auto start = fc::time_point::now();
+   auto remove_checkpoint = fc::make_scoped_exit([&checkpoint_dir](){
+      try { fc::remove_all( checkpoint_dir ); } catch( ... ) {}
+   });
+   auto checkpoint = chain.create_snapshot_checkpoint( checkpoint_dir );
+   remove_checkpoint.cancel();
+
+   std::string temp_path = snapshot_path + ".tmp";
+   auto snap_out = std::make_shared<std::ofstream>(temp_path, (std::ios::out | std::ios::binary));
+   auto writer = std::make_shared<ostream_snapshot_writer>(*snap_out);
+
+   if( !checkpoint ) {
+      // without reflinks snapshot is written from state database on main thread, as before checkpoints
+      auto remove_temp = fc::make_scoped_exit([&temp_path](){
+         try { fc::remove( temp_path ); } catch( ... ) {}
+      });
+      chain.write_snapshot( writer );
+      writer->finalize();
+      snap_out->flush();
+      snap_out->close();
+      fc::rename( temp_path, snapshot_path );
+      remove_temp.cancel();
+
+      auto& job = my->_snapshots[head_id];
+      job.info   = {head_id, snapshot_path};
+      job.start  = start;
+      job.done   = fc::time_point::now();
+      job.writer = writer;
+      ilog( "snapshot ${n} written on main thread, ${r} rows in ${t} ms", ("n", snapshot_path)
+            ("r", writer->rows_written())("t", (*job.done - start).count() / 1000) );
+      my->prune_snapshots();
+      return job.info;
+   }
+   ilog( "snapshot checkpoint of block ${id} taken in ${t} ms", ("id", head_id)("t", (fc::time_point::now() - start).count() / 1000) );
+
+   auto& job = my->_snapshots[head_id];
+   job.info   = {head_id, snapshot_path};
+   job.start  = start;
+   job.writer = writer;
+
+   if( !my->_snapshot_thread )
+      my->_snapshot_thread.emplace( 1 );
+   boost::asio::post( *my->_snapshot_thread, [impl = my.get(), &chain, checkpoint = *checkpoint, snap_out, writer,
+                                              temp_path, snapshot_path, head_id]() {
+      std::string error;
+      try {
+         chain.write_snapshot( checkpoint, writer );
+         writer->finalize();
+         snap_out->flush();
+         snap_out->close();
+         fc::rename( temp_path, snapshot_path );
+      } catch( const fc::exception& e ) {
+         error = e.to_detail_string();
+      } catch( const std::exception& e ) {
+         error = e.what();
+      } catch( ... ) {
+         error = "unknown exception";
+      }
+      try {
+         fc::remove_all( checkpoint.dir );
+         if( !error.empty() )
+            fc::remove( temp_path );
+      } catch( ... ) {}
+
+      app().post( priority::low, [impl, head_id, error]() {
+         auto itr = impl->_snapshots.find( head_id );
+         if( itr == impl->_snapshots.end() )
+            return;
+         auto& job = itr->second;
+         job.done  = fc::time_point::now();
+         job.error = error;
+         if( error.empty() ) {
+            ilog( "snapshot ${n} written, ${r} rows in ${t} ms", ("n", job.info.snapshot_name)
+                  ("r", job.writer->rows_written())("t", (*job.done - job.start).count() / 1000) );
+         } else {
+            elog( "failed to write snapshot ${n}: ${e}", ("n", job.info.snapshot_name)("e", error) );
+         }
+         impl->prune_snapshots();
+      });
+   });
 
-   auto snap_out = std::ofstream(snapshot_path, (std::ios::out | std::ios::binary));
-   auto writer = std::make_shared<ostream_snapshot_writer>(snap_out);
-   chain.write_snapshot(writer);
-   writer->finalize();
-   snap_out.flush();
-   snap_out.close();
+   return job.info;
+}
 
-   return {head_id, snapshot_path};
+pending_transaction_queue::stats producer_plugin::get_pending_transaction_stats() const {
+   return my->_pending_incoming_transactions.get_stats();
+}
+
+vector<producer_plugin::snapshot_status> producer_plugin::get_snapshot_status() const {
+   vector<snapshot_status> result;
+   const auto now = fc::time_point::now();
+   for( const auto& s : my->_snapshots ) {
+      const auto& job = s.second;
+      snapshot_status status;
+      status.head_block_id    = job.info.head_block_id;
+      status.snapshot_name    = job.info.snapshot_name;
+      status.status           = !job.done ? "in_progress" : job.error.empty() ? "completed" : "failed";
+      status.rows_written     = job.writer->rows_written();
+      status.sections_written = job.writer->sections_written();
+      status.elapsed_ms       = ((job.done ? *job.done : now) - job.start).count() / 1000;
+      status.error            = job.error;
+      result.emplace_back( std::move( status ) );
+   }
+   return result;
 }
 
 optional<fc::time_point> producer_plugin_impl::calculate_next_block_time(const account_name& producer_name, const block_timestamp_type& current_block_time) const {
@@ -1190,7 +1387,17 @@ producer_plugin_impl::start_block_result producer_plugin_impl::start_block() {
       }
 
       try {
-         size_t orig_pending_txn_size = _pending_incoming_transactions.size();
+         // pending incoming transactions of this block, highest fee first; trxs which fail subjectively are queued
+         // again for next block, trxs not tried are put back when this returns
+         std::deque<pending_transaction> incoming_trxs;
+         while( !_pending_incoming_transactions.empty() ) {
+            incoming_trxs.emplace_back( _pending_incoming_transactions.pop() );
+         }
+         auto requeue_incoming = fc::make_scoped_exit( [this, &incoming_trxs]() {
+            for( auto& e : incoming_trxs ) {
+               add_pending_transaction( std::move( e ) );
+            }
+         });
 
          // Processing unapplied transactions...
          //
@@ -1216,14 +1423,29 @@ producer_plugin_impl::start_block_result producer_plugin_impl::start_block() {
                   }
                };
 
-               auto itr = unapplied_trxs.begin();
-               while( itr != unapplied_trxs.end() ) {
-                  auto itr_next = itr; // save off next since itr may be invalidated by loop
-                  ++itr_next;
+               // tried highest priority first like incoming trxs, in order of id for a same priority,
+               // priorities are mostly cached from when trxs were incoming, none is applied if deadline is hit
+               std::vector<std::pair<uint64_t, transaction_metadata_ptr>> ordered_trxs;
+               ordered_trxs.reserve( unapplied_trxs_size );
+               for( const auto& t : unapplied_trxs ) {
+                  if( !t.second->priority && preprocess_deadline <= fc::time_point::now() ) {
+                     exhausted = true;
+                     break;
+                  }
+                  ordered_trxs.emplace_back( get_trx_priority( t.second ), t.second );
+               }
+               if( !exhausted ) {
+                  std::stable_sort( ordered_trxs.begin(), ordered_trxs.end(), []( const auto& a, const auto& b ) {
+                     return a.first > b.first;
+                  });
+               }
 
+               for( const auto& ordered : ordered_trxs ) {
                   if( preprocess_deadline <= fc::time_point::now() ) exhausted = true;
                   if( exhausted ) break;
-                  const transaction_metadata_ptr trx = itr->second;
+                  const transaction_metadata_ptr& trx = ordered.second;
+                  // chain.push_transaction can modify unapplied_trxs, skip trxs no longer in it
+                  if( unapplied_trxs.find( trx->signed_id ) == unapplied_trxs.end() ) continue;
                   auto category = calculate_transaction_category(trx);
                   if (category == tx_category::EXPIRED ||
                      (category == tx_category::UNEXPIRED_UNPERSISTED && _producers.empty()))
@@ -1232,7 +1454,7 @@ producer_plugin_impl::start_block_result producer_plugin_impl::start_block() {
                         fc_dlog(_trx_trace_log, "[TRX_TRACE] Node with producers configured is dropping an EXPIRED transaction that was PREVIOUSLY ACCEPTED : ${txid}",
                                ("txid", trx->id));
                      }
-                     itr = unapplied_trxs.erase( itr ); // unapplied_trxs map has not been modified, so simply erase and continue
+                     unapplied_trxs.erase( trx->signed_id );
                      continue;
                   } else if (category == tx_category::PERSISTED ||
                             (category == tx_category::UNEXPIRED_UNPERSISTED && _pending_block_mode == pending_block_mode::producing))
@@ -1266,8 +1488,6 @@ producer_plugin_impl::start_block_result producer_plugin_impl::start_block() {
                         return start_block_result::failed;
                      } FC_LOG_AND_DROP();
                   }
-
-                  itr = itr_next;
                }
 
                fc_dlog(_log, "Processed ${m} of ${n} previously applied transactions, Applied ${applied}, Failed/Dropped ${failed}",
@@ -1338,14 +1558,13 @@ producer_plugin_impl::start_block_result producer_plugin_impl::start_block() {
                num_processed++;
 
                // configurable ratio of incoming txns vs deferred txns
-               while (_incoming_trx_weight >= 1.0 && orig_pending_txn_size && _pending_incoming_transactions.size()) {
+               while (_incoming_trx_weight >= 1.0 && !incoming_trxs.empty()) {
                   if (scheduled_trx_deadline <= fc::time_point::now()) break;
 
-                  auto e = _pending_incoming_transactions.front();
-                  _pending_incoming_transactions.pop_front();
-                  --orig_pending_txn_size;
+                  auto e = std::move(incoming_trxs.front());
+                  incoming_trxs.pop_front();
                   _incoming_trx_weight -= 1.0;
-                  process_incoming_transaction_async(std::get<0>(e), std::get<1>(e), std::get<2>(e));
+                  process_incoming_transaction_async(e.trx, e.persist_until_expired, e.next);
                }
 
                if (scheduled_trx_deadline <= fc::time_point::now()) {
@@ -1381,7 +1600,7 @@ producer_plugin_impl::start_block_result producer_plugin_impl::start_block() {
                } FC_LOG_AND_DROP();
 
                _incoming_trx_weight += _incoming_defer_ratio;
-               if (!orig_pending_txn_size) _incoming_trx_weight = 0.0;
+               if (incoming_trxs.empty()) _incoming_trx_weight = 0.0;
 
                if( sch_itr_next == sch_idx.end() ) break;
                sch_itr = sch_idx.lower_bound( boost::make_tuple( next_delay_until, next_id ) );
@@ -1404,14 +1623,13 @@ producer_plugin_impl::start_block_result producer_plugin_impl::start_block() {
             // attempt to apply any pending incoming transactions
             _incoming_trx_weight = 0.0;
 
-            if (!_pending_incoming_transactions.empty()) {
-               fc_dlog(_log, "Processing ${n} pending transactions", ("n", _pending_incoming_transactions.size()));
-               while (orig_pending_txn_size && _pending_incoming_transactions.size()) {
+            if (!incoming_trxs.empty()) {
+               fc_dlog(_log, "Processing ${n} pending transactions", ("n", incoming_trxs.size()));
+               while (!incoming_trxs.empty()) {
                   if (preprocess_deadline <= fc::time_point::now()) return start_block_result::exhausted;
-                  auto e = _pending_incoming_transactions.front();
-                  _pending_incoming_transactions.pop_front();
-                  --orig_pending_txn_size;
-                  process_incoming_transaction_async(std::get<0>(e), std::get<1>(e), std::get<2>(e));
+                  auto e = std::move(incoming_trxs.front());
+                  incoming_trxs.pop_front();
+                  process_incoming_transaction_async(e.trx, e.persist_until_expired, e.next);
                }
             }
             return start_block_result::succeeded;
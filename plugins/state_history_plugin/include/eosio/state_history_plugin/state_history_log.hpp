@@ -5,7 +5,10 @@
 #pragma once
 
 #include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include <fstream>
+#include <memory>
 #include <stdint.h>
 
 #include <eosio/chain/exceptions.hpp>
@@ -66,6 +69,12 @@ class state_history_log {
    uint32_t             _end_block   = 0;
    chain::block_id_type last_block_id;
 
+   // read only mappings for read_entry and get_block_id, remapped when the files grow and dropped on truncate
+   std::unique_ptr<boost::interprocess::file_mapping>  log_mapping;
+   std::unique_ptr<boost::interprocess::mapped_region> log_region;
+   std::unique_ptr<boost::interprocess::file_mapping>  index_mapping;
+   std::unique_ptr<boost::interprocess::mapped_region> index_region;
+
  public:
    state_history_log(const char* const name, std::string log_filename, std::string index_filename)
        : name(name)
@@ -105,10 +114,12 @@ class state_history_log {
       EOS_ASSERT(end == pos + sizeof(header) + header.payload_size, chain::plugin_exception,
                  "wrote payload with incorrect size to ${name}.log", ("name", name));
       log.write((char*)&pos, sizeof(pos));
+      log.flush();
 
       index.seekg(0, std::ios_base::end);
       state_history_summary summary{.pos = pos};
       index.write((char*)&summary, sizeof(summary));
+      index.flush();
       if (_begin_block == _end_block)
          _begin_block = header.block_num;
       _end_block    = header.block_num + 1;
@@ -124,9 +135,23 @@ class state_history_log {
       return log;
    }
 
+   // read_entry copies the header and payload of a entry from the mappings of files, it does not move the streams
+   // used by write_entry, so readers only need to be serialized with writes
+   void read_entry(uint32_t block_num, state_history_log_header& header, chain::bytes& payload) {
+      auto pos = map_entry(block_num, header);
+      EOS_ASSERT(header.payload_size >= sizeof(uint32_t), chain::plugin_exception, "corrupt ${name}.log (9)",
+                 ("name", name));
+      const char* p = (const char*)log_region->get_address() + pos + sizeof(header);
+      uint32_t    s;
+      memcpy(&s, p, sizeof(s));
+      EOS_ASSERT(sizeof(s) + s <= header.payload_size, chain::plugin_exception, "corrupt ${name}.log (10)",
+                 ("name", name));
+      payload.assign(p + sizeof(s), p + sizeof(s) + s);
+   }
+
    chain::block_id_type get_block_id(uint32_t block_num) {
       state_history_log_header header;
-      get_entry(block_num, header);
+      map_entry(block_num, header);
       return header.block_id;
    }
 
@@ -243,6 +268,31 @@ class state_history_log {
       }
    }
 
+   // map_entry remaps files if the entry is not mapped yet, returns the position of entry in *.log
+   uint64_t map_entry(uint32_t block_num, state_history_log_header& header) {
+      namespace bip = boost::interprocess;
+      EOS_ASSERT(block_num >= _begin_block && block_num < _end_block, chain::plugin_exception,
+                 "read non-existing block in ${name}.log", ("name", name));
+      uint64_t index_end = uint64_t(block_num - _begin_block + 1) * sizeof(state_history_summary);
+      if (!index_region || index_region->get_size() < index_end) {
+         index_region.reset();
+         index_mapping = std::make_unique<bip::file_mapping>(index_filename.c_str(), bip::read_only);
+         index_region  = std::make_unique<bip::mapped_region>(*index_mapping, bip::read_only);
+      }
+      state_history_summary summary;
+      memcpy(&summary, (const char*)index_region->get_address() + index_end - sizeof(summary), sizeof(summary));
+
+      if (!log_region || log_region->get_size() < summary.pos + sizeof(header)) {
+         log_region.reset();
+         log_mapping = std::make_unique<bip::file_mapping>(log_filename.c_str(), bip::read_only);
+         log_region  = std::make_unique<bip::mapped_region>(*log_mapping, bip::read_only);
+      }
+      memcpy(&header, (const char*)log_region->get_address() + summary.pos, sizeof(header));
+      EOS_ASSERT(summary.pos + sizeof(header) + header.payload_size <= log_region->get_size(), chain::plugin_exception,
+                 "corrupt ${name}.log (11)", ("name", name));
+      return summary.pos;
+   }
+
    uint64_t get_pos(uint32_t block_num) {
       state_history_summary summary;
       index.seekg((block_num - _begin_block) * sizeof(summary));
@@ -251,6 +301,8 @@ class state_history_log {
    }
 
    void truncate(uint32_t block_num) {
+      log_region.reset();
+      index_region.reset();
       log.flush();
       index.flush();
       uint64_t num_removed = 0;
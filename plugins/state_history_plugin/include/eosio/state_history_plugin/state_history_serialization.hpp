@@ -5,6 +5,7 @@
 #pragma once
 
 #include <eosio/chain/account_object.hpp>
+#include <eosio/chain/config_on_chain.hpp>
 #include <eosio/chain/controller.hpp>
 #include <eosio/chain/exceptions.hpp>
 #include <eosio/chain/generated_transaction_object.hpp>
@@ -14,6 +15,7 @@
 #include <eosio/chain/resource_limits.hpp>
 #include <eosio/chain/resource_limits_private.hpp>
 #include <eosio/chain/trace.hpp>
+#include <eosio/chain/txfee_manager.hpp>
 #include <eosio/chain_plugin/chain_plugin.hpp>
 #include <eosio/state_history_plugin/state_history_plugin.hpp>
 
@@ -448,6 +450,30 @@ operator<<(datastream<ST>&
    return ds;
 };
 
+template <typename ST>
+datastream<ST>& operator<<(datastream<ST>&                                                 ds,
+                           const history_serial_wrapper<eosio::chain::config_data_object>& obj) {
+   fc::raw::pack(ds, fc::unsigned_int(0));
+   fc::raw::pack(ds, as_type<uint64_t>(obj.obj.typ.value));
+   fc::raw::pack(ds, as_type<int64_t>(obj.obj.num));
+   fc::raw::pack(ds, as_type<uint64_t>(obj.obj.key.value));
+   fc::raw::pack(ds, as_type<eosio::chain::asset>(obj.obj.fee));
+   return ds;
+}
+
+template <typename ST>
+datastream<ST>& operator<<(datastream<ST>&                                                ds,
+                           const history_serial_wrapper<eosio::chain::action_fee_object>& obj) {
+   fc::raw::pack(ds, fc::unsigned_int(0));
+   fc::raw::pack(ds, as_type<uint64_t>(obj.obj.account.value));
+   fc::raw::pack(ds, as_type<uint64_t>(obj.obj.message_type.value));
+   fc::raw::pack(ds, as_type<eosio::chain::asset>(obj.obj.fee));
+   fc::raw::pack(ds, as_type<uint32_t>(obj.obj.cpu_limit));
+   fc::raw::pack(ds, as_type<uint32_t>(obj.obj.net_limit));
+   fc::raw::pack(ds, as_type<uint32_t>(obj.obj.ram_limit));
+   return ds;
+}
+
 template <typename ST>
 datastream<ST>& operator<<(datastream<ST>& ds, const history_serial_wrapper<eosio::chain::action>& obj) {
    fc::raw::pack(ds, as_type<uint64_t>(obj.obj.account.value));
@@ -11,6 +11,7 @@
 #include <boost/asio/ip/host_name.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/strand.hpp>
+#include <boost/asio/thread_pool.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
 #include <boost/iostreams/device/back_inserter.hpp>
@@ -18,6 +19,9 @@
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/signals2/connection.hpp>
 
+#include <deque>
+#include <mutex>
+
 using tcp    = boost::asio::ip::tcp;
 namespace ws = boost::beast::websocket;
 
@@ -43,10 +47,10 @@ auto catch_and_log(F f) {
 }
 
 namespace bio = boost::iostreams;
-static bytes zlib_compress_bytes(bytes in) {
+static bytes zlib_compress_bytes(const bytes& in, int level) {
    bytes                  out;
    bio::filtering_ostream comp;
-   comp.push(bio::zlib_compressor(bio::zlib::default_compression));
+   comp.push(bio::zlib_compressor(level));
    comp.push(bio::back_inserter(out));
    bio::write(comp, in.data(), in.size());
    bio::close(comp);
@@ -65,18 +69,30 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
    std::unique_ptr<tcp::acceptor>                       acceptor;
    std::map<transaction_id_type, transaction_trace_ptr> cached_traces;
    transaction_trace_ptr                                onblock_trace;
-
+   int                                                  compression_level = bio::zlib::default_compression;
+
+   // entries are packed on main thread and compressed and written on write_thread, so compression is not on the
+   // path of accepting blocks. write_thread has one thread to write entries in order of blocks. log_mutex guards
+   // trace_log and chain_state_log, pending_writes is the log and block num of entries not written yet, it is
+   // used on main thread only.
+   fc::optional<boost::asio::thread_pool>                        write_thread;
+   std::mutex                                                    log_mutex;
+   std::deque<std::pair<const state_history_log*, uint32_t>>    pending_writes;
+
+   // read_threads read ahead trace and delta entries for sessions, read_ahead is the max entries read ahead
+   // by a session and the max messages queued on a session's socket
+   fc::optional<boost::asio::thread_pool>                        read_threads;
+   uint16_t                                                      read_threads_size = 2;
+   uint32_t                                                      read_ahead        = 64;
+
+   // called on read threads and main thread
    void get_log_entry(state_history_log& log, uint32_t block_num, fc::optional<bytes>& result) {
+      std::lock_guard<std::mutex> g(log_mutex);
       if (block_num < log.begin_block() || block_num >= log.end_block())
          return;
       state_history_log_header header;
-      auto&                    stream = log.get_entry(block_num, header);
-      uint32_t                 s;
-      stream.read((char*)&s, sizeof(s));
       result.emplace();
-      result->resize(s);
-      if (s)
-         stream.read(result->data(), s);
+      log.read_entry(block_num, header, *result);
    }
 
    void get_block(uint32_t block_num, fc::optional<bytes>& result) {
@@ -90,10 +106,12 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
    }
 
    fc::optional<chain::block_id_type> get_block_id(uint32_t block_num) {
+      std::unique_lock<std::mutex> g(log_mutex);
       if (trace_log && block_num >= trace_log->begin_block() && block_num < trace_log->end_block())
          return trace_log->get_block_id(block_num);
       if (chain_state_log && block_num >= chain_state_log->begin_block() && block_num < chain_state_log->end_block())
          return chain_state_log->get_block_id(block_num);
+      g.unlock();
       try {
          auto block = chain_plug->chain().fetch_block_by_number(block_num);
          if (block)
@@ -112,6 +130,24 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
       fc::optional<get_blocks_request_v0>        current_request;
       bool                                       need_to_send_update = false;
 
+      struct prefetched_entry {
+         uint32_t            block_num = 0;
+         fc::optional<bytes> traces;
+         fc::optional<bytes> deltas;
+      };
+
+      // entries of [prefetch_begin, prefetch_next) are in prefetched or being read on a read thread,
+      // prefetch_generation drops reads started before a fork or a new request
+      std::deque<prefetched_entry> prefetched;
+      bool                         prefetching         = false;
+      uint32_t                     prefetch_begin      = 0;
+      uint32_t                     prefetch_next       = 0;
+      uint32_t                     prefetch_generation = 0;
+
+      uint64_t        blocks_sent = 0;
+      uint64_t        bytes_sent  = 0;
+      fc::time_point  stream_start;
+
       session(std::shared_ptr<state_history_plugin_impl> plugin)
           : plugin(std::move(plugin)) {}
 
@@ -154,6 +190,7 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
       template <typename T>
       void send(T obj) {
          send_queue.push_back(fc::raw::pack(state_result{std::move(obj)}));
+         bytes_sent += send_queue.back().size();
          send();
       }
 
@@ -182,6 +219,7 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
          get_status_result_v0 result;
          result.head              = {chain.head_block_num(), chain.head_block_id()};
          result.last_irreversible = {chain.last_irreversible_block_num(), chain.last_irreversible_block_id()};
+         std::lock_guard<std::mutex> g(plugin->log_mutex);
          if (plugin->trace_log) {
             result.trace_begin_block = plugin->trace_log->begin_block();
             result.trace_end_block   = plugin->trace_log->end_block();
@@ -203,6 +241,10 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
          }
          req.have_positions.clear();
          current_request = req;
+         reset_prefetch();
+         blocks_sent  = 0;
+         bytes_sent   = 0;
+         stream_start = fc::time_point::now();
          send_update(true);
       }
 
@@ -216,36 +258,123 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
       void send_update(bool changed = false) {
          if (changed)
             need_to_send_update = true;
-         if (!send_queue.empty() || !need_to_send_update || !current_request ||
-             !current_request->max_messages_in_flight)
-            return;
+         while (send_queue.size() < plugin->read_ahead && need_to_send_update && current_request &&
+                current_request->max_messages_in_flight) {
+            if (!send_update_block())
+               return;
+         }
+      }
+
+      // send_update_block queues the update of next block, returns false if the entries of the block are not read yet
+      bool send_update_block() {
          auto&                chain = plugin->chain_plug->chain();
          get_blocks_result_v0 result;
          result.head              = {chain.head_block_num(), chain.head_block_id()};
          result.last_irreversible = {chain.last_irreversible_block_num(), chain.last_irreversible_block_id()};
          uint32_t current =
              current_request->irreversible_only ? result.last_irreversible.block_num : result.head.block_num;
-         if (current_request->start_block_num <= current &&
-             current_request->start_block_num < current_request->end_block_num) {
-            auto block_id = plugin->get_block_id(current_request->start_block_num);
+         const auto block_num = current_request->start_block_num;
+         if (block_num <= current && block_num < current_request->end_block_num) {
+            fc::optional<prefetched_entry> entry;
+            if (current_request->fetch_traces || current_request->fetch_deltas) {
+               if (plugin->is_write_pending(block_num))
+                  return false; // sent when the entries of block are written
+               if (block_num != prefetch_begin || block_num >= prefetch_next)
+                  reset_prefetch(block_num);
+               if (prefetched.empty()) {
+                  start_prefetch(current);
+                  return false; // sent when the read is done
+               }
+               entry = std::move(prefetched.front());
+               prefetched.pop_front();
+               ++prefetch_begin;
+               start_prefetch(current);
+            }
+            auto block_id = plugin->get_block_id(block_num);
             if (block_id) {
-               result.this_block  = block_position{current_request->start_block_num, *block_id};
-               auto prev_block_id = plugin->get_block_id(current_request->start_block_num - 1);
+               result.this_block  = block_position{block_num, *block_id};
+               auto prev_block_id = plugin->get_block_id(block_num - 1);
                if (prev_block_id)
-                  result.prev_block = block_position{current_request->start_block_num - 1, *prev_block_id};
+                  result.prev_block = block_position{block_num - 1, *prev_block_id};
                if (current_request->fetch_block)
-                  plugin->get_block(current_request->start_block_num, result.block);
-               if (current_request->fetch_traces && plugin->trace_log)
-                  plugin->get_log_entry(*plugin->trace_log, current_request->start_block_num, result.traces);
-               if (current_request->fetch_deltas && plugin->chain_state_log)
-                  plugin->get_log_entry(*plugin->chain_state_log, current_request->start_block_num, result.deltas);
+                  plugin->get_block(block_num, result.block);
+               if (entry) {
+                  result.traces = std::move(entry->traces);
+                  result.deltas = std::move(entry->deltas);
+               }
             }
             ++current_request->start_block_num;
+            if (!(++blocks_sent % 10000))
+               log_throughput();
          }
          send(std::move(result));
          --current_request->max_messages_in_flight;
          need_to_send_update = current_request->start_block_num <= current &&
                                current_request->start_block_num < current_request->end_block_num;
+         return true;
+      }
+
+      // reset_prefetch drops entries read ahead, reads in progress are dropped when they are done
+      void reset_prefetch(uint32_t block_num = 0) {
+         prefetched.clear();
+         prefetch_begin = prefetch_next = block_num;
+         ++prefetch_generation;
+      }
+
+      // start_prefetch read entries after the ones read ahead on a read thread, up to the last block which is
+      // at most current and is written in logs
+      void start_prefetch(uint32_t current) {
+         if (prefetching || prefetch_next - prefetch_begin >= plugin->read_ahead)
+            return;
+         uint32_t last = std::min(current, current_request->end_block_num - 1);
+         if (!plugin->pending_writes.empty())
+            last = std::min(last, plugin->pending_writes.front().second - 1);
+         if (prefetch_next > last)
+            return;
+         uint32_t n = std::min(last - prefetch_next + 1, plugin->read_ahead - (prefetch_next - prefetch_begin));
+
+         prefetching = true;
+         boost::asio::post(*plugin->read_threads, [self = shared_from_this(), this, begin = prefetch_next, n,
+                                                   generation = prefetch_generation,
+                                                   fetch_traces = current_request->fetch_traces,
+                                                   fetch_deltas = current_request->fetch_deltas]() {
+            std::vector<prefetched_entry> entries(n);
+            // a read error is rethrown on main thread to close the session, entries missing are never sent empty
+            std::exception_ptr error;
+            try {
+               for (uint32_t i = 0; i < n; ++i) {
+                  auto& entry     = entries[i];
+                  entry.block_num = begin + i;
+                  if (fetch_traces && plugin->trace_log)
+                     plugin->get_log_entry(*plugin->trace_log, entry.block_num, entry.traces);
+                  if (fetch_deltas && plugin->chain_state_log)
+                     plugin->get_log_entry(*plugin->chain_state_log, entry.block_num, entry.deltas);
+               }
+            } catch (...) {
+               error = std::current_exception();
+            }
+            app().post(priority::medium, [self, this, generation, error, entries = std::move(entries)]() mutable {
+               prefetching = false;
+               if (plugin->stopping || !plugin->sessions.count(this))
+                  return;
+               catch_and_close([&] {
+                  if (generation == prefetch_generation) {
+                     if (error)
+                        std::rethrow_exception(error);
+                     for (auto& entry : entries)
+                        prefetched.push_back(std::move(entry));
+                  }
+                  send_update();
+               });
+            });
+         });
+         prefetch_next += n;
+      }
+
+      void log_throughput() {
+         auto elapsed = std::max<int64_t>((fc::time_point::now() - stream_start).count(), 1);
+         ilog("state history session sent ${n} blocks, ${b} bytes, ${r} blocks/s",
+              ("n", blocks_sent)("b", bytes_sent)("r", blocks_sent * 1000000 / elapsed));
       }
 
       template <typename F>
@@ -283,6 +412,8 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
       }
 
       void close() {
+         if (blocks_sent)
+            log_throughput();
          socket_stream->next_layer().close();
          plugin->sessions.erase(this);
       }
@@ -355,6 +486,40 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
       }
    }
 
+   bool is_write_pending(uint32_t block_num) const {
+      return !pending_writes.empty() && block_num >= pending_writes.front().second;
+   }
+
+   void write_entry(state_history_log& log, const block_state_ptr& block_state, bytes&& payload) {
+      pending_writes.emplace_back(&log, block_state->block_num);
+      boost::asio::post(*write_thread, [this, self = shared_from_this(), &log, block_num = block_state->block_num,
+                                        block_id = block_state->id, prev_id = block_state->header.previous,
+                                        payload = std::move(payload)]() {
+         catch_and_log([&] {
+            auto bin = zlib_compress_bytes(payload, compression_level);
+            EOS_ASSERT(bin.size() == (uint32_t)bin.size(), plugin_exception, "payload is too big");
+            state_history_log_header header{
+                .block_num = block_num, .block_id = block_id, .payload_size = sizeof(uint32_t) + bin.size()};
+            std::lock_guard<std::mutex> g(log_mutex);
+            log.write_entry(header, prev_id, [&](auto& stream) {
+               uint32_t s = (uint32_t)bin.size();
+               stream.write((char*)&s, sizeof(s));
+               if (!bin.empty())
+                  stream.write(bin.data(), bin.size());
+            });
+         });
+         app().post(priority::medium, [this, self]() {
+            if (stopping)
+               return;
+            pending_writes.pop_front();
+            for (auto& s : sessions) {
+               if (s.second)
+                  s.second->send_update();
+            }
+         });
+      });
+   }
+
    void on_accepted_block(const block_state_ptr& block_state) {
       store_traces(block_state);
       store_chain_state(block_state);
@@ -363,6 +528,8 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
          if (p) {
             if (p->current_request && block_state->block_num < p->current_request->start_block_num)
                p->current_request->start_block_num = block_state->block_num;
+            if (block_state->block_num < p->prefetch_next)
+               p->reset_prefetch(); // entries of block may be read from the replaced fork
             p->send_update(true);
          }
       }
@@ -388,25 +555,19 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
       cached_traces.clear();
       onblock_trace.reset();
 
-      auto& db         = chain_plug->chain().db();
-      auto  traces_bin = zlib_compress_bytes(fc::raw::pack(make_history_serial_wrapper(db, traces)));
-      EOS_ASSERT(traces_bin.size() == (uint32_t)traces_bin.size(), plugin_exception, "traces is too big");
-
-      state_history_log_header header{.block_num    = block_state->block->block_num(),
-                                      .block_id     = block_state->block->id(),
-                                      .payload_size = sizeof(uint32_t) + traces_bin.size()};
-      trace_log->write_entry(header, block_state->block->previous, [&](auto& stream) {
-         uint32_t s = (uint32_t)traces_bin.size();
-         stream.write((char*)&s, sizeof(s));
-         if (!traces_bin.empty())
-            stream.write(traces_bin.data(), traces_bin.size());
-      });
+      auto& db = chain_plug->chain().db();
+      write_entry(*trace_log, block_state, fc::raw::pack(make_history_serial_wrapper(db, traces)));
    }
 
    void store_chain_state(const block_state_ptr& block_state) {
       if (!chain_state_log)
          return;
-      bool fresh = chain_state_log->begin_block() == chain_state_log->end_block();
+      bool fresh = std::none_of(pending_writes.begin(), pending_writes.end(),
+                                [&](auto& w) { return w.first == &*chain_state_log; });
+      if (fresh) {
+         std::lock_guard<std::mutex> g(log_mutex);
+         fresh = chain_state_log->begin_block() == chain_state_log->end_block();
+      }
       if (fresh)
          ilog("Placing initial state in block ${n}", ("n", block_state->block->block_num()));
 
@@ -485,17 +646,10 @@ struct state_history_plugin_impl : std::enable_shared_from_this<state_history_pl
       process_table("resource_limits_state", db.get_index<resource_limits::resource_limits_state_index>(), pack_row);
       process_table("resource_limits_config", db.get_index<resource_limits::resource_limits_config_index>(), pack_row);
 
-      auto deltas_bin = zlib_compress_bytes(fc::raw::pack(deltas));
-      EOS_ASSERT(deltas_bin.size() == (uint32_t)deltas_bin.size(), plugin_exception, "deltas is too big");
-      state_history_log_header header{.block_num    = block_state->block->block_num(),
-                                      .block_id     = block_state->block->id(),
-                                      .payload_size = sizeof(uint32_t) + deltas_bin.size()};
-      chain_state_log->write_entry(header, block_state->block->previous, [&](auto& stream) {
-         uint32_t s = (uint32_t)deltas_bin.size();
-         stream.write((char*)&s, sizeof(s));
-         if (!deltas_bin.empty())
-            stream.write(deltas_bin.data(), deltas_bin.size());
-      });
+      process_table("config_data", db.get_index<config_data_object_index>(), pack_row);
+      process_table("action_fee", db.get_index<action_fee_object_index>(), pack_row);
+
+      write_entry(*chain_state_log, block_state, fc::raw::pack(deltas));
    } // store_chain_state
 };   // state_history_plugin_impl
 
@@ -511,6 +665,13 @@ void state_history_plugin::set_program_options(options_description& cli, options
    cli.add_options()("delete-state-history", bpo::bool_switch()->default_value(false), "clear state history files");
    options("trace-history", bpo::bool_switch()->default_value(false), "enable trace history");
    options("chain-state-history", bpo::bool_switch()->default_value(false), "enable chain state history");
+   options("state-history-compression-level", bpo::value<int>()->default_value(bio::zlib::default_compression),
+           "zlib compression level of trace and chain state history, from 0 (none) and 1 (fastest) to 9 (smallest), "
+           "-1 is the zlib default");
+   options("state-history-read-threads", bpo::value<uint16_t>()->default_value(my->read_threads_size),
+           "Number of threads to read trace and chain state history for sessions");
+   options("state-history-read-ahead", bpo::value<uint32_t>()->default_value(my->read_ahead),
+           "Max number of blocks read ahead and queued for sending by a session");
    options("state-history-endpoint", bpo::value<string>()->default_value("127.0.0.1:8080"),
            "the endpoint upon which to listen for incoming connections. Caution: only expose this port to "
            "your internal network.");
@@ -543,6 +704,20 @@ void state_history_plugin::plugin_initialize(const variables_map& options) {
       my->endpoint_port    = std::stoi(port);
       idump((ip_port)(host)(port));
 
+      my->compression_level = options.at("state-history-compression-level").as<int>();
+      EOS_ASSERT(my->compression_level >= bio::zlib::default_compression &&
+                     my->compression_level <= bio::zlib::best_compression,
+                 plugin_config_exception, "invalid state-history-compression-level ${l}", ("l", my->compression_level));
+      my->write_thread.emplace(1);
+
+      my->read_threads_size = options.at("state-history-read-threads").as<uint16_t>();
+      EOS_ASSERT(my->read_threads_size > 0, plugin_config_exception,
+                 "state-history-read-threads ${num} must be greater than 0", ("num", my->read_threads_size));
+      my->read_ahead = options.at("state-history-read-ahead").as<uint32_t>();
+      EOS_ASSERT(my->read_ahead > 0, plugin_config_exception,
+                 "state-history-read-ahead ${num} must be greater than 0", ("num", my->read_ahead));
+      my->read_threads.emplace(my->read_threads_size);
+
       if (options.at("delete-state-history").as<bool>()) {
          ilog("Deleting state history");
          boost::filesystem::remove_all(state_history_dir);
@@ -567,6 +742,10 @@ void state_history_plugin::plugin_shutdown() {
    while (!my->sessions.empty())
       my->sessions.begin()->second->close();
    my->stopping = true;
+   if (my->read_threads)
+      my->read_threads->join();
+   if (my->write_thread)
+      my->write_thread->join();
 }
 
 } // namespace eosio
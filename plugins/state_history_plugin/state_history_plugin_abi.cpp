@@ -418,6 +418,24 @@ extern const char* const state_history_plugin_abi = R"({
                 { "type": "uint32", "name": "account_cpu_usage_average_window" },
                 { "type": "uint32", "name": "account_net_usage_average_window" }
             ]
+        },
+        {
+            "name": "config_data_v0", "fields": [
+                { "type": "name", "name": "typ" },
+                { "type": "int64", "name": "num" },
+                { "type": "name", "name": "key" },
+                { "type": "asset", "name": "fee" }
+            ]
+        },
+        {
+            "name": "action_fee_v0", "fields": [
+                { "type": "name", "name": "account" },
+                { "type": "name", "name": "message_type" },
+                { "type": "asset", "name": "fee" },
+                { "type": "uint32", "name": "cpu_limit" },
+                { "type": "uint32", "name": "net_limit" },
+                { "type": "uint32", "name": "ram_limit" }
+            ]
         }
     ],
     "types": [
@@ -452,7 +470,9 @@ extern const char* const state_history_plugin_abi = R"({
         { "name": "resource_limits_state", "types": ["resource_limits_state_v0"] },
         { "name": "resource_limits_ratio", "types": ["resource_limits_ratio_v0"] },
         { "name": "elastic_limit_parameters", "types": ["elastic_limit_parameters_v0"] },
-        { "name": "resource_limits_config", "types": ["resource_limits_config_v0"] }
+        { "name": "resource_limits_config", "types": ["resource_limits_config_v0"] },
+        { "name": "config_data", "types": ["config_data_v0"] },
+        { "name": "action_fee", "types": ["action_fee_v0"] }
     ],
     "tables": [
         { "name": "account", "type": "account", "key_names": ["name"] },
@@ -470,6 +490,8 @@ extern const char* const state_history_plugin_abi = R"({
         { "name": "resource_limits", "type": "resource_limits", "key_names": ["owner"] },
         { "name": "resource_usage", "type": "resource_usage", "key_names": ["owner"] },
         { "name": "resource_limits_state", "type": "resource_limits_state", "key_names": [] },
-        { "name": "resource_limits_config", "type": "resource_limits_config", "key_names": [] }
+        { "name": "resource_limits_config", "type": "resource_limits_config", "key_names": [] },
+        { "name": "config_data", "type": "config_data", "key_names": ["typ"] },
+        { "name": "action_fee", "type": "action_fee", "key_names": ["account", "message_type"] }
     ]
 })";
@@ -16,6 +16,8 @@
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/path.hpp>
 
+#include <thread>
+
 using namespace eosio::chain;
 namespace bfs = boost::filesystem;
 namespace bpo = boost::program_options;
@@ -27,6 +29,7 @@ struct blocklog {
    {}
 
    void read_log();
+   void verify_log();
    void set_program_options(options_description& cli);
    void initialize(const variables_map& options);
 
@@ -36,6 +39,8 @@ struct blocklog {
    uint32_t                         last_block;
    bool                             no_pretty_print;
    bool                             as_json_array;
+   bool                             verify_blocks;
+   uint16_t                         verify_threads;
 };
 
 void blocklog::read_log() {
@@ -130,6 +135,24 @@ void blocklog::read_log() {
       *out << "]";
 }
 
+void blocklog::verify_log() {
+   block_log block_logger(blocks_dir);
+   const auto end = block_logger.read_head();
+   EOS_ASSERT( end, block_log_exception, "No blocks found in block log" );
+
+   const uint32_t first = std::max( first_block, block_logger.first_block_num() );
+   const uint32_t last  = std::min( last_block, end->block_num() );
+   ilog( "verifying block num ${f} through block num ${l} on ${t} threads", ("f", first)("l", last)("t", verify_threads) );
+
+   const auto start = fc::time_point::now();
+   block_logger.verify_blocks( first, last, verify_threads, [&]( uint32_t verified ) {
+      const auto elapsed = std::max<int64_t>( (fc::time_point::now() - start).count(), 1 );
+      ilog( "verified ${n} of ${t} blocks, ${r} blocks/s",
+            ("n", verified)("t", last - first + 1)("r", uint64_t(verified) * 1000000 / elapsed) );
+   });
+   ilog( "block num ${f} through block num ${l} are verified", ("f", first)("l", last) );
+}
+
 void blocklog::set_program_options(options_description& cli)
 {
    cli.add_options()
@@ -145,6 +168,10 @@ void blocklog::set_program_options(options_description& cli)
           "Do not pretty print the output.  Useful if piping to jq to improve performance.")
          ("as-json-array", bpo::bool_switch(&as_json_array)->default_value(false),
           "Print out json blocks wrapped in json array (otherwise the output is free-standing json objects).")
+         ("verify-blocks", bpo::bool_switch(&verify_blocks)->default_value(false),
+          "Verify that the blocks from first to last can be read and link to the id of the block before them, instead of printing them.")
+         ("verify-threads", bpo::value<uint16_t>(&verify_threads)->default_value(static_cast<uint16_t>(std::max(std::thread::hardware_concurrency(), 1u))),
+          "Number of threads to verify blocks.")
          ("help", "Print this help message and exit.")
          ;
 
@@ -185,7 +212,10 @@ int main(int argc, char** argv)
         return 0;
       }
       blog.initialize(vmap);
-      blog.read_log();
+      if (blog.verify_blocks)
+         blog.verify_log();
+      else
+         blog.read_log();
    } catch( const fc::exception& e ) {
       elog( "${e}", ("e", e.to_detail_string()));
       return -1;
@@ -122,4 +122,51 @@ BOOST_FIXTURE_TEST_CASE( get_block_with_invalid_abi, TESTER ) try {
 
 } FC_LOG_AND_RETHROW() /// get_block_with_invalid_abi
 
+BOOST_AUTO_TEST_CASE( fix_vote_sum_voteage ) try {
+   // (staked, age, update_height) of fix-time votes to one bp
+   const std::vector<std::tuple<int64_t, int64_t, uint32_t>> votes = {
+      { 100, 0, 10 }, { 2500, 12345, 200 }, { 7, 99, 1000 }, { 1000000, 5, 1001 }
+   };
+
+   chain_apis::fix_vote_sum sum;
+   for( const auto& v : votes ) {
+      sum.staked     += std::get<0>(v);
+      sum.age_offset += std::get<1>(v) - static_cast<int128_t>(std::get<0>(v)) * std::get<2>(v);
+   }
+
+   for( uint32_t block_num : { 1001u, 5000u, 123456789u } ) {
+      int128_t expected = 0;
+      for( const auto& v : votes ) {
+         expected += static_cast<int128_t>(std::get<0>(v)) * static_cast<int128_t>(block_num - std::get<2>(v)) + std::get<1>(v);
+      }
+      BOOST_CHECK( sum.voteage_at(block_num) == expected );
+   }
+} FC_LOG_AND_RETHROW() /// fix_vote_sum_voteage
+
+BOOST_FIXTURE_TEST_CASE( vote_reward_index_invalidation, TESTER ) try {
+   produce_blocks(2);
+   create_accounts( {N(voter), N(other)} );
+   produce_block();
+
+   chain_apis::vote_reward_index index;
+   BOOST_CHECK( index.load_or_get(*control, N(voter)).empty() );
+   BOOST_CHECK( index.load_or_get(*control, N(other)).empty() );
+   BOOST_CHECK_EQUAL( index.size(), 2u );
+
+   // a fixvotes row written in scope of voter drops it, whoever wrote it
+   index.on_fixvotes_changed( N(voter), control->head_block_num() + 1 );
+   BOOST_CHECK_EQUAL( index.size(), 1u );
+
+   // loaded again after the change, dropped by undo while the change is reversible
+   index.load_or_get(*control, N(voter));
+   index.on_state_undone();
+   BOOST_CHECK_EQUAL( index.size(), 1u );
+
+   // once the change is irreversible an undo keeps it
+   index.load_or_get(*control, N(voter));
+   index.on_irreversible_block( control->head_block_num() + 1 );
+   index.on_state_undone();
+   BOOST_CHECK_EQUAL( index.size(), 2u );
+} FC_LOG_AND_RETHROW() /// vote_reward_index_invalidation
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,176 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#include <boost/test/unit_test.hpp>
+
+#include <eosio/testing/tester.hpp>
+#include <eosio/history_plugin/history_store.hpp>
+
+#include <fc/filesystem.hpp>
+
+using namespace eosio;
+using namespace eosio::chain;
+using namespace eosio::testing;
+
+static history_entry make_entry( uint64_t global_sequence, uint32_t block_num, const char* trx, flat_set<account_name> accounts ) {
+   history_entry e;
+   e.action.global_sequence     = global_sequence;
+   e.action.block_num           = block_num;
+   e.action.trx_id              = transaction_id_type::hash( std::string(trx) );
+   e.action.packed_action_trace = bytes( global_sequence, 'a' );
+   e.accounts                   = std::move(accounts);
+   return e;
+}
+
+static bool has_permission( const vector<permission_level>& permissions, const permission_level& p ) {
+   return std::find( permissions.begin(), permissions.end(), p ) != permissions.end();
+}
+
+BOOST_AUTO_TEST_SUITE(history_store_tests)
+
+BOOST_AUTO_TEST_CASE(history_store_add_and_fork) { try {
+   fc::temp_directory tempdir;
+   const auto alice_key = base_tester::get_public_key( N(alice), "active" );
+   const auto new_key   = base_tester::get_public_key( N(alice), "new" );
+   const auto match_all = []( const transaction_id_type& ) { return true; };
+
+   {
+      history_store store( tempdir.path() );
+      BOOST_REQUIRE( store.empty() );
+
+      store.add_block( 1, {}, { auth_change{ {N(alice), config::active_name}, {alice_key}, {N(bob)} } } );
+      store.add_block( 2, { make_entry( 1, 2, "t1", {N(alice), N(bob)} ), make_entry( 2, 2, "t1", {N(alice)} ) }, {} );
+      store.add_block( 3, { make_entry( 3, 3, "t2", {N(bob)} ) },
+                       { auth_change{ {N(alice), config::active_name}, {new_key}, {} } } );
+
+      BOOST_REQUIRE_EQUAL( store.begin_block(), 1 );
+      BOOST_REQUIRE_EQUAL( store.end_block(), 4 );
+      BOOST_REQUIRE_EQUAL( store.account_action_count( N(alice) ), 2 );
+      BOOST_REQUIRE_EQUAL( store.account_action_count( N(bob) ), 2 );
+      BOOST_REQUIRE_EQUAL( store.get_account_action( N(bob), 1 ).global_sequence, 3 );
+      BOOST_REQUIRE_EQUAL( store.get_account_action( N(alice), 1 ).packed_action_trace.size(), 2 );
+      BOOST_REQUIRE_EQUAL( store.get_transaction_actions( transaction_id_type::hash( std::string("t1") ), match_all ).size(), 2 );
+      BOOST_REQUIRE( store.get_key_permissions( alice_key ).empty() );
+      BOOST_REQUIRE( has_permission( store.get_key_permissions( new_key ), {N(alice), config::active_name} ) );
+      BOOST_REQUIRE( store.get_controlled_permissions( N(bob) ).empty() );
+
+      // block 3 is replaced by a block of other fork, its actions and auth changes are dropped
+      store.add_block( 3, { make_entry( 3, 3, "t3", {N(alice)} ) }, {} );
+
+      BOOST_REQUIRE_EQUAL( store.end_block(), 4 );
+      BOOST_REQUIRE_EQUAL( store.account_action_count( N(alice) ), 3 );
+      BOOST_REQUIRE_EQUAL( store.account_action_count( N(bob) ), 1 );
+      BOOST_REQUIRE( store.get_transaction_actions( transaction_id_type::hash( std::string("t2") ),
+                                                    [&]( const transaction_id_type& id ) {
+                                                       return id == transaction_id_type::hash( std::string("t2") );
+                                                    }).empty() );
+      BOOST_REQUIRE( has_permission( store.get_key_permissions( alice_key ), {N(alice), config::active_name} ) );
+      BOOST_REQUIRE( store.get_key_permissions( new_key ).empty() );
+      BOOST_REQUIRE( has_permission( store.get_controlled_permissions( N(bob) ), {N(alice), config::active_name} ) );
+   }
+
+   // indices are loaded again from files
+   history_store store( tempdir.path() );
+   BOOST_REQUIRE_EQUAL( store.begin_block(), 1 );
+   BOOST_REQUIRE_EQUAL( store.end_block(), 4 );
+   BOOST_REQUIRE_EQUAL( store.account_action_count( N(alice) ), 3 );
+   BOOST_REQUIRE_EQUAL( store.get_account_action( N(alice), 2 ).trx_id, transaction_id_type::hash( std::string("t3") ) );
+   BOOST_REQUIRE( has_permission( store.get_key_permissions( alice_key ), {N(alice), config::active_name} ) );
+
+   // a replay from an earlier block removes all blocks after it
+   store.add_block( 1, {}, {} );
+   BOOST_REQUIRE_EQUAL( store.end_block(), 2 );
+   BOOST_REQUIRE_EQUAL( store.account_action_count( N(alice) ), 0 );
+   BOOST_REQUIRE( store.get_key_permissions( alice_key ).empty() );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(history_store_gap) { try {
+   fc::temp_directory tempdir;
+   {
+      history_store store( tempdir.path() );
+      store.add_block( 1, { make_entry( 1, 1, "t1", {N(alice)} ) }, {} );
+      store.add_block( 2, {}, {} );
+
+      // the store is behind the chain, e.g. the plugin is enabled again later, the history is not wiped
+      BOOST_REQUIRE_THROW( store.add_block( 10, { make_entry( 9, 10, "t2", {N(bob)} ) }, {} ), plugin_exception );
+      BOOST_REQUIRE_EQUAL( store.begin_block(), 1 );
+      BOOST_REQUIRE_EQUAL( store.end_block(), 3 );
+      BOOST_REQUIRE_EQUAL( store.account_action_count( N(alice) ), 1 );
+      BOOST_REQUIRE_EQUAL( store.account_action_count( N(bob) ), 0 );
+   }
+
+   // unless restart_on_gap, then the history restarts from the block
+   history_store store( tempdir.path(), history_store::default_index_run_size, true );
+   BOOST_REQUIRE_EQUAL( store.end_block(), 3 );
+   store.add_block( 10, { make_entry( 9, 10, "t2", {N(bob)} ) }, {} );
+   BOOST_REQUIRE_EQUAL( store.begin_block(), 10 );
+   BOOST_REQUIRE_EQUAL( store.end_block(), 11 );
+   BOOST_REQUIRE_EQUAL( store.account_action_count( N(alice) ), 0 );
+   BOOST_REQUIRE_EQUAL( store.get_account_action( N(bob), 0 ).global_sequence, 9 );
+
+   store.add_block( 11, {}, {} );
+   BOOST_REQUIRE_EQUAL( store.end_block(), 12 );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(history_store_sorted_runs) { try {
+   fc::temp_directory tempdir;
+   const auto trx_id = []( uint32_t i ) { return transaction_id_type::hash( std::to_string( i ) ); };
+   const auto match_all = []( const transaction_id_type& ) { return true; };
+
+   // runs of 3 records, actions of block n are of alice and of bob if n is even, each block is a trx
+   const auto add_blocks = [&]( history_store& store, uint32_t begin, uint32_t end ) {
+      for( uint32_t n = begin; n < end; ++n ) {
+         flat_set<account_name> accounts{ N(alice) };
+         if( n % 2 == 0 ) accounts.insert( N(bob) );
+         store.add_block( n, { make_entry( n, n, std::to_string( n ).c_str(), accounts ),
+                               make_entry( n, n, std::to_string( n ).c_str(), {N(alice)} ) }, {} );
+      }
+   };
+   const auto check = [&]( const history_store& store, uint32_t end ) {
+      BOOST_REQUIRE_EQUAL( store.account_action_count( N(alice) ), 2 * ( end - 1 ) );
+      BOOST_REQUIRE_EQUAL( store.account_action_count( N(bob) ), ( end - 1 ) / 2 );
+      for( uint32_t s = 0; s < 2 * ( end - 1 ); ++s ) {
+         BOOST_REQUIRE_EQUAL( store.get_account_action( N(alice), s ).block_num, s / 2 + 1 );
+      }
+      for( uint32_t s = 0; s < ( end - 1 ) / 2; ++s ) {
+         BOOST_REQUIRE_EQUAL( store.get_account_action( N(bob), s ).block_num, 2 * s + 2 );
+      }
+      BOOST_REQUIRE_THROW( store.get_account_action( N(alice), 2 * ( end - 1 ) ), plugin_exception );
+      for( uint32_t n = 1; n < end; ++n ) {
+         const auto actions = store.get_transaction_actions( trx_id( n ), match_all );
+         BOOST_REQUIRE_EQUAL( actions.size(), 2 );
+         BOOST_REQUIRE_EQUAL( actions[0].trx_id, trx_id( n ) );
+         BOOST_REQUIRE_EQUAL( actions[1].block_num, n );
+      }
+   };
+
+   {
+      history_store store( tempdir.path(), 3 );
+      add_blocks( store, 1, 20 );
+      check( store, 20 );
+
+      // truncate into a sorted run
+      store.add_block( 8, {}, {} );
+      BOOST_REQUIRE_EQUAL( store.account_action_count( N(alice) ), 14 );
+      BOOST_REQUIRE( store.get_transaction_actions( trx_id( 9 ), [&]( const transaction_id_type& id ) {
+                                                       return id == trx_id( 9 );
+                                                    }).empty() );
+      add_blocks( store, 8, 30 );
+      check( store, 30 );
+   }
+
+   // runs are read again from the sorted files
+   {
+      history_store store( tempdir.path(), 3 );
+      check( store, 30 );
+   }
+
+   // runs of other size are sorted again
+   history_store store( tempdir.path(), 4 );
+   check( store, 30 );
+   add_blocks( store, 30, 35 );
+   check( store, 35 );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+
+from testUtils import Utils
+from Cluster import Cluster
+from WalletMgr import WalletMgr
+from Node import Node
+from TestHelper import TestHelper
+
+import signal
+
+###############################################################
+# nodeos_fee_history_test
+# Verifies history-compact-fee-traces: get_actions returns the fee of an action, and the fee of an action
+# which is filtered out is kept as a fee action of its own. With --mongodb it verifies mongodb-compact-fee-traces
+# too: fee_totals are not counted twice when irreversible blocks are processed again by a replay.
+# --dump-error-details <Upon error print etc/eosio/node_*/config.ini and var/lib/node_*/stderr.log to stdout>
+# --keep-logs <Don't delete var/lib/node_* folders upon test completion>
+###############################################################
+
+Print=Utils.Print
+errorExit=Utils.errorExit
+from core_symbol import CORE_SYMBOL
+
+args = TestHelper.parse_args({"--mongodb","--dump-error-details","--keep-logs","-v","--leave-running","--clean-run"
+                              ,"--p2p-plugin","--wallet-port"})
+debug=args.v
+enableMongo=args.mongodb
+dumpErrorDetails=args.dump_error_details
+keepLogs=args.keep_logs
+dontKill=args.leave_running
+killAll=args.clean_run
+p2pPlugin=args.p2p_plugin
+walletPort=args.wallet_port
+
+Utils.Debug=debug
+cluster=Cluster(walletd=True, enableMongo=enableMongo)
+walletMgr=WalletMgr(True, port=walletPort)
+testSuccessful=False
+killEosInstances=not dontKill
+killWallet=not dontKill
+
+timeout = .5 * 12 * 2 + 60 # time for finalization with 1 producer + 60 seconds padding
+Utils.setIrreversibleTimeout(timeout)
+
+fee_actions=("onfee", "voteagefee")
+
+def getHistoryActions(node, account):
+    cmdDesc="get actions"
+    cmd="%s -j %s -1 -100" % (cmdDesc, account.name)
+    return node.processCleosCmd(cmd, cmdDesc, exitOnError=True, exitMsg="account=%s" % (account.name))["actions"]
+
+def runMongo(node, subcommand):
+    cmd="%s %s" % (Utils.MongoPath, node.mongoEndpointArgs)
+    return Node.runMongoCmdReturnJson(cmd.split(), subcommand, exitOnError=True)
+
+def getFeeTotal(node, account):
+    # fee totals are int64, printed as strings so they are compared as they are stored
+    subcommand='db.fee_totals.find({"account":"%s"}).toArray().map(function(d){return {"fee":d.fee.toString(),"fee_actions":d.fee_actions.toString(),"block_num":d.block_num};})' % (account.name)
+    return runMongo(node, subcommand)
+
+try:
+    TestHelper.printSystemInfo("BEGIN")
+    cluster.setWalletMgr(walletMgr)
+
+    if enableMongo and not cluster.isMongodDbRunning():
+        errorExit("MongoDb doesn't seem to be running.")
+
+    cluster.killall(allInstances=killAll)
+    cluster.cleanup()
+    extraNodeosArgs=" --history-compact-fee-traces --filter-out eosio:transfer:"
+    if enableMongo:
+        extraNodeosArgs += " --mongodb-compact-fee-traces true"
+    Print("Stand up cluster")
+    if cluster.launch(pnodes=1, totalNodes=1, prodCount=1, p2pPlugin=p2pPlugin, extraNodeosArgs=extraNodeosArgs) is False:
+        Utils.cmdError("launcher")
+        errorExit("Failed to stand up eos cluster.")
+
+    accounts=Cluster.createAccountKeys(1)
+    if accounts is None:
+        errorExit("FAILURE - create keys")
+    testeraAccount=accounts[0]
+    testeraAccount.name="testera11111"
+    defproduceraAccount=cluster.defproduceraAccount
+
+    testWallet=walletMgr.create("test", [defproduceraAccount, cluster.eosioAccount, testeraAccount])
+
+    node=cluster.getNode(0)
+
+    Print("Create new account %s via %s" % (testeraAccount.name, defproduceraAccount.name))
+    trans=node.createInitializeAccount(testeraAccount, defproduceraAccount, stakedDeposit=0, waitForTransBlock=True, exitOnError=True)
+    newaccountTransId=Node.getTransId(trans)
+
+    Print("Transfer funds from %s to %s, transfers are filtered out" % (defproduceraAccount.name, testeraAccount.name))
+    trans=node.transferFunds(defproduceraAccount, testeraAccount, "1.0000 {0}".format(CORE_SYMBOL), "test transfer", waitForTransBlock=True)
+    transferTransId=Node.getTransId(trans)
+    transferBlockNum=Node.getTransBlockNum(trans)
+
+    Print("Verify the fee of a tracked action is in get_actions")
+    actions=getHistoryActions(node, defproduceraAccount)
+    newaccounts=[a for a in actions if a["action_trace"]["trx_id"] == newaccountTransId and a["action_trace"]["act"]["name"] == "newaccount"]
+    if len(newaccounts) != 1 or "fee" not in newaccounts[0] or Node.currencyStrToInt(newaccounts[0]["fee"]) <= 0:
+        errorExit("FAILURE - no fee in newaccount action: %s" % (newaccounts))
+    if [a for a in actions if a["action_trace"]["act"]["name"] in fee_actions and a["action_trace"]["trx_id"] == newaccountTransId]:
+        errorExit("FAILURE - fee action of a tracked action is tracked by itself: %s" % (actions))
+
+    Print("Verify the fee of a filtered action is kept")
+    transferActions=[a for a in actions if a["action_trace"]["trx_id"] == transferTransId]
+    if [a for a in transferActions if a["action_trace"]["act"]["name"] == "transfer"]:
+        errorExit("FAILURE - filtered transfer is tracked: %s" % (transferActions))
+    if not [a for a in transferActions if a["action_trace"]["act"]["name"] in fee_actions]:
+        errorExit("FAILURE - fee of filtered transfer is lost: %s" % (actions))
+
+    if enableMongo:
+        Print("Verify fee totals of %s once irreversible" % (defproduceraAccount.name))
+        node.waitForIrreversibleBlock(transferBlockNum, timeout)
+        node.waitForIrreversibleBlock(node.getIrreversibleBlockNum() + 1, timeout) # let the consumer thread catch up
+        feeTotal=getFeeTotal(node, defproduceraAccount)
+        if not feeTotal or int(feeTotal[0]["fee"]) <= 0:
+            errorExit("FAILURE - no fee total of %s: %s" % (defproduceraAccount.name, feeTotal))
+
+        Print("Replay blocks, fee totals are not counted again")
+        if not node.kill(signal.SIGTERM):
+            errorExit("Failed to shut down node")
+        node.cmd=node.cmd.replace(" --mongodb-wipe", "").replace(" --delete-all-blocks", "")
+        if not node.relaunch(0, "--replay-blockchain"):
+            errorExit("Failed to relaunch node")
+        node.waitForIrreversibleBlock(node.getHeadBlockNum(), timeout)
+        replayedTotal=getFeeTotal(node, defproduceraAccount)
+        if replayedTotal != feeTotal:
+            errorExit("FAILURE - fee total changed by replay, before: %s, after: %s" % (feeTotal, replayedTotal))
+
+        Print("Verify counted fees are deleted")
+        counted=runMongo(node, 'db.fees.find({"block_num":{"$lte":%d}}).toArray()' % (node.getIrreversibleBlockNum() - 1))
+        if counted:
+            errorExit("FAILURE - counted fees are kept: %s" % (counted))
+
+    testSuccessful=True
+finally:
+    TestHelper.shutdown(cluster, walletMgr, testSuccessful, killEosInstances, killWallet, keepLogs, killAll, dumpErrorDetails)
+
+exit(0)
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+
+from testUtils import Utils
+from Cluster import Cluster
+from WalletMgr import WalletMgr
+from TestHelper import TestHelper
+
+import json
+import os
+import shutil
+import signal
+import tempfile
+import urllib.request
+
+###############################################################
+# nodeos_snapshot_test
+# Creates snapshots by producer_api_plugin and follows them by get_snapshot_status. Snapshots are written
+# from a reflink checkpoint of state on a background thread if the file system has reflinks, else on main thread.
+# A snapshots-dir on other file system, /dev/shm, is always written on main thread.
+# --dump-error-details <Upon error print etc/eosio/node_*/config.ini and var/lib/node_*/stderr.log to stdout>
+# --keep-logs <Don't delete var/lib/node_* folders upon test completion>
+###############################################################
+
+Print=Utils.Print
+errorExit=Utils.errorExit
+
+args = TestHelper.parse_args({"--dump-error-details","--keep-logs","-v","--leave-running","--clean-run","--p2p-plugin","--wallet-port"})
+debug=args.v
+dumpErrorDetails=args.dump_error_details
+keepLogs=args.keep_logs
+dontKill=args.leave_running
+killAll=args.clean_run
+p2pPlugin=args.p2p_plugin
+walletPort=args.wallet_port
+
+Utils.Debug=debug
+cluster=Cluster(walletd=True)
+walletMgr=WalletMgr(True, port=walletPort)
+testSuccessful=False
+killEosInstances=not dontKill
+killWallet=not dontKill
+
+def producerApi(node, name):
+    url="http://%s:%d/v1/producer/%s" % (node.host, node.port, name)
+    request=urllib.request.Request(url, data=b"", method="POST")
+    with urllib.request.urlopen(request) as response:
+        return json.loads(response.read().decode("utf-8"))
+
+def createAndVerifySnapshot(node):
+    node.waitForNextBlock()
+    info=producerApi(node, "create_snapshot")
+    Print("Snapshot %s of block %s" % (info["snapshot_name"], info["head_block_id"]))
+
+    def getStatus():
+        for s in producerApi(node, "get_snapshot_status"):
+            if s["head_block_id"] == info["head_block_id"] and s["status"] != "in_progress":
+                return s
+        return None
+    status=Utils.waitForObj(getStatus, 120)
+    if status is None:
+        errorExit("FAILURE - snapshot %s is not finished: %s" % (info["snapshot_name"], producerApi(node, "get_snapshot_status")))
+    if status["status"] != "completed" or status["error"]:
+        errorExit("FAILURE - snapshot %s failed: %s" % (info["snapshot_name"], status))
+    if int(status["rows_written"]) <= 0 or status["sections_written"] <= 0:
+        errorExit("FAILURE - snapshot %s is empty: %s" % (info["snapshot_name"], status))
+    if not os.path.isfile(info["snapshot_name"]) or os.path.exists(info["snapshot_name"] + ".tmp"):
+        errorExit("FAILURE - snapshot file %s is not written" % (info["snapshot_name"]))
+    checkpoints=[f for f in os.listdir(os.path.dirname(info["snapshot_name"])) if f.startswith(".checkpoint-")]
+    if checkpoints:
+        errorExit("FAILURE - checkpoints are left: %s" % (checkpoints))
+
+try:
+    TestHelper.printSystemInfo("BEGIN")
+    cluster.setWalletMgr(walletMgr)
+
+    cluster.killall(allInstances=killAll)
+    cluster.cleanup()
+    Print("Stand up cluster")
+    if cluster.launch(pnodes=1, totalNodes=1, prodCount=1, p2pPlugin=p2pPlugin, dontBootstrap=True,
+                      extraNodeosArgs=" --plugin eosio::producer_api_plugin") is False:
+        Utils.cmdError("launcher")
+        errorExit("Failed to stand up eos cluster.")
+
+    node=cluster.getNode(0)
+
+    Print("Snapshot in snapshots-dir next to state")
+    createAndVerifySnapshot(node)
+
+    if os.path.isdir("/dev/shm"):
+        Print("Snapshot in snapshots-dir on other file system")
+        otherDir=tempfile.mkdtemp(dir="/dev/shm")
+        if not node.kill(signal.SIGTERM):
+            errorExit("Failed to shut down node")
+        if not node.relaunch(0, None, addOrSwapFlags={"--snapshots-dir": otherDir}):
+            errorExit("Failed to relaunch node")
+        createAndVerifySnapshot(node)
+        shutil.rmtree(otherDir, ignore_errors=True)
+
+    testSuccessful=True
+finally:
+    TestHelper.shutdown(cluster, walletMgr, testSuccessful, killEosInstances, killWallet, keepLogs, killAll, dumpErrorDetails)
+
+exit(0)
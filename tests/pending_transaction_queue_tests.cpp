@@ -0,0 +1,170 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#include <boost/test/unit_test.hpp>
+
+#include <eosio/testing/tester.hpp>
+#include <eosio/producer_plugin/pending_transaction_queue.hpp>
+#include <eosio/chain/txfee_manager.hpp>
+#include <eosio/chain/config_on_chain.hpp>
+
+using namespace eosio;
+using namespace eosio::chain;
+using namespace eosio::testing;
+
+static pending_transaction make_pending( const char* id, account_name payer, uint64_t priority, uint64_t size = 100 ) {
+   pending_transaction e;
+   e.trx      = std::make_shared<transaction_metadata>( signed_transaction() );
+   e.trx->id  = transaction_id_type::hash( std::string(id) );
+   e.payer    = payer;
+   e.priority = priority;
+   e.size     = size;
+   return e;
+}
+
+BOOST_AUTO_TEST_SUITE(pending_transaction_queue_tests)
+
+BOOST_AUTO_TEST_CASE(pending_transaction_queue_order_and_limits) { try {
+   pending_transaction_queue queue( 500, 2 );
+   vector<std::pair<transaction_id_type, pending_transaction_queue::drop_reason>> dropped;
+   const auto drop = [&]( pending_transaction&& e, pending_transaction_queue::drop_reason reason ) {
+      dropped.emplace_back( e.trx->id, reason );
+   };
+   const auto id = []( const char* s ) { return transaction_id_type::hash( std::string(s) ); };
+
+   queue.add( make_pending( "a1", N(alice), 10 ), drop );
+   queue.add( make_pending( "b1", N(bob), 30 ), drop );
+   queue.add( make_pending( "a2", N(alice), 20 ), drop );
+   BOOST_REQUIRE( dropped.empty() );
+   BOOST_REQUIRE_EQUAL( queue.size(), 3 );
+
+   // alice has two trxs, her trx of lowest priority is evicted for a higher one and a lower one is dropped
+   queue.add( make_pending( "a3", N(alice), 5 ), drop );
+   BOOST_REQUIRE_EQUAL( dropped.size(), 1 );
+   BOOST_REQUIRE( dropped.back().first == id( "a3" ) );
+   BOOST_REQUIRE( dropped.back().second == pending_transaction_queue::drop_reason::account_limit );
+   queue.add( make_pending( "a4", N(alice), 40 ), drop );
+   BOOST_REQUIRE_EQUAL( dropped.size(), 2 );
+   BOOST_REQUIRE( dropped.back().first == id( "a1" ) );
+   BOOST_REQUIRE_EQUAL( queue.size(), 3 );
+
+   // queue is full in bytes, trxs of lowest priority are evicted for a higher one
+   queue.add( make_pending( "c1", N(carol), 25, 200 ), drop );
+   BOOST_REQUIRE_EQUAL( dropped.size(), 2 );
+   queue.add( make_pending( "d1", N(dave), 1 ), drop );
+   BOOST_REQUIRE_EQUAL( dropped.size(), 3 );
+   BOOST_REQUIRE( dropped.back().first == id( "d1" ) );
+   BOOST_REQUIRE( dropped.back().second == pending_transaction_queue::drop_reason::queue_full );
+   queue.add( make_pending( "d2", N(dave), 50, 200 ), drop );
+   BOOST_REQUIRE_EQUAL( dropped.size(), 5 );
+   BOOST_REQUIRE( dropped[3].first == id( "a2" ) );
+   BOOST_REQUIRE( dropped[4].first == id( "c1" ) );
+
+   const auto& stats = queue.get_stats();
+   BOOST_REQUIRE_EQUAL( stats.depth, 3 );
+   BOOST_REQUIRE_EQUAL( stats.bytes, 400 );
+   BOOST_REQUIRE_EQUAL( stats.max_depth, 4 );
+   BOOST_REQUIRE_EQUAL( stats.added, 6 );
+   BOOST_REQUIRE_EQUAL( stats.dropped_account_limit, 2 );
+   BOOST_REQUIRE_EQUAL( stats.dropped_queue_full, 3 );
+
+   // highest priority first, in order of arrival for a same priority
+   queue.add( make_pending( "b2", N(bob), 50 ), drop );
+   BOOST_REQUIRE_EQUAL( dropped.size(), 5 );
+   vector<transaction_id_type> order;
+   while( !queue.empty() ) {
+      order.emplace_back( queue.pop().trx->id );
+   }
+   BOOST_REQUIRE( order == (vector<transaction_id_type>{ id( "d2" ), id( "b2" ), id( "a4" ), id( "b1" ) }) );
+   BOOST_REQUIRE_EQUAL( queue.get_stats().depth, 0 );
+   BOOST_REQUIRE_EQUAL( queue.get_stats().bytes, 0 );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(pending_transaction_queue_all_or_nothing) { try {
+   pending_transaction_queue queue( 500, 2 );
+   vector<transaction_id_type> dropped;
+   const auto drop = [&]( pending_transaction&& e, pending_transaction_queue::drop_reason ) {
+      dropped.emplace_back( e.trx->id );
+   };
+   const auto id = []( const char* s ) { return transaction_id_type::hash( std::string(s) ); };
+
+   queue.add( make_pending( "x1", N(alice), 10, 200 ), drop );
+   queue.add( make_pending( "x2", N(bob), 30, 200 ), drop );
+
+   // y only fits if x2 of higher priority is evicted too, so nothing is evicted for it
+   queue.add( make_pending( "y1", N(carol), 20, 400 ), drop );
+   BOOST_REQUIRE( dropped == vector<transaction_id_type>{ id( "y1" ) } );
+   BOOST_REQUIRE_EQUAL( queue.size(), 2 );
+   BOOST_REQUIRE_EQUAL( queue.get_stats().bytes, 400 );
+   BOOST_REQUIRE_EQUAL( queue.get_stats().dropped_queue_full, 1 );
+
+   // the trx evicted for the account limit frees room too
+   queue.add( make_pending( "x3", N(alice), 5, 100 ), drop );
+   BOOST_REQUIRE_EQUAL( dropped.size(), 1 );
+   queue.add( make_pending( "x4", N(alice), 20, 300 ), drop );
+   BOOST_REQUIRE( dropped == (vector<transaction_id_type>{ id( "y1" ), id( "x3" ), id( "x1" ) }) );
+   BOOST_REQUIRE_EQUAL( queue.size(), 2 );
+   BOOST_REQUIRE_EQUAL( queue.get_stats().bytes, 500 );
+   BOOST_REQUIRE_EQUAL( queue.get_stats().dropped_account_limit, 1 );
+   BOOST_REQUIRE_EQUAL( queue.get_stats().dropped_queue_full, 2 );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(pending_transaction_paid_fee) { try {
+   const asset required( 1000 );
+   transaction trn;
+   trn.fee = asset( 5000 );
+
+   // before onfee_action trx.fee is charged, after it only the required fee
+   BOOST_REQUIRE_EQUAL( calculate_paid_fee( trn, required, false, false ), asset( 5000 ) );
+   BOOST_REQUIRE_EQUAL( calculate_paid_fee( trn, required, true, false ), required );
+   trn.fee = asset( 999 );
+   BOOST_REQUIRE_EQUAL( calculate_paid_fee( trn, required, false, false ), asset( 0 ) );
+   BOOST_REQUIRE_EQUAL( calculate_paid_fee( trn, required, true, false ), asset( 0 ) );
+
+   // with fee_limit trx.fee is not checked, the required fee has to be in a non zero fee limit
+   BOOST_REQUIRE_EQUAL( calculate_paid_fee( trn, required, true, true ), required );
+   set_to_extensions( trn.transaction_extensions, transaction::fee_limit, asset( 999 ) );
+   BOOST_REQUIRE_EQUAL( calculate_paid_fee( trn, required, true, true ), asset( 0 ) );
+   set_to_extensions( trn.transaction_extensions, transaction::fee_limit, asset( 100000 ) );
+   BOOST_REQUIRE_EQUAL( calculate_paid_fee( trn, required, true, true ), required );
+   set_to_extensions( trn.transaction_extensions, transaction::fee_limit, asset( 0 ) );
+   BOOST_REQUIRE_EQUAL( calculate_paid_fee( trn, required, true, true ), required );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(pending_transaction_priority) { try {
+   tester chain;
+   chain.produce_blocks( 2 );
+
+   const auto make_trx = [&]( const asset& fee ) {
+      signed_transaction trx;
+      trx.actions.emplace_back( vector<permission_level>{{config::system_account_name, config::active_name}},
+                                newaccount{
+                                   .creator  = config::system_account_name,
+                                   .name     = N(alice),
+                                   .owner    = authority( chain.get_public_key( N(alice), "owner" ) ),
+                                   .active   = authority( chain.get_public_key( N(alice), "active" ) ),
+                                });
+      chain.set_transaction_headers( trx );
+      trx.fee = fee;
+      return std::make_shared<transaction_metadata>( trx );
+   };
+
+   const controller& ctl = *chain.control;
+   const auto required = ctl.get_txfee_manager().get_required_fee( ctl, make_trx( asset( 0 ) )->packed_trx->get_transaction() );
+   const auto priority = calculate_trx_priority( ctl, make_trx( required ) );
+   BOOST_REQUIRE_GT( priority, 0 );
+
+   // a fee over the required fee only buys priority if it is charged
+   const auto over_priority = calculate_trx_priority( ctl, make_trx( required + required ) );
+   if( is_func_has_open( ctl, config::func_typ::onfee_action ) ) {
+      BOOST_REQUIRE_EQUAL( over_priority, priority );
+   } else {
+      BOOST_REQUIRE_GT( over_priority, priority );
+   }
+   if( !is_func_has_open( ctl, config::func_typ::onfee_action ) || !is_func_has_open( ctl, config::func_typ::fee_limit ) ) {
+      BOOST_REQUIRE_EQUAL( calculate_trx_priority( ctl, make_trx( asset( 0 ) ) ), 0 );
+   }
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2713,4 +2713,49 @@ BOOST_AUTO_TEST_CASE(abi_deserialize_detailed_error_messages)
    } FC_LOG_AND_RETHROW()
 }
 
+BOOST_AUTO_TEST_CASE(abi_serializer_cache_by_sequence)
+{ try {
+   const char* first_abi = R"=====(
+   {
+      "version": "eosio::abi/1.0",
+      "structs": [{"name": "hi", "base": "", "fields": [{"name": "user", "type": "name"}]}],
+      "actions": [{"name": "hi", "type": "hi", "ricardian_contract": ""}]
+   }
+   )=====";
+   const char* second_abi = R"=====(
+   {
+      "version": "eosio::abi/1.0",
+      "structs": [{"name": "bye", "base": "", "fields": [{"name": "user", "type": "name"}]}],
+      "actions": [{"name": "bye", "type": "bye", "ricardian_contract": ""}]
+   }
+   )=====";
+
+   eosio::testing::tester chain;
+   chain.create_accounts( {N(abicache)} );
+   chain.set_abi( N(abicache), first_abi );
+
+   auto& cache = chain.control->get_abi_serializer_cache();
+   const auto& db = chain.control->db();
+   const auto stats = cache.get_stats();
+
+   auto abis = cache.get( db, N(abicache), max_serialization_time );
+   BOOST_REQUIRE( abis.valid() );
+   BOOST_CHECK_EQUAL( abis->get_action_type(N(hi)), "hi" );
+   // same abi_sequence, same shared serializer
+   auto again = cache.get( db, N(abicache), max_serialization_time );
+   BOOST_CHECK( &*again == &*abis );
+   BOOST_CHECK_EQUAL( cache.get_stats().hits, stats.hits + 1 );
+
+   chain.set_abi( N(abicache), second_abi );
+   auto updated = cache.get( db, N(abicache), max_serialization_time );
+   BOOST_REQUIRE( updated.valid() );
+   BOOST_CHECK( &*updated != &*abis );
+   BOOST_CHECK_EQUAL( updated->get_action_type(N(hi)), "" );
+   BOOST_CHECK_EQUAL( updated->get_action_type(N(bye)), "bye" );
+   // serializer handed out before setabi is still usable
+   BOOST_CHECK_EQUAL( abis->get_action_type(N(hi)), "hi" );
+
+   BOOST_CHECK( !cache.get( db, N(nobody), max_serialization_time ).valid() );
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,249 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#include <eosio/chain/block_log.hpp>
+#include <eosio/chain/genesis_state.hpp>
+
+#include <fc/filesystem.hpp>
+#include <fc/scoped_exit.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <csignal>
+#include <fstream>
+#include <thread>
+
+#include <sys/resource.h>
+
+using namespace eosio::chain;
+
+static signed_block_ptr make_block( const signed_block_ptr& prev ) {
+   auto b = std::make_shared<signed_block>();
+   if( prev ) {
+      b->previous  = prev->id();
+      b->timestamp = prev->timestamp.next();
+   }
+   return b;
+}
+
+BOOST_AUTO_TEST_SUITE(block_log_tests)
+
+BOOST_AUTO_TEST_CASE(block_log_read_block_range) { try {
+   fc::temp_directory tempdir;
+   block_log blog( tempdir.path() );
+
+   vector<signed_block_ptr> blocks = { make_block( nullptr ) };
+   blog.reset( genesis_state(), blocks.back() );
+   while( blocks.size() < 10 ) {
+      blocks.emplace_back( make_block( blocks.back() ) );
+      blog.append( blocks.back() );
+   }
+
+   BOOST_REQUIRE_EQUAL( blog.read_block_by_num( 5 )->id(), blocks[4]->id() );
+   BOOST_REQUIRE( !blog.read_block_by_num( 11 ) );
+   BOOST_REQUIRE_EQUAL( blog.get_block_pos( 11 ), block_log::npos );
+
+   auto range = blog.read_block_range( 3, 5 );
+   BOOST_REQUIRE_EQUAL( range.size(), 5 );
+   for( size_t i = 0; i < range.size(); ++i ) {
+      BOOST_REQUIRE_EQUAL( range[i]->id(), blocks[i + 2]->id() );
+   }
+   BOOST_REQUIRE_EQUAL( blog.read_block_range( 8, 10 ).size(), 3 );
+   BOOST_REQUIRE( blog.read_block_range( 11, 2 ).empty() );
+
+   // blocks are read from another thread while they are appended
+   std::atomic<bool> done{false};
+   std::atomic<bool> read_ok{true};
+   std::thread reader( [&]() {
+      while( !done ) {
+         for( uint32_t n = 1; n <= 10; ++n ) {
+            auto b = blog.read_block_by_num( n );
+            if( !b || b->id() != blocks[n - 1]->id() )
+               read_ok = false;
+         }
+      }
+   });
+   vector<signed_block_ptr> appended;
+   signed_block_ptr prev = blocks.back();
+   for( int i = 0; i < 100; ++i ) {
+      appended.emplace_back( make_block( prev ) );
+      blog.append( appended.back() );
+      prev = appended.back();
+   }
+   done = true;
+   reader.join();
+   BOOST_REQUIRE( read_ok );
+
+   range = blog.read_block_range( 1, 200 );
+   BOOST_REQUIRE_EQUAL( range.size(), 110 );
+   BOOST_REQUIRE_EQUAL( range.back()->id(), appended.back()->id() );
+
+   // index and views are built again when the log is opened
+   block_log reopened( tempdir.path() );
+   BOOST_REQUIRE_EQUAL( reopened.read_block_by_num( 110 )->id(), appended.back()->id() );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(block_log_index_and_verify) { try {
+   fc::temp_directory tempdir;
+   vector<signed_block_ptr> blocks = { make_block( nullptr ) };
+   {
+      block_log blog( tempdir.path() );
+      blog.reset( genesis_state(), blocks.back() );
+      while( blocks.size() < 50 ) {
+         blocks.emplace_back( make_block( blocks.back() ) );
+         blog.append( blocks.back() );
+      }
+      uint32_t verified = 0;
+      blog.verify_blocks( 1, 50, 4, [&]( uint32_t n ) { verified = n; } );
+      BOOST_REQUIRE_EQUAL( verified, 50 );
+   }
+
+   // index is reconstructed from the positions after blocks
+   fc::remove( tempdir.path() / "blocks.index" );
+   block_log blog( tempdir.path() );
+   for( uint32_t n = 1; n <= 50; ++n ) {
+      BOOST_REQUIRE_EQUAL( blog.read_block_by_num( n )->id(), blocks[n - 1]->id() );
+   }
+
+   // a block of right number which does not link to the block before it
+   auto bad = make_block( blocks.back() );
+   bad->previous._hash[1] ^= 1;
+   blog.append( bad );
+   blog.append( make_block( bad ) );
+   blog.verify_blocks( 1, 50, 4 );
+   BOOST_REQUIRE_EXCEPTION( blog.verify_blocks( 1, 52, 4 ), block_log_exception,
+                            []( const block_log_exception& e ) { return e.to_detail_string().find( "Block 51" ) != std::string::npos; } );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(block_log_index_corrupted_trailer) { try {
+   fc::temp_directory tempdir;
+   vector<signed_block_ptr> blocks = { make_block( nullptr ) };
+   uint64_t pos5 = 0, pos11 = 0;
+   {
+      block_log blog( tempdir.path() );
+      blog.reset( genesis_state(), blocks.back() );
+      while( blocks.size() < 20 ) {
+         blocks.emplace_back( make_block( blocks.back() ) );
+         blog.append( blocks.back() );
+      }
+      pos5  = blog.get_block_pos( 5 );
+      pos11 = blog.get_block_pos( 11 );
+   }
+
+   // the position after block 10 points to block 5, reconstruction must not build a index skipping blocks
+   {
+      std::fstream f( (tempdir.path() / "blocks.log").generic_string(), std::ios::in | std::ios::out | std::ios::binary );
+      f.seekp( pos11 - sizeof(uint64_t) );
+      f.write( (const char*)&pos5, sizeof(pos5) );
+   }
+   fc::remove( tempdir.path() / "blocks.index" );
+   BOOST_REQUIRE_EXCEPTION( block_log( tempdir.path() ), block_log_exception,
+                            []( const block_log_exception& e ) {
+                               return e.to_detail_string().find( "is 5 but 10 is expected" ) != std::string::npos;
+                            } );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(block_log_append_async) { try {
+   fc::temp_directory tempdir;
+   vector<signed_block_ptr> blocks = { make_block( nullptr ) };
+   {
+      block_log blog( tempdir.path() );
+      blog.set_write_queue( 4, fc::milliseconds( 10 ) );
+      blog.reset( genesis_state(), blocks.back() );
+      while( blocks.size() < 100 ) {
+         blocks.emplace_back( make_block( blocks.back() ) );
+         blog.append_async( blocks.back() );
+         // queued or written, a appended block is read
+         BOOST_REQUIRE_EQUAL( blog.read_block_by_num( blocks.size() )->id(), blocks.back()->id() );
+         BOOST_REQUIRE_EQUAL( blog.head()->id(), blocks.back()->id() );
+      }
+      BOOST_REQUIRE_EQUAL( blog.read_block_range( 1, 200 ).size(), 100 );
+
+      blog.flush();
+      auto stats = blog.get_write_stats();
+      BOOST_REQUIRE_EQUAL( stats.blocks_written, 99 );
+      BOOST_REQUIRE_EQUAL( stats.queue_depth, 0 );
+      BOOST_REQUIRE( stats.max_queue_depth <= 4 );
+      BOOST_REQUIRE( stats.groups > 0 && stats.groups <= 99 );
+      BOOST_REQUIRE( blog.durable_head_num() <= 100 );
+   }
+
+   // writer is drained and files are synced on close
+   {
+      block_log blog( tempdir.path() );
+      BOOST_REQUIRE_EQUAL( blog.head()->id(), blocks.back()->id() );
+      BOOST_REQUIRE_EQUAL( blog.durable_head_num(), 100 );
+   }
+
+   // a partial block written before a crash is truncated on open
+   const auto size = fc::file_size( tempdir.path() / "blocks.log" );
+   {
+      std::ofstream out( (tempdir.path() / "blocks.log").generic_string(), std::ios::app | std::ios::binary );
+      auto data = fc::raw::pack( *make_block( blocks.back() ) );
+      out.write( data.data(), data.size() / 2 );
+   }
+   block_log blog( tempdir.path() );
+   BOOST_REQUIRE_EQUAL( fc::file_size( tempdir.path() / "blocks.log" ), size );
+   BOOST_REQUIRE_EQUAL( blog.head()->id(), blocks.back()->id() );
+   blog.append( make_block( blocks.back() ) );
+   BOOST_REQUIRE_EQUAL( blog.read_block_by_num( 101 )->previous, blocks.back()->id() );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(block_log_writer_failure) { try {
+   fc::temp_directory tempdir;
+   vector<signed_block_ptr> blocks = { make_block( nullptr ) };
+
+   // files can not grow over the limit, the writer fails as on a full disk
+   struct rlimit limit;
+   BOOST_REQUIRE_EQUAL( getrlimit( RLIMIT_FSIZE, &limit ), 0 );
+   const struct rlimit old_limit = limit;
+   const auto old_handler = std::signal( SIGXFSZ, SIG_IGN );
+   auto restore = fc::make_scoped_exit( [&]() {
+      setrlimit( RLIMIT_FSIZE, &old_limit );
+      std::signal( SIGXFSZ, old_handler );
+   });
+   {
+      block_log blog( tempdir.path() );
+      blog.set_write_queue( 4, fc::microseconds() );
+      blog.reset( genesis_state(), blocks.back() );
+      blog.flush();
+
+      limit.rlim_cur = fc::file_size( tempdir.path() / "blocks.log" );
+      BOOST_REQUIRE_EQUAL( setrlimit( RLIMIT_FSIZE, &limit ), 0 );
+
+      bool failed = false;
+      while( !failed && blocks.size() < 100 ) {
+         blocks.emplace_back( make_block( blocks.back() ) );
+         try {
+            blog.append_async( blocks.back() );
+            blog.flush();
+         } catch( ... ) {
+            failed = true;
+         }
+      }
+      BOOST_REQUIRE( failed );
+
+      // the error of writer is thrown again until the log is closed
+      failed = false;
+      try {
+         blog.flush();
+      } catch( ... ) {
+         failed = true;
+      }
+      BOOST_REQUIRE( failed );
+   } // closing the log after the writer failed does not throw
+
+   restore.cancel();
+   BOOST_REQUIRE_EQUAL( setrlimit( RLIMIT_FSIZE, &old_limit ), 0 );
+   std::signal( SIGXFSZ, old_handler );
+
+   // the blocks written before the failure are kept
+   block_log blog( tempdir.path() );
+   BOOST_REQUIRE( blog.head() );
+   BOOST_REQUIRE( blog.head()->block_num() < blocks.size() );
+   BOOST_REQUIRE_EQUAL( blog.read_block_by_num( 1 )->id(), blocks.front()->id() );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -167,4 +167,74 @@ BOOST_AUTO_TEST_CASE(untrusted_producer_test)
 }
 #endif
 
+// blocks are prevalidated ahead of the blocks they link to being pushed, then pushed in order
+BOOST_AUTO_TEST_CASE(prevalidate_blocks_test)
+{ try {
+   tester main;
+   main.produce_blocks(10);
+
+   tester other;
+   vector<signed_block_ptr> blocks;
+   for( auto n = other.control->fork_db_head_block_num() + 1; n <= main.control->fork_db_head_block_num(); ++n ) {
+      blocks.emplace_back( main.control->fetch_block_by_number( n ) );
+   }
+   BOOST_REQUIRE( !blocks.empty() );
+   for( const auto& b : blocks ) {
+      BOOST_REQUIRE( other.control->prevalidate_block( b ) );
+   }
+   BOOST_REQUIRE( !other.control->prevalidate_block( blocks.back() ) );
+
+   for( const auto& b : blocks ) {
+      other.push_block( b );
+   }
+   BOOST_REQUIRE_EQUAL( other.control->head_block_id(), main.control->head_block_id() );
+   BOOST_REQUIRE_EQUAL( other.control->prevalidated_ahead(), 0 );
+
+   // a block with a signature of other key is rejected when it is pushed
+   auto b = main.produce_block();
+   auto copy_b = std::make_shared<signed_block>( b->clone() );
+   copy_b->producer_signature = main.get_private_key( N(other), "active" ).sign( copy_b->digest() );
+   BOOST_REQUIRE( other.control->prevalidate_block( copy_b ) );
+   BOOST_REQUIRE_THROW( other.push_block( copy_b ), wrong_signing_key );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_CASE(apply_block_shares_transactions_test)
+{ try {
+   tester main;
+   main.create_account( N(alice) );
+   main.create_account( N(bob) );
+   auto b = main.produce_block();
+
+   tester other;
+   for( auto n = other.control->fork_db_head_block_num() + 1; n < b->block_num(); ++n ) {
+      other.push_block( main.control->fetch_block_by_number( n ) );
+   }
+
+   set<const packed_transaction*> block_trxs;
+   for( const auto& receipt : b->transactions ) {
+      if( receipt.trx.contains<packed_transaction>() )
+         block_trxs.insert( &receipt.trx.get<packed_transaction>() );
+   }
+   BOOST_REQUIRE( !block_trxs.empty() );
+
+   vector<transaction_metadata_ptr> accepted;
+   auto c = other.control->accepted_transaction.connect( [&]( const transaction_metadata_ptr& trx ) {
+      if( !trx->implicit )
+         accepted.push_back( trx );
+   });
+   const auto block_use_count = b.use_count();
+   other.push_block( b );
+   c.disconnect();
+
+   // transactions are applied from the packed transactions in the block, not from copies of them
+   BOOST_REQUIRE_EQUAL( accepted.size(), block_trxs.size() );
+   for( const auto& trx : accepted ) {
+      BOOST_REQUIRE( block_trxs.count( trx->packed_trx.get() ) );
+   }
+   BOOST_REQUIRE( b.use_count() >= block_use_count + accepted.size() );
+
+   accepted.clear();
+   BOOST_REQUIRE_EQUAL( other.control->head_block_id(), b->id() );
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,7 @@
  *  @copyright defined in eos/LICENSE
  */
 #include <eosio/chain/global_property_object.hpp>
+#include <eosio/chain/memory_db.hpp>
 #include <eosio/testing/tester.hpp>
 
 #include <fc/crypto/digest.hpp>
@@ -99,4 +100,88 @@ BOOST_AUTO_TEST_SUITE(database_tests)
       } FC_LOG_AND_RETHROW()
    }
 
+   // rows read by memory_db are unpacked from key_value_object directly
+   BOOST_AUTO_TEST_CASE(memory_db_row_access) {
+      try {
+         TESTER test;
+         eosio::chain::database& db = const_cast<eosio::chain::database&>( test.control->db() );
+         auto ses = db.start_undo_session(true);
+
+         memory_db mdb(db);
+         memory_db::account_info acc;
+         BOOST_TEST(!mdb.get(N(eosio.test), N(eosio.test), N(accounts), N(billy), acc));
+
+         mdb.insert(N(eosio.test), N(eosio.test), N(accounts), N(billy),
+                    memory_db::account_info{N(billy), asset(12345)});
+         BOOST_TEST(mdb.get(N(eosio.test), N(eosio.test), N(accounts), N(billy), acc));
+         BOOST_TEST(acc.name == N(billy));
+         BOOST_TEST(acc.available.get_amount() == 12345);
+         BOOST_TEST(!mdb.get(N(eosio.test), N(eosio.test), N(accounts), N(joe), acc));
+
+         ses.undo();
+      } FC_LOG_AND_RETHROW()
+   }
+
+   // native_multi_index modify rows of is_fixed_size_row in place by the packed size of a default row
+   BOOST_AUTO_TEST_CASE(fixed_size_rows) {
+      auto check_fixed_size = []( const auto& row ) {
+         using row_type = std::decay_t<decltype(row)>;
+         BOOST_TEST(is_fixed_size_row<row_type>::value);
+         BOOST_TEST(fc::raw::pack_size(row) == fc::raw::pack_size(row_type{}));
+      };
+
+      check_fixed_size(memory_db::account_info{N(billy), asset(1000000)});
+      check_fixed_size(memory_db::eoslock_account{N(billy), asset(-1)});
+      check_fixed_size(memory_db::vote4ram_info{N(billy), asset(77)});
+      check_fixed_size(memory_db::votefix_info{1, N(billy), N(bp), N(fvote.a), {asset(3), 4, 5}, asset(6), 7, 8, true});
+      check_fixed_size(memory_db::chain_status{N(chainstatus), true});
+      check_fixed_size(memory_db::currency_stats{asset(1), asset(2), N(eosio)});
+      check_fixed_size(memory_db::vote_info{N(bp), asset(3), 4, 5, asset(6), 7});
+
+      BOOST_TEST(!is_fixed_size_row<memory_db::bp_info>::value);
+   }
+
+   // genesis accounts are prepared on thread pool, the state must not depend on size of the pool
+   BOOST_AUTO_TEST_CASE(genesis_accounts_thread_pool) {
+      try {
+         auto cfg = tester().get_config();
+
+         const uint32_t extra_accounts = 300;
+         for( uint32_t i = 0; i < extra_accounts; ++i ) {
+            std::string suffix;
+            for( uint32_t n = i; suffix.size() < 3; n /= 26 ) {
+               suffix.push_back( char('a' + n % 26) );
+            }
+            const auto acc_name = account_name( "gen." + suffix );
+
+            account_tuple account;
+            account.key   = base_tester::get_public_key( acc_name, "active" );
+            account.asset = asset( 10000 + i );
+            // name from key like mainnet genesis
+            account.name  = ( i % 10 == 0 ) ? N(a) : acc_name;
+            cfg.genesis.initial_account_list.push_back( account );
+
+            if( i % 3 == 0 ) {
+               cfg.active_initial_account_list.push_back( account );
+            }
+         }
+
+         fc::temp_directory tempdir;
+         auto make_config = [&]( uint16_t thread_pool_size ) {
+            auto c = cfg;
+            c.thread_pool_size = thread_pool_size;
+            c.blocks_dir = tempdir.path() / std::to_string(thread_pool_size) / config::default_blocks_dir_name;
+            c.state_dir  = tempdir.path() / std::to_string(thread_pool_size) / config::default_state_dir_name;
+            return c;
+         };
+
+         tester single( make_config(1) );
+         tester multi( make_config(4) );
+
+         const auto& accounts_idx = single.control->db().get_index<account_index>();
+         BOOST_TEST(accounts_idx.size() == multi.control->db().get_index<account_index>().size());
+         BOOST_TEST(single.control->calculate_integrity_hash().str() == multi.control->calculate_integrity_hash().str());
+      } FC_LOG_AND_RETHROW()
+   }
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,153 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#include <eosio/chain/txfee_manager.hpp>
+#include <eosio/testing/chainbase_fixture.hpp>
+#include <eosio/testing/tester.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace eosio::chain;
+using namespace eosio::testing;
+
+class fee_schedule_fixture: private chainbase_fixture<64*1024*1024>
+{
+   public:
+      fee_schedule_fixture()
+      :chainbase_fixture()
+      ,db(*chainbase_fixture::_db)
+      {
+         db.add_index<action_fee_object_index>();
+      }
+
+      chainbase::database& db;
+};
+
+// contract_action the i-th (account, action) used in tests, names are all distinct
+static std::pair<account_name, action_name> contract_action( uint64_t i ) {
+   return std::make_pair( account_name( (i + 1) << 20 ), action_name( (i % 97 + 1) << 40 ) );
+}
+
+BOOST_AUTO_TEST_SUITE(fee_schedule_tests)
+
+BOOST_AUTO_TEST_CASE(compiled_fee_schedule_insert_find_erase) try {
+   compiled_fee_schedule schedule;
+   const uint64_t count = 10000;
+
+   for( uint64_t i = 0; i < count; ++i ) {
+      const auto key = contract_action(i);
+      fee_schedule_entry entry;
+      entry.fee = asset(i + 1);
+      entry.has_fee = true;
+      schedule.insert(key.first, key.second, entry);
+   }
+   BOOST_REQUIRE_EQUAL(schedule.size(), count);
+
+   for( uint64_t i = 0; i < count; ++i ) {
+      const auto key = contract_action(i);
+      const auto* entry = schedule.find(key.first, key.second);
+      BOOST_REQUIRE(entry != nullptr);
+      BOOST_REQUIRE_EQUAL(entry->fee.get_amount(), int64_t(i + 1));
+   }
+   BOOST_REQUIRE(schedule.find(N(nobody), N(transfer)) == nullptr);
+
+   // erase every third entry, the rest must still be reachable after the backward shift
+   for( uint64_t i = 0; i < count; i += 3 ) {
+      const auto key = contract_action(i);
+      BOOST_REQUIRE(schedule.erase(key.first, key.second));
+      BOOST_REQUIRE(!schedule.erase(key.first, key.second));
+   }
+   for( uint64_t i = 0; i < count; ++i ) {
+      const auto key = contract_action(i);
+      const auto* entry = schedule.find(key.first, key.second);
+      if( i % 3 == 0 ) {
+         BOOST_REQUIRE(entry == nullptr);
+      } else {
+         BOOST_REQUIRE(entry != nullptr);
+         BOOST_REQUIRE_EQUAL(entry->fee.get_amount(), int64_t(i + 1));
+      }
+   }
+
+   schedule.clear();
+   BOOST_REQUIRE_EQUAL(schedule.size(), 0);
+   BOOST_REQUIRE(schedule.find(contract_action(1).first, contract_action(1).second) == nullptr);
+} FC_LOG_AND_RETHROW()
+
+// actions without fee come from any pushed transaction, they must not grow the compiled table
+BOOST_AUTO_TEST_CASE(compiled_fee_schedule_skip_missing_fee) try {
+   tester chain;
+   const auto& txfee = chain.control->get_txfee_manager();
+
+   const auto native = txfee.get_fee_schedule(*chain.control, config::system_account_name, N(transfer));
+   BOOST_REQUIRE(native.has_fee);
+   const auto size = txfee.compiled_fee_schedule_size();
+
+   for( uint64_t i = 0; i < 1000; ++i ) {
+      const auto key = contract_action(i);
+      BOOST_REQUIRE(!txfee.get_fee_schedule(*chain.control, key.first, key.second).has_fee);
+   }
+   BOOST_REQUIRE_EQUAL(txfee.compiled_fee_schedule_size(), size);
+
+   txfee.get_fee_schedule(*chain.control, config::system_account_name, N(transfer));
+   BOOST_REQUIRE_EQUAL(txfee.compiled_fee_schedule_size(), size);
+} FC_LOG_AND_RETHROW()
+
+// compare lookup cost of action_fee_object index plus native fee map with compiled fee schedule
+BOOST_FIXTURE_TEST_CASE(compiled_fee_schedule_benchmark, fee_schedule_fixture) try {
+   const uint64_t count  = 10000;
+   const uint64_t rounds = 20;
+
+   std::map<std::pair<account_name, action_name>, asset> fee_map;
+   compiled_fee_schedule schedule;
+   for( uint64_t i = 0; i < count; ++i ) {
+      const auto key = contract_action(i);
+      if( i % 2 == 0 ) {
+         db.create<action_fee_object>([&]( auto& fee_obj ) {
+            fee_obj.account = key.first;
+            fee_obj.message_type = key.second;
+            fee_obj.fee = asset(i + 1);
+         });
+      } else {
+         fee_map[key] = asset(i + 1);
+      }
+
+      fee_schedule_entry entry;
+      entry.fee = asset(i + 1);
+      entry.has_fee = true;
+      entry.by_setfee = ( i % 2 == 0 );
+      schedule.insert(key.first, key.second, entry);
+   }
+
+   int64_t old_sum = 0;
+   const auto old_start = fc::time_point::now();
+   for( uint64_t r = 0; r < rounds; ++r ) {
+      for( uint64_t i = 0; i < count; ++i ) {
+         const auto key = contract_action(i);
+         const auto* fee_in_db = db.find<action_fee_object, by_action_name>(boost::make_tuple(key.first, key.second));
+         if( fee_in_db != nullptr ) {
+            old_sum += fee_in_db->fee.get_amount();
+         } else {
+            old_sum += fee_map.find(key)->second.get_amount();
+         }
+      }
+   }
+   const auto old_cost = fc::time_point::now() - old_start;
+
+   int64_t new_sum = 0;
+   const auto new_start = fc::time_point::now();
+   for( uint64_t r = 0; r < rounds; ++r ) {
+      for( uint64_t i = 0; i < count; ++i ) {
+         const auto key = contract_action(i);
+         new_sum += schedule.find(key.first, key.second)->fee.get_amount();
+      }
+   }
+   const auto new_cost = fc::time_point::now() - new_start;
+
+   BOOST_REQUIRE_EQUAL(old_sum, new_sum);
+   BOOST_TEST_MESSAGE( "fee lookup of " << count << " actions x " << rounds << " rounds: "
+                       << "index and fee_map " << old_cost.count() << " us, "
+                       << "compiled fee schedule " << new_cost.count() << " us" );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,94 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#include <eosio/chain/fork_database.hpp>
+#include <eosio/testing/tester.hpp>
+
+#include <fc/filesystem.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+#include <fstream>
+
+using namespace eosio;
+using namespace eosio::chain;
+using namespace eosio::testing;
+
+BOOST_AUTO_TEST_SUITE(fork_database_tests)
+
+BOOST_AUTO_TEST_CASE(fork_database_log) { try {
+   tester main;
+   main.produce_blocks( 10 );
+
+   // states of current chain from tester, oldest first
+   vector<block_state_ptr> states;
+   for( auto n = main.control->fork_db_head_block_num(); auto s = main.control->fetch_block_state_by_number( n ); --n ) {
+      auto copy = std::make_shared<block_state>( *s );
+      copy->validated        = false;
+      copy->in_current_chain = false;
+      states.insert( states.begin(), copy );
+   }
+   BOOST_REQUIRE( !states.empty() );
+
+   fc::temp_directory tempdir;
+   fc::temp_directory crashdir;
+   block_id_type head_id;
+   block_state_ptr confirmed;
+   map<block_id_type, bool> present;
+   {
+      fork_database fdb( tempdir.path() );
+      fdb.set( states.front() );
+      for( size_t i = 1; i < states.size(); ++i ) {
+         fdb.add( states[i], true );
+      }
+      for( const auto& s : states ) {
+         if( fdb.get_block( s->id ) ) {
+            fdb.mark_in_current_chain( s, true );
+            fdb.set_validity( s, true );
+         }
+         present[s->id] = !!fdb.get_block( s->id );
+      }
+      head_id = fdb.head()->id;
+
+      // a confirmation is logged as a record of its own, not with the state it confirms
+      confirmed = fdb.head();
+      fdb.add( header_confirmation{ confirmed->id, confirmed->header.producer,
+                                    base_tester::get_private_key( confirmed->header.producer, "active" ).sign( confirmed->sig_digest() ) } );
+
+      // log is left as it is by a crash, with a partial record at its end
+      fc::copy( tempdir.path() / config::forkdb_log_filename, crashdir.path() / config::forkdb_log_filename );
+      std::ofstream out( (crashdir.path() / config::forkdb_log_filename).generic_string(), std::ios::app | std::ios::binary );
+      const uint32_t size = 1000;
+      out.write( (const char*)&size, sizeof(size) );
+      out.put( 1 );
+   }
+
+   {
+      fork_database crashed( crashdir.path() );
+      BOOST_REQUIRE_EQUAL( crashed.head()->id, head_id );
+      BOOST_REQUIRE_EQUAL( crashed.get_block( confirmed->id )->confirmations.size(), 1 );
+      for( const auto& p : present ) {
+         auto s = crashed.get_block( p.first );
+         BOOST_REQUIRE_EQUAL( !!s, p.second );
+         if( s ) {
+            BOOST_REQUIRE( s->validated );
+            BOOST_REQUIRE( s->in_current_chain );
+         }
+      }
+   }
+
+   // log is compacted on close, a forkdb.dat left with it is not loaded but removed
+   {
+      std::ofstream out( (tempdir.path() / config::forkdb_filename).generic_string(), std::ios::binary );
+      out << "stale";
+   }
+   fork_database reopened( tempdir.path() );
+   BOOST_REQUIRE( !fc::exists( tempdir.path() / config::forkdb_filename ) );
+   BOOST_REQUIRE_EQUAL( reopened.head()->id, head_id );
+   BOOST_REQUIRE_EQUAL( reopened.get_block( confirmed->id )->confirmations.size(), 1 );
+   BOOST_REQUIRE_EQUAL( fc::file_size( tempdir.path() / config::forkdb_log_filename ),
+                        fc::file_size( crashdir.path() / config::forkdb_log_filename ) );
+} FC_LOG_AND_RETHROW() }
+
+BOOST_AUTO_TEST_SUITE_END()
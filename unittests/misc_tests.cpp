@@ -6,6 +6,7 @@
 #include <eosio/chain/authority.hpp>
 #include <eosio/chain/authority_checker.hpp>
 #include <eosio/chain/chain_config.hpp>
+#include <eosio/chain/signature_recovery_cache.hpp>
 #include <eosio/chain/types.hpp>
 #include <eosio/testing/tester.hpp>
 
@@ -870,6 +871,48 @@ BOOST_AUTO_TEST_CASE(transaction_metadata_test) { try {
 
 } FC_LOG_AND_RETHROW() }
 
+BOOST_AUTO_TEST_CASE(signature_recovery_cache_test) { try {
+   testing::TESTER test;
+   signed_transaction trx;
+   trx.actions.emplace_back( vector<permission_level>{{config::system_account_name, config::active_name}}, N(eosio), N(reqauth), bytes() );
+   test.set_transaction_headers(trx);
+   auto private_key = test.get_private_key( config::system_account_name, "active" );
+   trx.sign( private_key, test.control->get_chain_id() );
+
+   // a transaction recovered when it is relayed is not recovered again for a block
+   auto& cache = signature_recovery_cache::instance();
+   auto relayed = std::make_shared<transaction_metadata>( std::make_shared<packed_transaction>( trx ) );
+   BOOST_CHECK_EQUAL( private_key.get_public_key(), *relayed->recover_keys( test.control->get_chain_id() ).second.begin() );
+   const auto before = cache.get_stats();
+   auto in_block = std::make_shared<transaction_metadata>( std::make_shared<packed_transaction>( trx ) );
+   BOOST_CHECK_EQUAL( private_key.get_public_key(), *in_block->recover_keys( test.control->get_chain_id() ).second.begin() );
+   BOOST_CHECK_EQUAL( cache.get_stats().hits, before.hits + 1 );
+
+   // entries are keyed by digest and signature, the oldest are evicted first
+   signature_recovery_cache small( config::sig_recovery_cache_shards );
+   const auto digest = trx.sig_digest( test.control->get_chain_id(), trx.context_free_data );
+   const auto& sig = trx.signatures.front();
+   signature_recovery_cache::entry e;
+   BOOST_CHECK( !small.find( digest, sig, e ) );
+   small.add( digest, sig, private_key.get_public_key(), fc::microseconds(10) );
+   BOOST_CHECK( small.find( digest, sig, e ) );
+   BOOST_CHECK_EQUAL( e.key, private_key.get_public_key() );
+   BOOST_CHECK( !small.find( digest_type::hash( digest ), sig, e ) );
+
+   // digest of same shard
+   auto other = digest;
+   other._hash[0] ^= 1;
+   small.add( other, sig, private_key.get_public_key(), fc::microseconds(10) );
+   BOOST_CHECK( !small.find( digest, sig, e ) );
+   BOOST_CHECK( small.find( other, sig, e ) );
+
+   auto stats = small.get_stats();
+   BOOST_CHECK_EQUAL( stats.hits, 2 );
+   BOOST_CHECK_EQUAL( stats.misses, 3 );
+   BOOST_CHECK_EQUAL( stats.evictions, 1 );
+   BOOST_CHECK_EQUAL( stats.size, 1 );
+} FC_LOG_AND_RETHROW() }
+
 BOOST_AUTO_TEST_CASE(reflector_init_test) {
    try {
 
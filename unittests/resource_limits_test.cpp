@@ -6,6 +6,9 @@
 
 #include <eosio/chain/config.hpp>
 #include <eosio/chain/resource_limits.hpp>
+#include <eosio/chain/contract_table_objects.hpp>
+#include <eosio/chain/config_on_chain.hpp>
+#include <eosio/chain/memory_db.hpp>
 #include <eosio/testing/chainbase_fixture.hpp>
 
 #include <boost/test/unit_test.hpp>
@@ -30,6 +33,10 @@ class resource_limits_fixture: private chainbase_fixture<512*1024>, public resou
       chainbase::database::session start_session() {
          return chainbase_fixture::_db->start_undo_session(true);
       }
+
+      chainbase::database& state_db() {
+         return *chainbase_fixture::_db;
+      }
 };
 
 constexpr uint64_t expected_elastic_iterations(uint64_t from, uint64_t to, uint64_t rate_num, uint64_t rate_den ) {
@@ -310,6 +317,33 @@ BOOST_AUTO_TEST_SUITE(resource_limits_test)
    } FC_LOG_AND_RETHROW();
 
 
+   BOOST_FIXTURE_TEST_CASE(ram_quota_from_vote4ramsum, resource_limits_fixture) try {
+      auto& db = state_db();
+      db.add_index<table_id_multi_index>();
+      db.add_index<key_value_index>();
+      db.add_index<config_data_object_index>();
+
+      const account_name account = N(alice);
+      initialize_account(account);
+      set_num_config_on_chain(db, config::res_typ::free_ram_per_account, 1024);
+      clear_ram_quotas();
+      BOOST_REQUIRE_EQUAL(get_account_ram_limit(account), 1024);
+      BOOST_REQUIRE_EQUAL(get_account_ram_limit(config::system_account_name), -1);
+
+      // 100 EOS stake for 10kb by default ram rent
+      memory_db{db}.insert(config::system_account_name, config::system_account_name, N(vote4ramsum),
+                           account, memory_db::vote4ram_info{account, asset(100 * 10000)});
+
+      // the quota is kept until the change of the row is told
+      BOOST_REQUIRE_EQUAL(get_account_ram_limit(account), 1024);
+      on_vote4ram_changed(account);
+      BOOST_REQUIRE_EQUAL(get_account_ram_limit(account), 1024 + 10240);
+
+      set_num_config_on_chain(db, config::res_typ::ram_rent_b_per_eos, 20480);
+      clear_ram_quotas();
+      BOOST_REQUIRE_EQUAL(get_account_ram_limit(account), 1024 + 20480);
+   } FC_LOG_AND_RETHROW();
+
    BOOST_FIXTURE_TEST_CASE(sanity_check, resource_limits_fixture) try {
       double total_staked_tokens = 1'000'000'000'0000.;
       double user_stake = 1'0000.;
@@ -5,6 +5,7 @@
 #include <sstream>
 
 #include <eosio/chain/snapshot.hpp>
+#include <eosio/chain/chain_snapshot.hpp>
 #include <eosio/testing/tester.hpp>
 
 #include <boost/mpl/list.hpp>
@@ -147,9 +148,45 @@ struct buffered_snapshot_suite {
 
 };
 
+// rows split into many small blocks which are decompressed on several threads
+struct small_block_snapshot_suite : buffered_snapshot_suite {
+   struct writer : public writer_t {
+      writer( const std::shared_ptr<write_storage_t>& storage )
+      :writer_t(*storage, 256)
+      ,storage(storage)
+      {
+
+      }
+
+      std::shared_ptr<write_storage_t> storage;
+   };
+
+   struct reader : public reader_t {
+      explicit reader(const std::shared_ptr<read_storage_t>& storage)
+      :reader_t(*storage, 4)
+      ,storage(storage)
+      {}
+
+      std::shared_ptr<read_storage_t> storage;
+   };
+
+   static auto get_writer() {
+      return std::make_shared<writer>(std::make_shared<write_storage_t>());
+   }
+
+   static auto finalize(const std::shared_ptr<writer>& w) {
+      w->finalize();
+      return w->storage->str();
+   }
+
+   static auto get_reader( const snapshot_t& buffer) {
+      return std::make_shared<reader>(std::make_shared<read_storage_t>(buffer));
+   }
+};
+
 BOOST_AUTO_TEST_SUITE(snapshot_tests)
 
-using snapshot_suites = boost::mpl::list<variant_snapshot_suite, buffered_snapshot_suite>;
+using snapshot_suites = boost::mpl::list<variant_snapshot_suite, buffered_snapshot_suite, small_block_snapshot_suite>;
 
 BOOST_AUTO_TEST_CASE_TEMPLATE(test_exhaustive_snapshot, SNAPSHOT_SUITE, snapshot_suites)
 {
@@ -257,4 +294,85 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(test_replay_over_snapshot, SNAPSHOT_SUITE, snapsho
    BOOST_REQUIRE_EQUAL(expected_post_integrity_hash.str(), snap_chain.control->calculate_integrity_hash().str());
 }
 
+BOOST_AUTO_TEST_CASE(test_compressed_snapshot_blocks)
+{
+   tester chain;
+   chain.create_account(N(snapshot));
+   chain.produce_blocks(1);
+   chain.control->abort_block();
+
+   std::ostringstream out;
+   auto writer = std::make_shared<ostream_snapshot_writer>(out, 256);
+   chain.control->write_snapshot(writer);
+   writer->finalize();
+   const auto snapshot = out.str();
+   BOOST_REQUIRE(writer->sections_written() > 0);
+
+   // sections may be read in any order, also more than once
+   std::istringstream in(snapshot);
+   auto istream_reader = std::make_shared<istream_snapshot_reader>(in, 2);
+   snapshot_reader& reader = *istream_reader;
+   reader.validate();
+   BOOST_REQUIRE(reader.has_section<genesis_state>());
+   BOOST_REQUIRE(!reader.has_section<genesis_state>("missing"));
+   for (int i = 0; i < 2; ++i) {
+      genesis_state genesis;
+      reader.read_section<genesis_state>([&]( auto& section ) {
+         section.read_row(genesis);
+      });
+      BOOST_REQUIRE_EQUAL(genesis.compute_chain_id().str(), chain.get_config().genesis.compute_chain_id().str());
+
+      reader.read_section<chain_snapshot_header>([&]( auto& section ) {
+         chain_snapshot_header header;
+         section.read_row(header);
+         header.validate();
+      });
+   }
+
+   // a truncated snapshot is rejected
+   std::istringstream truncated(snapshot.substr(0, snapshot.size() / 2));
+   istream_snapshot_reader truncated_reader(truncated);
+   BOOST_REQUIRE_THROW(truncated_reader.validate(), snapshot_exception);
+}
+
+BOOST_AUTO_TEST_CASE(test_snapshot_checkpoint)
+{
+   tester chain;
+   chain.create_account(N(snapshot));
+   chain.produce_blocks(1);
+   chain.control->abort_block();
+
+   const auto write = [&]( const std::function<void(const snapshot_writer_ptr&)>& f ) {
+      std::ostringstream out;
+      auto writer = std::make_shared<ostream_snapshot_writer>(out);
+      f(writer);
+      writer->finalize();
+      return out.str();
+   };
+   const auto snapshot = write([&]( const snapshot_writer_ptr& w ) { chain.control->write_snapshot(w); });
+
+   // a checkpoint is a reflink of state, so it is on the file system of state
+   const auto checkpoint_dir = chain.get_config().state_dir.parent_path() / "checkpoint";
+   auto checkpoint = chain.control->create_snapshot_checkpoint(checkpoint_dir);
+   if (checkpoint) {
+      // blocks applied after the checkpoint do not change it
+      chain.create_account(N(later));
+      chain.produce_blocks(2);
+      const auto from_checkpoint = write([&]( const snapshot_writer_ptr& w ) { chain.control->write_snapshot(*checkpoint, w); });
+      BOOST_REQUIRE(from_checkpoint == snapshot);
+      fc::remove_all(checkpoint->dir);
+   } else {
+      // no reflinks, snapshots are written by write_snapshot, nothing is left of the checkpoint
+      BOOST_TEST_MESSAGE("state directory has no reflinks, snapshot checkpoint is not tested");
+      BOOST_REQUIRE(!fc::exists(checkpoint_dir));
+   }
+
+   // a checkpoint on other file system can not be a reflink
+   if (fc::is_directory("/dev/shm")) {
+      fc::temp_directory other_dir("/dev/shm");
+      BOOST_REQUIRE(!chain.control->create_snapshot_checkpoint(other_dir.path() / "checkpoint"));
+      BOOST_REQUIRE(!fc::exists(other_dir.path() / "checkpoint"));
+   }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
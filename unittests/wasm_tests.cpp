@@ -4,11 +4,14 @@
  */
 #include <array>
 #include <utility>
+#include <fstream>
+#include <unistd.h>
 
 #include <eosio/chain/abi_serializer.hpp>
 #include <eosio/chain/exceptions.hpp>
 #include <eosio/chain/resource_limits.hpp>
 #include <eosio/chain/wasm_eosio_constraints.hpp>
+#include <eosio/chain/wasm_module_cache.hpp>
 #include <eosio/chain/wast_to_wasm.hpp>
 #include <eosio/testing/tester.hpp>
 
@@ -649,6 +652,196 @@ BOOST_FIXTURE_TEST_CASE( check_entry_behavior_2, TESTER ) try {
 } FC_LOG_AND_RETHROW()
 
 
+/**
+ * Instantiated modules are evicted by size, code set by setcode is prepared in background
+ */
+BOOST_AUTO_TEST_CASE( wasm_cache_eviction ) try {
+   fc::temp_directory tempdir;
+   auto cfg = tester().get_config();
+   cfg.blocks_dir = tempdir.path() / config::default_blocks_dir_name;
+   cfg.state_dir  = tempdir.path() / config::default_state_dir_name;
+   // keep just the module in use
+   cfg.wasm_cache_size = 1;
+   cfg.wasm_compile_threads = 1;
+
+   tester chain( cfg );
+   chain.produce_blocks(2);
+   chain.create_accounts( {N(entrycheck), N(entrycheck2)} );
+   chain.produce_block();
+
+   chain.set_code(N(entrycheck), entry_wast);
+   chain.set_code(N(entrycheck2), entry_wast_2);
+   chain.set_fee(N(entrycheck), N(), asset(100), 0, 0, 0);
+   chain.set_fee(N(entrycheck2), N(), asset(100), 0, 0, 0);
+   chain.produce_blocks(10);
+
+   auto push_entry = [&]( account_name acc ) {
+      signed_transaction trx;
+      action act;
+      act.account = acc;
+      act.name = N();
+      act.authorization = vector<permission_level>{{acc,config::active_name}};
+      trx.actions.push_back(act);
+
+      chain.set_transaction_headers(trx);
+      trx.sign(chain.get_private_key( acc, "active" ), chain.control->get_chain_id());
+      chain.push_transaction(trx);
+      chain.produce_blocks(1);
+      BOOST_REQUIRE_EQUAL(true, chain.chain_has_transaction(trx.id()));
+      BOOST_CHECK_EQUAL(transaction_receipt::executed, chain.get_transaction_receipt(trx.id()).status);
+   };
+
+   for( int i = 0; i < 3; ++i ) {
+      push_entry(N(entrycheck));
+      push_entry(N(entrycheck2));
+   }
+
+   const auto stats = chain.control->get_wasm_interface().get_cache_stats();
+   BOOST_CHECK_EQUAL(stats.modules, 1u);
+   BOOST_CHECK(stats.evictions > 0);
+   BOOST_CHECK(stats.precompiled_hits > 0);
+   // the module in use is kept even it is larger than the limit
+   BOOST_CHECK(stats.bytes > stats.max_bytes);
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( wasm_module_disk_cache ) try {
+   fc::temp_directory tempdir;
+   const auto cache_dir = tempdir.path() / config::default_wasm_cache_dir_name;
+
+   injected_module module;
+   module.code = {0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00};
+   module.initial_memory = std::vector<uint8_t>(1024, 0x5a);
+   const auto code_id = fc::sha256::hash( std::string("wasm_module_disk_cache") );
+
+   // a directory of other injection rules is removed at open
+   const auto stale_dir = cache_dir / "0000000000000000";
+   fc::create_directories( stale_dir );
+
+   wasm_module_cache cache( cache_dir, config::default_wasm_disk_cache_size );
+   BOOST_CHECK( !fc::exists( stale_dir ) );
+   BOOST_CHECK( !cache.load( code_id ) );
+
+   cache.store( code_id, module );
+   auto loaded = cache.load( code_id );
+   BOOST_REQUIRE( loaded );
+   BOOST_CHECK( loaded->code == module.code );
+   BOOST_CHECK( loaded->initial_memory == module.initial_memory );
+
+   // reopened cache sees the module stored before
+   BOOST_CHECK( wasm_module_cache( cache_dir, config::default_wasm_disk_cache_size ).load( code_id ) );
+
+   // a corrupted file is discarded and treated as missing
+   const auto file = cache.get_dir() / code_id.str();
+   {
+      std::fstream f( file.generic_string(), std::ios::in | std::ios::out | std::ios::binary );
+      f.seekp( -1, std::ios::end );
+      f.put( 0x00 );
+   }
+   BOOST_CHECK( !cache.load( code_id ) );
+   BOOST_CHECK( !fc::exists( file ) );
+   BOOST_CHECK_EQUAL( cache.get_size(), 0u );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( wasm_module_disk_cache_eviction ) try {
+   fc::temp_directory tempdir;
+   const auto cache_dir = tempdir.path() / config::default_wasm_cache_dir_name;
+
+   injected_module module;
+   module.code = {0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00};
+   module.initial_memory = std::vector<uint8_t>(1024, 0x5a);
+   const auto code_id = []( int i ) { return fc::sha256::hash( "wasm_module_disk_cache_eviction" + std::to_string(i) ); };
+
+   // room for three modules
+   uint64_t file_size = 0;
+   {
+      wasm_module_cache cache( cache_dir, config::default_wasm_disk_cache_size );
+      cache.store( code_id(0), module );
+      file_size = cache.get_size();
+      BOOST_REQUIRE( file_size > module.code.size() + module.initial_memory.size() );
+   }
+
+   wasm_module_cache cache( cache_dir, file_size * 3 );
+   cache.store( code_id(1), module );
+   cache.store( code_id(2), module );
+   BOOST_CHECK_EQUAL( cache.get_size(), file_size * 3 );
+
+   // module 0 is used, so module 1 is the least recently used one
+   BOOST_CHECK( cache.load( code_id(0) ) );
+   cache.store( code_id(3), module );
+   BOOST_CHECK_EQUAL( cache.get_size(), file_size * 3 );
+   BOOST_CHECK( !fc::exists( cache.get_dir() / code_id(1).str() ) );
+   BOOST_CHECK( cache.load( code_id(0) ) );
+   BOOST_CHECK( cache.load( code_id(2) ) );
+   BOOST_CHECK( cache.load( code_id(3) ) );
+
+   // files are bounded again when opened by a smaller size
+   wasm_module_cache reopened( cache_dir, file_size );
+   BOOST_CHECK_EQUAL( reopened.get_size(), file_size );
+
+   // a module larger than the limit is not stored
+   module.initial_memory.resize( file_size );
+   reopened.store( code_id(4), module );
+   BOOST_CHECK( !reopened.load( code_id(4) ) );
+   BOOST_CHECK_EQUAL( reopened.get_size(), file_size );
+} FC_LOG_AND_RETHROW()
+
+
+// resident_memory_bytes resident set size of this process, 0 if it is unknown
+static uint64_t resident_memory_bytes() {
+   uint64_t size = 0, resident = 0;
+   std::ifstream statm( "/proc/self/statm" );
+   if( !(statm >> size >> resident) )
+      return 0;
+   return resident * sysconf( _SC_PAGESIZE );
+}
+
+/**
+ * Modules evicted and instantiated again must not grow memory, the runtime frees what evicted modules left
+ */
+BOOST_AUTO_TEST_CASE( wasm_cache_eviction_memory ) try {
+   fc::temp_directory tempdir;
+   auto cfg = tester().get_config();
+   cfg.blocks_dir = tempdir.path() / config::default_blocks_dir_name;
+   cfg.state_dir  = tempdir.path() / config::default_state_dir_name;
+   // each module is evicted by the other one
+   cfg.wasm_cache_size = 1;
+
+   tester chain( cfg );
+   chain.produce_blocks(2);
+   const vector<account_name> accounts = { N(payloadless1), N(payloadless2) };
+   chain.create_accounts( accounts );
+   chain.produce_block();
+   for( const auto& acc : accounts ) {
+      chain.set_code( acc, contracts::payloadless_wasm() );
+      chain.set_abi( acc, contracts::payloadless_abi().data() );
+      chain.set_fee( acc, N(doit), asset(100), 0, 0, 0 );
+   }
+   chain.produce_blocks(10);
+
+   auto run_cycles = [&]( uint32_t cycles ) {
+      for( uint32_t i = 0; i < cycles; ++i ) {
+         for( const auto& acc : accounts ) {
+            chain.push_action( acc, N(doit), acc, mutable_variant_object() );
+         }
+         chain.produce_block();
+      }
+   };
+
+   run_cycles( 20 );
+   const auto evictions = chain.control->get_wasm_interface().get_cache_stats().evictions;
+   const auto resident = resident_memory_bytes();
+
+   run_cycles( 300 );
+   BOOST_REQUIRE( chain.control->get_wasm_interface().get_cache_stats().evictions >= evictions + 600 );
+   // leaked instances grow with each of 600 instantiations, the bound leaves room for chain state of blocks
+   if( resident > 0 ) {
+      const auto growth = int64_t( resident_memory_bytes() ) - int64_t( resident );
+      BOOST_TEST_MESSAGE( "resident memory growth after 600 evictions: " << growth << " bytes" );
+      BOOST_CHECK( growth < 64 * 1024 * 1024 );
+   }
+} FC_LOG_AND_RETHROW()
+
+
 /**
  * Ensure we can load a wasm w/o memory
  */